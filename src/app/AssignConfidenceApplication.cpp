@@ -7,13 +7,17 @@
 #include "AssignConfidenceApplication.h"
 #include "ComputeQValues.h"
 #include "io/MatchCollectionParser.h"
+#include "io/MatchColumnTable.h"
 #include "PosteriorEstimator.h"
 #include "util/FileUtils.h"
+#include "util/ParallelUtil.h"
 #include "util/Params.h"
 #include "util/StringUtils.h"
 
+#include <algorithm>
 #include <map>
 #include <utility>
+#include <boost/thread.hpp>
 
 using namespace std;
 using namespace Crux;
@@ -26,7 +30,7 @@ static const double EPSILON = 0.00000000000001;
 * \returns a blank ComputeQValues object
 */
 AssignConfidenceApplication::AssignConfidenceApplication():
-  spectrum_flag_(NULL), iteration_cnt_(0) {
+  spectrum_flag_(NULL), iteration_cnt_(0), num_threads_(1) {
 }
 
 /**
@@ -47,6 +51,169 @@ int stringToIndex(string myString) {
   return(returnValue);
 }
 
+/**
+ * The (file, scan, charge, rank) of a PSM, packed into two words, by which
+ * targets are paired with decoys
+ */
+typedef pair<unsigned long long, unsigned long long> PsmKey;
+
+struct PsmKeyHash {
+  size_t operator()(const PsmKey& key) const {
+    return (size_t)((key.first * 0x9e3779b97f4a7c15ULL) ^ (key.second + (key.first >> 29)));
+  }
+};
+
+static PsmKey makePsmKey(int fileIndex, int scan, int charge, int rank) {
+  return PsmKey(((unsigned long long)(unsigned int)fileIndex << 32) | (unsigned int)scan,
+                ((unsigned long long)(unsigned int)charge << 32) | (unsigned int)rank);
+}
+
+/**
+ * Pairs each target PSM with the decoy PSM of the same file, scan, charge
+ * and rank, and decides the target-decoy competitions between them. Shared
+ * by main and mainColumnar, which hold their PSMs differently.
+ */
+class TdcPairing {
+ public:
+  TdcPairing() : num_competitions_(0), num_ties_(0), num_lost_decoys_(0) {}
+
+  /**
+   * Remembers a decoy by its index, counted from 1. Of tied top-ranked
+   * decoys, the first is kept.
+   */
+  void addDecoy(int file_key, int scan, int charge, int rank, int index) {
+    decoys_.insert(make_pair(makePsmKey(file_key, scan, charge, rank), index));
+  }
+
+  /**
+   * \returns the index of the decoy paired with a target, or 0 if there
+   * is none
+   */
+  int findDecoy(int file_key, const char* file_name, int scan, int charge, int rank) {
+    unordered_map<PsmKey, int, PsmKeyHash>::const_iterator found =
+      decoys_.find(makePsmKey(file_key, scan, charge, rank));
+    if (found == decoys_.end()) {
+      carp(CARP_DEBUG, "Failed to find decoy for file=%s scan=%d charge=%d rank=%d.",
+           file_name, scan, charge, rank);
+      num_lost_decoys_++;
+      return 0;
+    }
+    return found->second;
+  }
+
+  /**
+   * \returns whether the target wins its competition with the decoy. Ties
+   * are broken at random.
+   */
+  bool targetWins(FLOAT_T target_score, FLOAT_T decoy_score, bool ascending) {
+    FLOAT_T score_difference = target_score - decoy_score;
+    num_competitions_++;
+    // Randomly break ties.
+    if (fabs(score_difference) < 1e-10) {
+      num_ties_++;
+      score_difference += 0.5 - ((double)myrandom() / UNIFORM_INT_DISTRIBUTION_MAX);
+    }
+    if (ascending) { // smaller scores are better
+      score_difference *= -1.0;
+    }
+    return score_difference >= 0.0;
+  }
+
+  void report(int num_psms) const {
+    carp(CARP_INFO, "%d tdc_collection", num_psms);
+    if (num_competitions_ > 0) {
+      carp(CARP_INFO, "Randomly broke %d ties in %d target-decoy competitions.", num_ties_, num_competitions_);
+    }
+    if (num_lost_decoys_ > 0) {
+      carp(CARP_INFO, "Failed to find %d decoys.", num_lost_decoys_);
+    }
+  }
+
+ private:
+  unordered_map<PsmKey, int, PsmKeyHash> decoys_;
+  int num_competitions_;
+  int num_ties_;
+  int num_lost_decoys_;
+};
+
+/**
+ * The rank filter and the peptide-level filter, with counts of the PSMs
+ * they skip, shared by main and mainColumnar.
+ */
+class PsmFilter {
+ public:
+  PsmFilter(int top_match, bool ascending)
+    : top_match_(top_match), ascending_(ascending),
+      num_target_rank_skipped_(0), num_decoy_rank_skipped_(0),
+      num_target_peptide_skipped_(0), num_decoy_peptide_skipped_(0) {}
+
+  /**
+   * \returns whether a PSM of the given rank is one of the top matches
+   */
+  bool keepRank(int rank, bool is_decoy) {
+    if (rank <= top_match_) {
+      return true;
+    }
+    if (is_decoy) {
+      num_decoy_rank_skipped_++;
+    } else {
+      num_target_rank_skipped_++;
+    }
+    return false;
+  }
+
+  /**
+   * \returns whether score is the best score of its peptide, which is then
+   * moved out of reach, so only one best-scoring PSM of each peptide is kept
+   */
+  bool keepPeptide(FLOAT_T* best_score, FLOAT_T score, bool is_decoy) {
+    if (*best_score != score) {  //not the best scoring peptide
+      if (is_decoy) {
+        num_decoy_peptide_skipped_++;
+      } else {
+        num_target_peptide_skipped_++;
+      }
+      return false;
+    }
+    *best_score += ascending_ ? -1.0 : 1.0;  //make sure only one best scoring peptide reported.
+    return true;
+  }
+
+  void report() const {
+    if (num_decoy_rank_skipped_ + num_target_rank_skipped_ > 0) {
+      carp(CARP_INFO, "Skipped %d target and %d decoy PSMs with rank > %d.",
+           num_target_rank_skipped_, num_decoy_rank_skipped_, top_match_);
+    }
+    if (num_target_peptide_skipped_ + num_decoy_peptide_skipped_ > 0) {
+      carp(CARP_INFO, "Skipped %d target and %d decoy PSMs due to peptide-level filtering.",
+           num_target_peptide_skipped_, num_decoy_peptide_skipped_);
+    }
+  }
+
+ private:
+  int top_match_;
+  bool ascending_;
+  int num_target_rank_skipped_;
+  int num_decoy_rank_skipped_;
+  int num_target_peptide_skipped_;
+  int num_decoy_peptide_skipped_;
+};
+
+/**
+ * \returns the score whose rank the top matches are chosen by, after
+ * target-decoy competition
+ */
+static SCORER_TYPE_T getRankScoreType(SCORER_TYPE_T score_type) {
+  switch (score_type) {
+  case BOTH_PVALUE:
+  case RESIDUE_EVIDENCE_PVAL:
+  case HYPER_SCORE:
+    return score_type;
+  default:
+    return XCORR;
+  }
+}
+
 /**
 * main method for ComputeQValues
 */
@@ -56,11 +223,6 @@ int AssignConfidenceApplication::main(int argc, char** argv) {
 }
 
 int AssignConfidenceApplication::main(const vector<string>& input_files) {
-  // Prepare the output files if not in Cascade Search
-  if (spectrum_flag_ == NULL) {
-    output_ = new OutputFiles(this);
-  }
-  
   ESTIMATION_METHOD_T estimation_method;
   string method_param = Params::GetString("estimation-method");
   carp(CARP_INFO, "Estimation method = %s.", method_param.c_str());
@@ -84,6 +246,13 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
   }
   bool sidak = Params::GetBool("sidak");
 
+  num_threads_ = Params::GetInt("num-threads");
+  if (num_threads_ < 1) {
+    num_threads_ = boost::thread::hardware_concurrency();
+  } else if (num_threads_ > 64) {
+    carp(CARP_FATAL, "Requested more than 64 threads.");
+  }
+
   int top_match = 1;
   if (estimation_method == PEPTIDE_LEVEL_METHOD) {
     top_match = MAX_PSMS+1;
@@ -134,6 +303,9 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
     case TAILOR_COL: //Added for tailor score calibration method by AKF
       score_type = TAILOR_SCORE;      
       break;
+    case HYPERSCORE_COL:
+      score_type = HYPER_SCORE;
+      break;
     default:
       carp(CARP_FATAL, "The PSM feature \"%s\" is not supported.", score_param.c_str());
     }
@@ -145,13 +317,23 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
     carp(CARP_WARNING, "Sidak adjustment may not be compatible with score: %s", score_param.c_str());
   }
 
+  if (spectrum_flag_ == NULL && !sidak && Params::GetBool("columnar-input") &&
+      mainColumnar(input_files, estimation_method, score_type)) {
+    return 0;
+  }
+
+  // Prepare the output files if not in Cascade Search
+  if (spectrum_flag_ == NULL) {
+    output_ = new OutputFiles(this);
+  }
+
   // Create two match collections, for targets and decoys.
   MatchCollection* target_matches = new MatchCollection();
   map<int, MatchCollection*> decoy_matches; // key is decoy index
 
   bool ascending, distinct_matches;
   MatchCollectionParser parser;
-  map<string, FLOAT_T> BestPeptideScore;
+  unordered_map<string, FLOAT_T> BestPeptideScore;
 
   bool avgTdc = estimation_method == TDC_METHOD;
   for (vector<string>::const_iterator iter = input_files.begin(); iter != input_files.end(); ++iter) {
@@ -192,6 +374,7 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
       vector<SCORER_TYPE_T> scoreTypes;
       scoreTypes.push_back(TAILOR_SCORE); 
       scoreTypes.push_back(XCORR);
+      scoreTypes.push_back(HYPER_SCORE);
       scoreTypes.push_back(EVALUE);
       scoreTypes.push_back(BOTH_PVALUE);
       scoreTypes.push_back(RESIDUE_EVIDENCE_PVAL);
@@ -250,13 +433,15 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
     }
 
     // Counters just to let the user know what's up.
-    int num_target_rank_skipped = 0;
-    int num_decoy_rank_skipped = 0;
-    int num_target_peptide_skipped = 0;
-    int num_decoy_peptide_skipped = 0;
-    
+    PsmFilter filter(top_match, ascending);
+    // Matches are filtered and paired by this rank
+    SCORER_TYPE_T rank_type = getRankScoreType(score_type);
+
     if (decoy_path != "") {
-      MatchCollection* temp_collection = parser.create(decoy_path, Params::GetString("protein-database"));
+      // Decoy PSMs are never written out, so only peptide-level
+      // filtering needs their peptides, and nothing needs their proteins.
+      MatchCollection* temp_collection = parser.create(decoy_path, Params::GetString("protein-database"),
+        estimation_method == PEPTIDE_LEVEL_METHOD ? MATCH_ATTRIBUTE_PEPTIDE : MATCH_ATTRIBUTE_NONE);
       carp(CARP_INFO, "Found %d PSMs in %s.", temp_collection->getMatchTotal(), decoy_path.c_str());
 
       if (temp_collection->hasMulitpleDecoys()) {
@@ -264,13 +449,16 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
         MatchIterator* decoy_iter = new MatchIterator(temp_collection);
         while (decoy_iter->hasNext()) {
           Crux::Match* decoy_match = decoy_iter->next();
+          // A match read without its peptide cannot be written as a target.
+          if (decoy_match->getPeptide() == NULL) {
+            decoy_match->setNullPeptide(true);
+          }
           match_collection->addMatch(decoy_match);
         }
         delete decoy_iter;
       } else {
         // Mark decoy matches
-        // key = (filename, scan number, charge, rank); value = index
-        map<boost::tuple <int, int, int, int>, int> pairidx;
+        TdcPairing pairing;
         int cnt = 0;
         MatchIterator* temp_iter = new MatchIterator(temp_collection);
         while (temp_iter->hasNext()) {
@@ -278,8 +466,7 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
           cnt++;
 
           // Only use top-ranked matches.
-          if (decoy_match->getRank(XCORR) > top_match) {
-            num_decoy_rank_skipped++;
+          if (!filter.keepRank(decoy_match->getRank(rank_type), true)) {
             continue;
           }
 
@@ -303,15 +490,12 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
               int fileIndex = stringToIndex(decoy_match->getSpectrum()->getFullFilename());
               int scanid = decoy_match->getSpectrum()->getFirstScan();
               int charge = decoy_match->getCharge();
-              int rank = decoy_match->getRank(XCORR);
-              boost::tuple<int, int, int, int> t(fileIndex, scanid, charge, rank);
+              int rank = decoy_match->getRank(rank_type);
 
               // If the PSM is already there, that means there was a tie
               // for top-ranked decoys.  In that case, there is no need to
               // store a pointer to the second one.
-              if (pairidx[t] == 0) {
-                pairidx[t] = cnt;
-              }
+              pairing.addDecoy(fileIndex, scanid, charge, rank, cnt);
             }
             break;
           case NUMBER_METHOD_TYPES:
@@ -328,9 +512,6 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
         }
 
         if (estimation_method != MIXMAX_METHOD) {
-          int numCompetitions = 0;
-          int numLostDecoys = 0;
-          int numTies = 0;
           MatchCollection* tdc_collection = new MatchCollection();
           tdc_collection->setScoredType(score_type, true);
           MatchIterator* target_iter = new MatchIterator(match_collection);
@@ -339,22 +520,15 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
             Crux::Match* target_match = target_iter->next();
 
             // Only use top-ranked matches.
-            if (target_match->getRank(XCORR) > top_match) {
-              num_target_rank_skipped++;
+            if (!filter.keepRank(target_match->getRank(rank_type), false)) {
               continue;
             }
 
             // Retrieve the index of the corresponding decoy PSM.
-            int fileIndex = stringToIndex(target_match->getSpectrum()->getFullFilename());
-            int scanid = target_match->getSpectrum()->getFirstScan();
-            int charge = target_match->getCharge();
-            int rank = target_match->getRank(XCORR);
-            int decoy_idx = pairidx[boost::tuple <int, int, int, int>(fileIndex, scanid, charge, rank)];
-            if (decoy_idx == 0) {
-              carp(CARP_DEBUG, "Failed to find decoy for file=%s scan=%d charge=%d rank=%d.",
-                   target_match->getSpectrum()->getFullFilename(), scanid, charge, rank);
-              numLostDecoys++;
-            }
+            const char* file_name = target_match->getSpectrum()->getFullFilename();
+            int decoy_idx = pairing.findDecoy(stringToIndex(file_name), file_name,
+              target_match->getSpectrum()->getFirstScan(), target_match->getCharge(),
+              target_match->getRank(rank_type));
 
             if (estimation_method == PEPTIDE_LEVEL_METHOD) {
               if (decoy_idx == 0) {
@@ -384,17 +558,8 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
                    target_match->getSpectrum()->getFirstScan(), target_match->getCharge(), target_match->getScore(score_type),
                    decoy_match->getSpectrum()->getFirstScan(), decoy_match->getCharge(), decoy_match->getScore(score_type));
 
-              FLOAT_T score_difference = target_match->getScore(score_type) - decoy_match->getScore(score_type);
-              numCompetitions++;
-              // Randomly break ties.
-              if (fabs(score_difference) < 1e-10) {
-                numTies++;
-                score_difference += 0.5 - ((double)myrandom() / UNIFORM_INT_DISTRIBUTION_MAX);
-              }
-              if (ascending) { // smaller scores are better
-                score_difference *= -1.0;
-              }
-              if (score_difference >= 0.0) {
+              if (pairing.targetWins(target_match->getScore(score_type),
+                                     decoy_match->getScore(score_type), ascending)) {
                 tdc_collection->addMatch(target_match);
               } else {
                 tdc_collection->addMatch(decoy_match);
@@ -405,13 +570,7 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
           delete decoy_iter;
           delete match_collection;
           match_collection = tdc_collection;
-          carp(CARP_INFO, "%d tdc_collection", match_collection->getMatchTotal());
-          if (numCompetitions > 0) {
-            carp(CARP_INFO, "Randomly broke %d ties in %d target-decoy competitions.", numTies, numCompetitions);
-          }
-          if (numLostDecoys > 0) {
-            carp(CARP_INFO, "Failed to find %d decoys.", numLostDecoys);
-          }
+          pairing.report(match_collection->getMatchTotal());
         }
       }
       delete temp_collection;
@@ -424,61 +583,23 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
       bool is_decoy = match->getNullPeptide();
 
       // Only use top-ranked matches.
-      if (score_type == BOTH_PVALUE) {
-        if (match->getRank(BOTH_PVALUE) > top_match) {
-          if (is_decoy) {
-            num_decoy_rank_skipped++;
-          } else {
-            num_target_rank_skipped++;
-          }
-          continue;
-        }
-      } else if (score_type == RESIDUE_EVIDENCE_PVAL) {
-        if (match->getRank(RESIDUE_EVIDENCE_PVAL) > top_match) {
-          if (is_decoy) {
-            num_decoy_rank_skipped++;
-          } else {
-            num_target_rank_skipped++;
-          }
-          continue;
-        }
-      } else {
-        if (match->getRank(XCORR) > top_match) {
-          if (is_decoy) {
-            num_decoy_rank_skipped++;
-          } else {
-            num_target_rank_skipped++;
-          }
-          continue;
-        }
+      if (!filter.keepRank(match->getRank(rank_type), is_decoy)) {
+        continue;
       }
 
       // Find and keep the best score for each decoy peptide.
       if (estimation_method == PEPTIDE_LEVEL_METHOD) {
-        FLOAT_T score = match->getScore(score_type);
-        string peptideStr = getPeptideSeq(match);
-
-        FLOAT_T bestScore;
-        try {
-          bestScore = BestPeptideScore.at(peptideStr);
-          if (bestScore != score) {  //not the best scoring peptide
-            if (is_decoy) {
-              num_decoy_peptide_skipped++;
-            } else {
-              num_target_peptide_skipped++;              
-            }
-            continue;
-          } else {
-            BestPeptideScore.at(peptideStr) += ascending ? -1.0 : 1.0;  //make sure only one best scoring peptide reported.
-          }
-        } catch (const out_of_range& oor) {
+        unordered_map<string, FLOAT_T>::iterator best = BestPeptideScore.find(getPeptideSeq(match));
+        if (best == BestPeptideScore.end()) {
           carp(CARP_DEBUG, "Error in peptide-level filtering");
+        } else if (!filter.keepPeptide(&best->second, match->getScore(score_type), is_decoy)) {
+          continue;
         }
       }
 
       // Do the Sidak correction.
       if (sidak) {
-        if (match->getRank(XCORR) > 1) {
+        if (match->getRank(rank_type) > 1) {
           carp_once(CARP_WARNING, "Sidak correction is not defined for non-top-matches. Further warnings are not shown.");
         }
         double sidak_adjustment = 1.0 - pow(1.0 - match->getScore(score_type), match->getTargetExperimentSize());
@@ -501,14 +622,7 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
     }
     delete match_iterator;
     delete match_collection;
-    if (num_decoy_rank_skipped + num_target_rank_skipped > 0) {
-      carp(CARP_INFO, "Skipped %d target and %d decoy PSMs with rank > %d.",
-           num_target_rank_skipped, num_decoy_rank_skipped, top_match);
-    }
-    if (num_target_peptide_skipped + num_decoy_peptide_skipped > 0) {
-      carp(CARP_INFO, "Skipped %d target and %d decoy PSMs due to peptide-level filtering.",
-           num_target_peptide_skipped, num_decoy_peptide_skipped);
-    }
+    filter.report();
   }
 
   if (sidak) {
@@ -543,6 +657,9 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
     } else if (score_type == RESIDUE_EVIDENCE_SCORE) {
       cols_to_print[RESIDUE_EVIDENCE_COL] = true;
       cols_to_print[RESIDUE_RANK_COL] = true;
+    } else if (score_type == HYPER_SCORE) {
+      cols_to_print[HYPERSCORE_COL] = true;
+      cols_to_print[HYPERSCORE_RANK_COL] = true;
     } else {
       cols_to_print[XCORR_SCORE_COL] = !target_matches->getScoredType(TIDE_SEARCH_EXACT_PVAL);
       cols_to_print[XCORR_RANK_COL] = true;
@@ -608,64 +725,22 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
 
   // Compute q-values.
   vector<FLOAT_T> qvalues;
-  switch (estimation_method) {
-  case TDC_METHOD:
-    if (avgTdc) {
-      carp(CARP_INFO, "Using a-TDC (%d decoy sets).", decoy_matches.size());
-      vector< vector<FLOAT_T> > decoy_scores;
-      AtdcScoreSet::getScores(target_matches, decoy_matches, score_type, ascending, target_scores, decoy_scores);
-      qvalues = AtdcScoreSet(target_scores, decoy_scores, ascending).fdps();
-      convert_fdr_to_qvalue(qvalues, true);
-      break;
-    }
-  case PEPTIDE_LEVEL_METHOD:
-    {
-      target_scores = target_matches->extractScores(score_type);
-      vector<FLOAT_T> decoy_scores;
-      for (map<int, MatchCollection*>::const_iterator i = decoy_matches.begin(); i != decoy_matches.end(); i++) {
-        vector<FLOAT_T> curScores = i->second->extractScores(score_type);
-        copy(curScores.begin(), curScores.end(), back_inserter(decoy_scores));
-      }
-      carp(CARP_INFO, "There are %d target and %d decoy PSMs for q-value computation.",
-           target_scores.size(), decoy_scores.size());
-      qvalues = compute_decoy_qvalues_tdc(target_scores, decoy_scores, ascending, 1.0);
-    }
-    break;
-  case MIXMAX_METHOD:
-    {
-      target_scores = target_matches->extractScores(score_type);
-      vector<FLOAT_T> decoy_scores;
-      for (map<int, MatchCollection*>::const_iterator i = decoy_matches.begin(); i != decoy_matches.end(); i++) {
-        vector<FLOAT_T> curScores = i->second->extractScores(score_type);
-        copy(curScores.begin(), curScores.end(), back_inserter(decoy_scores));
-      }
-      carp(CARP_INFO, "There are %d target and %d decoy PSMs for q-value computation.",
-           target_scores.size(), decoy_scores.size());
-      qvalues = compute_decoy_qvalues_mixmax(target_scores, decoy_scores, ascending, Params::GetDouble("pi-zero"));
-    }
-    break;
-  default:
-      carp(CARP_FATAL, "No estimation method specified.");
-  }
-
-  unsigned int fdr1 = 0;
-  unsigned int fdr5 = 0;
-  unsigned int fdr10 = 0;
-  for (vector<FLOAT_T>::const_iterator i = qvalues.begin(); i != qvalues.end(); i++) {
-    if (*i < 0.01) ++fdr1;
-    if (*i < 0.05) ++fdr5;
-    if (*i < 0.10) ++fdr10;
-  }
-  if (estimation_method == PEPTIDE_LEVEL_METHOD) {
-    carp(CARP_INFO, "Number of peptides at 1%% FDR = %d.", fdr1);
-    carp(CARP_INFO, "Number of peptides at 5%% FDR = %d.", fdr5);
-    carp(CARP_INFO, "Number of peptides at 10%% FDR = %d.", fdr10);
+  if (estimation_method == TDC_METHOD && avgTdc) {
+    carp(CARP_INFO, "Using a-TDC (%d decoy sets).", decoy_matches.size());
+    vector< vector<FLOAT_T> > decoy_scores;
+    AtdcScoreSet::getScores(target_matches, decoy_matches, score_type, ascending, target_scores, decoy_scores);
+    qvalues = AtdcScoreSet(target_scores, decoy_scores, ascending).fdps();
+    convert_fdr_to_qvalue(qvalues, true);
   } else {
-    carp(CARP_INFO, "Number of PSMs at 1%% FDR = %d.", fdr1);
-    carp(CARP_INFO, "Number of PSMs at 5%% FDR = %d.", fdr5);
-    carp(CARP_INFO, "Number of PSMs at 10%% FDR = %d.", fdr10);
-
+    target_scores = target_matches->extractScores(score_type);
+    vector<FLOAT_T> decoy_scores;
+    for (map<int, MatchCollection*>::const_iterator i = decoy_matches.begin(); i != decoy_matches.end(); i++) {
+      vector<FLOAT_T> curScores = i->second->extractScores(score_type);
+      copy(curScores.begin(), curScores.end(), back_inserter(decoy_scores));
+    }
+    qvalues = computeQValues(estimation_method, target_scores, decoy_scores, ascending);
   }
+  reportQValues(qvalues, estimation_method);
 
   // Store p-values to q-values as a hash, and then assign them.
   map<FLOAT_T, FLOAT_T> qvalue_hash = store_arrays_as_hash(target_scores, qvalues);
@@ -673,7 +748,7 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
   target_matches->assignQValues(&qvalue_hash, score_type, derived_score_type);
 
   // Store targets by score.
-  target_matches->sort(score_type);
+  target_matches->sort(score_type, num_threads_);
   if (spectrum_flag_ == NULL) {
     output_->writeMatches(target_matches);
     output_->writeFooters();
@@ -713,6 +788,453 @@ int AssignConfidenceApplication::main(const vector<string>& input_files) {
   return 0;
 } // Main
 
+/**
+ * \returns the column that columnar-input reads a score from, or
+ * NUMBER_MATCH_COLUMNS if the score is not read that way
+ */
+static MATCH_COLUMNS_T getColumnarScoreColumn(SCORER_TYPE_T score_type) {
+  switch (score_type) {
+  case XCORR:
+    return XCORR_SCORE_COL;
+  case TAILOR_SCORE:
+    return TAILOR_COL;
+  case HYPER_SCORE:
+    return HYPERSCORE_COL;
+  case EVALUE:
+    return EVALUE_COL;
+  case TIDE_SEARCH_EXACT_PVAL:
+    return EXACT_PVALUE_COL;
+  case TIDE_SEARCH_REFACTORED_XCORR:
+    return REFACTORED_SCORE_COL;
+  case RESIDUE_EVIDENCE_PVAL:
+    return RESIDUE_PVALUE_COL;
+  case RESIDUE_EVIDENCE_SCORE:
+    return RESIDUE_EVIDENCE_COL;
+  case BOTH_PVALUE:
+    return BOTH_PVALUE_COL;
+  default:
+    return NUMBER_MATCH_COLUMNS;
+  }
+}
+
+/**
+ * \returns the rank column that goes with the score, as getRankScoreType
+ */
+static MATCH_COLUMNS_T getColumnarRankColumn(SCORER_TYPE_T score_type) {
+  switch (getRankScoreType(score_type)) {
+  case BOTH_PVALUE:
+    return BOTH_PVALUE_RANK;
+  case RESIDUE_EVIDENCE_PVAL:
+    return RESIDUE_RANK_COL;
+  case HYPER_SCORE:
+    return HYPERSCORE_RANK_COL;
+  default:
+    return XCORR_RANK_COL;
+  }
+}
+
+/**
+ * A row of a MatchColumnTable that takes part in the q-value estimation.
+ */
+struct ColumnarPsm {
+  const MatchColumnTable* table_;
+  size_t row_;
+  bool is_decoy_;
+  FLOAT_T qvalue_;
+
+  ColumnarPsm(const MatchColumnTable* table, size_t row, bool is_decoy)
+    : table_(table), row_(row), is_decoy_(is_decoy), qvalue_(0) {}
+  FLOAT_T getScore() const { return table_->getScore(row_); }
+};
+
+static bool compareColumnarPsmsAsc(const ColumnarPsm& x, const ColumnarPsm& y) {
+  return x.getScore() < y.getScore();
+}
+
+static bool compareColumnarPsmsDesc(const ColumnarPsm& x, const ColumnarPsm& y) {
+  return x.getScore() > y.getScore();
+}
+
+/**
+ * The columnar counterpart of peptide_level_filtering: keeps the best score
+ * of each peptide, by its index in the tables.
+ */
+static void findBestPeptideScores(
+  const MatchColumnTable* table,
+  bool ascending,
+  vector<FLOAT_T>* best_scores,
+  vector<bool>* has_best_score,
+  size_t* num_peptides
+) {
+  for (size_t row = 0; row < table->size(); row++) {
+    int peptide = table->getPeptideIndex(row);
+    FLOAT_T score = table->getScore(row);
+    if (!(*has_best_score)[peptide]) {
+      (*has_best_score)[peptide] = true;
+      (*best_scores)[peptide] = score;
+      ++*num_peptides;
+    } else if ((ascending && (*best_scores)[peptide] > score) ||
+               (!ascending && score > (*best_scores)[peptide])) {
+      (*best_scores)[peptide] = score;
+    }
+  }
+}
+
+static void deleteTables(vector<MatchColumnTable*>& tables) {
+  for (vector<MatchColumnTable*>::iterator i = tables.begin(); i != tables.end(); ++i) {
+    delete *i;
+  }
+  tables.clear();
+}
+
+bool AssignConfidenceApplication::mainColumnar(
+  const vector<string>& input_files,
+  ESTIMATION_METHOD_T estimation_method,
+  SCORER_TYPE_T score_type
+) {
+  if (!Params::GetBool("txt-output") || Params::GetBool("pepxml-output") ||
+      Params::GetBool("mzid-output")) {
+    carp(CARP_WARNING, "columnar-input writes tab-delimited output only; "
+         "reading the PSMs the usual way.");
+    return false;
+  }
+  int top_match = 1;
+  if (estimation_method == PEPTIDE_LEVEL_METHOD) {
+    top_match = MAX_PSMS+1;
+  }
+
+  // Find the decoy file of each target file, as main does. The tables of
+  // the i-th target file and its decoy file are tables[2*i] and
+  // tables[2*i + 1], which is NULL if there is no decoy file.
+  vector<string> target_paths;
+  vector<string> decoy_paths;
+  vector<MatchColumnTable*> tables;
+  for (vector<string>::const_iterator iter = input_files.begin(); iter != input_files.end(); ++iter) {
+    string target_path = *iter;
+    string decoy_path = *iter;
+
+    if (target_path.find("decoy") != string::npos) {
+      carp(CARP_FATAL, "%s appears to be a decoy file. Only target or concatenated files "
+                       "should be given to assign-confidence because it automatically searches for "
+                       "corresponding decoy files.", target_path.c_str());
+    }
+
+    check_target_decoy_files(target_path, decoy_path);
+
+    if (!FileUtils::Exists(target_path)) {
+      carp(CARP_FATAL, "Target file %s not found", target_path.c_str());
+    } else if (!FileUtils::Exists(decoy_path)) {
+      if (estimation_method == MIXMAX_METHOD) {
+        carp(CARP_FATAL, "Cannot find file %s. Decoy file from separate target-decoy search is "
+                         "required for mix-max q-value calculation", decoy_path.c_str());
+      }
+      decoy_path = "";
+    }
+
+    for (int i = 0; i < 2; i++) {
+      const string& path = i == 0 ? target_path : decoy_path;
+      if (path.empty()) {
+        tables.push_back(NULL);
+        continue;
+      }
+      tables.push_back(new MatchColumnTable());
+      if (StringUtils::IEndsWith(path, ".xml") || StringUtils::IEndsWith(path, ".sqt") ||
+          StringUtils::IEndsWith(path, ".mzid") || !tables.back()->open(path)) {
+        carp(CARP_WARNING, "%s is not a tab-delimited file that can be memory-mapped; "
+             "reading the PSMs the usual way.", path.c_str());
+        deleteTables(tables);
+        return false;
+      }
+      if (!tables.back()->hasColumn(SCAN_COL) || !tables.back()->hasColumn(CHARGE_COL)) {
+        carp(CARP_WARNING, "%s has no scan or charge column; reading the PSMs the usual way.",
+             path.c_str());
+        deleteTables(tables);
+        return false;
+      }
+    }
+    target_paths.push_back(target_path);
+    decoy_paths.push_back(decoy_path);
+  }
+
+  // The rows are written as they are, under one header.
+  MATCH_COLUMNS_T qvalue_col = estimation_method == MIXMAX_METHOD ? QVALUE_MIXMAX_COL : QVALUE_TDC_COL;
+  for (size_t i = 0; i < target_paths.size(); i++) {
+    if (tables[2*i]->getColumnNames() != tables[0]->getColumnNames() ||
+        tables[2*i]->hasColumn(qvalue_col)) {
+      carp(CARP_WARNING, "The columns of %s differ from those of %s or include %s; "
+           "reading the PSMs the usual way.", target_paths[i].c_str(),
+           target_paths[0].c_str(), get_column_header(qvalue_col));
+      deleteTables(tables);
+      return false;
+    }
+  }
+
+  // If necessary, automatically identify the score type, as main does.
+  if (score_type == INVALID_SCORER_TYPE) {
+    vector<SCORER_TYPE_T> scoreTypes;
+    scoreTypes.push_back(TAILOR_SCORE);
+    scoreTypes.push_back(XCORR);
+    scoreTypes.push_back(HYPER_SCORE);
+    scoreTypes.push_back(EVALUE);
+    scoreTypes.push_back(BOTH_PVALUE);
+    scoreTypes.push_back(RESIDUE_EVIDENCE_PVAL);
+    scoreTypes.push_back(RESIDUE_EVIDENCE_SCORE);
+    scoreTypes.push_back(TIDE_SEARCH_EXACT_PVAL);
+    for (vector<SCORER_TYPE_T>::const_iterator i = scoreTypes.begin(); i != scoreTypes.end(); i++) {
+      if (tables[0]->hasValue(getColumnarScoreColumn(*i))) {
+        score_type = *i;
+        carp(CARP_INFO, "Automatically detected score type: %s", scorer_type_to_string(score_type));
+        break;
+      }
+    }
+  }
+  MATCH_COLUMNS_T score_col = getColumnarScoreColumn(score_type);
+  if (score_col == NUMBER_MATCH_COLUMNS) {
+    carp(CARP_WARNING, "columnar-input does not support this score; reading the PSMs the usual way.");
+    deleteTables(tables);
+    return false;
+  }
+  bool ascending = false;
+  switch (getDirection(score_type)) {
+    case -1:
+      ascending = false;
+      break;
+    case 1:
+      ascending = true;
+      break;
+    default:
+      carp(CARP_FATAL, "Cannot infer sort order for score %s.", scorer_type_to_string(score_type));
+  }
+  MATCH_COLUMNS_T score_rank_col = getColumnarRankColumn(score_type);
+
+  // Read the columns. Peptides are only needed for peptide-level estimation.
+  unordered_map<string, int> peptide_ids;
+  for (size_t i = 0; i < tables.size(); i++) {
+    if (tables[i] == NULL) {
+      continue;
+    }
+    if (i % 2 == 0 && !tables[i]->hasValue(score_col)) {
+      carp(CARP_FATAL, "The PSM feature \"%s\" was not found in file \"%s\".",
+           scorer_type_to_string(score_type), target_paths[i / 2].c_str());
+    }
+    tables[i]->load(score_col, score_rank_col, num_threads_,
+                    estimation_method == PEPTIDE_LEVEL_METHOD ? &peptide_ids : NULL);
+    if (tables[i]->hasMultipleDecoys()) {
+      carp(CARP_WARNING, "columnar-input does not support multiple decoys per target; "
+           "reading the PSMs the usual way.");
+      deleteTables(tables);
+      return false;
+    }
+  }
+
+  vector<FLOAT_T> best_peptide_scores(peptide_ids.size());
+  vector<bool> has_best_peptide_score(peptide_ids.size(), false);
+  size_t num_peptides = 0;
+  vector<ColumnarPsm> target_psms;
+  vector<FLOAT_T> decoy_scores;
+
+  for (size_t file_idx = 0; file_idx < target_paths.size(); file_idx++) {
+    const MatchColumnTable* targets = tables[2*file_idx];
+    const MatchColumnTable* decoys = tables[2*file_idx + 1];
+    carp(CARP_INFO, "Found %d PSMs in %s.", targets->size(), target_paths[file_idx].c_str());
+    carp(CARP_INFO, "Score type=%s, sorting in %s order",
+         scorer_type_to_string(score_type), ascending ? "ascending" : "descending");
+
+    // Find and keep the best score for each peptide.
+    if (estimation_method == PEPTIDE_LEVEL_METHOD) {
+      findBestPeptideScores(targets, ascending, &best_peptide_scores, &has_best_peptide_score, &num_peptides);
+      carp(CARP_INFO, "%d distinct target peptides.", num_peptides);
+    }
+
+    // Counters just to let the user know what's up.
+    PsmFilter filter(top_match, ascending);
+
+    // The PSMs of this file that remain after target-decoy competition.
+    vector<ColumnarPsm> psms;
+    if (decoys != NULL && estimation_method != MIXMAX_METHOD) {
+      carp(CARP_INFO, "Found %d PSMs in %s.", decoys->size(), decoy_paths[file_idx].c_str());
+
+      TdcPairing pairing;
+      vector<int> file_keys;
+      for (size_t i = 0; i < decoys->getFileNames().size(); i++) {
+        file_keys.push_back(stringToIndex(decoys->getFileNames()[i]));
+      }
+      for (size_t row = 0; row < decoys->size(); row++) {
+        // Only use top-ranked matches.
+        if (!filter.keepRank(decoys->getRank(row), true)) {
+          continue;
+        }
+        pairing.addDecoy(file_keys[decoys->getFileIndex(row)], decoys->getScan(row),
+                         decoys->getCharge(row), decoys->getRank(row), (int)row + 1);
+      }
+
+      // Find and keep the best score for each decoy peptide.
+      if (estimation_method == PEPTIDE_LEVEL_METHOD) {
+        findBestPeptideScores(decoys, ascending, &best_peptide_scores, &has_best_peptide_score, &num_peptides);
+        carp(CARP_INFO, "%d distinct target+decoy peptides.", num_peptides);
+      }
+
+      file_keys.clear();
+      for (size_t i = 0; i < targets->getFileNames().size(); i++) {
+        file_keys.push_back(stringToIndex(targets->getFileNames()[i]));
+      }
+      for (size_t row = 0; row < targets->size(); row++) {
+        // Only use top-ranked matches.
+        if (!filter.keepRank(targets->getRank(row), false)) {
+          continue;
+        }
+
+        // Retrieve the index of the corresponding decoy PSM.
+        int file_index = targets->getFileIndex(row);
+        int decoy_idx = pairing.findDecoy(file_keys[file_index], targets->getFileNames()[file_index].c_str(),
+          targets->getScan(row), targets->getCharge(row), targets->getRank(row));
+
+        ColumnarPsm target_psm(targets, row, targets->isDecoy(row));
+        if (estimation_method == PEPTIDE_LEVEL_METHOD) {
+          psms.push_back(target_psm);
+          if (decoy_idx != 0) {
+            psms.push_back(ColumnarPsm(decoys, decoy_idx - 1, true));
+          }
+          continue;
+        }
+        if (decoy_idx == 0) {
+          psms.push_back(target_psm);
+          continue;
+        }
+        ColumnarPsm decoy_psm(decoys, decoy_idx - 1, true);
+
+        // This is where the target-decoy competition happens.
+        psms.push_back(pairing.targetWins(target_psm.getScore(), decoy_psm.getScore(), ascending)
+                       ? target_psm : decoy_psm);
+      }
+      pairing.report((int)psms.size());
+    } else {
+      if (decoys != NULL) {
+        // Mix-max uses the decoys directly, because there is no TDC.
+        carp(CARP_INFO, "Found %d PSMs in %s.", decoys->size(), decoy_paths[file_idx].c_str());
+        for (size_t row = 0; row < decoys->size(); row++) {
+          if (filter.keepRank(decoys->getRank(row), true)) {
+            decoy_scores.push_back(decoys->getScore(row));
+          }
+        }
+      }
+      psms.reserve(targets->size());
+      for (size_t row = 0; row < targets->size(); row++) {
+        psms.push_back(ColumnarPsm(targets, row, targets->isDecoy(row)));
+      }
+    }
+
+    // Gather the PSMs into targets and decoys.
+    for (vector<ColumnarPsm>::const_iterator psm = psms.begin(); psm != psms.end(); ++psm) {
+      bool is_decoy = psm->is_decoy_;
+
+      // Only use top-ranked matches.
+      if (!filter.keepRank(psm->table_->getRank(psm->row_), is_decoy)) {
+        continue;
+      }
+
+      // Keep only the best-scoring PSM of each peptide.
+      FLOAT_T score = psm->getScore();
+      if (estimation_method == PEPTIDE_LEVEL_METHOD &&
+          !filter.keepPeptide(&best_peptide_scores[psm->table_->getPeptideIndex(psm->row_)], score, is_decoy)) {
+        continue;
+      }
+
+      if (is_decoy) {
+        decoy_scores.push_back(score);
+      } else {
+        target_psms.push_back(*psm);
+      }
+    }
+    filter.report();
+  }
+
+  // Compute q-values.
+  vector<FLOAT_T> target_scores;
+  target_scores.reserve(target_psms.size());
+  for (vector<ColumnarPsm>::const_iterator i = target_psms.begin(); i != target_psms.end(); ++i) {
+    target_scores.push_back(i->getScore());
+  }
+  vector<FLOAT_T> qvalues = computeQValues(estimation_method, target_scores, decoy_scores, ascending);
+  reportQValues(qvalues, estimation_method);
+
+  // Store p-values to q-values as a hash, and then assign them.
+  map<FLOAT_T, FLOAT_T> qvalue_hash = store_arrays_as_hash(target_scores, qvalues);
+  for (vector<ColumnarPsm>::iterator i = target_psms.begin(); i != target_psms.end(); ++i) {
+    FLOAT_T score = i->getScore();
+    if (isinf(score) || isnan(score)) {
+      carp(CARP_DEBUG, "Found inf or nan score.");
+      i->qvalue_ = numeric_limits<double>::quiet_NaN();
+      continue;
+    }
+    map<FLOAT_T, FLOAT_T>::const_iterator map_position = qvalue_hash.find(score);
+    if (map_position == qvalue_hash.end()) {
+      carp(CARP_FATAL, "Cannot find q-value corresponding to score of %g.", score);
+    }
+    i->qvalue_ = map_position->second;
+  }
+
+  // Write the targets by score, each row as it was read.
+  ParallelUtil::StableSort(target_psms.begin(), target_psms.end(),
+                           ascending ? compareColumnarPsmsAsc : compareColumnarPsmsDesc, num_threads_);
+  string output_file = OutputFiles::makeFileName(
+    Params::GetString("fileroot"), this, Params::GetBool("concat") ? NULL : "target", "txt",
+    Params::GetString("output-dir"));
+  ofstream* output = FileUtils::GetWriteStream(output_file, Params::GetBool("overwrite"));
+  if (output == NULL) {
+    carp(CARP_FATAL, "Error creating file '%s'.", output_file.c_str());
+  }
+  *output << StringUtils::Join(tables[0]->getColumnNames(), '\t') << '\t'
+          << get_column_header(qvalue_col) << '\n';
+  int precision = Params::GetInt("precision");
+  for (vector<ColumnarPsm>::const_iterator i = target_psms.begin(); i != target_psms.end(); ++i) {
+    i->table_->writeRow(*output, i->row_);
+    *output << '\t' << StringUtils::ToString(i->qvalue_, precision, false) << '\n';
+  }
+  output->close();
+  delete output;
+  deleteTables(tables);
+  return true;
+}
+
+
+vector<FLOAT_T> AssignConfidenceApplication::computeQValues(
+  ESTIMATION_METHOD_T estimation_method,
+  vector<FLOAT_T>& target_scores,
+  vector<FLOAT_T>& decoy_scores,
+  bool ascending
+) {
+  carp(CARP_INFO, "There are %d target and %d decoy PSMs for q-value computation.",
+       target_scores.size(), decoy_scores.size());
+  switch (estimation_method) {
+  case TDC_METHOD:
+  case PEPTIDE_LEVEL_METHOD:
+    return compute_decoy_qvalues_tdc(target_scores, decoy_scores, ascending, 1.0);
+  case MIXMAX_METHOD:
+    return compute_decoy_qvalues_mixmax(target_scores, decoy_scores, ascending, Params::GetDouble("pi-zero"));
+  default:
+    carp(CARP_FATAL, "No estimation method specified.");
+  }
+  return vector<FLOAT_T>();
+}
+
+void AssignConfidenceApplication::reportQValues(
+  const vector<FLOAT_T>& qvalues,
+  ESTIMATION_METHOD_T estimation_method
+) {
+  unsigned int fdr1 = 0;
+  unsigned int fdr5 = 0;
+  unsigned int fdr10 = 0;
+  for (vector<FLOAT_T>::const_iterator i = qvalues.begin(); i != qvalues.end(); i++) {
+    if (*i < 0.01) ++fdr1;
+    if (*i < 0.05) ++fdr5;
+    if (*i < 0.10) ++fdr10;
+  }
+  const char* unit = estimation_method == PEPTIDE_LEVEL_METHOD ? "peptides" : "PSMs";
+  carp(CARP_INFO, "Number of %s at 1%% FDR = %d.", unit, fdr1);
+  carp(CARP_INFO, "Number of %s at 5%% FDR = %d.", unit, fdr5);
+  carp(CARP_INFO, "Number of %s at 10%% FDR = %d.", unit, fdr10);
+}
 
 /**
 * Find the best-scoring match for each peptide in a given collection.
@@ -1103,53 +1625,64 @@ vector<FLOAT_T> AssignConfidenceApplication::compute_decoy_qvalues_tdc(
        target_scores.size(), decoy_scores.size());
 
   // Sort both sets of scores.
-  if (ascending) {
-    sort(target_scores.begin(), target_scores.end(), Match::ScoreLess);
-    sort(decoy_scores.begin(), decoy_scores.end(), Match::ScoreLess);
-  } else {
-    sort(target_scores.begin(), target_scores.end(), Match::ScoreGreater);
-    sort(decoy_scores.begin(), decoy_scores.end(), Match::ScoreGreater);
-  }
-
-  // Compute false discovery rate for each target score.
-  vector<FLOAT_T> qvalues;
-  qvalues.reserve(target_scores.size());
-  int decoy_idx = 0;
-  for (int target_idx = 0; target_idx < target_scores.size(); target_idx++) {
-    double target_score = target_scores[target_idx];
-
-    // Find the index of the first decoy score greater than this target score.
-    if (ascending) {
-      while (decoy_idx < decoy_scores.size() &&
-             Match::ScoreLess(decoy_scores[decoy_idx], target_score)) {
-        carp(CARP_DEBUG, "Decoy score %g.", decoy_scores[decoy_idx]);
-        decoy_idx++;
+  bool (*compare)(FLOAT_T, FLOAT_T) = ascending ? Match::ScoreLess : Match::ScoreGreater;
+  ParallelUtil::StableSort(target_scores.begin(), target_scores.end(), compare, num_threads_);
+  ParallelUtil::StableSort(decoy_scores.begin(), decoy_scores.end(), compare, num_threads_);
+
+  // Compute false discovery rate for each target score. The number of
+  // decoys scoring better than a target only grows along the sorted
+  // targets, so each range of targets finds its first count by binary
+  // search and counts on from there.
+  size_t num_targets = target_scores.size();
+  vector<FLOAT_T> qvalues(num_targets);
+  vector< pair<size_t, size_t> > ranges = ParallelUtil::Ranges(num_targets, num_threads_);
+  ParallelUtil::ForEach(ranges.size(), [&](size_t range_idx) {
+    // A range may start inside a run of tied targets, which all get the
+    // FDR of the first of them.
+    size_t tie_idx = ranges[range_idx].first;
+    while (tie_idx > 0 && target_scores[tie_idx - 1] == target_scores[ranges[range_idx].first]) {
+      tie_idx--;
+    }
+    size_t decoy_idx = lower_bound(decoy_scores.begin(), decoy_scores.end(),
+                                   target_scores[tie_idx], compare) - decoy_scores.begin();
+    FLOAT_T fdr = 1.0;
+    for (size_t target_idx = tie_idx; target_idx < ranges[range_idx].second; target_idx++) {
+      if (target_idx == tie_idx || target_scores[target_idx] != target_scores[tie_idx]) {
+        tie_idx = target_idx;
+        // Find the index of the first decoy score greater than this target score.
+        while (decoy_idx < decoy_scores.size() &&
+               compare(decoy_scores[decoy_idx], target_scores[target_idx])) {
+          decoy_idx++;
+        }
+        // FDR = (#decoys + 1)/ #targets
+        fdr = ((FLOAT_T)(decoy_idx + 1)/(FLOAT_T)(target_idx + 1));
+        if (fdr > 1.0) {
+          fdr = 1.0;
+        }
       }
-    } else {   
-      while (decoy_idx < decoy_scores.size() &&
-             Match::ScoreGreater(decoy_scores[decoy_idx], target_score)) {
-        carp(CARP_DEBUG, "Decoy score %g.", decoy_scores[decoy_idx]);
-        decoy_idx++;
+      if (target_idx >= ranges[range_idx].first) {
+        qvalues[target_idx] = fdr;
       }
     }
-
-    // FDR = (#decoys + 1)/ #targets
-    FLOAT_T fdr = ((FLOAT_T)(decoy_idx + 1)/(FLOAT_T)(target_idx + 1));
-    if (fdr > 1.0) {
-      fdr = 1.0;
-    }
-    carp(CARP_DEBUG, "FDR for score %g = min(1,%d/%d) = %g",
-         target_score, decoy_idx, target_idx + 1, fdr);
-    qvalues.push_back(fdr);
-    // assign fdr for this and any following with same score
-    while (target_idx < target_scores.size() - 1 && target_scores[target_idx + 1] == target_score) {
-      target_idx++;
-      qvalues.push_back(fdr);
+  });
+
+  // Convert the FDRs into q-values, i.e. the minimum FDR at or after each
+  // target: each range takes its own minima, and is then capped by the
+  // q-value at the start of the next range.
+  ParallelUtil::ForEach(ranges.size(), [&](size_t range_idx) {
+    for (size_t idx = ranges[range_idx].second - 1; idx > ranges[range_idx].first; idx--) {
+      qvalues[idx - 1] = min(qvalues[idx - 1], qvalues[idx]);
     }
+  });
+  vector<FLOAT_T> next_qvalues(ranges.size(), 1.0);
+  for (size_t range_idx = ranges.size() - 1; range_idx > 0; range_idx--) {
+    next_qvalues[range_idx - 1] = min(qvalues[ranges[range_idx].first], next_qvalues[range_idx]);
   }
-  
-  // Convert the FDRs into q-values.
-  convert_fdr_to_qvalue(qvalues, true);
+  ParallelUtil::ForEach(ranges.size(), [&](size_t range_idx) {
+    for (size_t idx = ranges[range_idx].first; idx < ranges[range_idx].second; idx++) {
+      qvalues[idx] = min(qvalues[idx], next_qvalues[range_idx]);
+    }
+  });
 
   return qvalues;
 }
@@ -1191,35 +1724,43 @@ vector<FLOAT_T> AssignConfidenceApplication::compute_decoy_qvalues_mixmax(
 
   //Sort decoy and target stores
   if (ascending) {
-    sort(target_scores.begin(), target_scores.end(), greater<FLOAT_T>());
-    sort(decoy_scores.begin(), decoy_scores.end(), greater<FLOAT_T>());
+    ParallelUtil::StableSort(target_scores.begin(), target_scores.end(), greater<FLOAT_T>(), num_threads_);
+    ParallelUtil::StableSort(decoy_scores.begin(), decoy_scores.end(), greater<FLOAT_T>(), num_threads_);
   } else {
-    sort(target_scores.begin(), target_scores.end());
-    sort(decoy_scores.begin(), decoy_scores.end());
+    ParallelUtil::StableSort(target_scores.begin(), target_scores.end(), less<FLOAT_T>(), num_threads_);
+    ParallelUtil::StableSort(decoy_scores.begin(), decoy_scores.end(), less<FLOAT_T>(), num_threads_);
   }
 
   //histogram of the target scores.
   vector<double> h_w_le_z(num_decoys + 1, 0); //histogram for N_{w<=z}
   vector<double> h_z_le_z(num_decoys + 1, 0); //histogram for N_{z<=z}
 
-  int idx = 0;
-  for (int i = 0; i < num_decoys; ++i) {
-    while (idx < num_targets && (ascending ?
-      decoy_scores[i] <= target_scores[idx] :
-      decoy_scores[i] >= target_scores[idx])) {
-      ++idx;
-    }
-    h_w_le_z[i] = (double)idx;
-  }
-  idx = 0;
-  for (int i = 0; i < num_decoys; ++i) {
-    while (idx < num_targets && (ascending ?
-      decoy_scores[i] <= decoy_scores[idx] :
-      decoy_scores[i] >= decoy_scores[idx])) {
-      ++idx;
+  // Both counts only grow along the sorted decoys, so each range of decoys
+  // finds its first counts by binary search and counts on from there.
+  vector< pair<size_t, size_t> > ranges = ParallelUtil::Ranges(num_decoys, num_threads_);
+  ParallelUtil::ForEach(ranges.size(), [&](size_t range_idx) {
+    FLOAT_T first_decoy = decoy_scores[ranges[range_idx].first];
+    size_t w_idx = partition_point(target_scores.begin(), target_scores.end(), [&](FLOAT_T score) {
+      return ascending ? first_decoy <= score : first_decoy >= score;
+    }) - target_scores.begin();
+    size_t z_idx = partition_point(decoy_scores.begin(), decoy_scores.end(), [&](FLOAT_T score) {
+      return ascending ? first_decoy <= score : first_decoy >= score;
+    }) - decoy_scores.begin();
+    for (size_t i = ranges[range_idx].first; i < ranges[range_idx].second; ++i) {
+      while (w_idx < num_targets && (ascending ?
+        decoy_scores[i] <= target_scores[w_idx] :
+        decoy_scores[i] >= target_scores[w_idx])) {
+        ++w_idx;
+      }
+      h_w_le_z[i] = (double)w_idx;
+      while (z_idx < num_decoys && (ascending ?
+        decoy_scores[i] <= decoy_scores[z_idx] :
+        decoy_scores[i] >= decoy_scores[z_idx])) {
+        ++z_idx;
+      }
+      h_z_le_z[i] = (double)z_idx;
     }
-    h_z_le_z[i] = (double)idx;
-  }
+  });
   h_w_le_z[num_decoys] = (double)(num_targets);
   h_z_le_z[num_decoys] = (double)(num_decoys);
 
@@ -1262,7 +1803,7 @@ vector<FLOAT_T> AssignConfidenceApplication::compute_decoy_qvalues_mixmax(
 
 void AssignConfidenceApplication::peptide_level_filtering(
   MatchCollection* match_collection,
-  map<string, FLOAT_T>* BestPeptideScore, 
+  unordered_map<string, FLOAT_T>* BestPeptideScore, 
   SCORER_TYPE_T score_type,
   bool ascending) {
 
@@ -1337,6 +1878,7 @@ int AssignConfidenceApplication::getDirection(SCORER_TYPE_T scoreType) {
     case RESIDUE_EVIDENCE_SCORE:
     case PERCOLATOR_SCORE:
     case TAILOR_SCORE:    //Added for tailor score calibration method by AKF    
+    case HYPER_SCORE:
       // higher score better, ascending = false
       return -1;
     case EVALUE:
@@ -1464,6 +2006,8 @@ vector<string> AssignConfidenceApplication::getOptions() const {
     "list-of-files",
     "combine-charge-states",
     "combine-modified-peptides",
+    "columnar-input",
+    "num-threads",
     "fileroot"
   };
   return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
@@ -21,6 +21,7 @@
 #include "model/MatchCollection.h"
 #include "io/OutputFiles.h"
 #include "model/Peptide.h"
+#include <unordered_map>
 #include "boost/tuple/tuple.hpp" // This will be <tuple> once we move to C++11.
 #include "boost/tuple/tuple_comparison.hpp"
 
@@ -46,6 +47,7 @@ class AssignConfidenceApplication : public CruxApplication {
   unsigned int accepted_psms_;
   string index_name_;
   bool is_final_;
+  int num_threads_;
 
   class AtdcScoreSet {
    public:
@@ -165,7 +167,7 @@ class AssignConfidenceApplication : public CruxApplication {
 
   void peptide_level_filtering(
     MatchCollection* match_collection,
-    std::map<string, FLOAT_T>* BestPeptideScore,
+    std::unordered_map<string, FLOAT_T>* BestPeptideScore,
     SCORER_TYPE_T score_type,
     bool ascending);
   
@@ -190,6 +192,37 @@ class AssignConfidenceApplication : public CruxApplication {
     std::vector<FLOAT_T>& decoy_scores,
     bool ascending,
     FLOAT_T pi_zero);
+
+ protected:
+  /**
+   * Computes the q-values of the target scores by TDC, which peptide-level
+   * estimation also uses, or by mix-max. Shared by main and mainColumnar.
+   */
+  std::vector<FLOAT_T> computeQValues(
+    ESTIMATION_METHOD_T estimation_method,
+    std::vector<FLOAT_T>& target_scores,
+    std::vector<FLOAT_T>& decoy_scores,
+    bool ascending);
+
+  /**
+   * Logs how many targets pass the usual FDR thresholds
+   */
+  static void reportQValues(
+    const std::vector<FLOAT_T>& qvalues,
+    ESTIMATION_METHOD_T estimation_method);
+
+  /**
+   * Estimates q-values the same way as main, but from the columns of
+   * tab-delimited inputs read into MatchColumnTables rather than from
+   * MatchCollections, and writes each target row as it was read with a
+   * q-value column appended.
+   * \returns false, without writing anything, if the inputs or options
+   * need the MatchCollection path
+   */
+  bool mainColumnar(
+    const std::vector<std::string>& input_files,
+    ESTIMATION_METHOD_T estimation_method,
+    SCORER_TYPE_T score_type);
 };
 
 #endif //ASSIGNCONFIDENCE_H
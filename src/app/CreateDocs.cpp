@@ -33,6 +33,9 @@
 #include "app/CascadeSearchApplication.h"
 #include "app/AssignConfidenceApplication.h"
 #include "app/SubtractIndexApplication.h"
+#include "app/MergeSearchResultsApplication.h"
+#include "app/TideClientApplication.h"
+#include "app/TideServerApplication.h"
 #include "DIAmeterApplication.h"
 #include "app/SpectrumConvertApplication.h"
 using namespace std;
@@ -56,6 +59,7 @@ int CreateDocs::main(int argc, char** argv) {
   apps.add(new GetMs2Spectrum());
   apps.add(new KojakApplication());
   apps.add(new MakePinApplication());
+  apps.add(new MergeSearchResultsApplication());
   apps.add(new LocalizeModificationApplication());
   apps.add(new ParamMedicApplication());
   apps.add(new PercolatorApplication());
@@ -68,6 +72,8 @@ int CreateDocs::main(int argc, char** argv) {
   apps.add(new SubtractIndexApplication());
   apps.add(new TideIndexApplication());
   apps.add(new TideSearchApplication());
+  apps.add(new TideServerApplication());
+  apps.add(new TideClientApplication());
   apps.add(new DIAmeterApplication());
   apps.add(new SpectrumConvertApplication());
   
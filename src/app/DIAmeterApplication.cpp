@@ -19,11 +19,13 @@
 #include "util/MathUtil.h"
 #include "TideMatchSet.h"
 
-#include "io/DIAmeterFeatureScaler.h"
-#include "io/DIAmeterPSMFilter.h"
+#include "io/DIAmeterPSMTable.h"
 
 DIAmeterApplication::DIAmeterApplication():
-  remove_index_(""), output_pin_(""), output_percolator_(""), scan_gap_(0) { /* do nothing */
+  remove_index_(""), output_pin_(""), output_percolator_(""), scan_gap_(0),
+  peptides_header_(NULL), proteins_(NULL), predrt_library_(NULL), chunks_(NULL),
+  total_spec_charges_(0), ms1scan_mz_intensity_rank_map_(NULL), ms1scan_slope_intercept_map_(NULL),
+  ms1_xic_store_(NULL), next_window_(0), next_chunk_to_write_(0), num_searched_(0), print_interval_(0), psm_table_(NULL) {
 }
 
 DIAmeterApplication::~DIAmeterApplication() {
@@ -43,11 +45,16 @@ int DIAmeterApplication::main(const vector<string>& input_files) {
 int DIAmeterApplication::main(const vector<string>& input_files, const string input_index) {
   carp(CARP_INFO, "Running diameter...");
 
-  bool dia_mode = true;
-
   double bin_width_  = Params::GetDouble("mz-bin-width");
   double bin_offset_ = Params::GetDouble("mz-bin-offset");
-  int print_interval = Params::GetInt("print-search-progress");
+  print_interval_ = Params::GetInt("print-search-progress");
+  int num_threads = Params::GetInt("num-threads");
+  if (num_threads < 1) {
+    num_threads = boost::thread::hardware_concurrency();
+  } else if (num_threads > 64) {
+    carp(CARP_FATAL, "Requested more than 64 threads.");
+  }
+  carp(CARP_INFO, "Number of Threads: %d", num_threads);
 
   TideMatchSet::curScoreFunction_ = XCORR_SCORE;
   TideMatchSet::top_matches_ = Params::GetInt("top-match");
@@ -102,28 +109,26 @@ int DIAmeterApplication::main(const vector<string>& input_files, const string in
       &pepHeader.nprotterm_mods(), &pepHeader.cprotterm_mods(), bin_width_, bin_offset_);
 
   // Output setup
-  string output_file_name_unsorted_ = make_file_path("diameter.tmp.txt");
   string output_file_name_scaled_ = make_file_path("diameter.psm-features.txt");
   string output_file_name_filtered_ = make_file_path("diameter.psm-features.filtered.txt");
 
-  vector<int> negative_isotope_errors = TideSearchApplication::getNegativeIsotopeErrors();
+  negative_isotope_errors_ = TideSearchApplication::getNegativeIsotopeErrors();
 
-  ofstream* output_file = create_stream_in_path(output_file_name_unsorted_.c_str(), NULL, Params::GetBool("overwrite"));
-  string output_header = TideMatchSet::getHeader(DIAMETER_TSV, "");
-  *output_file << output_header;
+  // the results are kept in memory until they are scaled and filtered
+  DIAmeterPSMTable psm_table(TideMatchSet::getHeader(DIAMETER_TSV, ""));
 
-  map<string, double> peptide_predrt_map;
-  getPeptidePredRTMapping(&peptide_predrt_map);
+  DIAmeterRTLibrary predrt_library;
+  getPeptidePredRTMapping(&predrt_library);
 
   vector<InputFile> ms1_spectra_files = getInputFiles(input_files, 1);
   vector<InputFile> ms2_spectra_files = getInputFiles(input_files, 2);
 
-  long int num_range_skipped = 0;
-  long int num_precursors_skipped = 0;
-  long int num_isotopes_skipped = 0;
-  long int num_retained = 0;
-
-  ObservedPeakSet observed(Params::GetBool("use-neutral-loss-peaks"), Params::GetBool("use-flanking-peaks") );
+  // Shared by the search threads
+  peptides_file_ = peptides_file;
+  peptides_header_ = &peptides_header;
+  proteins_ = &proteins;
+  predrt_library_ = &predrt_library;
+  psm_table_ = &psm_table;
  
   // Loop through spectrum files
   for (int file_idx=0; file_idx < input_files.size(); ++file_idx) {
@@ -132,24 +137,23 @@ int DIAmeterApplication::main(const vector<string>& input_files, const string in
     string origin_file = ms2_spectra_files.at(file_idx).OriginalName;
 
     // load MS1 and MS2 spectra
+    MS1Peaks ms1_peaks;
     map<int, boost::tuple<double*, double*, double*, int>> ms1scan_mz_intensity_rank_map;
     map<int, boost::tuple<double, double>> ms1scan_slope_intercept_map;
-    loadMS1Spectra(ms1_spectra_file, &ms1scan_mz_intensity_rank_map, &ms1scan_slope_intercept_map);
+    loadMS1Spectra(ms1_spectra_file, &ms1_peaks, &ms1scan_mz_intensity_rank_map, &ms1scan_slope_intercept_map, num_threads);
     SpectrumCollection* spectra = loadSpectra(ms2_spectra_file);
+    DIAmeterXicStore ms1_xic_store;
+    for (map<int, boost::tuple<double*, double*, double*, int>>::const_iterator i = ms1scan_mz_intensity_rank_map.begin(); i != ms1scan_mz_intensity_rank_map.end(); i++) {
+      ms1_xic_store.addScan(i->first, (i->second).get<0>(), (i->second).get<1>(), (i->second).get<3>());
+    }
 
     carp(CARP_INFO, "new max_ms1scan:%d \t scan_gap:%d \t avg_noise_intensity_logrank:%f", max_ms1scan_, scan_gap_, avg_noise_intensity_logrank_);
     if (scan_gap_ <= 0) { carp(CARP_FATAL, "Scan gap cannot be non-positive:%d", scan_gap_); }
 
     resetMods();
 
-    // Active queue to process the indexed peptides
-    HeadedRecordReader peptide_reader = HeadedRecordReader(peptides_file, &peptides_header);
-    ActivePeptideQueue* active_peptide_queue = new ActivePeptideQueue(peptide_reader.Reader(), proteins, NULL, dia_mode);
-
     // Some setup adopted from TideSearch
     const vector<SpectrumCollection::SpecCharge>* spec_charges = spectra->SpecCharges();
-    int sc_index = -1;
-    FLOAT_T sc_total = (FLOAT_T)spec_charges->size();
 
     // Infer the isolation window size, which will be used if windowWideness is not provided in the input file
     double current_mz = 0; avg_isowin_width_ = 0;
@@ -177,156 +181,62 @@ int DIAmeterApplication::main(const vector<string>& input_files, const string in
     // Therefore, we divide the collection of SpecCharge into different chunks, each of which contains spectra
     // corresponding to the same (scan-win, charge) pair. Within each chunk, the spectra should be sort by the MS2 scan.
     // The motivation here is to build per chunk (i.e. scan-win) map to extract chromatogram for precursor-fragment coelution.
+    vector<vector<SpectrumCollection::SpecCharge> > chunks;
     vector<SpectrumCollection::SpecCharge> spec_charge_chunk;
     int curr_precursor_mz = 0;
 
     for (vector<SpectrumCollection::SpecCharge>::const_iterator sc_chunk = spec_charges->begin(); sc_chunk < spec_charges->begin() + (spec_charges->size()); sc_chunk++) {
-      ++sc_index;
-      if (print_interval > 0 && sc_index > 0 && sc_index % print_interval == 0) {
-        carp(CARP_INFO, "%d spectrum-charge combinations searched, %.0f%% complete", sc_index, sc_index / sc_total * 100);
-      }
+      int precursor_mz_chunk = int(sc_chunk->spectrum->PrecursorMZ());
 
-      Spectrum* spectrum_chunk = sc_chunk->spectrum;
-      int precursor_mz_chunk = int(spectrum_chunk->PrecursorMZ());
-
-      // deal with a chunk if it's either the end of the same mz or it's the last element
+      // close a chunk if it's either the end of the same mz or it's the last element
       if (((precursor_mz_chunk != curr_precursor_mz) || (sc_chunk == (spec_charges->begin() + spec_charges->size()-1))) && (spec_charge_chunk.size() > 0) ) {
-
-        // cache the MS2 peaks specific to the current isolation window
-        map<int, boost::tuple<double*, double*, int>> ms2scan_mz_intensity_map;
-        buildSpectraIndexFromIsoWindow(&spec_charge_chunk, &ms2scan_mz_intensity_map);
-
-        // the TTOF-specific denoising should occur in the for loop below
-        for (int chunk_idx = 0; chunk_idx < spec_charge_chunk.size(); ++chunk_idx) {
-          Spectrum* spectrum = spec_charge_chunk.at(chunk_idx).spectrum;
-          int charge = spec_charge_chunk.at(chunk_idx).charge;
-
-          double precursor_mz = spectrum->PrecursorMZ();
-          int scan_num = spectrum->SpectrumNumber();
-          int ms1_scan_num = spectrum->MS1SpectrumNum();
-
-          //denoising-related
-          if (Params::GetBool("spectra-denoising")) {
-            int neighbor_cnt = 0;
-            vector<double> proceed_mzs, succeed_mzs;
-            if (chunk_idx > 0) {
-              ++neighbor_cnt;
-              int neighbor_chunk_idx = chunk_idx - 1;
-              Spectrum* neighbor_spectrum = spec_charge_chunk.at(neighbor_chunk_idx).spectrum;
-              for (int neighbor_peak_idx = 0; neighbor_peak_idx < neighbor_spectrum->Size(); ++neighbor_peak_idx) {
-                proceed_mzs.push_back(neighbor_spectrum->M_Z(neighbor_peak_idx));
-              }
-              std::sort(proceed_mzs.begin(), proceed_mzs.end());
-            }
-
-            if (chunk_idx < (spec_charge_chunk.size()-1)) {
-              ++neighbor_cnt;
-              int neighbor_chunk_idx = chunk_idx + 1;
-              Spectrum* neighbor_spectrum = spec_charge_chunk.at(neighbor_chunk_idx).spectrum;
-              for (int neighbor_peak_idx = 0; neighbor_peak_idx < neighbor_spectrum->Size(); ++neighbor_peak_idx) {
-                succeed_mzs.push_back(neighbor_spectrum->M_Z(neighbor_peak_idx));
-              }
-              std::sort(succeed_mzs.begin(), succeed_mzs.end());
-            }
-
-            vector<bool> peak_supported;
-            for (int peak_idx = 0; peak_idx < spectrum->Size(); ++peak_idx) {
-              double peak_mz = spectrum->M_Z(peak_idx);
-
-              int supported_cnt = 0;
-              int proceed_mz_idx = MathUtil::binarySearch(&proceed_mzs, peak_mz);
-              if (proceed_mz_idx >= 0) {
-                double matched_mz = proceed_mzs.at(proceed_mz_idx);
-                double ppm = fabs(peak_mz - matched_mz) * 1000000 / max(peak_mz, matched_mz);
-                if (ppm <= Params::GetInt("frag-ppm")) { ++supported_cnt; }
-              }
-
-              int succeed_mz_idx = MathUtil::binarySearch(&succeed_mzs, peak_mz);
-              if (succeed_mz_idx >= 0) {
-                double matched_mz = succeed_mzs.at(succeed_mz_idx);
-                double ppm = fabs(peak_mz - matched_mz) * 1000000 / max(peak_mz, matched_mz);
-                if (ppm <= Params::GetInt("frag-ppm")) { ++supported_cnt; }
-              }
-
-              if (supported_cnt >= neighbor_cnt) {
-                peak_supported.push_back(true);
-              } else {
-                peak_supported.push_back(false);
-              }
-            }
-            spectrum->UpdatePeakSupport(&peak_supported);
-          }
-
-          // The active peptide queue holds the candidate peptides for spectrum.
-          // Calculate and set the window, depending on the window type.
-          vector<double>* min_mass = new vector<double>();
-          vector<double>* max_mass = new vector<double>();
-          double min_range, max_range;
-
-          carp(CARP_DETAILED_DEBUG, "MS1Scan:%d \t MS2Scan:%d \t precursor_mz:%f \t charge:%d", ms1_scan_num, scan_num, precursor_mz, charge);
-          computeWindowDIA(spec_charge_chunk.at(chunk_idx), &negative_isotope_errors, min_mass, max_mass, &min_range, &max_range);
-
-          // Normalize the observed spectrum and compute the cache of frequently-needed
-          // values for taking dot products with theoretical spectra.
-          // TODO: Note that here each specturm might be preprocessed multiple times, one for each charge, potentially can be improved!
-          observed.PreprocessSpectrum(*spectrum, charge, &num_range_skipped, &num_precursors_skipped, &num_isotopes_skipped, &num_retained, dia_mode);
-          active_peptide_queue->SetActiveRange(min_mass, max_mass, min_range, max_range);
-
-
-          if (active_peptide_queue->nCandPeptides_ == 0) { // No peptides to score.
-            delete min_mass;
-            delete max_mass;
-            continue; 
-          }
-          // allocate PSMscores for N scores
-          TideMatchSet psm_scores(active_peptide_queue, &observed);  //nPeptides_ includes acitve and inacitve peptides
-
-          TideSearchApplication::XCorrScoring(charge, observed, active_peptide_queue, psm_scores);
-
-          reportDIA(output_file, origin_file, spec_charge_chunk.at(chunk_idx), active_peptide_queue, proteins,
-              psm_scores, &observed, &ms1scan_mz_intensity_rank_map, &ms1scan_slope_intercept_map,
-              &ms2scan_mz_intensity_map, &peptide_predrt_map);
-
-          delete min_mass;
-          delete max_mass;
-        }
-
-        // clear up for next chunk
-        for (map<int, boost::tuple<double*, double*, int>>::const_iterator i = ms2scan_mz_intensity_map.begin(); i != ms2scan_mz_intensity_map.end(); i++) {
-          delete[] (i->second).get<0>(); 
-          delete[] (i->second).get<1>();
-        }
-        ms2scan_mz_intensity_map.clear();
+        chunks.push_back(spec_charge_chunk);
         spec_charge_chunk.clear();
       }
       curr_precursor_mz = precursor_mz_chunk;
       spec_charge_chunk.push_back(*sc_chunk);      
     }
-        
+
+    // group the chunks of each isolation window, in the order of their first chunk
+    map<int, int> window_index;
+    windows_.clear();
+    for (size_t chunk_idx = 0; chunk_idx < chunks.size(); ++chunk_idx) {
+      int precursor_mz_chunk = int(chunks[chunk_idx].front().spectrum->PrecursorMZ());
+      map<int, int>::const_iterator window = window_index.find(precursor_mz_chunk);
+      if (window == window_index.end()) {
+        window = window_index.insert(make_pair(precursor_mz_chunk, (int)windows_.size())).first;
+        windows_.push_back(vector<int>());
+      }
+      windows_[window->second].push_back((int)chunk_idx);
+    }
+
+    origin_file_ = origin_file;
+    chunks_ = &chunks;
+    total_spec_charges_ = spec_charges->size();
+    ms1scan_mz_intensity_rank_map_ = &ms1scan_mz_intensity_rank_map;
+    ms1scan_slope_intercept_map_ = &ms1scan_slope_intercept_map;
+    ms1_xic_store_ = &ms1_xic_store;
+    next_window_ = 0;
+    chunk_results_.assign(chunks.size(), (string*)NULL);
+    next_chunk_to_write_ = 0;
+    num_searched_ = 0;
+
+    boost::thread_group threadgroup;
+    for (int t = 1; t < min(num_threads, (int)windows_.size()); ++t) {
+      threadgroup.add_thread(new boost::thread(boost::bind(&DIAmeterApplication::searchWindows, this)));
+    }
+    searchWindows();
+    threadgroup.join_all();
+
     // clean up
     delete spectra;
-    for (map<int, boost::tuple<double*, double*, double*, int>>::const_iterator i = ms1scan_mz_intensity_rank_map.begin(); i != ms1scan_mz_intensity_rank_map.end(); i++) {
-      delete[] (i->second).get<0>();
-      delete[] (i->second).get<1>();
-      delete[] (i->second).get<2>();
-    }
     ms1scan_mz_intensity_rank_map.clear();
     ms1scan_slope_intercept_map.clear();    
-    delete active_peptide_queue;
-  }
-  if (output_file) {
-    output_file->close();
-    delete output_file;  
   }
 
-  // standardize the features
-  DIAmeterFeatureScaler diameterScaler(output_file_name_unsorted_.c_str());
-  diameterScaler.calcDataQuantile();
-  diameterScaler.writeScaledFile(output_file_name_scaled_.c_str());
-
-  // filter the edges
-  DIAmeterPSMFilter diameterFilter(output_file_name_scaled_.c_str());
-  diameterFilter.loadAndFilter(output_file_name_filtered_.c_str(), Params::GetBool("psm-filter") );
+  // standardize the features and filter the edges
+  psm_table.scaleFeatures(num_threads);
+  psm_table.write(output_file_name_scaled_.c_str(), output_file_name_filtered_.c_str(), Params::GetBool("psm-filter"));
 
   // generate .pin file by calling make-pin
   MakePinApplication pinApp;
@@ -350,8 +260,199 @@ int DIAmeterApplication::main(const vector<string>& input_files, const string in
   return 0;
 }
 
+void DIAmeterApplication::searchWindows() {
+  vector<PeptideLane> lanes;
+  ObservedPeakSet observed(Params::GetBool("use-neutral-loss-peaks"), Params::GetBool("use-flanking-peaks") );
+
+  while (true) {
+    size_t window;
+    {
+      boost::mutex::scoped_lock lock(search_mutex_);
+      if (next_window_ >= windows_.size()) {
+        break;
+      }
+      window = next_window_++;
+    }
+    for (vector<int>::const_iterator chunk = windows_[window].begin(); chunk != windows_[window].end(); ++chunk) {
+      string* results = new string();
+      // the chunk is only searched by this thread
+      searchChunk(chunks_->at(*chunk), &lanes, &observed, *results);
+      writeChunkResults(*chunk, results);
+    }
+  }
+
+  for (vector<PeptideLane>::iterator lane = lanes.begin(); lane != lanes.end(); ++lane) {
+    delete lane->queue_;
+    delete lane->reader_;
+  }
+}
+
+void DIAmeterApplication::searchChunk(vector<SpectrumCollection::SpecCharge>& spec_charge_chunk, vector<PeptideLane>* lanes,
+                                      ObservedPeakSet* observed, string& results) {
+  long int num_range_skipped = 0;
+  long int num_precursors_skipped = 0;
+  long int num_isotopes_skipped = 0;
+  long int num_retained = 0;
+  PeptideLane* lane = NULL;
+
+  // cache the MS2 peaks specific to the current isolation window
+  map<int, boost::tuple<double*, double*, int>> ms2scan_mz_intensity_map;
+  buildSpectraIndexFromIsoWindow(&spec_charge_chunk, &ms2scan_mz_intensity_map);
+  DIAmeterXicStore ms2_xic_store;
+  for (map<int, boost::tuple<double*, double*, int>>::const_iterator i = ms2scan_mz_intensity_map.begin(); i != ms2scan_mz_intensity_map.end(); i++) {
+    ms2_xic_store.addScan(i->first, (i->second).get<0>(), (i->second).get<1>(), (i->second).get<2>());
+  }
+
+  // the TTOF-specific denoising should occur in the for loop below
+  for (int chunk_idx = 0; chunk_idx < spec_charge_chunk.size(); ++chunk_idx) {
+    Spectrum* spectrum = spec_charge_chunk.at(chunk_idx).spectrum;
+    int charge = spec_charge_chunk.at(chunk_idx).charge;
+
+    double precursor_mz = spectrum->PrecursorMZ();
+    int scan_num = spectrum->SpectrumNumber();
+    int ms1_scan_num = spectrum->MS1SpectrumNum();
+
+    //denoising-related
+    if (Params::GetBool("spectra-denoising")) {
+      int neighbor_cnt = 0;
+      vector<double> proceed_mzs, succeed_mzs;
+      if (chunk_idx > 0) {
+        ++neighbor_cnt;
+        int neighbor_chunk_idx = chunk_idx - 1;
+        Spectrum* neighbor_spectrum = spec_charge_chunk.at(neighbor_chunk_idx).spectrum;
+        for (int neighbor_peak_idx = 0; neighbor_peak_idx < neighbor_spectrum->Size(); ++neighbor_peak_idx) {
+          proceed_mzs.push_back(neighbor_spectrum->M_Z(neighbor_peak_idx));
+        }
+        std::sort(proceed_mzs.begin(), proceed_mzs.end());
+      }
+
+      if (chunk_idx < (spec_charge_chunk.size()-1)) {
+        ++neighbor_cnt;
+        int neighbor_chunk_idx = chunk_idx + 1;
+        Spectrum* neighbor_spectrum = spec_charge_chunk.at(neighbor_chunk_idx).spectrum;
+        for (int neighbor_peak_idx = 0; neighbor_peak_idx < neighbor_spectrum->Size(); ++neighbor_peak_idx) {
+          succeed_mzs.push_back(neighbor_spectrum->M_Z(neighbor_peak_idx));
+        }
+        std::sort(succeed_mzs.begin(), succeed_mzs.end());
+      }
+
+      vector<bool> peak_supported;
+      for (int peak_idx = 0; peak_idx < spectrum->Size(); ++peak_idx) {
+        double peak_mz = spectrum->M_Z(peak_idx);
+
+        int supported_cnt = 0;
+        int proceed_mz_idx = MathUtil::binarySearch(&proceed_mzs, peak_mz);
+        if (proceed_mz_idx >= 0) {
+          double matched_mz = proceed_mzs.at(proceed_mz_idx);
+          double ppm = fabs(peak_mz - matched_mz) * 1000000 / max(peak_mz, matched_mz);
+          if (ppm <= Params::GetInt("frag-ppm")) { ++supported_cnt; }
+        }
+
+        int succeed_mz_idx = MathUtil::binarySearch(&succeed_mzs, peak_mz);
+        if (succeed_mz_idx >= 0) {
+          double matched_mz = succeed_mzs.at(succeed_mz_idx);
+          double ppm = fabs(peak_mz - matched_mz) * 1000000 / max(peak_mz, matched_mz);
+          if (ppm <= Params::GetInt("frag-ppm")) { ++supported_cnt; }
+        }
+
+        if (supported_cnt >= neighbor_cnt) {
+          peak_supported.push_back(true);
+        } else {
+          peak_supported.push_back(false);
+        }
+      }
+      spectrum->UpdatePeakSupport(&peak_supported);
+    }
+
+    // The active peptide queue holds the candidate peptides for spectrum.
+    // Calculate and set the window, depending on the window type.
+    vector<double>* min_mass = new vector<double>();
+    vector<double>* max_mass = new vector<double>();
+    double min_range, max_range;
+
+    carp(CARP_DETAILED_DEBUG, "MS1Scan:%d \t MS2Scan:%d \t precursor_mz:%f \t charge:%d", ms1_scan_num, scan_num, precursor_mz, charge);
+    computeWindowDIA(spec_charge_chunk.at(chunk_idx), &negative_isotope_errors_, min_mass, max_mass, &min_range, &max_range);
+
+    // Normalize the observed spectrum and compute the cache of frequently-needed
+    // values for taking dot products with theoretical spectra.
+    // TODO: Note that here each specturm might be preprocessed multiple times, one for each charge, potentially can be improved!
+    observed->PreprocessSpectrum(*spectrum, charge, &num_range_skipped, &num_precursors_skipped, &num_isotopes_skipped, &num_retained, true /* dia_mode */);
+    if (lane == NULL) {
+      lane = getLane(lanes, min_range);
+    }
+    ActivePeptideQueue* active_peptide_queue = lane->queue_;
+    active_peptide_queue->SetActiveRange(min_mass, max_mass, min_range, max_range);
+    lane->min_range_ = min_range;
+
+
+    if (active_peptide_queue->nCandPeptides_ == 0) { // No peptides to score.
+      delete min_mass;
+      delete max_mass;
+      continue; 
+    }
+    // allocate PSMscores for N scores
+    TideMatchSet psm_scores(active_peptide_queue, observed);  //nPeptides_ includes acitve and inacitve peptides
+
+    TideSearchApplication::XCorrScoring(charge, *observed, active_peptide_queue, psm_scores);
+
+    reportDIA(results, origin_file_, spec_charge_chunk.at(chunk_idx), active_peptide_queue, *proteins_,
+        psm_scores, observed, ms1scan_mz_intensity_rank_map_, ms1scan_slope_intercept_map_,
+        &ms2_xic_store, predrt_library_);
+
+    delete min_mass;
+    delete max_mass;
+  }
+
+  // clear up for next chunk
+  for (map<int, boost::tuple<double*, double*, int>>::const_iterator i = ms2scan_mz_intensity_map.begin(); i != ms2scan_mz_intensity_map.end(); i++) {
+    delete[] (i->second).get<0>(); 
+    delete[] (i->second).get<1>();
+  }
+}
+
+DIAmeterApplication::PeptideLane* DIAmeterApplication::getLane(vector<PeptideLane>* lanes, double min_range) {
+  PeptideLane* best = NULL;
+  for (vector<PeptideLane>::iterator lane = lanes->begin(); lane != lanes->end(); ++lane) {
+    if (lane->min_range_ <= min_range && (best == NULL || lane->min_range_ > best->min_range_)) {
+      best = &*lane;
+    }
+  }
+  if (best != NULL) {
+    return best;
+  }
+
+  // Active queue to process the indexed peptides
+  PeptideLane lane;
+  lane.min_range_ = min_range;
+  lane.reader_ = new PeptideReader(peptides_file_);
+  if (!lane.reader_->OK()) {
+    carp(CARP_FATAL, "Error reading index (%s)", peptides_file_.c_str());
+  }
+  lane.queue_ = new ActivePeptideQueue(lane.reader_, *proteins_, NULL, true);
+  lanes->push_back(lane);
+  return &lanes->back();
+}
+
+void DIAmeterApplication::writeChunkResults(int chunk, string* results) {
+  boost::mutex::scoped_lock lock(search_mutex_);
+  chunk_results_[chunk] = results;
+  while (next_chunk_to_write_ < chunk_results_.size() && chunk_results_[next_chunk_to_write_] != NULL) {
+    psm_table_->addRows(*chunk_results_[next_chunk_to_write_]);
+    delete chunk_results_[next_chunk_to_write_];
+    chunk_results_[next_chunk_to_write_] = NULL;
+    ++next_chunk_to_write_;
+  }
+
+  long int searched = num_searched_;
+  num_searched_ += chunks_->at(chunk).size();
+  if (print_interval_ > 0 && searched / print_interval_ != num_searched_ / print_interval_) {
+    carp(CARP_INFO, "%d spectrum-charge combinations searched, %.0f%% complete",
+         num_searched_, 100.0 * num_searched_ / total_spec_charges_);
+  }
+}
+
 void DIAmeterApplication::reportDIA(
-  ofstream* output_file,  // output file to write to
+  string& results,  // string to append the results to
   const string& spectrum_filename, // name of spectrum file
   const SpectrumCollection::SpecCharge& sc, // spectrum and charge for matches
   ActivePeptideQueue* peptides, // peptide queue
@@ -360,8 +461,8 @@ void DIAmeterApplication::reportDIA(
   ObservedPeakSet* observed,
   map<int, boost::tuple<double*, double*, double*, int>>* ms1scan_mz_intensity_rank_map,
   map<int, boost::tuple<double, double>>* ms1scan_slope_intercept_map,
-  map<int, boost::tuple<double*, double*, int>>* ms2scan_mz_intensity_map,
-  map<string, double>* peptide_predrt_map
+  DIAmeterXicStore* ms2_xic_store,
+  const DIAmeterRTLibrary* predrt_library
 ) {
   Spectrum* spectrum = sc.spectrum;
   int charge = sc.charge;
@@ -416,48 +517,36 @@ void DIAmeterApplication::reportDIA(
   }
 
   // Loop through each corresponding ms1scan and ms2scan pair (ppm-based)
-  vector<boost::tuple<double*, double*, int, double*, double*, int>> mz_intensity_arrs_vector;
+  DIAmeterXicWindow xic_window(ms1_xic_store_, ms2_xic_store, Params::GetInt("prec-ppm"), Params::GetInt("frag-ppm"));
   for (pair<vector<int>::const_iterator, vector<int>::const_iterator> f(valid_ms1scans.begin(), valid_ms2scans.begin());
     f.first != valid_ms1scans.end() && f.second != valid_ms2scans.end(); ++f.first, ++f.second) {
 
     int curr_ms1scan = *(f.first);
     int curr_ms2scan = *(f.second);
 
-    int ms1_peak_num = -1; double *ms1_mz_arr = NULL, *ms1_intensity_arr = NULL;
-    int ms2_peak_num = -1; double *ms2_mz_arr = NULL, *ms2_intensity_arr = NULL;
-
-    map<int, boost::tuple<double*, double*, double*, int>>::iterator ms1_intensityIter = ms1scan_mz_intensity_rank_map->find(curr_ms1scan);
-    if (ms1_intensityIter == ms1scan_mz_intensity_rank_map->end()) {
+    int ms1_pos = ms1_xic_store_->find(curr_ms1scan);
+    if (ms1_pos < 0) {
       carp(CARP_DETAILED_DEBUG, "No intensity found in MS1 scan:%d !!!", curr_ms1scan);
-    } else {
-      ms1_mz_arr = (ms1_intensityIter->second).get<0>();
-      ms1_intensity_arr = (ms1_intensityIter->second).get<1>();
-      ms1_peak_num = (ms1_intensityIter->second).get<3>();
     }
-
-    map<int, boost::tuple<double*, double*, int>>::iterator ms2_intensityIter = ms2scan_mz_intensity_map->find(curr_ms2scan);
-    if (ms2_intensityIter == ms2scan_mz_intensity_map->end()) {
+    int ms2_pos = ms2_xic_store->find(curr_ms2scan);
+    if (ms2_pos < 0) {
       carp(CARP_DETAILED_DEBUG, "No intensity found in MS2 scan:%d !!!", curr_ms2scan);
-    } else {
-      ms2_mz_arr = (ms2_intensityIter->second).get<0>();
-      ms2_intensity_arr = (ms2_intensityIter->second).get<1>();
-      ms2_peak_num = (ms2_intensityIter->second).get<2>();
     }
 
-    if (ms1_intensity_arr != NULL && ms2_intensity_arr != NULL) {
-      mz_intensity_arrs_vector.push_back(boost::make_tuple(ms1_mz_arr, ms1_intensity_arr, ms1_peak_num, ms2_mz_arr, ms2_intensity_arr, ms2_peak_num));
+    if (ms1_pos >= 0 && ms2_pos >= 0) {
+      xic_window.addScans(ms1_pos, ms2_pos);
     }
   }
+  // the window keeps the chromatograms shared by the target and decoy candidates
   map<TideMatchSet::PSMScores::iterator, boost::tuple<double, double, double>> coelute_map;
-  computePrecFragCoelute(matches.concat_or_target_psm_scores_, peptides, &mz_intensity_arrs_vector, &coelute_map, charge);
-  computePrecFragCoelute(matches.decoy_psm_scores_,            peptides, &mz_intensity_arrs_vector, &coelute_map, charge);
+  computePrecFragCoelute(matches.concat_or_target_psm_scores_, peptides, &xic_window, &coelute_map, charge);
+  computePrecFragCoelute(matches.decoy_psm_scores_,            peptides, &xic_window, &coelute_map, charge);
 
   // calculate MS2 p-value
   map<TideMatchSet::PSMScores::iterator, boost::tuple<double, double>> ms2pval_map;
   computeMS2Pval(matches.concat_or_target_psm_scores_, peptides, observed, &ms2pval_map);
   computeMS2Pval(matches.decoy_psm_scores_,            peptides, observed, &ms2pval_map);
 
-  string results;
   int spectrum_file_cnt = 0; // This is not needed here. This is needed for mzTab results file format.
   matches.printResults(
     DIAMETER_TSV, spectrum_filename, 
@@ -469,7 +558,7 @@ void DIAmeterApplication::reportDIA(
     &logrank_map,
     &coelute_map,
     &ms2pval_map,
-    peptide_predrt_map);
+    predrt_library);
 
   matches.printResults(
     DIAMETER_TSV, spectrum_filename, 
@@ -481,9 +570,7 @@ void DIAmeterApplication::reportDIA(
     &logrank_map,
     &coelute_map,
     &ms2pval_map,
-    peptide_predrt_map);
-
-  *output_file << results;
+    predrt_library);
 }
 
 void DIAmeterApplication::computePrecIntRank(
@@ -523,11 +610,11 @@ void DIAmeterApplication::computePrecIntRank(
 void DIAmeterApplication::computePrecFragCoelute(
   TideMatchSet::PSMScores& vec,
   ActivePeptideQueue* peptides,
-  vector<boost::tuple<double*, double*, int, double*, double*, int>>* mz_intensity_arrs_vector,
+  DIAmeterXicWindow* xic_window,
   map<TideMatchSet::PSMScores::iterator, boost::tuple<double, double, double>>* coelute_map,
   int charge
 ) {
-  int coelute_size = mz_intensity_arrs_vector->size();
+  int coelute_size = xic_window->size();
   vector<double> ms1_corrs, ms2_corrs, ms1_ms2_corrs;
 
   for (TideMatchSet::PSMScores::iterator i = vec.begin(); i != vec.end(); ++i) {
@@ -536,44 +623,18 @@ void DIAmeterApplication::computePrecFragCoelute(
     double peptide_mz_m0 = Peptide::MassToMz(peptide.Mass(), charge);
     // Fragment signals
     vector<double> ion_mzs = peptide.IonMzs();
-    // Precursor and fragment chromatograms
+    // Precursor and fragment chromatograms, owned by xic_window
     vector<double*> ms1_chroms, ms2_chroms;
 
     // build Precursor chromatograms
+    vector<double> prec_mzs;
     for (int prec_offset = 0; prec_offset < 3; ++prec_offset ) {
-      double prec_mz = peptide_mz_m0 + 1.0*prec_offset/(charge * 1.0);
-
-      double* intensity_arr = new double[coelute_size];
-      fill_n(intensity_arr, coelute_size, 0);
-
-      for (int coelute_idx = 0; coelute_idx < coelute_size; ++coelute_idx ) {
-        boost::tuple<double*, double*, int, double*, double*, int> mz_intensity_arrs = mz_intensity_arrs_vector->at(coelute_idx);
-        double* ms1_mz_arr = mz_intensity_arrs.get<0>();
-        double* ms1_intensity_arr = mz_intensity_arrs.get<1>();
-        int ms1_peak_num = mz_intensity_arrs.get<2>();
-
-        intensity_arr[coelute_idx] = closestPPMValue(ms1_mz_arr, ms1_intensity_arr, ms1_peak_num, prec_mz, Params::GetInt("prec-ppm"), 0, true);
-      }
-      ms1_chroms.push_back(intensity_arr);
+      prec_mzs.push_back(peptide_mz_m0 + 1.0*prec_offset/(charge * 1.0));
     }
+    xic_window->precursorChroms(prec_mzs, &ms1_chroms);
 
     // build Fragment chromatograms
-    for (int frag_offset = 0; frag_offset < ion_mzs.size(); ++frag_offset ) {
-      double frag_mz = ion_mzs.at(frag_offset);
-
-      double* intensity_arr = new double[coelute_size];
-      fill_n(intensity_arr, coelute_size, 0);
-
-      for (int coelute_idx = 0; coelute_idx < coelute_size; ++coelute_idx ) {
-        boost::tuple<double*, double*, int, double*, double*, int> mz_intensity_arrs = mz_intensity_arrs_vector->at(coelute_idx);
-        double* ms2_mz_arr = mz_intensity_arrs.get<3>();
-        double* ms2_intensity_arr = mz_intensity_arrs.get<4>();
-        int ms2_peak_num = mz_intensity_arrs.get<5>();
-
-        intensity_arr[coelute_idx] = closestPPMValue(ms2_mz_arr, ms2_intensity_arr, ms2_peak_num, frag_mz, Params::GetInt("frag-ppm"), 0, true);
-      }
-      ms2_chroms.push_back(intensity_arr);
-    }
+    xic_window->fragmentChroms(ion_mzs, &ms2_chroms);
 
     // calculate correlation among MS1
     ms1_corrs.clear();
@@ -607,17 +668,25 @@ void DIAmeterApplication::computePrecFragCoelute(
     if (ms2_corrs.size() > 0) { ms2_corrs.resize(Params::GetInt("coelution-topk")); ms2_mean = std::accumulate(ms2_corrs.begin(), ms2_corrs.end(), 0.0) / ms2_corrs.size(); }
     if (ms1_ms2_corrs.size() > 0) { ms1_ms2_corrs.resize(Params::GetInt("coelution-topk")); ms1_ms2_mean = std::accumulate(ms1_ms2_corrs.begin(), ms1_ms2_corrs.end(), 0.0) / ms1_ms2_corrs.size(); }
     coelute_map->insert(make_pair(i, boost::make_tuple(ms1_mean, ms2_mean, ms1_ms2_mean)));
+  }
+}
 
-     // clean up
-     for (int prec_offset = 0; prec_offset < ms1_chroms.size(); ++prec_offset ) { 
-      delete[] ms1_chroms.at(prec_offset); 
+// The number of distinct bins of the sorted mzbins that hold a filtered peak,
+// adding the squares of their intensities to intensity_sum
+static int matchFilteredPeaks(const vector<int>& mzbins, const vector<double>& peak_intensities, double* intensity_sum) {
+  int matched_cnt = 0;
+  int num_bins = peak_intensities.size();
+  for (size_t idx = 0; idx < mzbins.size(); ++idx) {
+    int mzbin = mzbins[idx];
+    if (mzbin < 0 || mzbin >= num_bins || peak_intensities[mzbin] <= 0 || (idx > 0 && mzbin == mzbins[idx-1])) {
+      continue;
     }
-    for (int frag_offset = 0; frag_offset < ms2_chroms.size(); ++frag_offset ) { 
-      delete[] ms2_chroms.at(frag_offset);
+    ++matched_cnt;
+    if (intensity_sum != NULL) {
+      *intensity_sum += peak_intensities[mzbin] * peak_intensities[mzbin];
     }
-    ms1_chroms.clear();
-    ms2_chroms.clear();
   }
+  return matched_cnt;
 }
 
 void DIAmeterApplication::computeMS2Pval(
@@ -629,35 +698,24 @@ void DIAmeterApplication::computeMS2Pval(
   int smallest_mzbin = observed->SmallestMzbin();
   int largest_mzbin = observed->LargestMzbin();
 
-  vector<pair<int, double>> filtered_peak_tuples = observed->FilteredPeakTuples();
+  // built once per spectrum by the preprocessing
+  const vector<double>& filtered_peak_intensities = observed->FilteredPeakIntensities();
 
-  double ms2_coverage = 1.0 * filtered_peak_tuples.size() / (largest_mzbin - smallest_mzbin + 1);
+  double ms2_coverage = 1.0 * observed->FilteredPeakTuples().size() / (largest_mzbin - smallest_mzbin + 1);
   double log_p = log(ms2_coverage);
   double log_1_min_p = log(1 - ms2_coverage);
 
   carp(CARP_DETAILED_DEBUG, "Mzbin range:[%d, %d] \t ms2_coverage: %f ", smallest_mzbin, largest_mzbin, ms2_coverage );
-  // a sanity check if filtered_peak_tuples is sorted ascendingly w.r.t mzbin
-  vector<int> filtered_peak_mzbins;
-  vector<double> filtered_peak_intensities;
-  for (int idx = 0; idx < filtered_peak_tuples.size(); ++idx) {
-    filtered_peak_mzbins.push_back(filtered_peak_tuples.at(idx).first);
-    filtered_peak_intensities.push_back(filtered_peak_tuples.at(idx).second);
-  }
 
-  vector<int> intersect_mzbins;
   vector<double> pvalue_binomial_probs;
 
   for (TideMatchSet::PSMScores::iterator i = vec.begin(); i != vec.end(); ++i) {
     Peptide& peptide = *(peptides->GetPeptide((*i).ordinal_));
-    vector<int> ion_mzbins = peptide.IonMzbins();
-
-    intersect_mzbins.clear();
-    // sort(ion_mzbins.begin(), ion_mzbins.end()); // sort the vector for calculating the intersection lateron
-
-    set_intersection(filtered_peak_mzbins.begin(), filtered_peak_mzbins.end(), ion_mzbins.begin(), ion_mzbins.end(), back_inserter(intersect_mzbins));
+    const vector<int>& ion_mzbins = peptide.IonMzbins();
+    int matched_cnt = matchFilteredPeaks(ion_mzbins, filtered_peak_intensities, NULL);
 
     pvalue_binomial_probs.clear();
-    for (int k = intersect_mzbins.size(); k <= ion_mzbins.size(); ++k ) {
+    for (int k = matched_cnt; k <= (int)ion_mzbins.size(); ++k ) {
       double binomial_prob = MathUtil::LogNChooseK(ion_mzbins.size(), k) + k * log_p + (ion_mzbins.size()-k) * log_1_min_p;
       pvalue_binomial_probs.push_back(binomial_prob);
     }
@@ -667,31 +725,14 @@ void DIAmeterApplication::computeMS2Pval(
     double ms2pval2 = 0.0, intensitysum = 0.0;
 
     // deal with another alternative
-    vector<int> b_ion_mzbins = peptide.BIonMzbins();
-    vector<int> y_ion_mzbins = peptide.YIonMzbins();
-
-    intersect_mzbins.clear(); intensitysum = 0.0;
-    set_intersection(filtered_peak_mzbins.begin(), filtered_peak_mzbins.end(), b_ion_mzbins.begin(), b_ion_mzbins.end(), back_inserter(intersect_mzbins));
-    ms2pval2 += MathUtil::gammaln(1.0 + intersect_mzbins.size());
-    for (int k = 0; k < intersect_mzbins.size(); ++k ) {
-      std::vector<int>::iterator itr = find(filtered_peak_mzbins.begin(), filtered_peak_mzbins.end(), intersect_mzbins.at(k));
-      if (itr != filtered_peak_mzbins.cend()) {
-        int hit_idx = distance(filtered_peak_mzbins.begin(), itr);
-        intensitysum += (filtered_peak_intensities.at(hit_idx)*filtered_peak_intensities.at(hit_idx));
-      }
-    }
+    intensitysum = 0.0;
+    matched_cnt = matchFilteredPeaks(peptide.BIonMzbins(), filtered_peak_intensities, &intensitysum);
+    ms2pval2 += MathUtil::gammaln(1.0 + matched_cnt);
     ms2pval2 += log(1.0 + intensitysum);
 
-    intersect_mzbins.clear(); intensitysum = 0.0;
-    set_intersection(filtered_peak_mzbins.begin(), filtered_peak_mzbins.end(), y_ion_mzbins.begin(), y_ion_mzbins.end(), back_inserter(intersect_mzbins));
-    ms2pval2 += MathUtil::gammaln(1.0 + intersect_mzbins.size());
-    for (int k = 0; k < intersect_mzbins.size(); ++k ) {
-      std::vector<int>::iterator itr = find(filtered_peak_mzbins.begin(), filtered_peak_mzbins.end(), intersect_mzbins.at(k));
-      if (itr != filtered_peak_mzbins.cend()) {
-        int hit_idx = distance(filtered_peak_mzbins.begin(), itr);
-        intensitysum += (filtered_peak_intensities.at(hit_idx)*filtered_peak_intensities.at(hit_idx));
-      }
-    }
+    intensitysum = 0.0;
+    matched_cnt = matchFilteredPeaks(peptide.YIonMzbins(), filtered_peak_intensities, &intensitysum);
+    ms2pval2 += MathUtil::gammaln(1.0 + matched_cnt);
     ms2pval2 += log(1.0 + intensitysum);
     ms2pval_map->insert(make_pair(i, boost::make_tuple(ms2pval1, ms2pval2 )));
   }
@@ -722,14 +763,35 @@ vector<InputFile> DIAmeterApplication::getInputFiles(const vector<string>& filep
   return input_sr;
 }
 
-void DIAmeterApplication::getPeptidePredRTMapping(map<string, double>* peptide_predrt_map, int percent_bins) {
-  carp(CARP_INFO, "predrt-files: %s ", Params::GetString("predrt-files").c_str());
+void DIAmeterApplication::getPeptidePredRTMapping(DIAmeterRTLibrary* predrt_library, int percent_bins) {
+  string library_file = Params::GetString("predrt-library");
+  string predrt_files = Params::GetString("predrt-files");
+  // it's possible that multiple mapping files are provided and concatenated by comma
+  vector<string> mapping_paths = StringUtils::Split(predrt_files, ",");
+  unsigned long long source_fingerprint = DIAmeterRTLibrary::fingerprint(mapping_paths);
+
+  // The library is reused unless it was built from other predictions
+  bool library_exists = !library_file.empty() && FileUtils::Exists(library_file);
+  if (library_exists) {
+    carp(CARP_INFO, "predrt-library: %s ", library_file.c_str());
+    if (!predrt_library->open(library_file)) {
+      if (predrt_files.empty()) {
+        carp(CARP_FATAL, "Could not read the retention time library %s", library_file.c_str());
+      }
+      carp(CARP_WARNING, "Rebuilding the retention time library %s from predrt-files.", library_file.c_str());
+    } else if (predrt_files.empty() || predrt_library->sourceFingerprint() == source_fingerprint) {
+      carp(CARP_DEBUG, "predrt-library size:%d", (int)predrt_library->size());
+      return;
+    } else {
+      carp(CARP_WARNING, "The retention time library %s was built from other predrt-files; "
+           "rebuilding it.", library_file.c_str());
+    }
+  }
+  carp(CARP_INFO, "predrt-files: %s ", predrt_files.c_str());
 
   map<string, double> tmp_map;
   vector<double> predrt_vec;
 
-  // it's possible that multiple mapping files are provided and concatenated by comma
-  vector<string> mapping_paths = StringUtils::Split(Params::GetString("predrt-files"), ",");
   for(int file_idx = 0; file_idx < mapping_paths.size(); file_idx++) {
     if (!FileUtils::Exists(mapping_paths.at(file_idx))) {
       carp(CARP_DEBUG, "The mapping file %s does not exist! \n", mapping_paths.at(file_idx).c_str());
@@ -759,18 +821,34 @@ void DIAmeterApplication::getPeptidePredRTMapping(map<string, double>* peptide_p
     }
   }
 
-  if (predrt_vec.size() <= 0) { return; }
+  if (predrt_vec.size() <= 0) {
+    // no predictions, so no library to write; drop a stale one that was opened
+    predrt_library->build(map<string, double>(), source_fingerprint);
+    return;
+  }
   double min_predrt = *min_element(predrt_vec.begin(), predrt_vec.end());
   double max_predrt = *max_element(predrt_vec.begin(), predrt_vec.end());
   carp(CARP_DETAILED_DEBUG, "min_predrt:%f \t max_predrt:%f", min_predrt, max_predrt );
 
   vector<double> rt_percent_vec = MathUtil::linspace(min_predrt, max_predrt, percent_bins);
+  map<string, double> peptide_predrt_map;
   for (map<string, double>::iterator it = tmp_map.begin(); it != tmp_map.end(); it++) {
     double predrt = it->second;
     double predrt2 = 1.0*std::count_if(rt_percent_vec.begin(), rt_percent_vec.end(), [&](int val){ return val <= predrt; })/percent_bins;
-    peptide_predrt_map->insert(make_pair(it->first, predrt2 ));
+    peptide_predrt_map.insert(make_pair(it->first, predrt2 ));
+  }
+  carp(CARP_DETAILED_DEBUG, "peptide_predrt_map size:%d", peptide_predrt_map.size());
+
+  predrt_library->build(peptide_predrt_map, source_fingerprint);
+  if (library_file.empty() || predrt_library->size() == 0) {
+    return;
+  }
+  if (library_exists && !Params::GetBool("overwrite")) {
+    carp(CARP_WARNING, "The retention time library %s was not updated; set --overwrite T "
+         "to replace it.", library_file.c_str());
+  } else if (predrt_library->write(library_file)) {
+    carp(CARP_INFO, "Wrote the retention time library %s", library_file.c_str());
   }
-  carp(CARP_DETAILED_DEBUG, "peptide_predrt_map size:%d", peptide_predrt_map->size());
 }
 
 void DIAmeterApplication::buildSpectraIndexFromIsoWindow(vector<SpectrumCollection::SpecCharge>* spec_charge_chunk, map<int, boost::tuple<double*, double*, int>>* ms2scan_mz_intensity_map) {
@@ -799,36 +877,95 @@ void DIAmeterApplication::buildSpectraIndexFromIsoWindow(vector<SpectrumCollecti
 }
 
 void DIAmeterApplication::loadMS1Spectra(const std::string& file,
+  MS1Peaks* ms1_peaks,
   map<int, boost::tuple<double*, double*, double*, int>>* ms1scan_mz_intensity_rank_map,
-  map<int, boost::tuple<double, double>>* ms1scan_slope_intercept_map
+  map<int, boost::tuple<double, double>>* ms1scan_slope_intercept_map,
+  int num_threads
 ) {
   SpectrumCollection* spectra = loadSpectra(file);
+  const vector<SpectrumCollection::SpecCharge>* spec_charges = spectra->SpecCharges();
+
+  // the peaks of each scan start at its offset in ms1_peaks
+  vector<size_t> offsets(1, 0);
+  for (vector<SpectrumCollection::SpecCharge>::const_iterator sc = spec_charges->begin(); sc != spec_charges->end(); ++sc) {
+    offsets.push_back(offsets.back() + sc->spectrum->Size());
+  }
+  ms1_peaks->mz_.resize(offsets.back());
+  ms1_peaks->intensity_.resize(offsets.back());
+  ms1_peaks->intensity_rank_.resize(offsets.back());
+
+  // the scans are independent, so they are ranked by num_threads threads
+  vector<MS1ScanStats> stats(spec_charges->size());
+  size_t num_workers = max(1, min(num_threads, (int)spec_charges->size()));
+  boost::thread_group threadgroup;
+  for (size_t t = 1; t < num_workers; ++t) {
+    threadgroup.add_thread(new boost::thread(boost::bind(&DIAmeterApplication::rankMS1Scans, this,
+      spec_charges, &offsets, t, num_workers, ms1_peaks, &stats)));
+  }
+  rankMS1Scans(spec_charges, &offsets, 0, num_workers, ms1_peaks, &stats);
+  threadgroup.join_all();
 
   double accumulated_intensity_logrank = 0.0, accumulated_peaknum = 0.0, accumulated_intercept = 0.0, accumulated_intercept_cnt = 0;
-  const vector<SpectrumCollection::SpecCharge>* spec_charges = spectra->SpecCharges();
+  for (size_t scan_idx = 0; scan_idx < spec_charges->size(); ++scan_idx) {
+    int ms1_scan_num = spec_charges->at(scan_idx).spectrum->MS1SpectrumNum();
+    int peak_num = offsets[scan_idx + 1] - offsets[scan_idx];
+
+    if (stats[scan_idx].fitted_) {
+      (*ms1scan_slope_intercept_map)[ms1_scan_num] = stats[scan_idx].slope_intercept_;
+      accumulated_intercept += stats[scan_idx].slope_intercept_.get<1>();
+      accumulated_intercept_cnt += 1;
+    }
 
-  for (vector<SpectrumCollection::SpecCharge>::const_iterator sc = spec_charges->begin();sc < spec_charges->begin() + (spec_charges->size()); sc++) {
-    Spectrum* spectrum = sc->spectrum;
-    int ms1_scan_num = spectrum->MS1SpectrumNum();
+    accumulated_intensity_logrank += stats[scan_idx].noise_intensity_logrank_;
+    (*ms1scan_mz_intensity_rank_map)[ms1_scan_num] = boost::make_tuple(
+      ms1_peaks->mz_.data() + offsets[scan_idx], ms1_peaks->intensity_.data() + offsets[scan_idx],
+      ms1_peaks->intensity_rank_.data() + offsets[scan_idx], peak_num);
+
+    accumulated_peaknum += peak_num;
+  }
+  delete spectra;
+
+  // calculate the average noise intensity logrank, which is used as default value when MS1 scan is empty.
+  avg_noise_intensity_logrank_ =  accumulated_intensity_logrank / max(1.0, 1.0*spec_charges->size());
+  avg_ms1_intercept_ = accumulated_intercept / max(1.0, accumulated_intercept_cnt);
+}
+
+void DIAmeterApplication::rankMS1Scans(const vector<SpectrumCollection::SpecCharge>* spec_charges,
+  const vector<size_t>* offsets, size_t first, size_t step,
+  MS1Peaks* ms1_peaks, vector<MS1ScanStats>* stats
+) {
+  for (size_t scan_idx = first; scan_idx < spec_charges->size(); scan_idx += step) {
+    Spectrum* spectrum = spec_charges->at(scan_idx).spectrum;
     int peak_num = spectrum->Size();
     double noise_intensity_logrank = 0;
 
     vector<double> sorted_intensity_vec = spectrum->DescendingSortedPeakIntensity();
-    double* mz_arr = new double[peak_num];
-    double* intensity_arr = new double[peak_num];
-    double* intensity_rank_arr = new double[peak_num];
+    // The rank of a peak counts the peaks whose intensity, truncated to an
+    // integer, is at least its own. Sorting the truncated intensities once
+    // lets each rank be found by a binary search.
+    vector<double> truncated_intensity_vec(sorted_intensity_vec.rbegin(), sorted_intensity_vec.rend());
+    for (vector<double>::iterator i = truncated_intensity_vec.begin(); i != truncated_intensity_vec.end(); ++i) {
+      *i = (int)*i;
+    }
+    sort(truncated_intensity_vec.begin(), truncated_intensity_vec.end());
 
+    size_t offset = offsets->at(scan_idx);
     for (int peak_idx = 0; peak_idx < peak_num; ++peak_idx) {
       double peak_mz = spectrum->M_Z(peak_idx);
       double peak_intensity = spectrum->Intensity(peak_idx);
-      double peak_intensity_logrank = log(1.0+std::count_if(sorted_intensity_vec.begin(), sorted_intensity_vec.end(), [&](int val){ return val >= peak_intensity; }));
+      int peak_rank = truncated_intensity_vec.end() - lower_bound(truncated_intensity_vec.begin(), truncated_intensity_vec.end(), peak_intensity);
+      double peak_intensity_logrank = log(1.0+peak_rank);
 
-      mz_arr[peak_idx] = peak_mz;
-      intensity_arr[peak_idx] = peak_intensity;
-      intensity_rank_arr[peak_idx] = peak_intensity_logrank;
+      ms1_peaks->mz_[offset + peak_idx] = peak_mz;
+      ms1_peaks->intensity_[offset + peak_idx] = peak_intensity;
+      ms1_peaks->intensity_rank_[offset + peak_idx] = peak_intensity_logrank;
       noise_intensity_logrank = max(noise_intensity_logrank, peak_intensity_logrank);
     }
 
+    MS1ScanStats& scan_stats = stats->at(scan_idx);
+    scan_stats.noise_intensity_logrank_ = noise_intensity_logrank;
+    scan_stats.fitted_ = false;
+
     // fitting the linear regression of log intensity
     int ignore_top = 20; int min_sample_size = 500;
     int retain_cnt = min(min_sample_size, int((peak_num - ignore_top) * 0.2));
@@ -847,23 +984,11 @@ void DIAmeterApplication::loadMS1Spectra(const std::string& file,
       }
 
       if (log_intensity_vec.size() > 0) {
-        boost::tuple<double, double> slope_intercept_tp = MathUtil::fitLinearRegression(&log_intensity_vec, &log_rank_vec);
-        (*ms1scan_slope_intercept_map)[ms1_scan_num] = slope_intercept_tp;
-        accumulated_intercept += slope_intercept_tp.get<1>();
-        accumulated_intercept_cnt += 1;
+        scan_stats.slope_intercept_ = MathUtil::fitLinearRegression(&log_intensity_vec, &log_rank_vec);
+        scan_stats.fitted_ = true;
       }
     }
-
-    accumulated_intensity_logrank += noise_intensity_logrank;
-    (*ms1scan_mz_intensity_rank_map)[ms1_scan_num] = boost::make_tuple(mz_arr, intensity_arr, intensity_rank_arr, peak_num);
-
-    accumulated_peaknum += peak_num;
   }
-  delete spectra;
-
-  // calculate the average noise intensity logrank, which is used as default value when MS1 scan is empty.
-  avg_noise_intensity_logrank_ =  accumulated_intensity_logrank / max(1.0, 1.0*spec_charges->size());
-  avg_ms1_intercept_ = accumulated_intercept / max(1.0, accumulated_intercept_cnt);
 }
 
 SpectrumCollection* DIAmeterApplication::loadSpectra(const std::string& file) {
@@ -1013,11 +1138,13 @@ vector<string> DIAmeterApplication::getOptions() const {
   "max-precursor-charge",
   "mz-bin-offset",
   "mz-bin-width",
+  "num-threads",
   "output-dir",
   "overwrite",
   // "parameter-file",  
   // "precursor-window",
   "predrt-files",
+  "predrt-library",
   // "msamanda-regional-topk",
   // "coelution-oneside-scans",
   // "coelution-topk",
@@ -1103,7 +1230,6 @@ void DIAmeterApplication::processParams() {
   Params::Set("use-tailor-calibration", true);
   Params::Set("precursor-window-type", "mz");
   Params::Set("spectrum-parser", "pwiz");
-  Params::Set("num-threads", 1);
 
   // these are makepin-specific param settings
   output_pin_ = "diameter.features.pin";
@@ -20,6 +20,9 @@
 #include "spectrum.pb.h"
 #include "tide/theoretical_peak_set.h"
 #include "tide/max_mz.h"
+#include "io/DIAmeterPSMTable.h"
+#include "io/DIAmeterRTLibrary.h"
+#include "io/DIAmeterXicStore.h"
 
 using namespace std;
 struct InputFile {
@@ -68,15 +71,76 @@ class DIAmeterApplication : public CruxApplication {
 
   SpectrumCollection* loadSpectra(const std::string& file);
 
+  // The peaks of the MS1 scans of a run, one scan after another; the
+  // entries of ms1scan_mz_intensity_rank_map point into them
+  struct MS1Peaks {
+    vector<double> mz_, intensity_, intensity_rank_;
+  };
+  // What the noise model learns from one MS1 scan
+  struct MS1ScanStats {
+    double noise_intensity_logrank_;
+    bool fitted_;  // whether the scan has enough peaks to fit the slope and intercept
+    boost::tuple<double, double> slope_intercept_;
+  };
+
   void loadMS1Spectra(const std::string& file,
+          MS1Peaks* ms1_peaks,
           map<int, boost::tuple<double*, double*, double*, int>>* ms1scan_mz_intensity_rank_map,
-          map<int, boost::tuple<double, double>>* ms1scan_slope_intercept_map
+          map<int, boost::tuple<double, double>>* ms1scan_slope_intercept_map,
+          int num_threads
   );
+  // Rank the peaks of every step-th MS1 scan from first, and fit its noise model
+  void rankMS1Scans(const vector<SpectrumCollection::SpecCharge>* spec_charges,
+          const vector<size_t>* offsets, size_t first, size_t step,
+          MS1Peaks* ms1_peaks, vector<MS1ScanStats>* stats);
 
   void buildSpectraIndexFromIsoWindow(vector<SpectrumCollection::SpecCharge>* spec_charge_chunk, map<int, boost::tuple<double*, double*, int>>* ms2scan_mz_intensity_map);
 
+  // The chunks of a spectrum file, each holding the spectra of one
+  // (isolation window, charge), are searched by num-threads threads. The
+  // chunks of an isolation window share their spectra, whose peak support is
+  // set by the denoising, so one thread searches all of them in order. Each
+  // thread takes the next window and has its own peptide queues, one per
+  // range of masses it moves through in order. The results of the chunks are
+  // written in the order of the chunks.
+  struct PeptideLane {
+    ActivePeptideQueue* queue_;
+    PeptideReader* reader_;
+    double min_range_;  // of the last active range
+  };
+  string peptides_file_;
+  pb::Header* peptides_header_;
+  const ProteinVec* proteins_;
+  vector<int> negative_isotope_errors_;
+  DIAmeterRTLibrary* predrt_library_;
+
+  string origin_file_;
+  vector<vector<SpectrumCollection::SpecCharge> >* chunks_;
+  long int total_spec_charges_;
+  vector<vector<int> > windows_;  // the chunks of each isolation window
+  map<int, boost::tuple<double*, double*, double*, int>>* ms1scan_mz_intensity_rank_map_;
+  map<int, boost::tuple<double, double>>* ms1scan_slope_intercept_map_;
+  DIAmeterXicStore* ms1_xic_store_;  // the MS1 scans of the run
+
+  boost::mutex search_mutex_;  // guards the members below
+  size_t next_window_;
+  vector<string*> chunk_results_;  // NULL until the chunk is searched
+  size_t next_chunk_to_write_;
+  long int num_searched_;  // spectrum-charge combinations
+  int print_interval_;
+  DIAmeterPSMTable* psm_table_;
+
+  void searchWindows();
+  void searchChunk(vector<SpectrumCollection::SpecCharge>& spec_charge_chunk, vector<PeptideLane>* lanes,
+                   ObservedPeakSet* observed, string& results);
+  // The lane whose queue can move to the active range starting at
+  // min_range: the one furthest along that has not passed it, or a new one.
+  PeptideLane* getLane(vector<PeptideLane>* lanes, double min_range);
+  // Write the results of chunk and of the chunks after it that are ready
+  void writeChunkResults(int chunk, string* results);
+
   void reportDIA(
-    ofstream* output_file,  // output file to write to
+    string& results,  // string to append the results to
     const string& spectrum_filename, // name of spectrum file
     const SpectrumCollection::SpecCharge& sc, // spectrum and charge for matches
     ActivePeptideQueue* peptides, // peptide queue
@@ -85,8 +149,8 @@ class DIAmeterApplication : public CruxApplication {
     ObservedPeakSet* observed,
     map<int, boost::tuple<double*, double*, double*, int>>* ms1scan_mz_intensity_rank_map,
     map<int, boost::tuple<double, double>>* ms1scan_slope_intercept_map,
-    map<int, boost::tuple<double*, double*, int>>* ms2scan_mz_intensity_map,
-    map<string, double>* peptide_predrt_map
+    DIAmeterXicStore* ms2_xic_store,  // the MS2 scans of the isolation window
+    const DIAmeterRTLibrary* predrt_library
   );
 
   void computePrecIntRank(
@@ -105,7 +169,7 @@ class DIAmeterApplication : public CruxApplication {
   void computePrecFragCoelute(
     TideMatchSet::PSMScores& vec,
     ActivePeptideQueue* peptides,
-    vector<boost::tuple<double*, double*, int, double*, double*, int>>* mz_intensity_arrs_vector,
+    DIAmeterXicWindow* xic_window,
       map<TideMatchSet::PSMScores::iterator, boost::tuple<double, double, double>>* coelute_map,
       int charge
   );
@@ -126,7 +190,9 @@ class DIAmeterApplication : public CruxApplication {
     double* max_range
   );
 
-  void getPeptidePredRTMapping(map<string, double>* peptide_predrt_map, int percent_bins = 200);
+  // Read the predicted retention times from predrt-library, or from
+  // predrt-files, writing predrt-library if it is set
+  static void getPeptidePredRTMapping(DIAmeterRTLibrary* predrt_library, int percent_bins = 200);
 
   double closestPPMValue(
     const double* mz_arr,
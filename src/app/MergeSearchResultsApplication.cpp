@@ -0,0 +1,518 @@
+/**
+ * \file MergeSearchResultsApplication.cpp
+ * \brief Merges the results of a tide-search split into shards of the
+ * peptide index into those of a single search.
+ *
+ * Every shard reports the top-match+1 best PSMs per spectrum (and decoy
+ * set), so the top-match+1 best PSMs of the whole search are among them.
+ * The PSMs are merged as TideMatchSet gathers them, after which the
+ * delta-Cn, delta-LCn, ranks and Sp ranks are recomputed over the merged
+ * PSMs, and the Tailor scores from the Tailor quantile of all candidates,
+ * found among the top XCorr scores each shard lists in
+ * tide-search.shard-stats.txt. That file also holds the exact scores of
+ * the reported PSMs, so the recomputed values are those of a single search
+ * rather than of the rounded scores in the results.
+ *
+ * Shards write their spectra in the order they were searched, which is the
+ * same in every shard, so the shards are merged one spectrum at a time.
+ ************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include "MergeSearchResultsApplication.h"
+#include "io/carp.h"
+#include "io/MatchColumns.h"
+#include "util/crux-utils.h"
+#include "util/FileUtils.h"
+#include "util/Params.h"
+#include "util/StringUtils.h"
+
+using namespace std;
+
+// Same as in TideMatchSet
+static const double TAILOR_QUANTILE_TH = 0.01;
+static const double TAILOR_OFFSET = 5.0;
+
+// A PSM read from the results of a shard
+struct MergedPsm {
+  vector<string> fields_;
+  int shard_;
+  int decoy_set_;  // 0 for targets and concatenated results
+  double score_;   // exact scores, from tide-search.shard-stats.txt
+  double xcorr_;
+  double sp_score_;
+};
+
+static int findColumn(const vector<string>& columns, MATCH_COLUMNS_T column) {
+  vector<string>::const_iterator i = find(columns.begin(), columns.end(), get_column_header(column));
+  return i == columns.end() ? -1 : i - columns.begin();
+}
+
+/**
+ * Reads the spectra of one shard in the order they were searched: the line
+ * of tide-search.shard-stats.txt of each spectrum, along with its PSMs in
+ * one of the results files.
+ */
+class MergeSearchResultsApplication::ShardReader {
+ public:
+  ShardReader(int shard, const string& stats_file, const string& results_file, bool decoy)
+    : shard_(shard), sequence_(0), stats_file_(stats_file),
+      results_file_(results_file), decoy_(decoy) {
+    stats_in_.open(stats_file.c_str());
+    results_in_.open(results_file.c_str());
+    if (!stats_in_.good()) {
+      carp(CARP_FATAL, "Could not open %s.", stats_file.c_str());
+    }
+    if (!results_in_.good()) {
+      carp(CARP_FATAL, "Could not open %s.", results_file.c_str());
+    }
+    string line;
+    getline(stats_in_, line);
+    getline(results_in_, header_);
+  }
+
+  const string& header() const { return header_; }
+  const string& resultsFile() const { return results_file_; }
+
+  /**
+   * Reads the next spectrum of the shard, with PSMs of num_columns fields.
+   * \returns false at the end of the shard.
+   */
+  bool next(size_t num_columns, int decoy_idx_col) {
+    string line;
+    do {
+      if (!getline(stats_in_, line)) {
+        return false;
+      }
+    } while (line.empty());
+    vector<string> fields = StringUtils::Split(line, '\t');
+    if (fields.size() != 9) {
+      carp(CARP_FATAL, "Invalid line in %s: %s", stats_file_.c_str(), line.c_str());
+    }
+    try {
+      sequence_ = StringUtils::FromString<unsigned long long>(fields[0]);
+      spectrum_ = fields[1] + '\t' + fields[2] + '\t' + fields[3] + '\t' + fields[4];
+      stats_.psms_ = StringUtils::FromString<unsigned long long>(fields[5]);
+      stats_.top_xcorr_.clear();
+      vector<string> top_xcorr = fields[6].empty() ? vector<string>() : StringUtils::Split(fields[6], ',');
+      for (vector<string>::const_iterator i = top_xcorr.begin(); i != top_xcorr.end(); ++i) {
+        stats_.top_xcorr_.push_back(StringUtils::FromExactString(*i));
+      }
+
+      // the PSMs of the spectrum in the results file, in the order of their scores
+      psms_.clear();
+      const string& scores = fields[decoy_ ? 8 : 7];
+      vector<string> psm_scores = scores.empty() ? vector<string>() : StringUtils::Split(scores, ',');
+      for (vector<string>::const_iterator i = psm_scores.begin(); i != psm_scores.end(); ++i) {
+        vector<string> values = StringUtils::Split(*i, ':');
+        if (values.size() != 3) {
+          throw runtime_error("Invalid scores '" + *i + "'");
+        }
+        string row;
+        if (!getline(results_in_, row)) {
+          carp(CARP_FATAL, "%s ends before the PSMs listed in %s.", results_file_.c_str(),
+               stats_file_.c_str());
+        }
+        MergedPsm psm;
+        psm.fields_ = StringUtils::Split(row, '\t');
+        if (psm.fields_.size() != num_columns) {
+          carp(CARP_FATAL, "Invalid line in %s: %s", results_file_.c_str(), row.c_str());
+        }
+        psm.shard_ = shard_;
+        psm.decoy_set_ = decoy_idx_col < 0 ? 0 :
+          max(0, StringUtils::FromString<int>(psm.fields_[decoy_idx_col]));
+        psm.score_ = StringUtils::FromExactString(values[0]);
+        psm.xcorr_ = StringUtils::FromExactString(values[1]);
+        psm.sp_score_ = StringUtils::FromExactString(values[2]);
+        psms_.push_back(psm);
+      }
+    } catch (const runtime_error& e) {
+      carp(CARP_FATAL, "Invalid line in %s: %s", stats_file_.c_str(), e.what());
+    }
+    return true;
+  }
+
+  int shard_;
+  unsigned long long sequence_;
+  string spectrum_;  // file, scan, charge and neutral mass, joined by tabs
+  ShardStats stats_;
+  vector<MergedPsm> psms_;
+
+ private:
+  string stats_file_;
+  string results_file_;
+  bool decoy_;
+  ifstream stats_in_;
+  ifstream results_in_;
+  string header_;
+};
+
+MergeSearchResultsApplication::MergeSearchResultsApplication() {
+  top_matches_ = 0;
+  precision_ = 0;
+}
+
+MergeSearchResultsApplication::~MergeSearchResultsApplication() {
+}
+
+int MergeSearchResultsApplication::main(int argc, char** argv) {
+  return main(Params::GetStrings("shard directories"));
+}
+
+int MergeSearchResultsApplication::main(const vector<string>& shard_dirs) {
+  carp(CARP_INFO, "Running merge-search-results...");
+
+  top_matches_ = Params::GetInt("top-match");
+  precision_ = Params::GetInt("precision");
+  inexact_tailor_.clear();
+
+  for (vector<string>::const_iterator i = shard_dirs.begin(); i != shard_dirs.end(); ++i) {
+    if (!FileUtils::Exists(make_file_path("tide-search.shard-stats.txt", *i))) {
+      carp(CARP_FATAL, "%s is not the output directory of a tide-search with "
+           "num-shards greater than 1.", i->c_str());
+    }
+  }
+
+  // A concatenated search writes tide-search.txt, a separate one writes
+  // tide-search.target.txt and, if there are decoys, tide-search.decoy.txt
+  vector<string> result_files;
+  if (FileUtils::Exists(make_file_path("tide-search.txt", shard_dirs.front()))) {
+    result_files.push_back("tide-search.txt");
+  } else {
+    result_files.push_back("tide-search.target.txt");
+    if (FileUtils::Exists(make_file_path("tide-search.decoy.txt", shard_dirs.front()))) {
+      result_files.push_back("tide-search.decoy.txt");
+    }
+  }
+  for (vector<string>::const_iterator i = result_files.begin(); i != result_files.end(); ++i) {
+    for (vector<string>::const_iterator j = shard_dirs.begin(); j != shard_dirs.end(); ++j) {
+      string shard_file = make_file_path(*i, *j);
+      if (!FileUtils::Exists(shard_file)) {
+        carp(CARP_FATAL, "%s does not exist; all shards must be searched with the "
+             "same parameters.", shard_file.c_str());
+      }
+    }
+    string output_file = make_file_path(*i);
+    carp(CARP_INFO, "Merging %d shards into %s.", (int)shard_dirs.size(), output_file.c_str());
+    mergeFiles(shard_dirs, *i, output_file);
+  }
+
+  if (!inexact_tailor_.empty()) {
+    carp(CARP_WARNING, "The Tailor quantile of %d spectra was estimated from too few "
+         "scores of some shard; their Tailor scores are approximate.", (int)inexact_tailor_.size());
+  }
+  return 0;
+}
+
+double MergeSearchResultsApplication::tailorQuantile(const vector<ShardStats>& stats, bool& exact) {
+  // The position of the quantile among all candidates, as in
+  // TideMatchSet::gatherTargetsDecoys
+  unsigned long long psms = 0;
+  vector<double> scores;
+  for (vector<ShardStats>::const_iterator i = stats.begin(); i != stats.end(); ++i) {
+    psms += i->psms_;
+    scores.insert(scores.end(), i->top_xcorr_.begin(), i->top_xcorr_.end());
+  }
+  int quantile_pos = (int)(TAILOR_QUANTILE_TH*(double)psms+0.5)-1;
+  if (quantile_pos < 2)
+    quantile_pos = 2;
+  if ((unsigned long long)quantile_pos >= psms)
+    quantile_pos = (int)psms-1;
+
+  // The quantile is exact if every shard listed its scores down to it
+  exact = true;
+  for (vector<ShardStats>::const_iterator i = stats.begin(); i != stats.end(); ++i) {
+    if (i->top_xcorr_.size() < min(i->psms_, (unsigned long long)quantile_pos+1)) {
+      exact = false;
+    }
+  }
+  if (scores.empty()) {
+    exact = false;
+    return 1.0;
+  }
+  sort(scores.begin(), scores.end(), greater<double>());
+  if ((size_t)quantile_pos >= scores.size()) {
+    quantile_pos = scores.size()-1;
+  }
+  return scores[quantile_pos] + TAILOR_OFFSET;
+}
+
+// Orders shard readers so that make_heap puts the next spectrum on top
+struct CompareShardSequence {
+  bool operator()(const pair<unsigned long long, int>& x, const pair<unsigned long long, int>& y) const {
+    return x > y;
+  }
+};
+
+void MergeSearchResultsApplication::mergeFiles(const vector<string>& shard_dirs,
+                                               const string& result_file, const string& output_file) {
+  bool decoy = result_file == "tide-search.decoy.txt";
+  vector<ShardReader*> readers;
+  for (size_t shard = 0; shard < shard_dirs.size(); ++shard) {
+    readers.push_back(new ShardReader(shard,
+      make_file_path("tide-search.shard-stats.txt", shard_dirs[shard]),
+      make_file_path(result_file, shard_dirs[shard]), decoy));
+    if (readers[shard]->header() != readers[0]->header()) {
+      carp(CARP_FATAL, "The columns of %s differ from those of %s; all shards must be "
+           "searched with the same parameters.", readers[shard]->resultsFile().c_str(),
+           readers[0]->resultsFile().c_str());
+    }
+  }
+
+  const string& header = readers[0]->header();
+  vector<string> columns = StringUtils::Split(header, '\t');
+  int file_col = findColumn(columns, FILE_COL);
+  int scan_col = findColumn(columns, SCAN_COL);
+  int charge_col = findColumn(columns, CHARGE_COL);
+  int delta_cn_col = findColumn(columns, DELTA_CN_COL);
+  int delta_lcn_col = findColumn(columns, DELTA_LCN_COL);
+  int xcorr_col = findColumn(columns, XCORR_SCORE_COL);
+  int tailor_col = findColumn(columns, TAILOR_COL);
+  int sp_rank_col = findColumn(columns, SP_RANK_COL);
+  int distinct_col = findColumn(columns, DISTINCT_MATCHES_SPECTRUM_COL);
+  int decoy_idx_col = findColumn(columns, DECOY_INDEX_COL);
+  // The score the PSMs were ranked by, as in TideMatchSet::getColumns
+  bool pvalues = false;
+  int rank_col;
+  if (findColumn(columns, BOTH_PVALUE_COL) >= 0) {
+    pvalues = true;
+    rank_col = findColumn(columns, BOTH_PVALUE_RANK);
+  } else if (findColumn(columns, HYPERSCORE_COL) >= 0) {
+    rank_col = findColumn(columns, HYPERSCORE_RANK_COL);
+  } else {
+    rank_col = findColumn(columns, XCORR_RANK_COL);
+  }
+  if (file_col < 0 || scan_col < 0 || charge_col < 0 || rank_col < 0) {
+    carp(CARP_FATAL, "%s is not a tide-search results file.", readers[0]->resultsFile().c_str());
+  }
+
+  // A k-way merge of the shards by the order the spectra were searched in
+  vector<pair<unsigned long long, int> > heap;
+  for (size_t shard = 0; shard < readers.size(); ++shard) {
+    if (readers[shard]->next(columns.size(), decoy_idx_col)) {
+      heap.push_back(make_pair(readers[shard]->sequence_, (int)shard));
+    }
+  }
+  make_heap(heap.begin(), heap.end(), CompareShardSequence());
+
+  ofstream* out = create_stream_in_path(output_file.c_str(), NULL, Params::GetBool("overwrite"));
+  *out << header << '\n';
+  int gather_size = top_matches_ + 1;
+  vector<MergedPsm> psms;
+  vector<ShardStats> stats;
+  vector<int> shards;
+  while (!heap.empty()) {
+    // The shards that have PSMs of the next spectrum
+    unsigned long long sequence = heap.front().first;
+    shards.clear();
+    while (!heap.empty() && heap.front().first == sequence) {
+      pop_heap(heap.begin(), heap.end(), CompareShardSequence());
+      shards.push_back(heap.back().second);
+      heap.pop_back();
+    }
+    const string& spectrum = readers[shards.front()]->spectrum_;
+    psms.clear();
+    stats.clear();
+    for (vector<int>::const_iterator i = shards.begin(); i != shards.end(); ++i) {
+      ShardReader* reader = readers[*i];
+      if (reader->spectrum_ != spectrum) {
+        carp(CARP_FATAL, "Spectrum %llu of %s differs from that of %s; all shards must be "
+             "searched with the same spectra and parameters.", sequence,
+             reader->resultsFile().c_str(), readers[shards.front()]->resultsFile().c_str());
+      }
+      psms.insert(psms.end(), reader->psms_.begin(), reader->psms_.end());
+      stats.push_back(reader->stats_);
+    }
+
+    if (pvalues) {
+      stable_sort(psms.begin(), psms.end(),
+                  [](const MergedPsm& x, const MergedPsm& y) { return x.score_ < y.score_; });
+    } else {
+      stable_sort(psms.begin(), psms.end(),
+                  [](const MergedPsm& x, const MergedPsm& y) { return x.score_ > y.score_; });
+    }
+
+    // Gather the best top-match+1 PSMs of each decoy set, and sum up the
+    // candidates of the shards
+    vector<MergedPsm*> gathered;
+    map<int, int> gathered_count;
+    map<int, unsigned long long> shard_candidates;
+    for (vector<MergedPsm>::iterator i = psms.begin(); i != psms.end(); ++i) {
+      if (gathered_count[i->decoy_set_]++ < gather_size) {
+        gathered.push_back(&*i);
+      }
+      if (distinct_col >= 0) {
+        shard_candidates[i->shard_] = StringUtils::FromString<unsigned long long>(i->fields_[distinct_col]);
+      }
+    }
+    unsigned long long candidates = 0;
+    for (map<int, unsigned long long>::const_iterator i = shard_candidates.begin(); i != shard_candidates.end(); ++i) {
+      candidates += i->second;
+    }
+
+    double quantile_score = 1.0;
+    if (tailor_col >= 0 && xcorr_col >= 0) {
+      bool exact = false;
+      quantile_score = tailorQuantile(stats, exact);
+      if (!exact) {
+        // once per spectrum, though its target and decoy files are both merged
+        inexact_tailor_.insert(StringUtils::ToString(sequence, 0));
+      }
+    }
+
+    // Recompute the scores that depend on the other PSMs, as in
+    // TideMatchSet::calculateAdditionalScores
+    if (!gathered.empty()) {
+      size_t last_psm = (size_t)top_matches_ < gathered.size() ? gathered.size()-2 : gathered.size()-1;
+      for (size_t i = 0; i < gathered.size(); ++i) {
+        vector<string>& fields = gathered[i]->fields_;
+        double score = gathered[i]->score_;
+        double next_score = i+1 < gathered.size() ? gathered[i+1]->score_ : score;
+        double last_score = gathered[last_psm]->score_;
+        double delta_cn, delta_lcn;
+        if (pvalues) {
+          delta_cn = -log10(score) + log10(next_score);
+          delta_lcn = -log10(score) + log10(last_score);
+        } else {
+          delta_cn = (score - next_score)/max(score, 1.0);
+          delta_lcn = (score - last_score)/max(score, 1.0);
+        }
+        if (i+1 == gathered.size()) {
+          delta_cn = 0.0;
+        }
+        if (delta_cn_col >= 0) {
+          fields[delta_cn_col] = StringUtils::ToString(delta_cn, precision_);
+        }
+        if (delta_lcn_col >= 0) {
+          fields[delta_lcn_col] = StringUtils::ToString(delta_lcn, precision_);
+        }
+        if (tailor_col >= 0 && xcorr_col >= 0) {
+          fields[tailor_col] = StringUtils::ToString((gathered[i]->xcorr_ + TAILOR_OFFSET)/quantile_score, precision_);
+        }
+        if (distinct_col >= 0) {
+          fields[distinct_col] = StringUtils::ToString(candidates, 0);
+        }
+      }
+    }
+
+    // Sp ranks among the gathered PSMs of the same decoy set, as in
+    // TideMatchSet::calculateSpScores
+    if (sp_rank_col >= 0) {
+      map<int, vector<MergedPsm*> > sp_psms;
+      for (vector<MergedPsm*>::iterator i = gathered.begin(); i != gathered.end(); ++i) {
+        sp_psms[(*i)->decoy_set_].push_back(*i);
+      }
+      for (map<int, vector<MergedPsm*> >::iterator i = sp_psms.begin(); i != sp_psms.end(); ++i) {
+        stable_sort(i->second.begin(), i->second.end(),
+                    [](const MergedPsm* x, const MergedPsm* y) { return x->sp_score_ > y->sp_score_; });
+        for (size_t j = 0; j < i->second.size(); ++j) {
+          i->second[j]->fields_[sp_rank_col] = StringUtils::ToString(j+1, 0);
+        }
+      }
+    }
+
+    // Print the top matches of each decoy set, as in TideMatchSet::printResults
+    map<int, int> cnt;
+    for (vector<MergedPsm*>::iterator i = gathered.begin(); i != gathered.end(); ++i) {
+      int rank = ++cnt[(*i)->decoy_set_];
+      if (rank > top_matches_) {
+        continue;
+      }
+      (*i)->fields_[rank_col] = StringUtils::ToString(rank, 0);
+      *out << StringUtils::Join((*i)->fields_, '\t') << '\n';
+    }
+
+    // Move on to the next spectrum of the shards
+    for (vector<int>::const_iterator i = shards.begin(); i != shards.end(); ++i) {
+      if (readers[*i]->next(columns.size(), decoy_idx_col)) {
+        if (readers[*i]->sequence_ <= sequence) {
+          carp(CARP_FATAL, "The spectra of %s are out of order.", readers[*i]->resultsFile().c_str());
+        }
+        heap.push_back(make_pair(readers[*i]->sequence_, *i));
+        push_heap(heap.begin(), heap.end(), CompareShardSequence());
+      }
+    }
+  }
+  out->close();
+  delete out;
+  for (vector<ShardReader*>::iterator i = readers.begin(); i != readers.end(); ++i) {
+    delete *i;
+  }
+}
+
+string MergeSearchResultsApplication::getName() const {
+  return "merge-search-results";
+}
+
+string MergeSearchResultsApplication::getDescription() const {
+  return
+    "[[nohtml:Merge the output directories of a tide-search split into shards "
+    "of the peptide index into the results of a single search.]]"
+    "[[html:<p>Merge the output directories of a tide-search that was split "
+    "into shards with the <code>--num-shards</code> and <code>--shard-index</code> "
+    "options into the results of a single search. Each shard scores the spectra "
+    "against its part of the peptide index, and reports the top-match+1 best "
+    "matches of each spectrum along with statistics of all of its candidates. "
+    "This command selects the top matches of each spectrum among those of all "
+    "shards, and recomputes the delta-Cn, delta-LCn, rank, Sp rank, Tailor and "
+    "distinct matches/spectrum values over all candidates.</p>"
+    "<p>The shards must be searched with the same parameters, and this command "
+    "must be run with the same top-match and precision.</p>]]";
+}
+
+vector<string> MergeSearchResultsApplication::getArgs() const {
+  string arr[] = {
+    "shard directories+"
+  };
+  return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
+}
+
+vector<string> MergeSearchResultsApplication::getOptions() const {
+  string arr[] = {
+    "fileroot",
+    "output-dir",
+    "overwrite",
+    "parameter-file",
+    "precision",
+    "top-match",
+    "verbosity"
+  };
+  return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
+}
+
+vector< pair<string, string> > MergeSearchResultsApplication::getOutputs() const {
+  vector< pair<string, string> > outputs;
+  outputs.push_back(make_pair("tide-search.target.txt",
+    "a <a href=\"../file-formats/txt-format.html\">tab-delimited text file</a> containing the "
+    "merged target PSMs, as written by tide-search."));
+  outputs.push_back(make_pair("tide-search.decoy.txt",
+    "a <a href=\"../file-formats/txt-format.html\">tab-delimited text file</a> containing the "
+    "merged decoy PSMs. Only written if the shards wrote decoy PSMs."));
+  outputs.push_back(make_pair("tide-search.txt",
+    "a <a href=\"../file-formats/txt-format.html\">tab-delimited text file</a> containing the "
+    "merged PSMs of a search with concat=T, instead of the two files above."));
+  outputs.push_back(make_pair("merge-search-results.log.txt",
+    "a log file containing a copy of all messages that were printed to stderr."));
+  outputs.push_back(make_pair("merge-search-results.params.txt",
+    "a file containing the name and value of all parameters/options for the "
+    "current operation. Not all parameters in the file may have been used in "
+    "the operation. The resulting file can be used with the --parameter-file "
+    "option for other crux programs."));
+  return outputs;
+}
+
+bool MergeSearchResultsApplication::needsOutputDirectory() const {
+  return true;
+}
+
+void MergeSearchResultsApplication::processParams() {
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
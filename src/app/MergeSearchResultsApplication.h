@@ -0,0 +1,101 @@
+/**
+ * \file MergeSearchResultsApplication.h
+ * \brief Merges the results of a tide-search split into shards of the
+ * peptide index (num-shards, shard-index) into those of a single search.
+ ***********************************************************/
+#ifndef MERGESEARCHRESULTSAPPLICATION_H
+#define MERGESEARCHRESULTSAPPLICATION_H
+
+#include "CruxApplication.h"
+#include <set>
+#include <string>
+#include <vector>
+
+class MergeSearchResultsApplication : public CruxApplication {
+
+ public:
+
+  /**
+   * Constructor
+   */
+  MergeSearchResultsApplication();
+
+  /**
+   * Destructor
+   */
+  ~MergeSearchResultsApplication();
+
+  /**
+   * Main methods
+   */
+  virtual int main(int argc, char** argv);
+
+  int main(const std::vector<std::string>& shard_dirs);
+
+  /**
+   * Returns the command name
+   */
+  virtual std::string getName() const;
+
+  /**
+   * Returns the command description
+   */
+  virtual std::string getDescription() const;
+
+  /**
+   * Returns the command arguments
+   */
+  virtual std::vector<std::string> getArgs() const;
+
+  /**
+   * Returns the command options
+   */
+  virtual std::vector<std::string> getOptions() const;
+
+  /**
+   * Returns the command outputs
+   */
+  virtual std::vector< std::pair<std::string, std::string> > getOutputs() const;
+
+  /**
+   * Returns whether the application needs the output directory or not.
+   */
+  virtual bool needsOutputDirectory() const;
+
+  /**
+   * Processes the parameters
+   */
+  virtual void processParams();
+
+ protected:
+
+  // The statistics of one spectrum in one shard, from tide-search.shard-stats.txt
+  struct ShardStats {
+    unsigned long long psms_;     // number of scored candidates
+    std::vector<double> top_xcorr_;  // highest XCorr scores, decreasing
+  };
+
+  class ShardReader;
+
+  // Merge the results file of the shards into output_file, reading the
+  // spectra of all shards in the order they were searched
+  void mergeFiles(const std::vector<std::string>& shard_dirs,
+                  const std::string& result_file, const std::string& output_file);
+
+  // The Tailor quantile score of a spectrum over all shards. Sets exact to
+  // false if a shard did not report enough of its top scores.
+  static double tailorQuantile(const std::vector<ShardStats>& stats, bool& exact);
+
+  int top_matches_;
+  int precision_;
+  std::set<std::string> inexact_tailor_;  // spectra with an approximate Tailor quantile
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
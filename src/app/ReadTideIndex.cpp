@@ -5,6 +5,7 @@
 #include "parameter.h"
 #include "app/tide/records_to_vector-inl.h"
 #include "app/tide/peptide.h"
+#include "app/tide/peptide_blocks.h"
 #include "util/Params.h"
 #include <vector>
 
@@ -44,9 +45,9 @@ int ReadTideIndex::main(int argc, char** argv) {
 
   // Read peptides index file
   carp(CARP_INFO, "Reading peptides...");
-  pb::Header peptides_header;
-  HeadedRecordReader peptide_reader(peptides_file, &peptides_header);
-  if (peptides_header.file_type() != pb::Header::PEPTIDES ||
+  PeptideReader reader(peptides_file);
+  const pb::Header& peptides_header = reader.Header();
+  if (!reader.OK() || peptides_header.file_type() != pb::Header::PEPTIDES ||
       !peptides_header.has_peptides_header()) {
     carp(CARP_FATAL, "Error reading index (%s)", peptides_file.c_str());
   }
@@ -66,11 +67,10 @@ int ReadTideIndex::main(int argc, char** argv) {
   *output_stream << get_column_header(SEQUENCE_COL) << '\t'
                  << get_column_header(PROTEIN_ID_COL) << endl;
 
-  RecordReader* reader = peptide_reader.Reader();
-  while (!reader->Done()) {
+  while (!reader.Done()) {
     // Read peptide
     pb::Peptide pb_peptide;
-    reader->Read(&pb_peptide);
+    reader.Read(&pb_peptide);
     if (Params::GetBool("skip-decoys") && pb_peptide.has_decoy_index()) {
       continue;
     }
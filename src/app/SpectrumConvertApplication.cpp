@@ -92,6 +92,8 @@ vector<string> SpectrumConvertApplication::getOptions() const {
     "spectrum-outdir",
     "overwrite",
     "parameter-file",
+    "spectrum-memory-limit",
+    "temp-dir",
     "verbosity"
   };
   return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
@@ -176,7 +178,11 @@ void SpectrumConvertApplication::getInputFiles(int thread_id) {
       }
       carp(CARP_DEBUG, "New spectrumrecords filename: %s", spectrumrecords.c_str());
       int spectra_num = 0;
-      if (!SpectrumRecordWriter::convert(original_name, spectrumrecords, spectra_num)) {
+      // Threads left over when there are fewer files than threads help
+      // decode the spectra within each file.
+      int decode_threads = max(1, num_threads_ / (int)inputFiles_.size());
+      if (!SpectrumRecordWriter::convert(original_name, spectrumrecords, spectra_num,
+                                         2, false, decode_threads)) {
         carp(CARP_FATAL, "Error converting %s to spectrumrecords format", original_name.c_str());
       }
       locks_array_[LOCK_SPECTRUM_READING]->lock();
@@ -62,6 +62,10 @@ int SubtractIndexApplication::main(int argc, char** argv) {
     carp(CARP_FATAL, "Error reading index (%s)", peptides_file1.c_str());
   }
   const pb::Header::PeptidesHeader& pepHeader1 = peptides_header1.peptides_header();
+  if (pepHeader1.block_encoded()) {
+    carp(CARP_FATAL, "%s is a compressed index, which subtract-index does not "
+                     "support. Rebuild it with --compress-index F.", index1.c_str());
+  }
   DECOY_TYPE_T headerDecoyType = (DECOY_TYPE_T)pepHeader1.decoys();
   if (headerDecoyType != NO_DECOYS) {
     has_decoys = true;
@@ -81,6 +85,10 @@ int SubtractIndexApplication::main(int argc, char** argv) {
   carp(CARP_INFO, "Reading index %s", index2.c_str());
   pb::Header peptides_header2;
   HeadedRecordReader peptide_reader2(peptides_file2, &peptides_header2);
+  if (peptides_header2.peptides_header().block_encoded()) {
+    carp(CARP_FATAL, "%s is a compressed index, which subtract-index does not "
+                     "support. Rebuild it with --compress-index F.", index2.c_str());
+  }
   ProteinVec proteins2;
   pb::Header protein_header2;
   if (!ReadRecordsToVector<pb::Protein, const pb::Protein>(&proteins2,
@@ -0,0 +1,115 @@
+/**
+ * \file TideClientApplication.cpp
+ * \brief Sends spectrum files to a running tide-server to be searched.
+ *
+ * The files are searched by the server, with its parameters, and the
+ * results written to output-dir. See TideServerApplication.cpp for the
+ * protocol.
+ ************************************************************/
+#include "TideClientApplication.h"
+#include "io/carp.h"
+#include "util/FileUtils.h"
+#include "util/LocalSocket.h"
+#include "util/Params.h"
+#include "util/StringUtils.h"
+
+using namespace std;
+
+TideClientApplication::TideClientApplication() {
+}
+
+TideClientApplication::~TideClientApplication() {
+}
+
+int TideClientApplication::main(int argc, char** argv) {
+  return main(Params::GetStrings("tide spectra file"));
+}
+
+int TideClientApplication::main(const vector<string>& spectrum_files) {
+  const string socket_path = Params::GetString("server-socket");
+  LocalSocket* server = LocalSocket::Connect(socket_path);
+  if (server == NULL) {
+    carp(CARP_FATAL, "Could not connect to a tide-server on %s.", socket_path.c_str());
+  }
+
+  // The server may run in another directory
+  string request = "search " + FileUtils::AbsPath(Params::GetString("output-dir")) + "\n";
+  for (vector<string>::const_iterator i = spectrum_files.begin(); i != spectrum_files.end(); ++i) {
+    if (!FileUtils::Exists(*i)) {
+      carp(CARP_FATAL, "Spectrum file %s does not exist.", i->c_str());
+    }
+    request += FileUtils::AbsPath(*i) + "\n";
+  }
+  request += "\n";
+  if (!server->Write(request)) {
+    carp(CARP_FATAL, "Could not send the request to the tide-server on %s.", socket_path.c_str());
+  }
+
+  carp(CARP_INFO, "Waiting for the tide-server on %s...", socket_path.c_str());
+  string line;
+  while (server->ReadLine(&line)) {
+    if (StringUtils::StartsWith(line, "ok ")) {
+      carp(CARP_INFO, "Wrote %s", line.substr(3).c_str());
+    } else if (line == "done") {
+      delete server;
+      return 0;
+    } else if (StringUtils::StartsWith(line, "error ")) {
+      carp(CARP_FATAL, "tide-server: %s", line.substr(6).c_str());
+    }
+  }
+  carp(CARP_FATAL, "The tide-server on %s stopped before finishing the search.",
+       socket_path.c_str());
+  return 1;
+}
+
+string TideClientApplication::getName() const {
+  return "tide-client";
+}
+
+string TideClientApplication::getDescription() const {
+  return
+    "[[nohtml:Search spectrum files using a running tide-server.]]"
+    "[[html:<p>Send spectrum files to a running <code>tide-server</code>, "
+    "which searches them against the index it keeps in memory, with the "
+    "parameters it was started with, and writes the results to the output "
+    "directory. The command returns when the search is done.</p>]]";
+}
+
+vector<string> TideClientApplication::getArgs() const {
+  string arr[] = {
+    "tide spectra file+"
+  };
+  return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
+}
+
+vector<string> TideClientApplication::getOptions() const {
+  string arr[] = {
+    "output-dir",
+    "server-socket",
+    "verbosity"
+  };
+  return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
+}
+
+vector< pair<string, string> > TideClientApplication::getOutputs() const {
+  vector< pair<string, string> > outputs;
+  outputs.push_back(make_pair("tide-search.target.txt",
+    "a tab-delimited text file containing the target PSMs, written by the "
+    "server. The server writes the same files as tide-search would with its "
+    "parameters."));
+  outputs.push_back(make_pair("tide-search.decoy.txt",
+    "a tab-delimited text file containing the decoy PSMs. This file will only "
+    "be created if the index was created with decoys."));
+  return outputs;
+}
+
+bool TideClientApplication::needsOutputDirectory() const {
+  return false;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
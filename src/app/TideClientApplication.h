@@ -0,0 +1,71 @@
+/**
+ * \file TideClientApplication.h
+ * \brief Sends spectrum files to a running tide-server to be searched.
+ ***********************************************************/
+#ifndef TIDECLIENTAPPLICATION_H
+#define TIDECLIENTAPPLICATION_H
+
+#include "CruxApplication.h"
+#include <string>
+#include <vector>
+
+class TideClientApplication : public CruxApplication {
+
+ public:
+
+  /**
+   * Constructor
+   */
+  TideClientApplication();
+
+  /**
+   * Destructor
+   */
+  ~TideClientApplication();
+
+  /**
+   * Main methods
+   */
+  virtual int main(int argc, char** argv);
+
+  int main(const std::vector<std::string>& spectrum_files);
+
+  /**
+   * Returns the command name
+   */
+  virtual std::string getName() const;
+
+  /**
+   * Returns the command description
+   */
+  virtual std::string getDescription() const;
+
+  /**
+   * Returns the command arguments
+   */
+  virtual std::vector<std::string> getArgs() const;
+
+  /**
+   * Returns the command options
+   */
+  virtual std::vector<std::string> getOptions() const;
+
+  /**
+   * Returns the command outputs
+   */
+  virtual std::vector< std::pair<std::string, std::string> > getOutputs() const;
+
+  /**
+   * Returns whether the application needs the output directory or not.
+   */
+  virtual bool needsOutputDirectory() const;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
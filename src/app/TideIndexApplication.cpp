@@ -29,6 +29,7 @@
 #include "TideIndexApplication.h"
 #include "app/tide/modifications.h"
 #include "app/tide/records_to_vector-inl.h"
+#include "app/tide/peptide_blocks.h"
 #include "ParamMedicApplication.h"
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
@@ -154,6 +155,7 @@ int TideIndexApplication::main(
       carp(CARP_DEBUG, "Removing old index file(s)");
       FileUtils::Remove(out_proteins);
       FileUtils::Remove(out_peptides);
+      FileUtils::Remove(PeptideBlockWriter::BlocksFileName(out_peptides));
       FileUtils::Remove(out_residue_stats);
       FileUtils::Remove(modless_peptides);
       FileUtils::Remove(peakless_peptides);
@@ -918,6 +920,11 @@ int TideIndexApplication::main(
   carp(CARP_INFO, "Generated %lu target peptides.", peptide_cnt);
   carp(CARP_INFO, "Generated %lu decoy peptides.", decoy_count);
   carp(CARP_INFO, "Generated %lu peptides in total.", peptide_cnt + decoy_count);
+
+  if (Params::GetBool("compress-index") &&
+      !PeptideBlockWriter::ConvertRecords(out_peptides)) {
+    carp(CARP_FATAL, "Error compressing the peptide index %s", out_peptides.c_str());
+  }
   
   // Recover stderr
   cerr.rdbuf(old);
@@ -1015,6 +1022,7 @@ vector<string> TideIndexApplication::getOptions() const {
   string arr[] = {
     "allow-dups",
     "clip-nterm-methionine",
+    "compress-index",
     "cterm-peptide-mods-spec",
     "cterm-protein-mods-spec",
     "custom-enzyme",
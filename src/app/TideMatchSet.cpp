@@ -6,6 +6,7 @@
 #include "tide/peptide.h"
 #include "crux_version.h"
 #include "TideSearchApplication.h"
+#include "io/DIAmeterRTLibrary.h"
 
 // SCORE_FUNCTION_T is defined in ./src/model/objects.h
 SCORE_FUNCTION_T TideMatchSet::curScoreFunction_ = INVALID_SCORE_FUNCTION;
@@ -18,6 +19,8 @@ bool TideMatchSet::concat_ = false;
 string TideMatchSet::decoy_prefix_ = "";
 int TideMatchSet::psm_id_mzTab_  = 1;
 string TideMatchSet::fasta_file_name_ = "null";
+bool TideMatchSet::compute_sp_ = false;
+int TideMatchSet::num_shards_ = 1;
 
 
 // column IDs are defined in ./src/io/MatchColumns.h and /src/io/MatchColumns.cpp
@@ -40,6 +43,42 @@ int TideMatchSet::XCorr_tsv_cols[] = {
     DECOY_INDEX_COL
   };    
 
+ int TideMatchSet::HyperScore_tsv_cols[] = {
+    FILE_COL, SCAN_COL, CHARGE_COL, RETENTION_TIME_COL, SPECTRUM_PRECURSOR_MZ_COL, SPECTRUM_NEUTRAL_MASS_COL,
+    PEPTIDE_MASS_COL, DELTA_CN_COL, DELTA_LCN_COL, HYPERSCORE_COL,
+    BY_IONS_MATCHED_COL, BY_IONS_TOTAL_COL, BY_IONS_FRACTION_COL, BY_IONS_REPEAT_MATCH_COL,
+    HYPERSCORE_RANK_COL, DISTINCT_MATCHES_SPECTRUM_COL, SEQUENCE_COL, MODIFICATIONS_COL, UNMOD_SEQUENCE_COL,
+    PROTEIN_ID_COL, FLANKING_AA_COL, TARGET_DECOY_COL, ORIGINAL_TARGET_SEQUENCE_COL,
+    DECOY_INDEX_COL
+  };    
+
+// The column sets used with compute-sp=T
+int TideMatchSet::XCorr_Sp_tsv_cols[] = {
+    FILE_COL, SCAN_COL, CHARGE_COL, RETENTION_TIME_COL, SPECTRUM_PRECURSOR_MZ_COL, SPECTRUM_NEUTRAL_MASS_COL,
+    PEPTIDE_MASS_COL, DELTA_CN_COL, DELTA_LCN_COL, SP_SCORE_COL, SP_RANK_COL, XCORR_SCORE_COL, TAILOR_COL, 
+    BY_IONS_MATCHED_COL, BY_IONS_TOTAL_COL, BY_IONS_FRACTION_COL, BY_IONS_REPEAT_MATCH_COL,
+    XCORR_RANK_COL, DISTINCT_MATCHES_SPECTRUM_COL, SEQUENCE_COL, MODIFICATIONS_COL, UNMOD_SEQUENCE_COL,
+    PROTEIN_ID_COL, FLANKING_AA_COL, TARGET_DECOY_COL, ORIGINAL_TARGET_SEQUENCE_COL,
+    DECOY_INDEX_COL
+  };    
+ int TideMatchSet::Pvalues_Sp_tsv_cols[] = {
+    FILE_COL, SCAN_COL, CHARGE_COL, RETENTION_TIME_COL, SPECTRUM_PRECURSOR_MZ_COL, SPECTRUM_NEUTRAL_MASS_COL,
+    PEPTIDE_MASS_COL, DELTA_CN_COL, DELTA_LCN_COL, SP_SCORE_COL, SP_RANK_COL, XCORR_SCORE_COL, TAILOR_COL, 
+    BY_IONS_MATCHED_COL, BY_IONS_TOTAL_COL, BY_IONS_FRACTION_COL, BY_IONS_REPEAT_MATCH_COL, REFACTORED_SCORE_COL, EXACT_PVALUE_COL, 
+    RESIDUE_EVIDENCE_COL, RESIDUE_PVALUE_COL, BOTH_PVALUE_COL, BOTH_PVALUE_RANK, 
+    DISTINCT_MATCHES_SPECTRUM_COL, SEQUENCE_COL, MODIFICATIONS_COL, UNMOD_SEQUENCE_COL,
+    PROTEIN_ID_COL, FLANKING_AA_COL, TARGET_DECOY_COL, ORIGINAL_TARGET_SEQUENCE_COL,
+    DECOY_INDEX_COL
+  };    
+ int TideMatchSet::HyperScore_Sp_tsv_cols[] = {
+    FILE_COL, SCAN_COL, CHARGE_COL, RETENTION_TIME_COL, SPECTRUM_PRECURSOR_MZ_COL, SPECTRUM_NEUTRAL_MASS_COL,
+    PEPTIDE_MASS_COL, DELTA_CN_COL, DELTA_LCN_COL, SP_SCORE_COL, SP_RANK_COL, HYPERSCORE_COL,
+    BY_IONS_MATCHED_COL, BY_IONS_TOTAL_COL, BY_IONS_FRACTION_COL, BY_IONS_REPEAT_MATCH_COL,
+    HYPERSCORE_RANK_COL, DISTINCT_MATCHES_SPECTRUM_COL, SEQUENCE_COL, MODIFICATIONS_COL, UNMOD_SEQUENCE_COL,
+    PROTEIN_ID_COL, FLANKING_AA_COL, TARGET_DECOY_COL, ORIGINAL_TARGET_SEQUENCE_COL,
+    DECOY_INDEX_COL
+  };    
+
   int TideMatchSet::Diameter_tsv_cols[] = {
     FILE_COL, SCAN_COL, CHARGE_COL, SPECTRUM_PRECURSOR_MZ_COL, SPECTRUM_NEUTRAL_MASS_COL,
     PEPTIDE_MASS_COL, DELTA_CN_COL, DELTA_LCN_COL,  XCORR_SCORE_COL, TAILOR_COL, XCORR_RANK_COL,
@@ -93,6 +132,20 @@ int TideMatchSet::Pvalues_mzTab_cols[] = {
     MZTAB_OPT_MS_RUN_1_DECOY_INDEX
   };    
 
+int TideMatchSet::HyperScore_mzTab_cols[] = {
+    MZTAB_PSH, MZTAB_SEQUENCE, MZTAB_PSM_ID, MZTAB_ACCESSION, MZTAB_UNIQUE, MZTAB_DATABASE,
+    MZTAB_DATABASE_VERSION, MZTAB_SEARCH_ENGINE, 
+    MZTAB_SEARCH_ENGINE_SCORE_1,  // [MS, MS:1001331, X!Tandem:hyperscore]
+    MZTAB_SEARCH_ENGINE_SCORE_3,  // [MS, MS:1001143, The SEQUEST result 'DeltaCn'.]
+    MZTAB_SEARCH_ENGINE_SCORE_4,  // [, , hyperscore rank, ]
+    MZTAB_MODIFICATIONS, MZTAB_RETENTION_TIME,
+    MZTAB_CHARGE, MZTAB_EXP_MASS_TO_CHARGE, MZTAB_CALC_MASS_TO_CHARGE, MZTAB_SPECTRA_REF,
+    MZTAB_PRE, MZTAB_POST, MZTAB_START, MZTAB_END, MZTAB_OPT_MS_RUN_1_SPECTRUM_NEUTRAL_MASS,
+    MZTAB_OPT_MS_RUN_1_DELTA_LCN, MZTAB_OPT_MS_RUN_1_DISTINCT_MATCHES_PER_SPEC,
+    MZTAB_OPT_MS_RUN_1_TARGET_DECOY, MZTAB_OPT_MS_RUN_1_ORIGINAL_TARGET_SEQUENCE_COL, 
+    MZTAB_OPT_MS_RUN_1_DECOY_INDEX
+  };    
+
 // int TideMatchSet::XCorr_pin_cols[] = {
 //     POUT_PSMID_COL, SPECTRUM_PRECURSOR_MZ_COL, SPECTRUM_NEUTRAL_MASS_COL,
 //     PEPTIDE_MASS_COL, DELTA_CN_COL, DELTA_LCN_COL, XCORR_SCORE_COL, TAILOR_COL, 
@@ -114,6 +167,7 @@ TideMatchSet::TideMatchSet(ActivePeptideQueue* active_peptide_queue, ObservedPea
   psm_scores_processed_ = false;
   active_peptide_queue_ = active_peptide_queue;
   observed_ = observed;  // Pointer to the experimental spectrum data 
+  sp_scorer_ = NULL;
 
   psm_scores_ = PSMScores(active_peptide_queue->nPeptides_);  
 };
@@ -130,11 +184,26 @@ int* TideMatchSet::getColumns(TSV_OUTPUT_FORMATS_T format, size_t& numHeaders){
     case TIDE_SEARCH_TSV:
       switch (curScoreFunction_) {
         case XCORR_SCORE:
+          if (compute_sp_) {
+            numHeaders = sizeof(XCorr_Sp_tsv_cols) / sizeof(int);
+            return XCorr_Sp_tsv_cols;
+          }
           numHeaders = sizeof(XCorr_tsv_cols) / sizeof(int);
           return XCorr_tsv_cols;
         case PVALUES:
+          if (compute_sp_) {
+            numHeaders = sizeof(Pvalues_Sp_tsv_cols) / sizeof(int);
+            return Pvalues_Sp_tsv_cols;
+          }
           numHeaders = sizeof(Pvalues_tsv_cols) / sizeof(int);
           return Pvalues_tsv_cols;
+        case HYPERSCORE:
+          if (compute_sp_) {
+            numHeaders = sizeof(HyperScore_Sp_tsv_cols) / sizeof(int);
+            return HyperScore_Sp_tsv_cols;
+          }
+          numHeaders = sizeof(HyperScore_tsv_cols) / sizeof(int);
+          return HyperScore_tsv_cols;
         // case DIAMETER:
         //   numHeaders = sizeof(Diameter_tsv_cols) / sizeof(int);
         //   return Diameter_tsv_cols;
@@ -148,6 +217,9 @@ int* TideMatchSet::getColumns(TSV_OUTPUT_FORMATS_T format, size_t& numHeaders){
         case PVALUES:
           numHeaders = sizeof(Pvalues_mzTab_cols) / sizeof(int);
           return Pvalues_mzTab_cols;
+        case HYPERSCORE:
+          numHeaders = sizeof(HyperScore_mzTab_cols) / sizeof(int);
+          return HyperScore_mzTab_cols;
         // case DIAMETER:
         //   numHeaders = sizeof(Diameter_mzTab_cols) / sizeof(int);
         //   return Diameter_mzTab_cols;
@@ -196,10 +268,17 @@ string TideMatchSet::getHeader(TSV_OUTPUT_FORMATS_T format, string tide_index_mz
       for(unsigned int i=0; i < tide_spectra_files.size(); i++) {
         mztab_meta_data << "MTD\tms_run[" << i + 1 << "]-location\tfile://" << tide_spectra_files[i]  <<  "\n";
       }
-      mztab_meta_data << "MTD\tpsm_search_engine_score[" << search_engine_score_index++ << "]\t[MS, MS:1001155, SEQUEST:xcorr, ]\n";
-      mztab_meta_data << "MTD\tpsm_search_engine_score[" << search_engine_score_index++ << "]\t[MS, MS:1003366, tailor score, ]\n";
-      mztab_meta_data << "MTD\tpsm_search_engine_score[" << search_engine_score_index++ << "]\t[MS, MS:1001143, SEQUEST:deltacn, ]\n";
-      if (curScoreFunction_ != PVALUES) {
+      if (curScoreFunction_ == HYPERSCORE) {
+        mztab_meta_data << "MTD\tpsm_search_engine_score[" << search_engine_score_index++ << "]\t[MS, MS:1001331, X!Tandem:hyperscore, ]\n";
+        search_engine_score_index++; //a jump for the tailor score
+        mztab_meta_data << "MTD\tpsm_search_engine_score[" << search_engine_score_index++ << "]\t[MS, MS:1001143, SEQUEST:deltacn, ]\n";
+        mztab_meta_data << "MTD\tpsm_search_engine_score[" << search_engine_score_index++ << "]\t[, , hyperscore rank, ]\n";
+      } else {
+        mztab_meta_data << "MTD\tpsm_search_engine_score[" << search_engine_score_index++ << "]\t[MS, MS:1001155, SEQUEST:xcorr, ]\n";
+        mztab_meta_data << "MTD\tpsm_search_engine_score[" << search_engine_score_index++ << "]\t[MS, MS:1003366, tailor score, ]\n";
+        mztab_meta_data << "MTD\tpsm_search_engine_score[" << search_engine_score_index++ << "]\t[MS, MS:1001143, SEQUEST:deltacn, ]\n";
+      }
+      if (curScoreFunction_ == XCORR_SCORE) {
         mztab_meta_data << "MTD\tpsm_search_engine_score[" << search_engine_score_index++ << "]\t[MS, MS:1003358, XCorr rank, ]\n";
       }
       if (curScoreFunction_ == PVALUES) {
@@ -338,14 +417,29 @@ void TideMatchSet::getReport(TSV_OUTPUT_FORMATS_T format, string spectrum_filena
   concat_or_target_report.clear();
   decoy_report.clear();
 
+  SearchProfile::Counters* profile = active_peptide_queue_->ProfileCounters();
+
   // Get the top_n target and decoy PSMs
-  gatherTargetsDecoys(); 
-  
-  //calculate tailor, delta_cn, and delta_lcn for the top n matches
-  calculateAdditionalScores(concat_or_target_psm_scores_, sc);  
-  calculateAdditionalScores(decoy_psm_scores_, sc);  // decoy_psm_scores is empty in case of concat=T
+  {
+    ScopedPhaseTimer timer(profile, SearchProfile::TOP_K);
+    gatherTargetsDecoys(); 
+  }
+
+  {
+    ScopedPhaseTimer timer(profile, SearchProfile::ADDITIONAL_SCORES);
+    // Sp is only computed for the gathered PSMs
+    if (sp_scorer_ != NULL) {
+      calculateSpScores(concat_or_target_psm_scores_);
+      calculateSpScores(decoy_psm_scores_);
+    }
+
+    //calculate tailor, delta_cn, and delta_lcn for the top n matches
+    calculateAdditionalScores(concat_or_target_psm_scores_, sc);  
+    calculateAdditionalScores(decoy_psm_scores_, sc);  // decoy_psm_scores is empty in case of concat=T
+  }
 
   // Prepare the results in a string
+  ScopedPhaseTimer timer(profile, SearchProfile::OUTPUT);
   printResults(format, spectrum_filename, sc, spectrum_file_cnt, true, concat_or_target_psm_scores_, concat_or_target_report);  // true = target
   printResults(format, spectrum_filename, sc, spectrum_file_cnt, false, decoy_psm_scores_, decoy_report); // decoy_report is an empty string if decoy_psm_scores is empty; false = decoy
 
@@ -373,6 +467,9 @@ void TideMatchSet::gatherTargetsDecoys() {
   case PVALUES:
     comp = &cmpCombinedPvalue;
     break;
+  case HYPERSCORE:
+    comp = &cmpHyperScore;
+    break;
   }
 
   quantile_score_ = 1.0;
@@ -385,10 +482,20 @@ void TideMatchSet::gatherTargetsDecoys() {
   if (quantile_pos >= psm_scores_.size()) 
     quantile_pos = psm_scores_.size()-1; // the last element
 
+  // In shard mode, keep enough of the top scores for the quantile of the
+  // candidates of all shards, which have about num_shards_ times as many.
+  int top_pos = quantile_pos;
+  shard_top_xcorr_.clear();
+  if (num_shards_ > 1) {
+    int merged_pos = (int)ceil(TAILOR_QUANTILE_TH*(double)psm_scores_.size()*num_shards_) + num_shards_ + 2;
+    top_pos = min(max(top_pos, merged_pos), (int)psm_scores_.size()-1);
+  }
   make_heap(psm_scores_.begin(), psm_scores_.end(), cmpXcorrScore);
-  for (int i = 0; i <= quantile_pos; ++i){
+  for (int i = 0; i <= top_pos; ++i){
     pop_heap(psm_scores_.begin(), psm_scores_.end()-i, cmpXcorrScore);
-    Scores back = psm_scores_[psm_scores_.size()-1-i];
+    if (num_shards_ > 1) {
+      shard_top_xcorr_.push_back(psm_scores_[psm_scores_.size()-1-i].xcorr_score_);
+    }
   }
   quantile_score_ = psm_scores_[psm_scores_.size()-1-quantile_pos].xcorr_score_ + TAILOR_OFFSET; // Make sure scores positive
 
@@ -472,6 +579,13 @@ void TideMatchSet::calculateAdditionalScores(PSMScores& psm_scores, const Spectr
         (*it).delta_cn_ = -log10((*it).combined_pval_) + log10((*(it+1)).combined_pval_);
       else 
         (*it).delta_cn_ = 0.0;
+      break;
+    case HYPERSCORE:
+      (*it).delta_lcn_ = ((*it).hyper_score_ - (*last_psm_).hyper_score_)/max((*it).hyper_score_, 1.0);
+      if (it != psm_scores.end()-1)
+        (*it).delta_cn_ = ((*it).hyper_score_ - (*(it+1)).hyper_score_)/max((*it).hyper_score_, 1.0);
+      else 
+        (*it).delta_cn_ = 0.0;
     }
     // }
     // break;
@@ -485,12 +599,97 @@ void TideMatchSet::calculateAdditionalScores(PSMScores& psm_scores, const Spectr
 
 }
 
+string TideMatchSet::getShardStats(string spectrum_filename, const SpectrumCollection::SpecCharge* sc, unsigned long long sequence) {
+  // The sequence number orders the spectra the same way in every shard, and
+  // file, scan, charge and neutral mass identify the spectrum as in the
+  // results. They are followed by the number of scored candidates, the top
+  // XCorr scores, and the scores of the PSMs written to the target (or
+  // concatenated) and decoy results. Scores are written exactly, so that
+  // merge-search-results recomputes the same values as a single search.
+  string stats = StringUtils::ToString(sequence, 0) + '\t' + spectrum_filename + '\t' +
+    StringUtils::ToString(sc->spectrum->SpectrumNumber(), 0) + '\t' +
+    StringUtils::ToString(sc->charge, 0) + '\t' +
+    StringUtils::ToString((sc->spectrum->PrecursorMZ() - MASS_PROTON)*sc->charge, mass_precision_) + '\t' +
+    StringUtils::ToString(psm_scores_.size(), 0) + '\t';
+  for (size_t i = 0; i < shard_top_xcorr_.size(); ++i) {
+    if (i > 0) {
+      stats += ',';
+    }
+    stats += StringUtils::ToExactString(shard_top_xcorr_[i]);
+  }
+  return stats + '\t' + getShardScores(concat_or_target_psm_scores_) + '\t' +
+    getShardScores(decoy_psm_scores_) + '\n';
+}
+
+string TideMatchSet::getShardScores(PSMScores& psm_scores) {
+  // The PSMs printResults writes, each as the score they are ranked by,
+  // XCorr and Sp, separated by colons
+  string scores;
+  vector<int> cnt(decoy_num_ + 1, 0);
+  for (PSMScores::iterator it = psm_scores.begin(); it != psm_scores.end(); ++it) {
+    int decoy_idx = active_peptide_queue_->GetPeptide((*it).ordinal_)->DecoyIdx();
+    if (++cnt[decoy_idx < 0 ? 0 : decoy_idx] > top_matches_ + 1) {
+      continue;
+    }
+    double score;
+    switch (curScoreFunction_) {
+    case PVALUES:
+      score = (*it).combined_pval_;
+      break;
+    case HYPERSCORE:
+      score = (*it).hyper_score_;
+      break;
+    default:
+      score = (*it).xcorr_score_;
+    }
+    if (!scores.empty()) {
+      scores += ',';
+    }
+    scores += StringUtils::ToExactString(score) + ':' +
+      StringUtils::ToExactString((*it).xcorr_score_) + ':' +
+      StringUtils::ToExactString((*it).sp_score_);
+  }
+  return scores;
+}
+
+void TideMatchSet::calculateSpScores(PSMScores& psm_scores) {
+  // The gatherTargetsDecoys must be run and sp_scorer_ prepared before calling this function.
+  // PSMs are ranked by Sp separately for each decoy set, like their other ranks.
+  vector<vector<SpScorer::SpScoreData> >& sp_scores = sp_scorer_->set_scores_;
+  vector<vector<size_t> >& psms = sp_scorer_->set_psms_;
+  for (size_t i = 0; i < sp_scores.size(); ++i) {
+    sp_scores[i].clear();
+    psms[i].clear();
+  }
+  for (size_t i = 0; i < psm_scores.size(); ++i) {
+    Peptide* peptide = *(psm_scores[i].peptide_itr_);
+    size_t set = peptide->DecoyIdx() < 0 ? 0 : peptide->DecoyIdx() + 1;
+    if (set >= sp_scores.size()) {
+      sp_scores.resize(set + 1);
+      psms.resize(set + 1);
+    }
+    sp_scores[set].push_back(SpScorer::SpScoreData());
+    sp_scorer_->Score(*peptide, sp_scores[set].back());
+    psms[set].push_back(i);
+  }
+  for (size_t set = 0; set < sp_scores.size(); ++set) {
+    if (sp_scores[set].empty()) {
+      continue;
+    }
+    sp_scorer_->RankSpScores(sp_scores[set]);
+    for (size_t j = 0; j < psms[set].size(); ++j) {
+      psm_scores[psms[set][j]].sp_score_ = sp_scores[set][j].sp_score;
+      psm_scores[psms[set][j]].sp_rank_ = sp_scores[set][j].sp_rank;
+    }
+  }
+}
+
 void TideMatchSet::printResults(TSV_OUTPUT_FORMATS_T format, string spectrum_filename, const SpectrumCollection::SpecCharge* sc, int spectrum_file_cnt, bool target, PSMScores& psm_scores, string& report,
     map<PSMScores::iterator, boost::tuple<double, double, double>>* intensity_map,
     map<PSMScores::iterator, boost::tuple<double, double, double>>* logrank_map,
     map<PSMScores::iterator, boost::tuple<double, double, double>>* coelute_map,
     map<PSMScores::iterator, boost::tuple<double, double>>* ms2pval_map,
-    map<string, double>* peptide_predrt_map) { 
+    const DIAmeterRTLibrary* predrt_library) { 
   // The order of the fields of the results is solely based on the column order
   size_t numHeaders;
   int* header_cols = getColumns(format, numHeaders);
@@ -519,6 +718,9 @@ cnt[i] counts only decoys, for i = 0-->decoy_num
   for (int i=0; i <= decoy_num_; ++i) {
     cnt.push_back(0);
   }
+  // A shard reports all gathered PSMs, so that merge-search-results has the
+  // one after the top matches of the merged search for its delta scores.
+  int report_matches = num_shards_ > 1 ? top_matches_ + 1 : top_matches_;
   double predrt;
   
   for (PSMScores::iterator it = psm_scores.begin(); it != psm_scores.end(); ++it) {
@@ -526,7 +728,7 @@ cnt[i] counts only decoys, for i = 0-->decoy_num
     int decoy_idx = peptide->DecoyIdx();
     decoy_idx = decoy_idx < 0 ? 0 : decoy_idx;
     ++cnt[decoy_idx];
-    if (cnt[decoy_idx] > top_matches_) {
+    if (cnt[decoy_idx] > report_matches) {
       continue;
     }
 
@@ -571,7 +773,13 @@ cnt[i] counts only decoys, for i = 0-->decoy_num
       case DELTA_LCN_COL:
         report += StringUtils::ToString((*it).delta_lcn_, score_precision_);        // delta_lcn
         break;
-      case MZTAB_SEARCH_ENGINE_SCORE_1:  // xcorr score
+      case MZTAB_SEARCH_ENGINE_SCORE_1:  // xcorr score, or hyperscore
+        if (curScoreFunction_ == HYPERSCORE) {
+          report += StringUtils::ToString((*it).hyper_score_, score_precision_);    // hyperscore
+        } else {
+          report += StringUtils::ToString((*it).xcorr_score_, score_precision_);    // xcorr score
+        }
+        break;
       case XCORR_SCORE_COL:
         report += StringUtils::ToString((*it).xcorr_score_, score_precision_);      // xcorr score
         break;       
@@ -585,6 +793,15 @@ cnt[i] counts only decoys, for i = 0-->decoy_num
       case REFACTORED_SCORE_COL:
         report += StringUtils::ToString((*it).refactored_xcorr_, score_precision_);      // refactored xcorr score
         break;
+      case HYPERSCORE_COL:
+        report += StringUtils::ToString((*it).hyper_score_, score_precision_);      // hyperscore
+        break;
+      case SP_SCORE_COL:
+        report += StringUtils::ToString((*it).sp_score_, score_precision_);         // sp score
+        break;
+      case SP_RANK_COL:
+        report += StringUtils::ToString((*it).sp_rank_, 0);                         // sp rank
+        break;
       case MZTAB_SEARCH_ENGINE_SCORE_6:      // exact p-value
         if (curScoreFunction_ == PVALUES) {
           report += StringUtils::ToString((*it).exact_pval_, score_precision_, false);      // exact p-value score
@@ -642,7 +859,7 @@ cnt[i] counts only decoys, for i = 0-->decoy_num
         report += StringUtils::ToString((*it).repeat_ion_match_, score_precision_);  // fraction of the matched per total by-ions
         break;
   
-      case MZTAB_SEARCH_ENGINE_SCORE_4:  // [MS, MS:1003358, XCorr rank]
+      case MZTAB_SEARCH_ENGINE_SCORE_4:  // [MS, MS:1003358, XCorr rank], or hyperscore rank
         if (curScoreFunction_ != PVALUES) {
           report += StringUtils::ToString(cnt[decoy_idx], 0);  // rank
         } else {
@@ -657,6 +874,7 @@ cnt[i] counts only decoys, for i = 0-->decoy_num
         }
         break;
       case BOTH_PVALUE_RANK:    // combined p-value rank
+      case HYPERSCORE_RANK_COL:
       case XCORR_RANK_COL:
         report += StringUtils::ToString(cnt[decoy_idx], 0);
         break;
@@ -767,11 +985,8 @@ cnt[i] counts only decoys, for i = 0-->decoy_num
         break;
       case RT_DIFF_COL:
         predrt = 0.5;
-        if (peptide_predrt_map != NULL) {
-          map<string, double>::iterator predrtIter = peptide_predrt_map->find(peptide_with_mods);
-          if (predrtIter != peptide_predrt_map->end()) { 
-            predrt = predrtIter->second; 
-          }
+        if (predrt_library != NULL) {
+          predrt_library->find(peptide_with_mods, &predrt);
         }
         report += StringUtils::ToString(fabs(predrt - sc->spectrum->RTime()), score_precision_, true);
         break;
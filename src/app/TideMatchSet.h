@@ -20,6 +20,8 @@ using namespace std;
 
 typedef vector<const pb::Protein*> ProteinVec;
 
+class DIAmeterRTLibrary;
+
 class TideMatchSet {    
  public:
   class Scores {
@@ -36,6 +38,7 @@ class TideMatchSet {
     int by_ion_total_;    
     int repeat_ion_match_; 
     double sp_score_;
+    int sp_rank_;
     double hyper_score_;
     double hyper_score_la_; 
     double delta_cn_;
@@ -44,7 +47,7 @@ class TideMatchSet {
     deque<Peptide*>::const_iterator peptide_itr_;
     Scores():ordinal_(0), xcorr_score_(0.0), exact_pval_(0.0), refactored_xcorr_(0.0), 
       resEv_score_(0.0), resEv_pval_(0.0), combined_pval_(0.0), tailor_(0.0), by_ion_matched_(0), by_ion_total_(0), 
-      sp_score_(0), hyper_score_(0), hyper_score_la_(0), delta_cn_(0), delta_lcn_(0), active_(false) {}
+      sp_score_(0), sp_rank_(0), hyper_score_(0), hyper_score_la_(0), delta_cn_(0), delta_lcn_(0), active_(false) {}
   };
 //   typedef FixedCapacityArray<Scores> PSMScores;
   typedef vector<Scores> PSMScores;
@@ -68,10 +71,15 @@ class TideMatchSet {
   // Define the column names and their order in the result files.
   static int XCorr_tsv_cols[];  //these are declared at the beginning of TideMatchSet.cpp
   static int Pvalues_tsv_cols[];
+  static int HyperScore_tsv_cols[];
   static int Diameter_tsv_cols[]; 
+  static int XCorr_Sp_tsv_cols[];  // the same columns with the Sp score and rank
+  static int Pvalues_Sp_tsv_cols[];
+  static int HyperScore_Sp_tsv_cols[];
 
   static int XCorr_mzTab_cols[];  //these are declared at the beginning of TideMatchSet.cpp
   static int Pvalues_mzTab_cols[];  //these are declared at the beginning of TideMatchSet.cpp
+  static int HyperScore_mzTab_cols[];  //these are declared at the beginning of TideMatchSet.cpp
 
   static int XCorr_pin_cols[];  //these are declared at the beginning of TideMatchSet.cpp
   static int Pvalues_pin_cols[];
@@ -87,18 +95,29 @@ class TideMatchSet {
                    string &concat_or_target_report, string& decoy_report);
   void gatherTargetsDecoys();  // Additional scores are:  delta_cn, delta_lcn, tailor
   void calculateAdditionalScores(PSMScores& psm_scores, const SpectrumCollection::SpecCharge* sc);  // Additional scores are:  delta_cn, delta_lcn, tailor; 
+  void calculateSpScores(PSMScores& psm_scores);  // Sp score and Sp rank among the gathered PSMs of the same decoy set
   void printResults(TSV_OUTPUT_FORMATS_T format, string spectrum_filename, const SpectrumCollection::SpecCharge* sc, int spectrum_file_cnt, bool target, PSMScores& psm_scores, string& results,
     map<PSMScores::iterator, boost::tuple<double, double, double>>* intensity_map = NULL,
     map<PSMScores::iterator, boost::tuple<double, double, double>>* logrank_map = NULL,
     map<PSMScores::iterator, boost::tuple<double, double, double>>* coelute_map = NULL,
     map<PSMScores::iterator, boost::tuple<double, double>>* ms2pval_map = NULL,
-    map<string, double>* peptide_predrt_map = NULL);
+    const DIAmeterRTLibrary* predrt_library = NULL);
+  // The line of tide-search.shard-stats.txt of the spectrum, with the
+  // statistics and exact scores merge-search-results needs to recompute
+  // the scores that depend on the other shards. getReport must be run first.
+  string getShardStats(string spectrum_filename, const SpectrumCollection::SpecCharge* sc, unsigned long long sequence);
+  // The exact scores of the PSMs of psm_scores that printResults writes
+  string getShardScores(PSMScores& psm_scores);
 
   static string GetModificationList(const pb::ModTable* mod_table, string site_prefix, string position_prefix, bool variable, int& cnt);
   /* Constants required for the tailor scoring */
   const double TAILOR_QUANTILE_TH = 0.01;
   const double TAILOR_OFFSET = 5.0 ;
   double quantile_score_;
+  // The highest XCorr scores of all candidates in decreasing order, enough to
+  // find the Tailor quantile of the search over all shards. Only gathered in
+  // shard mode.
+  vector<double> shard_top_xcorr_;
   
   PSMScores::iterator last_psm_;
   ActivePeptideQueue* active_peptide_queue_;  
@@ -109,6 +128,10 @@ class TideMatchSet {
   // But it is just needed  only for top-N PSMs. So, we need to used
   // the observed spectrum vector to calculate the repeat_ion_match here.
   ObservedPeakSet* observed_;  
+
+  // Workspace of the search thread for the Sp scores of the top-N PSMs,
+  // prepared for the spectrum of this match set. NULL unless compute_sp_.
+  SpScorer* sp_scorer_;
   
   // Global static parameters
   static SCORE_FUNCTION_T curScoreFunction_;
@@ -121,6 +144,8 @@ class TideMatchSet {
   static bool concat_;
   static int psm_id_mzTab_;
   static string fasta_file_name_;
+  static bool compute_sp_;
+  static int num_shards_;  // greater than 1 when searching one shard of the index
 
 //  private:
   PSMScores concat_or_target_psm_scores_;
@@ -6,6 +6,8 @@
 #include "io/carp.h"
 #include "parameter.h"
 #include "io/SpectrumRecordWriter.h"
+#include "io/SpectrumRecordCache.h"
+#include "io/MatchColumns.h"
 #include "TideIndexApplication.h"
 #include "TideSearchApplication.h"
 #include "ParamMedicApplication.h"
@@ -75,7 +77,26 @@ TideSearchApplication::TideSearchApplication() {
   out_mztab_decoy_ = NULL;      // mzTAB output format for the decoy psms only
   out_pin_target_ = NULL;        // pin output format for percolator
   out_pin_decoy_ = NULL;        // pin output format for percolator for the decoy psms only
+  out_shard_stats_ = NULL;
+  num_shards_ = 1;
+  shard_index_ = 0;
   total_spectra_num_ = 0;       // The total number of spectra searched. This is counted during the spectrum conversion
+  peptides_header_ = NULL;
+  proteins_ = NULL;
+  locations_ = NULL;
+  next_file_to_convert_ = 0;
+  files_converting_ = 0;
+  fragment_index_top_n_ = 0;
+  compute_sp_ = false;
+  profile_ = NULL;
+  checkpoint_ = NULL;
+  next_sequence_ = 0;
+  next_result_sequence_ = 0;
+  numa_ = NULL;
+  index_data_ = NULL;
+  split_candidates_ = 0;
+  searching_threads_ = 0;
+  num_split_spectra_ = 0;
 
   for (int i = 0; i < NUMBER_LOCK_TYPES; i++) {  // LOCK_TYPES are defined in model/objects.h
     locks_array_.push_back(new boost::mutex());
@@ -133,6 +154,24 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
   }
   carp(CARP_INFO, "Number of Threads: %d", num_threads_);
 
+  num_shards_ = Params::GetInt("num-shards");
+  shard_index_ = Params::GetInt("shard-index");
+  if (shard_index_ >= num_shards_) {
+    carp(CARP_FATAL, "shard-index (%d) must be less than num-shards (%d).",
+         shard_index_, num_shards_);
+  }
+  if (num_shards_ > 1) {
+    // The shards are combined by merge-search-results from their txt output
+    if (!Params::GetBool("txt-output")) {
+      carp(CARP_FATAL, "A sharded search requires txt-output.");
+    }
+    if (Params::GetBool("mztab-output")) {
+      carp(CARP_FATAL, "mzTab output is not supported by a sharded search.");
+    }
+    carp(CARP_INFO, "Searching shard %d of %d of the peptide index.",
+         shard_index_, num_shards_);
+  }
+
 
   // Check scan-number parameter
   string scan_range = Params::GetString("scan-number");
@@ -164,14 +203,30 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
   if (curScoreFunction_ >= NUMBER_SCORE_FUNCTIONS) {
     carp(CARP_FATAL, "Invalid score function.");
   }
+  // Sp is required by the sqt output
+  compute_sp_ = Params::GetBool("compute-sp") || Params::GetBool("sqt-output");
+  fragment_index_top_n_ = Params::GetInt("fragment-index-top-n");
+  if (fragment_index_top_n_ > 0) {
+    if (curScoreFunction_ != XCORR_SCORE) {
+      carp(CARP_FATAL, "fragment-index-top-n can only be used with score-function xcorr.");
+    }
+    if (fragment_index_top_n_ <= top_matches_) {
+      carp(CARP_WARNING, "fragment-index-top-n (%d) is not larger than top-match (%d); "
+           "delta scores of the last reported match may be inaccurate.", 
+           fragment_index_top_n_, top_matches_);
+    }
+    carp(CARP_INFO, "Computing XCorr for the %d candidates sharing the most fragments "
+         "with each spectrum.", fragment_index_top_n_);
+  }
  
   // Get a peptide reader to the peptide index datasets along with proteins, auxlocs. 
-  vector<const pb::Protein*> proteins;
-  vector<const pb::AuxLocation*> locations;
-  pb::Header peptides_header;
+  IndexData local_index_data;
+  IndexData* index_data = index_data_ != NULL ? index_data_ : &local_index_data;
+  if (index_data->index_ != input_index) {
+    readIndexData(input_index, index_data);
+  }
   string peptides_file = FileUtils::Join(input_index, "pepix");  
-  HeadedRecordReader peptide_reader = HeadedRecordReader(peptides_file, &peptides_header);
-  getPeptideIndexData(input_index, proteins, locations, peptides_header);
+  getPeptideIndexData(input_index, *index_data);
   tide_index_mzTab_file_path_ = FileUtils::Join(input_index, TideIndexApplication::tide_index_mzTab_filename_);
 
   TideMatchSet::curScoreFunction_ = curScoreFunction_;
@@ -181,6 +236,24 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
   TideMatchSet::score_precision_ = Params::GetInt("precision");
   TideMatchSet::mod_precision_ = Params::GetInt("mod-precision");
   TideMatchSet::concat_ = Params::GetBool("concat");  
+  TideMatchSet::compute_sp_ = compute_sp_;
+  TideMatchSet::num_shards_ = num_shards_;
+  if (Params::GetBool("profile-output")) {
+    profile_ = new SearchProfile();
+  }
+  int checkpoint_interval = Params::GetInt("checkpoint-interval");
+  if (Params::GetBool("resume") && checkpoint_interval == 0) {
+    carp(CARP_FATAL, "resume requires checkpoint-interval to be set.");
+  }
+  if (checkpoint_interval > 0) {
+    string checkpoint_file_name = make_file_path("tide-search.checkpoint", output_dir_);
+    checkpoint_ = new SearchCheckpoint(checkpoint_file_name, checkpoint_interval,
+                                       checkpointFingerprint(input_files, input_index));
+    if (Params::GetBool("resume") && !checkpoint_->Load()) {
+      carp(CARP_WARNING, "There is no checkpoint %s to resume from, starting a new search.",
+           checkpoint_file_name.c_str());
+    }
+  }
 
   // Create the output files, print headers
   createOutputFiles(); 
@@ -191,69 +264,145 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
   for (vector<string>::const_iterator original_file_name = input_files.begin(); original_file_name != input_files.end(); ++original_file_name) {
     inputFiles_.push_back(TideSearchApplication::InputFile(*original_file_name, *original_file_name, false));
   }
-  // Launch threads to convert files
-  boost::thread_group threadgroup_input_files;
-  for (int t = 1; t < num_threads_; ++t) {
-    boost::thread * currthread = new boost::thread(boost::bind(&TideSearchApplication::getInputFiles, this, t));
-    threadgroup_input_files.add_thread(currthread);
-  }
-  getInputFiles(0);
-  // Join threads
-  threadgroup_input_files.join_all();
 
-  if (total_spectra_num_ > 0) {
-    carp(CARP_INFO, "There were a total of %d spectrum conversions from %d input spectrum files.",
-         total_spectra_num_, inputFiles_.size());
+  peptides_file_ = peptides_file;
+  peptides_header_ = &index_data->peptides_header_;
+  proteins_ = &index_data->proteins_;
+  locations_ = &index_data->locations_;
+
+  if (Params::GetBool("numa-placement")) {
+    numa_ = new NumaTopology();
+    carp(CARP_INFO, "Placing the search threads on %d cores of %d NUMA nodes.",
+         numa_->NumCpus(), numa_->NumNodes());
+    if (numa_->NumNodes() > 1) {
+      // Copy the proteins to the nodes the threads run on, each by a thread
+      // of that node so that the copy is allocated there
+      node_proteins_.resize(numa_->NumNodes());
+      node_locations_.resize(numa_->NumNodes());
+      set<int> nodes;
+      for (int t = 0; t < num_threads_; ++t) {
+        nodes.insert(numa_->NodeOfThread(t));
+      }
+      boost::thread_group threadgroup;
+      for (set<int>::const_iterator node = nodes.begin(); node != nodes.end(); ++node) {
+        threadgroup.add_thread(new boost::thread(boost::bind(&TideSearchApplication::replicateIndexData, this, *node)));
+      }
+      threadgroup.join_all();
+    }
   }
-  carp(CARP_INFO, "Elapsed time: %.3g s", wall_clock() / 1e6);
 
-  // Create the active_peptide_queues and peptide_readers for each threads
-  vector<HeadedRecordReader*> peptide_reader_threads;
-  vector<ActivePeptideQueue*> APQ;
-  for (int i = 0; i < num_threads_; i++) {
-    peptide_reader_threads.push_back(new HeadedRecordReader(peptides_file, &peptides_header));
-    APQ.push_back(new ActivePeptideQueue(peptide_reader_threads.back()->Reader(), proteins, &locations));
+  // Spectra with enough candidates are scored by several threads, so that a
+  // few of them do not leave all but one thread idle at the end of the search
+  split_candidates_ = num_threads_ > 1 ? Params::GetInt("split-candidates") : 0;
+  searching_threads_ = num_threads_;
+
+  bool pipelined = Params::GetBool("pipeline-search") && inputFiles_.size() > 1;
+  if (pipelined && checkpoint_ != NULL) {
+    // Checkpoints number the spectra in the order of the spectrum heap
+    carp(CARP_WARNING, "pipeline-search cannot be used with checkpoint-interval; "
+         "searching the files in order of precursor mass.");
+    pipelined = false;
+  }
+  if (pipelined && num_shards_ > 1) {
+    // Shards write the spectra in the order of the spectrum heap too
+    carp(CARP_WARNING, "pipeline-search cannot be used with num-shards; "
+         "searching the files in order of precursor mass.");
+    pipelined = false;
   }
+  if (pipelined) {
+    // Search each file as soon as it is converted, with conversions and
+    // searches sharing the same threads. Each thread streams the index
+    // through its own queue, as in the search in order of mass.
+    carp(CARP_INFO, "Starting pipelined conversion and search of %d files.",
+         (int)inputFiles_.size());
+    boost::thread_group threadgroup;
+    for (int t = 1; t < num_threads_; ++t) {
+      threadgroup.add_thread(new boost::thread(boost::bind(&TideSearchApplication::pipeline_search, this, t)));
+    }
+    pipeline_search(0);
+    threadgroup.join_all();
+    if (numa_ != NULL) {
+      numa_->Unpin();
+    }
+    if (total_spectra_num_ > 0) {
+      carp(CARP_INFO, "There were a total of %d spectrum conversions from %d input spectrum files.",
+           total_spectra_num_, inputFiles_.size());
+    }
+  } else {
+    // Launch threads to convert files
+    boost::thread_group threadgroup_input_files;
+    for (int t = 1; t < num_threads_; ++t) {
+      boost::thread * currthread = new boost::thread(boost::bind(&TideSearchApplication::getInputFiles, this, t));
+      threadgroup_input_files.add_thread(currthread);
+    }
+    getInputFiles(0);
+    // Join threads
+    threadgroup_input_files.join_all();
+
+    if (total_spectra_num_ > 0) {
+      carp(CARP_INFO, "There were a total of %d spectrum conversions from %d input spectrum files.",
+           total_spectra_num_, inputFiles_.size());
+    }
+    carp(CARP_INFO, "Elapsed time: %.3g s", wall_clock() / 1e6);
+    if (checkpoint_ != NULL) {
+      checkpoint_->Write();  // record the converted files
+    }
+
+    // Create the active_peptide_queues and peptide_readers for each threads
+    vector<PeptideReader*> peptide_reader_threads(num_threads_, (PeptideReader*)NULL);
+    vector<ActivePeptideQueue*> APQ;
+    for (int i = 0; i < num_threads_; i++) {
+      if (numa_ != NULL) {
+        APQ.push_back(NULL);  // opened by the thread once it has been placed
+      } else {
+        APQ.push_back(openPeptideQueue(&peptide_reader_threads[i]));
+      }
+    }
 
-  carp(CARP_INFO, "Starting search.");
-  // Read the first spectrum records from each input files 
-  int file_cnt = 0;
-  pb::Spectrum pb_spectrum; // spectrum message struct
-  for (vector<InputFile>::iterator spectrum_file = inputFiles_.begin(); spectrum_file != inputFiles_.end(); ++spectrum_file, ++file_cnt) {
+    carp(CARP_INFO, "Starting search.");
+    // Read the first spectrum records from each input files 
+    int file_cnt = 0;
+    pb::Spectrum pb_spectrum; // spectrum message struct
+    for (vector<InputFile>::iterator spectrum_file = inputFiles_.begin(); spectrum_file != inputFiles_.end(); ++spectrum_file, ++file_cnt) {
 
-    string spectrum_records_file = spectrum_file->SpectrumRecords;
-    spectrum_reader_.push_back(new HeadedRecordReader(spectrum_records_file));
+      string spectrum_records_file = spectrum_file->SpectrumRecords;
+      spectrum_reader_.push_back(new HeadedRecordReader(spectrum_records_file));
+
+      if (!spectrum_reader_.back()->Done() ) {
+        spectrum_reader_.back()->Read(&pb_spectrum);
+        spectrum_heap_.push_back(make_pair(pb_spectrum, file_cnt));
+      }
+      if ( !spectrum_reader_.back()->OK() ){
+        carp(CARP_FATAL, "Spectrum records file %s is corrupt.", spectrum_records_file.c_str());
+      }
 
-    if (!spectrum_reader_.back()->Done() ) {
-      spectrum_reader_.back()->Read(&pb_spectrum);
-      spectrum_heap_.push_back(make_pair(pb_spectrum, file_cnt));
-    }
-    if ( !spectrum_reader_.back()->OK() ){
-      carp(CARP_FATAL, "Spectrum records file %s is corrupt.", spectrum_records_file.c_str());
     }
+    // make a heap with the spectrum records 
+    make_heap(spectrum_heap_.begin(), spectrum_heap_.end(), compare_spectrum());
 
-  }
-  // make a heap with the spectrum records 
-  make_heap(spectrum_heap_.begin(), spectrum_heap_.end(), compare_spectrum());
+    // Create thread data
+    vector<thread_data> thread_data_array;
+    for (int t = 0; t < num_threads_; ++t) {
+        thread_data_array.push_back(thread_data(APQ[t], t));
+    }
 
-  // Create thread data
-  vector<thread_data> thread_data_array;
-  for (int t = 0; t < num_threads_; ++t) {
-      thread_data_array.push_back(thread_data(APQ[t], t));
-  }
+    // Launch threads
+    boost::thread_group threadgroup;
+    for (int t = 1; t < num_threads_; ++t) {
+      boost::thread * currthread = new boost::thread(boost::bind(&TideSearchApplication::spectrum_search, this, (void *) &(thread_data_array[t])));
+      threadgroup.add_thread(currthread);
+    }
 
-  // Launch threads
-  boost::thread_group threadgroup;
-  for (int t = 1; t < num_threads_; ++t) {
-    boost::thread * currthread = new boost::thread(boost::bind(&TideSearchApplication::spectrum_search, this, (void *) &(thread_data_array[t])));
-    threadgroup.add_thread(currthread);
-  }
+    // Searches through part of the spec charge vector while waiting for threads are busy
+    spectrum_search( (void *)  &(thread_data_array[0]) );
 
-  // Searches through part of the spec charge vector while waiting for threads are busy
-  spectrum_search( (void *)  &(thread_data_array[0]) );
+    // Join threads
+    threadgroup.join_all();
+    if (numa_ != NULL) {
+      numa_->Unpin();
+    }
 
-  // Join threads
-  threadgroup.join_all();
+  }
 
   // Print statistics
   long int total_peaks = num_precursors_skipped_ + num_isotopes_skipped_ + num_range_skipped_ + num_retained_;
@@ -274,14 +423,35 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
   carp(CARP_INFO, "Average number of candidates per spectrum-charge combination: %lf ",
     ((double)total_candidate_peptides_) /  (double)num_spectra_searched_ );
   carp(CARP_INFO, "%d spectrum-charge combinations loaded, %d spectrum-charge combinations searched. ", num_spectra_, num_spectra_searched_);
+  if (num_split_spectra_ > 0) {
+    carp(CARP_INFO, "Scored the candidates of %d spectrum-charge combinations with "
+         "more than one thread.", num_split_spectra_);
+  }
+  if (profile_ != NULL) {
+    string profile_file_name = make_file_path("tide-search.profile.json", output_dir_);
+    profile_->Write(profile_file_name, wall_clock() / 1e6, num_threads_, num_spectra_searched_);
+    carp(CARP_INFO, "Wrote the search profile to %s.", profile_file_name.c_str());
+    delete profile_;
+    profile_ = NULL;
+  }
   
-  convertResults();
+  if (num_shards_ > 1) {
+    carp(CARP_INFO, "Run merge-search-results on the output directories of all "
+         "shards to get the results of the search.");
+  } else {
+    convertResults();
+  }
 
   // Delete temporary spectrumrecords file
  for (vector<TideSearchApplication::InputFile>::iterator original_file_name = inputFiles_.begin(); original_file_name != inputFiles_.end(); ++original_file_name) {
+    if ((*original_file_name).Keep) {
+      continue;  // store-spectra output, cached or input spectrumrecords
+    }
     carp(CARP_DEBUG, "Deleting %s", (*original_file_name).SpectrumRecords.c_str());
     remove((*original_file_name).SpectrumRecords.c_str());
   }
+  // the spectra are read, so cached entries may be evicted by other runs
+  SpectrumRecordCache::release();
 
   // Delete stuffs
   if (out_tsv_target_ != NULL)
@@ -296,6 +466,30 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
     delete out_pin_target_;
   if (out_pin_decoy_ != NULL)
     delete out_pin_decoy_;
+  if (out_shard_stats_ != NULL)
+    delete out_shard_stats_;
+
+  if (numa_ != NULL) {
+    for (size_t node = 0; node < node_proteins_.size(); ++node) {
+      for (ProteinVec::iterator i = node_proteins_[node].begin(); i != node_proteins_[node].end(); ++i) {
+        delete *i;
+      }
+      for (vector<const pb::AuxLocation*>::iterator i = node_locations_[node].begin(); i != node_locations_[node].end(); ++i) {
+        delete *i;
+      }
+    }
+    node_proteins_.clear();
+    node_locations_.clear();
+    delete numa_;
+    numa_ = NULL;
+  }
+
+  // The search is complete, nothing left to resume
+  if (checkpoint_ != NULL) {
+    checkpoint_->Remove();
+    delete checkpoint_;
+    checkpoint_ = NULL;
+  }
 
   return 0;
 }
@@ -303,22 +497,34 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
 void TideSearchApplication::spectrum_search(void *threadarg) {  
   struct thread_data *my_data = (struct thread_data *) threadarg;
 
-  ActivePeptideQueue* active_peptide_queue = my_data->active_peptide_queue_;
   int thread_id = my_data->thread_id_;
+  PeptideReader* peptide_reader = NULL;
+  if (numa_ != NULL) {
+    // Allocate the queue and the workspaces of the thread on its node
+    my_data->active_peptide_queue_ = openPeptideQueue(&peptide_reader, placeThread(thread_id));
+  }
+  ActivePeptideQueue* active_peptide_queue = my_data->active_peptide_queue_;
+
+  SearchProfile::Counters* profile = active_peptide_queue->ProfileCounters();
 
   int input_file_source;
   pb::Spectrum pb_spectrum;  
   while (true){
+    helpScoring(profile, false);
 
     // Get the next spectrum records with the smallest neutral mass from the heap and load the next spectrum records from the input files.
-    locks_array_[LOCK_SPECTRUM_READING]->lock();
+    lockProfiled(LOCK_SPECTRUM_READING, profile, SearchProfile::LOCK_WAIT_SPECTRUM_READING);
+    ScopedPhaseTimer timer(profile, SearchProfile::SPECTRUM_READING);
     if (spectrum_heap_.size() == 0) {
       locks_array_[LOCK_SPECTRUM_READING]->unlock();
-      return;
+      timer.Stop();
+      helpScoring(profile, true);
+      break;
     }
     // access the lightest spectra in the heap
     auto spectrum_pair = spectrum_heap_.front();   
     input_file_source = spectrum_pair.second;
+    unsigned long long sequence = next_sequence_++;
     string spectrum_file_name = inputFiles_[input_file_source].OriginalName;
 
     // remove the lightest spectra from the heap.
@@ -334,6 +540,11 @@ void TideSearchApplication::spectrum_search(void *threadarg) {
     if ( !spectrum_reader_[input_file_source]->OK() ){
       carp(CARP_FATAL, "Spectrum records file %s is corrupt.", spectrum_file_name.c_str());
     }
+    if (checkpoint_ != NULL && checkpoint_->Done(sequence)) {
+      // searched before the interruption of the resumed search
+      locks_array_[LOCK_SPECTRUM_READING]->unlock();
+      continue;
+    }
     ++num_spectra_;
     if (print_interval_ > 0 && num_spectra_ > 0 && num_spectra_ % print_interval_ == 0) {
       carp(CARP_INFO, "%d spectrum-charge combinations searched.", num_spectra_);
@@ -341,98 +552,337 @@ void TideSearchApplication::spectrum_search(void *threadarg) {
 
     pb_spectrum = spectrum_pair.first;
     locks_array_[LOCK_SPECTRUM_READING]->unlock();
-    
-    Spectrum* spectrum = new Spectrum(pb_spectrum); 
-    
-    int charge = spectrum->ChargeState(0);
-    double neutral_mass = pb_spectrum.neutral_mass();
-    SpectrumCollection::SpecCharge* sc = new SpectrumCollection::SpecCharge(neutral_mass, charge, spectrum, 0);
-   
-    // Search one spectrum against its candidate peptides
-
-    double precursor_mz = spectrum->PrecursorMZ();
-    int scan_num = spectrum->SpectrumNumber();
-
-    if (precursor_mz < spectrum_min_mz_|| 
-        precursor_mz > spectrum_max_mz_ || 
-        scan_num < min_scan_ || 
-        scan_num > max_scan_ ||
-        spectrum->Size() < min_peaks_  ||
-        charge < min_precursor_charge_ || 
-        charge >max_precursor_charge_ ) {
-        delete spectrum;
-        delete sc;
-      
-      continue; 
-   }
+    timer.Stop();
 
-    if (spectrum_flag_ != NULL) {  // TODO: Do something, possibly for cascade search
-    }
+    searchSpectrum(pb_spectrum, input_file_source, active_peptide_queue, sequence);
+  }
+  if (numa_ != NULL) {
+    delete active_peptide_queue;
+    delete peptide_reader;
+    my_data->active_peptide_queue_ = NULL;
+  }
+}
 
-    double min_range, max_range;
-    vector<double>* min_mass = new vector<double>();
-    vector<double>* max_mass = new vector<double>();
+void TideSearchApplication::searchSpectrum(const pb::Spectrum& pb_spectrum, int input_file_source, ActivePeptideQueue* active_peptide_queue, unsigned long long sequence) {
+  string spectrum_file_name = inputFiles_[input_file_source].OriginalName;
+  SearchProfile::Counters* profile = active_peptide_queue->ProfileCounters();
+  
+  ScopedPhaseTimer decode_timer(profile, SearchProfile::SPECTRUM_READING);
+  Spectrum* spectrum = new Spectrum(pb_spectrum); 
+  decode_timer.Stop();
+  
+  int charge = spectrum->ChargeState(0);
+  double neutral_mass = pb_spectrum.neutral_mass();
+  SpectrumCollection::SpecCharge* sc = new SpectrumCollection::SpecCharge(neutral_mass, charge, spectrum, 0);
+ 
+  // Search one spectrum against its candidate peptides
+
+  double precursor_mz = spectrum->PrecursorMZ();
+  int scan_num = spectrum->SpectrumNumber();
+
+  if (precursor_mz < spectrum_min_mz_|| 
+      precursor_mz > spectrum_max_mz_ || 
+      scan_num < min_scan_ || 
+      scan_num > max_scan_ ||
+      spectrum->Size() < min_peaks_  ||
+      charge < min_precursor_charge_ || 
+      charge >max_precursor_charge_ ) {
+      delete spectrum;
+      delete sc;
+      setSearched(sequence);
     
-    computeWindow(*sc, min_mass, max_mass, &min_range, &max_range);
-    active_peptide_queue->SetActiveRange(min_mass, max_mass, min_range, max_range);
-    delete min_mass;
-    delete max_mass;
+    return; 
+ }
 
-    if (active_peptide_queue->nCandPeptides_ == 0) { // No peptides to score.
-      delete spectrum;
-      delete sc;  
-      continue; 
-    }
-    long num_range_skipped = 0;
-    long num_precursors_skipped = 0;
-    long num_isotopes_skipped = 0;
-    long num_retained = 0;
-
-    ObservedPeakSet observed(use_neutral_loss_peaks_, use_flanking_peaks_);
-    observed.PreprocessSpectrum(*(sc->spectrum), charge, &num_range_skipped,
-      &num_precursors_skipped,
-      &num_isotopes_skipped, &num_retained);
-
-    locks_array_[LOCK_CANDIDATES]->lock();
-    total_candidate_peptides_ += active_peptide_queue->nCandPeptides_;
-    ++num_spectra_searched_;    
-    num_range_skipped_ += num_range_skipped;
-    num_precursors_skipped_ += num_precursors_skipped;
-    num_isotopes_skipped_ += num_isotopes_skipped;
-    num_retained_ += num_retained;
-    locks_array_[LOCK_CANDIDATES]->unlock();  
+  if (spectrum_flag_ != NULL) {  // TODO: Do something, possibly for cascade search
+  }
+
+  double min_range, max_range;
+  vector<double>* min_mass = new vector<double>();
+  vector<double>* max_mass = new vector<double>();
+  
+  ScopedPhaseTimer active_range_timer(profile, SearchProfile::ACTIVE_RANGE);
+  computeWindow(*sc, min_mass, max_mass, &min_range, &max_range);
+  active_peptide_queue->SetActiveRange(min_mass, max_mass, min_range, max_range);
+  delete min_mass;
+  delete max_mass;
+  active_range_timer.Stop();
+  if (profile != NULL) {
+    profile->AddCandidates(active_peptide_queue->nCandPeptides_);
+    profile->AddQueueSize(active_peptide_queue->queue_.size());
+  }
+
+  if (active_peptide_queue->nCandPeptides_ == 0) { // No peptides to score.
+    delete spectrum;
+    delete sc;  
+    setSearched(sequence);
+    return; 
+  }
+  long num_range_skipped = 0;
+  long num_precursors_skipped = 0;
+  long num_isotopes_skipped = 0;
+  long num_retained = 0;
+
+  ScopedPhaseTimer preprocessing_timer(profile, SearchProfile::PREPROCESSING);
+  ObservedPeakSet observed(use_neutral_loss_peaks_, use_flanking_peaks_);
+  observed.PreprocessSpectrum(*(sc->spectrum), charge, &num_range_skipped,
+    &num_precursors_skipped,
+    &num_isotopes_skipped, &num_retained);
+  preprocessing_timer.Stop();
+
+  lockProfiled(LOCK_CANDIDATES, profile, SearchProfile::LOCK_WAIT_CANDIDATES);
+  total_candidate_peptides_ += active_peptide_queue->nCandPeptides_;
+  ++num_spectra_searched_;    
+  num_range_skipped_ += num_range_skipped;
+  num_precursors_skipped_ += num_precursors_skipped;
+  num_isotopes_skipped_ += num_isotopes_skipped;
+  num_retained_ += num_retained;
+  locks_array_[LOCK_CANDIDATES]->unlock();  
  
-    // allocate PSMscores for N scores
-    TideMatchSet psm_scores(active_peptide_queue, &observed);  //nPeptides_ includes acitve and inacitve peptides
-
-    // Calculate the scores needed
-    switch (curScoreFunction_) {
-      case PVALUES:
-        PValueScoring(sc, active_peptide_queue, psm_scores);
-        //break; // Run standard xcorr scoring in case of combined p-value calculations
-      case XCORR_SCORE:
-        // Spectrum preprocessing for xcorr scoring
-        XCorrScoring(sc->charge, observed, active_peptide_queue, psm_scores);
+  // allocate PSMscores for N scores
+  TideMatchSet psm_scores(active_peptide_queue, &observed);  //nPeptides_ includes acitve and inacitve peptides
+
+  // Calculate the scores needed
+  ScopedPhaseTimer scoring_timer(profile, SearchProfile::SCORING);
+  switch (curScoreFunction_) {
+    case PVALUES:
+      PValueScoring(sc, active_peptide_queue, psm_scores);
+      //break; // Run standard xcorr scoring in case of combined p-value calculations
+    case XCORR_SCORE:
+      // Spectrum preprocessing for xcorr scoring
+      if (curScoreFunction_ == XCORR_SCORE && fragment_index_top_n_ == 0 &&
+          splitXCorrScoring(sc->charge, observed, active_peptide_queue, psm_scores)) {
         break;
-      // case HYPERSCOR: TODO add new scoring functions here
-    } 
-    // Print the top-N results to the output files, 
-    // The delta_cn, delta_lcn, repeat_ion_match, and tailor score calculation happens in PrintResults
-    PrintResults(sc, spectrum_file_name, input_file_source, &psm_scores);
+      }
+      XCorrScoring(sc->charge, observed, active_peptide_queue, psm_scores,
+                   curScoreFunction_ == XCORR_SCORE ? fragment_index_top_n_ : 0);
+      break;
+    case HYPERSCORE:
+      HyperScoring(sc, active_peptide_queue, psm_scores);
+      break;
+  } 
+  scoring_timer.Stop();
+  if (compute_sp_) {
+    ScopedPhaseTimer sp_timer(profile, SearchProfile::ADDITIONAL_SCORES);
+    psm_scores.sp_scorer_ = PrepareSpScorer(sc);
+  }
+  // Print the top-N results to the output files, 
+  // The delta_cn, delta_lcn, repeat_ion_match, and tailor score calculation happens in PrintResults
+  PrintResults(sc, spectrum_file_name, input_file_source, &psm_scores, sequence);
 
-    delete spectrum;
-    delete sc;
+  delete spectrum;
+  delete sc;
+}
+
+// Open a reader on the peptide index and an active peptide queue on it.
+ActivePeptideQueue* TideSearchApplication::openPeptideQueue(PeptideReader** reader, int node) {
+  const ProteinVec& proteins = node_proteins_.empty() ? *proteins_ : node_proteins_[node];
+  vector<const pb::AuxLocation*>* locations = node_locations_.empty() ? locations_ : &node_locations_[node];
+  *reader = openPeptideReader();
+  ActivePeptideQueue* active_peptide_queue = new ActivePeptideQueue(*reader, proteins, locations);
+  if (fragment_index_top_n_ > 0) {
+    active_peptide_queue->EnableFragmentIndex();
+  }
+  if (profile_ != NULL) {
+    active_peptide_queue->SetProfileCounters(profile_->NewCounters());
+  }
+  if (num_shards_ > 1) {
+    active_peptide_queue->SetShard(shard_index_, num_shards_);
+  }
+  return active_peptide_queue;
+}
+
+// Open a reader on the peptides of the index, in whichever encoding it uses.
+PeptideReader* TideSearchApplication::openPeptideReader() {
+  PeptideReader* reader = new PeptideReader(peptides_file_);
+  if (!reader->OK()) {
+    carp(CARP_FATAL, "Error reading index (%s)", peptides_file_.c_str());
+  }
+  return reader;
+}
+
+void TideSearchApplication::replicateIndexData(int node) {
+  numa_->PinToNode(node);
+  ProteinVec& proteins = node_proteins_[node];
+  proteins.reserve(proteins_->size());
+  for (ProteinVec::const_iterator i = proteins_->begin(); i != proteins_->end(); ++i) {
+    proteins.push_back(new pb::Protein(**i));
+  }
+  vector<const pb::AuxLocation*>& locations = node_locations_[node];
+  locations.reserve(locations_->size());
+  for (vector<const pb::AuxLocation*>::const_iterator i = locations_->begin(); i != locations_->end(); ++i) {
+    locations.push_back(new pb::AuxLocation(**i));
+  }
+}
+
+int TideSearchApplication::placeThread(int thread_id) {
+  numa_->PinThread(thread_id);
+  return node_proteins_.empty() ? 0 : numa_->NodeOfThread(thread_id);
+}
+
+void TideSearchApplication::setSearched(unsigned long long sequence) {
+  if (out_shard_stats_ != NULL) {
+    // an empty entry lets the spectra after it be written
+    locks_array_[LOCK_RESULTS]->lock();
+    pending_results_[sequence];
+    writePendingResults();
+    locks_array_[LOCK_RESULTS]->unlock();
+  } else if (checkpoint_ != NULL) {
+    locks_array_[LOCK_RESULTS]->lock();
+    checkpoint_->SetDone(sequence);
+    locks_array_[LOCK_RESULTS]->unlock();
+  }
+}
+
+string TideSearchApplication::checkpointFingerprint(const vector<string>& input_files, const string& input_index) const {
+  // The inputs and every parameter that may change the results
+  stringstream text;
+  text << FileUtils::AbsPath(input_index) << '\n';
+  for (vector<string>::const_iterator i = input_files.begin(); i != input_files.end(); ++i) {
+    text << FileUtils::AbsPath(*i) << ' ' << FileUtils::Size(*i) << '\n';
+  }
+  stringstream params;
+  Params::Write(&params, false);
+  string line;
+  while (getline(params, line)) {
+    if (line.empty() || line[0] == '#' ||
+        line.compare(0, 7, "resume=") == 0 ||
+        line.compare(0, 12, "num-threads=") == 0 ||
+        line.compare(0, 15, "numa-placement=") == 0 ||
+        line.compare(0, 17, "split-candidates=") == 0 ||
+        line.compare(0, 10, "overwrite=") == 0 ||
+        line.compare(0, 10, "verbosity=") == 0 ||
+        line.compare(0, 22, "print-search-progress=") == 0 ||
+        line.compare(0, 15, "profile-output=") == 0) {
+      continue;
+    }
+    text << line << '\n';
+  }
+  return SearchCheckpoint::Hash(text.str());
+}
+
+void TideSearchApplication::lockProfiled(int lock, SearchProfile::Counters* counters, SearchProfile::Phase phase) {
+  ScopedPhaseTimer timer(counters, phase);
+  locks_array_[lock]->lock();
+}
+
+// Each thread takes the next spectrum of the first converted file that has
+// spectra left, or converts the next file if there is none. Threads only
+// wait at the end, for the last conversions to finish. A thread keeps its
+// queue for the whole search and rewinds it when it moves to another file.
+void TideSearchApplication::pipeline_search(int thread_id) {
+  int node = numa_ != NULL ? placeThread(thread_id) : 0;
+  PeptideReader* peptide_reader;
+  ActivePeptideQueue* active_peptide_queue = openPeptideQueue(&peptide_reader, node);
+  SearchProfile::Counters* profile = active_peptide_queue->ProfileCounters();
+
+  int current_file = -1;
+  pb::Spectrum pb_spectrum;
+  while (true) {
+    int input_file_source = -1;
+    bool convert = false;
+    {
+      boost::mutex::scoped_lock lock(pipeline_mutex_);
+      while (converted_files_.empty() && next_file_to_convert_ >= inputFiles_.size() &&
+             files_converting_ > 0) {
+        pipeline_cond_.wait(lock);
+      }
+      if (!converted_files_.empty()) {
+        ScopedPhaseTimer timer(profile, SearchProfile::SPECTRUM_READING);
+        input_file_source = converted_files_.front().first;
+        HeadedRecordReader* spectrum_reader = converted_files_.front().second;
+        if (spectrum_reader->Done()) {
+          delete spectrum_reader;
+          converted_files_.pop_front();
+          continue;
+        }
+        spectrum_reader->Read(&pb_spectrum);
+        if (!spectrum_reader->OK()) {
+          carp(CARP_FATAL, "Spectrum records file %s is corrupt.",
+               inputFiles_[input_file_source].SpectrumRecords.c_str());
+        }
+        ++num_spectra_;
+        if (print_interval_ > 0 && num_spectra_ > 0 && num_spectra_ % print_interval_ == 0) {
+          carp(CARP_INFO, "%d spectrum-charge combinations searched.", num_spectra_);
+        }
+      } else if (next_file_to_convert_ < inputFiles_.size()) {
+        input_file_source = next_file_to_convert_++;
+        ++files_converting_;
+        convert = true;
+      } else {
+        lock.unlock();
+        helpScoring(profile, true);
+        break;
+      }
+    }
+    if (convert) {
+      convertInputFile(inputFiles_[input_file_source], 1);
+      HeadedRecordReader* spectrum_reader = new HeadedRecordReader(inputFiles_[input_file_source].SpectrumRecords);
+      boost::mutex::scoped_lock lock(pipeline_mutex_);
+      --files_converting_;
+      converted_files_.push_back(make_pair(input_file_source, spectrum_reader));
+      pipeline_cond_.notify_all();
+      continue;
+    }
+    if (input_file_source != current_file) {
+      // the spectra of the file start again from the lightest
+      active_peptide_queue->Rewind();
+      current_file = input_file_source;
+    }
+    helpScoring(profile, false);
+    searchSpectrum(pb_spectrum, input_file_source, active_peptide_queue);
   }
+
+  delete active_peptide_queue;
+  delete peptide_reader;
 }
 
-void TideSearchApplication::XCorrScoring(int charge, ObservedPeakSet& observed, ActivePeptideQueue* active_peptide_queue, TideMatchSet& psm_scores){
+void TideSearchApplication::XCorrScoring(int charge, ObservedPeakSet& observed, ActivePeptideQueue* active_peptide_queue, TideMatchSet& psm_scores, int fragment_top_n){
 
   // Score the inactive peptides in the peptide queue if the number of nCadPeptides 
   // is less than the minimum. This is needed for Tailor scoring to get enough PSMS scores for statistics
   bool score_inactive_peptides = true;
   if (active_peptide_queue->min_candidates_ < active_peptide_queue->nCandPeptides_)
     score_inactive_peptides = false;
-  
+
+  FragmentIndex* fragment_index = active_peptide_queue->GetFragmentIndex();
+  if (fragment_top_n > 0 && fragment_index != NULL && 
+      active_peptide_queue->nCandPeptides_ > fragment_top_n) {
+    // Count the fragments each candidate shares with the spectrum through the
+    // fragment-ion index and compute the XCorr of the top-N candidates only.
+    int first = active_peptide_queue->begin_ - active_peptide_queue->queue_.begin();
+    int last = active_peptide_queue->end_ - active_peptide_queue->queue_.begin();
+    vector<int> shared_peaks;
+    fragment_index->CountSharedPeaks(observed.GetCache(), observed.getCacheEnd(),
+                                     first, last, charge > 2, &shared_peaks);
+    vector<pair<int, int> > candidates;  // (shared peaks, ordinal)
+    candidates.reserve(active_peptide_queue->nCandPeptides_);
+    int cnt = 0;
+    for (deque<Peptide*>::const_iterator iter = active_peptide_queue->begin_; 
+      iter != active_peptide_queue->end_;
+      ++iter, ++cnt) {
+      if ((*iter)->active_ == true || score_inactive_peptides == true) 
+        candidates.push_back(make_pair(shared_peaks[cnt], cnt));
+    }
+    if (candidates.size() > (size_t)fragment_top_n) {
+      nth_element(candidates.begin(), candidates.begin() + fragment_top_n, candidates.end(), 
+                  greater<pair<int, int> >());
+      candidates.resize(fragment_top_n);
+    }
+    for (vector<pair<int, int> >::const_iterator i = candidates.begin(); i != candidates.end(); ++i) {
+      XCorrScorePeptide(charge, observed, active_peptide_queue->begin_ + i->second, i->second, psm_scores);
+    }
+    // Keep only the scored candidates, so that the others are neither
+    // reported nor counted in the Tailor quantile
+    TideMatchSet::PSMScores scored;
+    scored.reserve(candidates.size());
+    for (vector<pair<int, int> >::const_iterator i = candidates.begin(); i != candidates.end(); ++i) {
+      scored.push_back(psm_scores.psm_scores_[i->second]);
+    }
+    psm_scores.psm_scores_.swap(scored);
+    return;
+  }
+
   //Actual Xcorr Scoring        
   int cnt = 0;
   for (deque<Peptide*>::const_iterator iter = active_peptide_queue->begin_; 
@@ -440,28 +890,156 @@ void TideSearchApplication::XCorrScoring(int charge, ObservedPeakSet& observed,
     ++iter, ++cnt) {
     if ((*iter)->active_ == false && score_inactive_peptides == false) 
       continue;
-    int xcorr = 0;
-    int match_cnt = 0;
-    int temp = 0;
-    // int repeat_ion_match = 0;
-  
-    // Score with single charged b-y ion theoretical peaks
-    xcorr += PeakMatching(observed, (*iter)->peaks_0, match_cnt, temp);
+    XCorrScorePeptide(charge, observed, iter, cnt, psm_scores);
+  } 
+}
 
-    if (charge > 2){
-      // Score with double charged b-y ion theoretical peaks
-      xcorr += PeakMatching(observed, (*iter)->peaks_1, match_cnt, temp);      
+bool TideSearchApplication::splitXCorrScoring(int charge, ObservedPeakSet& observed, ActivePeptideQueue* active_peptide_queue, TideMatchSet& psm_scores) {
+  int size = active_peptide_queue->end_ - active_peptide_queue->begin_;
+  if (split_candidates_ == 0 || size < split_candidates_) {
+    return false;
+  }
+  // Parts of at least half split-candidates, at most one per thread
+  int num_parts = min(num_threads_, 2 * size / split_candidates_);
+  int parts_left = num_parts;
+  ScoringPart part;
+  part.charge_ = charge;
+  part.observed_ = &observed;
+  part.active_peptide_queue_ = active_peptide_queue;
+  part.psm_scores_ = &psm_scores;
+  part.score_inactive_peptides_ = active_peptide_queue->min_candidates_ >= active_peptide_queue->nCandPeptides_;
+  part.parts_left_ = &parts_left;
+
+  // The scoring time of the calling thread is counted by searchSpectrum
+  SearchProfile::Counters* profile = NULL;
+  boost::mutex::scoped_lock lock(split_mutex_);
+  ++num_split_spectra_;
+  for (int i = 1; i < num_parts; ++i) {
+    part.first_ = (long)size * i / num_parts;
+    part.last_ = (long)size * (i + 1) / num_parts;
+    scoring_parts_.push_back(part);
+  }
+  split_cond_.notify_all();
+  part.first_ = 0;
+  part.last_ = size / num_parts;
+  scorePart(part, lock, profile);
+
+  // Score the parts that were not taken, which may include those of other
+  // spectra, then wait for the rest
+  while (parts_left > 0) {
+    if (!scoring_parts_.empty()) {
+      ScoringPart next = scoring_parts_.front();
+      scoring_parts_.pop_front();
+      scorePart(next, lock, profile);
+    } else {
+      split_cond_.wait(lock);
     }
+  }
+  return true;
+}
+
+void TideSearchApplication::helpScoring(SearchProfile::Counters* profile, bool wait) {
+  if (split_candidates_ == 0) {
+    return;
+  }
+  boost::mutex::scoped_lock lock(split_mutex_);
+  if (wait) {
+    --searching_threads_;
+    split_cond_.notify_all();
+  }
+  while (true) {
+    if (!scoring_parts_.empty()) {
+      ScoringPart part = scoring_parts_.front();
+      scoring_parts_.pop_front();
+      scorePart(part, lock, profile);
+    } else if (wait && searching_threads_ > 0) {
+      split_cond_.wait(lock);
+    } else {
+      return;
+    }
+  }
+}
+
+void TideSearchApplication::scorePart(const ScoringPart& part, boost::mutex::scoped_lock& lock, SearchProfile::Counters* profile) {
+  lock.unlock();
+  ScopedPhaseTimer timer(profile, SearchProfile::SCORING);
+  deque<Peptide*>::const_iterator iter = part.active_peptide_queue_->begin_ + part.first_;
+  for (int cnt = part.first_; cnt < part.last_; ++iter, ++cnt) {
+    if ((*iter)->active_ == false && part.score_inactive_peptides_ == false)
+      continue;
+    XCorrScorePeptide(part.charge_, *part.observed_, iter, cnt, *part.psm_scores_);
+  }
+  timer.Stop();
+  lock.lock();
+  if (--*part.parts_left_ == 0) {
+    split_cond_.notify_all();
+  }
+}
+
+void TideSearchApplication::XCorrScorePeptide(int charge, ObservedPeakSet& observed, deque<Peptide*>::const_iterator iter, int cnt, TideMatchSet& psm_scores) {
+  int xcorr = 0;
+  int match_cnt = 0;
+  int temp = 0;
+  // int repeat_ion_match = 0;
+
+  // Score with single charged b-y ion theoretical peaks
+  xcorr += PeakMatching(observed, (*iter)->peaks_0, match_cnt, temp);
+
+  if (charge > 2){
+    // Score with double charged b-y ion theoretical peaks
+    xcorr += PeakMatching(observed, (*iter)->peaks_1, match_cnt, temp);      
+  }
+  psm_scores.psm_scores_[cnt].peptide_itr_ = iter;
+  psm_scores.psm_scores_[cnt].ordinal_ = cnt;    
+  psm_scores.psm_scores_[cnt].xcorr_score_ = (double)xcorr/XCORR_SCALING;
+  psm_scores.psm_scores_[cnt].by_ion_matched_ = match_cnt;
+  psm_scores.psm_scores_[cnt].active_ = (*iter)->active_;
+  psm_scores.psm_scores_[cnt].by_ion_total_ = (*iter)->peaks_0.size();
+  if (charge > 2){
+    psm_scores.psm_scores_[cnt].by_ion_total_ += (*iter)->peaks_1.size();
+  }
+}
+
+void TideSearchApplication::HyperScoring(const SpectrumCollection::SpecCharge* sc, ActivePeptideQueue* active_peptide_queue, TideMatchSet& psm_scores) {
+  HyperScorer* scorer = hyper_scorer_.get();
+  if (scorer == NULL) {
+    scorer = new HyperScorer();
+    hyper_scorer_.reset(scorer);
+  }
+  bool score_inactive_peptides = true;
+  if (active_peptide_queue->min_candidates_ < active_peptide_queue->nCandPeptides_)
+    score_inactive_peptides = false;
+
+  scorer->Prepare(*(sc->spectrum), sc->charge);
+  scorer->ScoreCandidates(active_peptide_queue->begin_, active_peptide_queue->end_,
+                          sc->charge > 2, score_inactive_peptides);
+
+  int cnt = 0;
+  for (deque<Peptide*>::const_iterator iter = active_peptide_queue->begin_; 
+    iter != active_peptide_queue->end_;
+    ++iter, ++cnt) {
+    if ((*iter)->active_ == false && score_inactive_peptides == false) 
+      continue;
     psm_scores.psm_scores_[cnt].peptide_itr_ = iter;
     psm_scores.psm_scores_[cnt].ordinal_ = cnt;    
-    psm_scores.psm_scores_[cnt].xcorr_score_ = (double)xcorr/XCORR_SCALING;
-    psm_scores.psm_scores_[cnt].by_ion_matched_ = match_cnt;
+    psm_scores.psm_scores_[cnt].hyper_score_ = scorer->Score(cnt);
+    psm_scores.psm_scores_[cnt].by_ion_matched_ = scorer->BMatched(cnt) + scorer->YMatched(cnt);
     psm_scores.psm_scores_[cnt].active_ = (*iter)->active_;
-    psm_scores.psm_scores_[cnt].by_ion_total_ = (*iter)->peaks_0.size();
-    if (charge > 2){
-      psm_scores.psm_scores_[cnt].by_ion_total_ += (*iter)->peaks_1.size();
+    psm_scores.psm_scores_[cnt].by_ion_total_ = (*iter)->peaks_1b.size() + (*iter)->peaks_1y.size();
+    if (sc->charge > 2){
+      psm_scores.psm_scores_[cnt].by_ion_total_ += (*iter)->peaks_2b.size() + (*iter)->peaks_2y.size();
     }
-  } 
+  }
+}
+
+SpScorer* TideSearchApplication::PrepareSpScorer(const SpectrumCollection::SpecCharge* sc) {
+  SpScorer* scorer = sp_scorer_.get();
+  if (scorer == NULL) {
+    scorer = new SpScorer();
+    sp_scorer_.reset(scorer);
+  }
+  scorer->Prepare(*(sc->spectrum), sc->charge, SpScorer::MaxMz(*(sc->spectrum), sc->charge));
+  return scorer;
 }
 
 int TideSearchApplication::PeakMatching(ObservedPeakSet& observed, vector<unsigned int>& peak_list, int& matching_peaks, int& repeat_matching_peaks) {
@@ -1191,21 +1769,33 @@ vector<int> TideSearchApplication::getNegativeIsotopeErrors() {
 }
 
 
-void TideSearchApplication::getPeptideIndexData(const string input_index, ProteinVec& proteins, vector<const pb::AuxLocation*>& locations, pb::Header& peptides_header){
-
+void TideSearchApplication::readIndexData(const string& input_index, IndexData* index_data) {
   string peptides_file = FileUtils::Join(input_index, "pepix");  
   string proteins_file = FileUtils::Join(input_index, "protix");
   string auxlocs_file = FileUtils::Join(input_index, "auxlocs");  
-  string residue_stats_file = FileUtils::Join(input_index, "residue_stat");  
 
   // Read protein index file
   carp(CARP_INFO, "Reading index %s", input_index.c_str());
 
-  pb::Header protein_header;
-
-  if (!ReadRecordsToVector<pb::Protein, const pb::Protein>(&proteins, proteins_file, &protein_header)) {
+  if (!ReadRecordsToVector<pb::Protein, const pb::Protein>(&index_data->proteins_, proteins_file, &index_data->protein_header_)) {
     carp(CARP_FATAL, "Error reading index (%s)", proteins_file.c_str());
   }
+
+  // Read auxlocs index file
+  ReadRecordsToVector<pb::AuxLocation>(&index_data->locations_, auxlocs_file);
+
+  HeadedRecordReader peptide_reader(peptides_file, &index_data->peptides_header_);
+  index_data->index_ = input_index;
+}
+
+void TideSearchApplication::getPeptideIndexData(const string input_index, IndexData& index_data){
+  const ProteinVec& proteins = index_data.proteins_;
+  const pb::Header& protein_header = index_data.protein_header_;
+  pb::Header& peptides_header = index_data.peptides_header_;
+
+  string peptides_file = FileUtils::Join(input_index, "pepix");  
+  string residue_stats_file = FileUtils::Join(input_index, "residue_stat");  
+
   // There shouldn't be more than one header in the protein pb.
   pb::Header_Source headerSource = protein_header.source(0);  
   string decoy_prefix = "";
@@ -1220,9 +1810,6 @@ void TideSearchApplication::getPeptideIndexData(const string input_index, Protei
   if (headerSource.has_filename()){
     TideMatchSet::fasta_file_name_ = headerSource.filename();
   }
-  
-  // Read auxlocs index file
-  ReadRecordsToVector<pb::AuxLocation>(&locations, auxlocs_file);
 
   // Read peptides index file
 
@@ -1296,8 +1883,11 @@ void TideSearchApplication::getPeptideIndexData(const string input_index, Protei
       memset(nvAAMassCounterI, 0, MaxModifiedAAMassBin * sizeof(unsigned int));
 
       pb::Peptide current_pb_peptide_;
-      HeadedRecordReader peptide_reader = HeadedRecordReader(peptides_file, &peptides_header);
-      while (!(peptide_reader.Done())) { //read all peptides form index
+      PeptideReader peptide_reader(peptides_file);
+      if (!peptide_reader.OK()) {
+        carp(CARP_FATAL, "Error reading index (%s)", peptides_file.c_str());
+      }
+      while (!peptide_reader.Done()) { //read all peptides form index
         peptide_reader.Read(&current_pb_peptide_);
         Peptide peptide(current_pb_peptide_, proteins);
         vector<double> residue_masses = peptide.getAAMasses(); //retrieves the amino acid masses, modifications included
@@ -1401,10 +1991,13 @@ vector<string> TideSearchApplication::getOptions() const {
   string arr[] = {
     "auto-mz-bin-width",
     "auto-precursor-window",
+    "checkpoint-interval",
+    "compute-sp",
     "concat",
     "deisotope",
     "elution-window-size",
     "fileroot",
+    "fragment-index-top-n",
     "fragment-tolerance",
     "isotope-error",
     "mass-precision",
@@ -1416,13 +2009,16 @@ vector<string> TideSearchApplication::getOptions() const {
     "mz-bin-width",
     "mzid-output",
     "mztab-output",
+    "num-shards",
     "num-threads",
+    "numa-placement",
     "output-dir",
     "override-charges",
     "overwrite",
     "parameter-file",
     "pepxml-output",
     "pin-output",
+    "pipeline-search",
     "pm-charges",
     "pm-max-frag-mz",
     "pm-max-precursor-delta-ppm",
@@ -1439,17 +2035,25 @@ vector<string> TideSearchApplication::getOptions() const {
     "precursor-window",
     "precursor-window-type",
     "print-search-progress",
+    "profile-output",
     "remove-precursor-peak",
     "remove-precursor-tolerance",
+    "resume",
     "scan-number",
     "score-function",
+    "shard-index",
     "skip-preprocessing",
+    "spectrum-cache-dir",
+    "spectrum-cache-size",
     "spectrum-max-mz",
+    "spectrum-memory-limit",
     "spectrum-min-mz",
     "spectrum-parser",
+    "split-candidates",
     "sqt-output",
     "store-index",
     "store-spectra",
+    "temp-dir",
     "top-match",
     "txt-output",
     "use-flanking-peaks",
@@ -1635,45 +2239,71 @@ void TideSearchApplication::getInputFiles(int thread_id) {
   // Try to read all spectrum files as spectrumrecords, convert those that fail
   if (thread_id > inputFiles_.size())
     return;
+  // Threads left over when there are fewer files than threads help
+  // decode the spectra within each file.
+  int decode_threads = max(1, num_threads_ / (int)inputFiles_.size());
   for (vector<TideSearchApplication::InputFile>::iterator original_file_name = inputFiles_.begin()+thread_id; 
        original_file_name < inputFiles_.begin() + (inputFiles_.size()); 
        original_file_name = original_file_name + num_threads_) 
     {
-    carp(CARP_DEBUG, "Start processing input files");
-    bool keepSpectrumrecords = true;
-    string original_name = (*original_file_name).OriginalName;
-    string spectrumrecords = original_name;
-    // Check if the input file is spectrum records of google protocol buffer
-    pb::Header header;
-    HeadedRecordReader reader(original_name, &header);
-    if (header.file_type() != pb::Header::SPECTRA) {
-      // converting to spectrumrecords file 
-
-      carp(CARP_INFO, "Converting %s to spectrumrecords format", original_name.c_str());
-      carp(CARP_DEBUG, "Elapsed time starting conversion: %.3g s", wall_clock() / 1e6);
-      
-      spectrumrecords = Params::GetString("store-spectra");
-      keepSpectrumrecords = !spectrumrecords.empty();
+    convertInputFile(*original_file_name, decode_threads);
+  }
+}
+
+void TideSearchApplication::convertInputFile(InputFile& input_file, int decode_threads) {
+  carp(CARP_DEBUG, "Start processing input files");
+  int file = &input_file - &inputFiles_[0];
+  if (checkpoint_ != NULL &&
+      checkpoint_->GetSpectrumRecords(file, &input_file.SpectrumRecords, &input_file.Keep)) {
+    carp(CARP_INFO, "Reusing %s from the interrupted search", input_file.SpectrumRecords.c_str());
+    return;
+  }
+  bool keepSpectrumrecords = true;
+  string original_name = input_file.OriginalName;
+  string spectrumrecords = original_name;
+  // Check if the input file is spectrum records of google protocol buffer
+  pb::Header header;
+  HeadedRecordReader reader(original_name, &header);
+  if (header.file_type() != pb::Header::SPECTRA) {
+    // converting to spectrumrecords file 
+
+    carp(CARP_INFO, "Converting %s to spectrumrecords format", original_name.c_str());
+    carp(CARP_DEBUG, "Elapsed time starting conversion: %.3g s", wall_clock() / 1e6);
+    
+    int spectra_num = 0;
+    spectrumrecords = Params::GetString("store-spectra");
+    keepSpectrumrecords = !spectrumrecords.empty();
+    if (!keepSpectrumrecords && !Params::GetString("spectrum-cache-dir").empty()) {
+      // Converted files in the cache outlive this run, so keep them.
+      keepSpectrumrecords = true;
+      if (!SpectrumRecordCache::convert(original_name, spectrumrecords, spectra_num,
+                                        2, false, decode_threads)) {
+        carp(CARP_FATAL, "Error converting %s to spectrumrecords format", original_name.c_str());
+      }
+    } else {
       if (!keepSpectrumrecords) {
-        spectrumrecords = make_file_path(FileUtils::BaseName( original_name) + ".spectrumrecords.tmp");
+        spectrumrecords = make_file_path(FileUtils::BaseName( original_name) + ".spectrumrecords.tmp", output_dir_);
       } else if (inputFiles_.size() > 1) {
         carp(CARP_FATAL, "Cannot use store-spectra option with multiple input "
                          "spectrum files");
       }
       carp(CARP_DEBUG, "New spectrumrecords filename: %s", spectrumrecords.c_str());
-      int spectra_num = 0;
-      if (!SpectrumRecordWriter::convert(original_name, spectrumrecords, spectra_num)) {
+      if (!SpectrumRecordWriter::convert(original_name, spectrumrecords, spectra_num,
+                                         2, false, decode_threads)) {
         carp(CARP_FATAL, "Error converting %s to spectrumrecords format", original_name.c_str());
       }
-      locks_array_[LOCK_SPECTRUM_READING]->lock();
-      total_spectra_num_ += spectra_num;
-      locks_array_[LOCK_SPECTRUM_READING]->unlock();
-
     }
-    (*original_file_name).SpectrumRecords  = spectrumrecords;
-    (*original_file_name).Keep = keepSpectrumrecords;
-    carp(CARP_DEBUG, "Finish converting");
+    locks_array_[LOCK_SPECTRUM_READING]->lock();
+    total_spectra_num_ += spectra_num;
+    locks_array_[LOCK_SPECTRUM_READING]->unlock();
+
+  }
+  input_file.SpectrumRecords  = spectrumrecords;
+  input_file.Keep = keepSpectrumrecords;
+  if (checkpoint_ != NULL) {
+    checkpoint_->SetSpectrumRecords(file, spectrumrecords, keepSpectrumrecords);
   }
+  carp(CARP_DEBUG, "Finish converting");
 }
 
 void TideSearchApplication::createOutputFiles() {
@@ -1682,17 +2312,19 @@ void TideSearchApplication::createOutputFiles() {
    
   bool overwrite = Params::GetBool("overwrite");  
   bool concat = Params::GetBool("concat");
+  // The outputs of a resumed search are appended to
+  bool resuming = checkpoint_ != NULL && checkpoint_->Resuming();
 
   string concat_file_name;
   string target_file_name;
   string decoy_file_name;
 
   // Get output files for tsv format
-  concat_file_name = make_file_path("tide-search.txt");
-  target_file_name = make_file_path("tide-search.target.txt");
-  decoy_file_name  = make_file_path("tide-search.decoy.txt");
+  concat_file_name = make_file_path("tide-search.txt", output_dir_);
+  target_file_name = make_file_path("tide-search.target.txt", output_dir_);
+  decoy_file_name  = make_file_path("tide-search.decoy.txt", output_dir_);
 
-  if (overwrite) {
+  if (overwrite && !resuming) {
     remove(concat_file_name.c_str());  
     remove(target_file_name.c_str());  
     remove(decoy_file_name.c_str());  
@@ -1703,28 +2335,25 @@ void TideSearchApplication::createOutputFiles() {
 
     if (concat) {
 
-      out_tsv_target_ = create_stream_in_path(concat_file_name.c_str(), NULL, overwrite);
+      out_tsv_target_ = openOutputFile(concat_file_name, overwrite, header);
       output_file_name_ = concat_file_name;
-      *out_tsv_target_ << header; 
 
     } else {
 
-      out_tsv_target_ = create_stream_in_path(target_file_name.c_str(), NULL, overwrite);
+      out_tsv_target_ = openOutputFile(target_file_name, overwrite, header);
       output_file_name_ = target_file_name;
-      *out_tsv_target_ << header; 
       if (decoy_num_ > 0) {
-        out_tsv_decoy_ = create_stream_in_path(decoy_file_name.c_str(), NULL, overwrite);
-        *out_tsv_decoy_ << header;
+        out_tsv_decoy_ = openOutputFile(decoy_file_name, overwrite, header);
       }
     }  
   }
 
   // Get output files for mzTAB format
-  concat_file_name = make_file_path("tide-search.mzTab");
-  target_file_name = make_file_path("tide-search.target.mzTab");
-  decoy_file_name  = make_file_path("tide-search.decoy.mzTab");
+  concat_file_name = make_file_path("tide-search.mzTab", output_dir_);
+  target_file_name = make_file_path("tide-search.target.mzTab", output_dir_);
+  decoy_file_name  = make_file_path("tide-search.decoy.mzTab", output_dir_);
 
-  if (overwrite) {
+  if (overwrite && !resuming) {
     remove(concat_file_name.c_str());  
     remove(target_file_name.c_str());  
     remove(decoy_file_name.c_str());  
@@ -1736,29 +2365,62 @@ void TideSearchApplication::createOutputFiles() {
     string header = TideMatchSet::getHeader(TIDE_SEARCH_MZTAB_TSV, tide_index_mzTab_file_path_);  // Gets the column headers
     if (concat) {
 
-      out_mztab_target_ = create_stream_in_path(concat_file_name.c_str(), NULL, overwrite);
+      out_mztab_target_ = openOutputFile(concat_file_name, overwrite, header);
       output_file_name_ = concat_file_name;
-      *out_mztab_target_ << header; 
 
     } else {
 
-      out_mztab_target_ = create_stream_in_path(target_file_name.c_str(), NULL, overwrite);
+      out_mztab_target_ = openOutputFile(target_file_name, overwrite, header);
       output_file_name_ = target_file_name;
-      *out_mztab_target_ << header; 
 
       if (decoy_num_ > 0) {
-        out_mztab_decoy_ = create_stream_in_path(decoy_file_name.c_str(), NULL, overwrite);
-        *out_mztab_decoy_ << header;
+        out_mztab_decoy_ = openOutputFile(decoy_file_name, overwrite, header);
       }
     }  
   }
 
+  if (num_shards_ > 1) {
+    string stats_file_name = make_file_path("tide-search.shard-stats.txt", output_dir_);
+    if (overwrite && !resuming) {
+      remove(stats_file_name.c_str());
+    }
+    string header = string("sequence\t") + get_column_header(FILE_COL) + '\t' +
+      get_column_header(SCAN_COL) + '\t' + get_column_header(CHARGE_COL) + '\t' +
+      get_column_header(SPECTRUM_NEUTRAL_MASS_COL) +
+      "\tpsms\ttop xcorr scores\ttarget psm scores\tdecoy psm scores\n";
+    out_shard_stats_ = openOutputFile(stats_file_name, overwrite, header);
+  }
+}
+
+ofstream* TideSearchApplication::openOutputFile(const string& file_name, bool overwrite, const string& header) {
+  ofstream* stream;
+  unsigned long long length;
+  if (checkpoint_ != NULL && checkpoint_->OutputLength(file_name, &length)) {
+    // Drop the results written after the last checkpoint
+    if (FileUtils::Size(file_name) < length) {
+      carp(CARP_FATAL, "%s is shorter than in the checkpoint; the search cannot be resumed.",
+           file_name.c_str());
+    }
+    FileUtils::Resize(file_name, length);
+    stream = new ofstream(file_name.c_str(), ios::out | ios::in);
+    stream->seekp(0, ios::end);
+    if (!stream->good()) {
+      carp(CARP_FATAL, "Could not reopen %s.", file_name.c_str());
+    }
+  } else {
+    stream = create_stream_in_path(file_name.c_str(), NULL, overwrite);
+    *stream << header;
+  }
+  if (checkpoint_ != NULL) {
+    checkpoint_->AddOutput(file_name, stream);
+  }
+  return stream;
 }
 
 void TideSearchApplication::convertResults() const {
   PSMConvertApplication converter;
   if (!Params::GetBool("concat")) {
-    string target_file_name = make_file_path("tide-search.target.txt");
+    string target_file_name = make_file_path("tide-search.target.txt", output_dir_);
     if (Params::GetBool("pin-output")) {
       converter.convertFile("tsv", "pin", target_file_name, "tide-search.target.", Params::GetString("protein-database"), true);
     }
@@ -1773,7 +2435,7 @@ void TideSearchApplication::convertResults() const {
     }
 
     if (decoy_num_>0) {
-      string decoy_file_name = make_file_path("tide-search.decoy.txt");
+      string decoy_file_name = make_file_path("tide-search.decoy.txt", output_dir_);
       if (Params::GetBool("pin-output")) {
         converter.convertFile("tsv", "pin", decoy_file_name, "tide-search.decoy.", Params::GetString("protein-database"), true);
       }
@@ -1788,7 +2450,7 @@ void TideSearchApplication::convertResults() const {
       }
     }
   } else {
-    string concat_file_name = make_file_path("tide-search.txt");
+    string concat_file_name = make_file_path("tide-search.txt", output_dir_);
     if (Params::GetBool("pin-output")) {
       converter.convertFile("tsv", "pin", concat_file_name, "tide-search.", Params::GetString("protein-database"), true);
     }
@@ -1804,35 +2466,75 @@ void TideSearchApplication::convertResults() const {
   }
 }
 
-void TideSearchApplication::PrintResults(const SpectrumCollection::SpecCharge* sc, string spectrum_file_name, int spectrum_file_cnt, TideMatchSet* psm_scores) {
+void TideSearchApplication::PrintResults(const SpectrumCollection::SpecCharge* sc, string spectrum_file_name, int spectrum_file_cnt, TideMatchSet* psm_scores, unsigned long long sequence) {
+  string mztab_concat_or_target_report;
+  string mztab_decoy_report;
   string concat_or_target_report;
   string decoy_report;
+  SearchProfile::Counters* profile = psm_scores->active_peptide_queue_->ProfileCounters();
 
   if (out_mztab_target_ != NULL) {
-    psm_scores->getReport(TIDE_SEARCH_MZTAB_TSV, spectrum_file_name, sc, spectrum_file_cnt, concat_or_target_report, decoy_report); 
-    locks_array_[LOCK_RESULTS]->lock();
-    *out_mztab_target_ << concat_or_target_report;
+    psm_scores->getReport(TIDE_SEARCH_MZTAB_TSV, spectrum_file_name, sc, spectrum_file_cnt, mztab_concat_or_target_report, mztab_decoy_report); 
+  }
+  if ( out_tsv_target_ != NULL) {
+    psm_scores->getReport(TIDE_SEARCH_TSV, spectrum_file_name, sc, spectrum_file_cnt, concat_or_target_report, decoy_report); 
+  }
+  if (out_shard_stats_ != NULL) {
+    // A shard writes the spectra in order, once all earlier ones are written
+    PendingResults results;
+    results.target_.swap(concat_or_target_report);
+    results.decoy_.swap(decoy_report);
+    results.stats_ = psm_scores->getShardStats(spectrum_file_name, sc, sequence);
+    lockProfiled(LOCK_RESULTS, profile, SearchProfile::LOCK_WAIT_RESULTS);
+    pending_results_[sequence].swap(results);
+    writePendingResults();
     locks_array_[LOCK_RESULTS]->unlock();
+    return;
+  }
 
+  // All results of the spectrum are written at once, so a checkpoint never
+  // sees part of them.
+  lockProfiled(LOCK_RESULTS, profile, SearchProfile::LOCK_WAIT_RESULTS);
+  if (out_mztab_target_ != NULL) {
+    *out_mztab_target_ << mztab_concat_or_target_report;
     if (out_mztab_decoy_ != NULL) {
-      locks_array_[LOCK_RESULTS]->lock();
-      *out_mztab_decoy_ << decoy_report;
-      locks_array_[LOCK_RESULTS]->unlock();
+      *out_mztab_decoy_ << mztab_decoy_report;
     }
   }
-
   if ( out_tsv_target_ != NULL) {
-    psm_scores->getReport(TIDE_SEARCH_TSV, spectrum_file_name, sc, spectrum_file_cnt, concat_or_target_report, decoy_report); 
-    locks_array_[LOCK_RESULTS]->lock();
     *out_tsv_target_ << concat_or_target_report;
-    locks_array_[LOCK_RESULTS]->unlock();
-    
     if (out_tsv_decoy_ != NULL) {
-      locks_array_[LOCK_RESULTS]->lock();
       *out_tsv_decoy_ << decoy_report;
-      locks_array_[LOCK_RESULTS]->unlock();
     }
   }
+  if (checkpoint_ != NULL) {
+    checkpoint_->SetDone(sequence);
+  }
+  locks_array_[LOCK_RESULTS]->unlock();
+}
+
+void TideSearchApplication::writePendingResults() {
+  while (true) {
+    if (checkpoint_ != NULL && checkpoint_->Done(next_result_sequence_)) {
+      // written before the interruption of the resumed search
+      ++next_result_sequence_;
+      continue;
+    }
+    map<unsigned long long, PendingResults>::iterator next = pending_results_.begin();
+    if (next == pending_results_.end() || next->first != next_result_sequence_) {
+      return;
+    }
+    *out_tsv_target_ << next->second.target_;
+    if (out_tsv_decoy_ != NULL) {
+      *out_tsv_decoy_ << next->second.decoy_;
+    }
+    *out_shard_stats_ << next->second.stats_;
+    if (checkpoint_ != NULL) {
+      checkpoint_->SetDone(next_result_sequence_);
+    }
+    pending_results_.erase(next);
+    ++next_result_sequence_;
+  }
 }
 
 //Added by Andy Lin in Feb 2016
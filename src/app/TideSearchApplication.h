@@ -7,6 +7,7 @@
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <deque>
 #include <gflags/gflags.h>
 #include "peptides.pb.h"
 #include "spectrum.pb.h"
@@ -14,6 +15,10 @@
 #include "tide/max_mz.h"
 #include "util/MathUtil.h"
 #include "tide/ActivePeptideQueue.h"
+#include "tide/hyper_score.h"
+#include "tide/search_profile.h"
+#include "tide/search_checkpoint.h"
+#include "tide/numa_topology.h"
 #include "TideIndexApplication.h"
 #include "TideMatchSet.h"
 
@@ -22,6 +27,17 @@ using namespace std;
 
 
 class TideSearchApplication : public CruxApplication {
+ public:
+  // The records of a peptide index that take long to read. A search reads
+  // its own, unless it is given ones that were read before, as tide-server
+  // does to keep an index loaded for all the searches it runs.
+  struct IndexData {
+    string index_;
+    ProteinVec proteins_;
+    vector<const pb::AuxLocation*> locations_;
+    pb::Header protein_header_;
+    pb::Header peptides_header_;
+  };
  private:
   struct InputFile {
     std::string OriginalName;
@@ -65,6 +81,8 @@ class TideSearchApplication : public CruxApplication {
   double min_precursor_charge_;
   double max_precursor_charge_;
   int num_threads_;
+  int fragment_index_top_n_;
+  bool compute_sp_;
   double fragTol_;
   int granularityScale_;  
   int total_spectra_num_;
@@ -76,16 +94,59 @@ class TideSearchApplication : public CruxApplication {
   ofstream* out_mztab_decoy_;      // mzTAB output format for the decoy psms only
   ofstream* out_pin_target_;        // pin output format for percolator
   ofstream* out_pin_decoy_;        // pin output format for percolator for the decoy psms only
+  ofstream* out_shard_stats_;      // statistics for merge-search-results, in shard mode only
+
+  // In shard mode, the results of a spectrum wait here until those of all
+  // spectra taken before it from spectrum_heap_ are written, so that every
+  // shard writes the spectra in the same order for merge-search-results.
+  struct PendingResults {
+    string target_;
+    string decoy_;
+    string stats_;
+    void swap(PendingResults& other) {
+      target_.swap(other.target_);
+      decoy_.swap(other.decoy_);
+      stats_.swap(other.stats_);
+    }
+  };
+  map<unsigned long long, PendingResults> pending_results_;
+  unsigned long long next_result_sequence_;
+  // Write the pending results that are next in order, with LOCK_RESULTS held
+  void writePendingResults();
+
+  // Search only the peptides of shard shard_index_ of num_shards_
+  int num_shards_;
+  int shard_index_;
 
   vector<boost::mutex *> locks_array_;  
 
+  // Per-phase timing of the search, NULL unless profile-output is set
+  SearchProfile* profile_;
+  // Acquire one of locks_array_, counting the wait in counters (may be NULL)
+  void lockProfiled(int lock, SearchProfile::Counters* counters, SearchProfile::Phase phase);
+
+  IndexData* index_data_;  // NULL unless set with setIndexData
+  string output_dir_;      // empty for output-dir
+
+  // Journal of the searched spectra, NULL unless checkpoint-interval is set.
+  // Spectra are numbered in the order they are taken from spectrum_heap_.
+  SearchCheckpoint* checkpoint_;
+  unsigned long long next_sequence_;
+  string checkpointFingerprint(const vector<string>& input_files, const string& input_index) const;
+  // Mark a spectrum without results as searched
+  void setSearched(unsigned long long sequence);
+
   void getInputFiles(int thread_id);
-  void getPeptideIndexData(string, ProteinVec& proteins, vector<const pb::AuxLocation*>& locations, pb::Header& peptides_header);
+  void convertInputFile(InputFile& input_file, int decode_threads);
+  void getPeptideIndexData(string, IndexData& index_data);
   void createOutputFiles();
+  // Create an output file and write its header, or reopen the file of an
+  // interrupted search at its checkpointed length.
+  ofstream* openOutputFile(const string& file_name, bool overwrite, const string& header);
 
   void convertResults() const;  
 
-  void PrintResults(const SpectrumCollection::SpecCharge* sc, string spectrum_file_name, int spectrum_file_cnt, TideMatchSet* psm_scores);
+  void PrintResults(const SpectrumCollection::SpecCharge* sc, string spectrum_file_name, int spectrum_file_cnt, TideMatchSet* psm_scores, unsigned long long sequence = 0);
 
 
   vector<pair<pb::Spectrum, int>> spectrum_heap_; // vector -> first = neutral_mass, second = file number
@@ -94,7 +155,76 @@ class TideSearchApplication : public CruxApplication {
 
   // sprectrum search executed in parallel threads
   void spectrum_search(void *threadarg);  
-  
+
+  // Search a single spectrum against its candidate peptides and print the results
+  // The sequence number identifies the spectrum in the checkpoint.
+  void searchSpectrum(const pb::Spectrum& pb_spectrum, int input_file_source, ActivePeptideQueue* active_peptide_queue, unsigned long long sequence = 0);
+
+  // Peptide index data shared by all active peptide queues
+  string peptides_file_;
+  pb::Header* peptides_header_;
+  const ProteinVec* proteins_;
+  vector<const pb::AuxLocation*>* locations_;
+
+  // Thread placement, NULL unless numa-placement is set. On a machine with
+  // several NUMA nodes, every node used has its own copy of the proteins and
+  // auxiliary locations of the index.
+  NumaTopology* numa_;
+  vector<ProteinVec> node_proteins_;
+  vector<vector<const pb::AuxLocation*> > node_locations_;
+  void replicateIndexData(int node);
+  // Pin the calling search thread to its core. Returns its node.
+  int placeThread(int thread_id);
+
+  // Open a reader on the peptide index and an active peptide queue on it,
+  // using the index data of node. The caller deletes the queue, then the
+  // reader.
+  ActivePeptideQueue* openPeptideQueue(PeptideReader** reader, int node = 0);
+  PeptideReader* openPeptideReader();
+
+  // Pipelined search (pipeline-search): each of the num-threads threads
+  // either converts the next file or joins the search of the first converted
+  // one. The threads searching a file take turns at its spectra, in order of
+  // mass, each streaming the index through its own queue, which starts over
+  // when the thread moves to another file.
+  size_t next_file_to_convert_;
+  int files_converting_;
+  deque<pair<int, HeadedRecordReader*> > converted_files_; ///< with readers on their spectra
+  boost::mutex pipeline_mutex_;
+  boost::condition_variable pipeline_cond_;
+  void pipeline_search(int thread_id);
+
+  // The XCorr of the candidates of a spectrum with at least split-candidates
+  // of them is computed in parts: the thread searching the spectrum queues
+  // the parts, and threads between two spectra of their own, or done with
+  // theirs, score them. Parts are contiguous ranges of the candidates of the
+  // queue, so their scores need no merging.
+  struct ScoringPart {
+    int charge_;
+    ObservedPeakSet* observed_;
+    ActivePeptideQueue* active_peptide_queue_;
+    TideMatchSet* psm_scores_;
+    bool score_inactive_peptides_;
+    int first_;
+    int last_;
+    int* parts_left_;  // parts of the spectrum not scored yet
+  };
+  int split_candidates_;
+  int searching_threads_;  // threads that may still split a spectrum
+  long int num_split_spectra_;
+  deque<ScoringPart> scoring_parts_;
+  boost::mutex split_mutex_;  // guards the members above and parts_left_
+  boost::condition_variable split_cond_;
+  // Score the candidates of the spectrum in parts if there are enough of
+  // them. Returns false if they were not scored.
+  bool splitXCorrScoring(int charge, ObservedPeakSet& observed, ActivePeptideQueue* active_peptide_queue, TideMatchSet& psm_scores);
+  // Score the queued parts of other threads. With wait, the calling thread
+  // has no spectra left and keeps scoring parts until all threads are done.
+  void helpScoring(SearchProfile::Counters* profile, bool wait);
+  // Score part and take it off the parts left of its spectrum; lock holds
+  // split_mutex_, and is released while scoring.
+  void scorePart(const ScoringPart& part, boost::mutex::scoped_lock& lock, SearchProfile::Counters* profile);
+
   // comparition of Spectrum data, based on neutral mass
   struct compare_spectrum{
     bool operator()(pair<pb::Spectrum, int> &spec_1, pair<pb::Spectrum, int> &spec_2){
@@ -115,6 +245,14 @@ class TideSearchApplication : public CruxApplication {
 
   void PValueScoring(const SpectrumCollection::SpecCharge* sc, ActivePeptideQueue* active_peptide_queue, TideMatchSet& psm_scores);
 
+  // HyperScore of all candidates, using the calling thread's HyperScorer
+  void HyperScoring(const SpectrumCollection::SpecCharge* sc, ActivePeptideQueue* active_peptide_queue, TideMatchSet& psm_scores);
+  boost::thread_specific_ptr<HyperScorer> hyper_scorer_;
+
+  // Sp workspace of the calling thread, prepared for the spectrum of sc
+  SpScorer* PrepareSpScorer(const SpectrumCollection::SpecCharge* sc);
+  boost::thread_specific_ptr<SpScorer> sp_scorer_;
+
   void computeWindow(
       const SpectrumCollection::SpecCharge& sc,
       vector<double>* out_min,
@@ -184,10 +322,19 @@ class TideSearchApplication : public CruxApplication {
   
   // These are public functions to be accessed from diameter application.
   static vector<int> getNegativeIsotopeErrors();
-  static void XCorrScoring(int charge, ObservedPeakSet& observed, ActivePeptideQueue* active_peptide_queue, TideMatchSet& psm_scores);
+  // With fragment_top_n > 0 and a fragment-ion index on the queue, only the
+  // fragment_top_n candidates that share the most peaks with the spectrum
+  // are scored; the other entries of psm_scores stay inactive.
+  static void XCorrScoring(int charge, ObservedPeakSet& observed, ActivePeptideQueue* active_peptide_queue, TideMatchSet& psm_scores, int fragment_top_n = 0);
   static int PeakMatching(ObservedPeakSet& observed, vector<unsigned int>& peak_list, int& matching_peaks, int& repeat_matching_peaks);
+  static void XCorrScorePeptide(int charge, ObservedPeakSet& observed, deque<Peptide*>::const_iterator iter, int cnt, TideMatchSet& psm_scores);
   void setSpectrumFlag(map<pair<string, unsigned int>, bool>* spectrum_flag);
 
+  static void readIndexData(const string& input_index, IndexData* index_data);
+  void setIndexData(IndexData* index_data) { index_data_ = index_data; }
+  // Write the outputs to output_dir rather than to output-dir
+  void setOutputDir(const string& output_dir) { output_dir_ = output_dir; }
+
 
   /**
    * Constructor
@@ -0,0 +1,255 @@
+/**
+ * \file TideServerApplication.cpp
+ * \brief Keeps a tide index loaded and runs the tide-search requests of
+ * tide-client against it.
+ *
+ * Reading the proteins and auxiliary locations of a large index can take
+ * longer than searching a small spectrum file, so a workflow that searches
+ * many files one at a time pays for it again and again. tide-server reads
+ * them once, then listens on a Unix domain socket and searches the files
+ * of each request with a new TideSearchApplication sharing them. Requests
+ * are run one at a time, each using all the search threads.
+ *
+ * A request is the line "search <output directory>", followed by one
+ * spectrum file per line and an empty line. The server answers with a line
+ * "ok <file>" for each result file and a line "done", or with a single line
+ * "error <message>". All paths are absolute.
+ *
+ * The search parameters are those the server was started with.
+ ************************************************************/
+#include <algorithm>
+#include "TideServerApplication.h"
+#include "io/carp.h"
+#include "util/crux-utils.h"
+#include "util/FileUtils.h"
+#include "util/LocalSocket.h"
+#include "util/Params.h"
+#include "util/StringUtils.h"
+
+using namespace std;
+
+TideServerApplication::TideServerApplication() {
+}
+
+TideServerApplication::~TideServerApplication() {
+}
+
+int TideServerApplication::main(int argc, char** argv) {
+  carp(CARP_INFO, "Running tide-server...");
+
+  // Outputs written by other commands from the txt results would go to
+  // output-dir instead of the directory of the request
+  const char* unsupported[] = {
+    "pin-output", "pepxml-output", "mzid-output", "sqt-output", "resume"
+  };
+  for (size_t i = 0; i < sizeof(unsupported) / sizeof(const char*); ++i) {
+    if (Params::GetBool(unsupported[i])) {
+      carp(CARP_FATAL, "%s is not supported by tide-server.", unsupported[i]);
+    }
+  }
+  if (Params::GetInt("checkpoint-interval") > 0) {
+    carp(CARP_FATAL, "checkpoint-interval is not supported by tide-server.");
+  }
+  if (!Params::GetString("store-spectra").empty()) {
+    carp(CARP_FATAL, "store-spectra is not supported by tide-server.");
+  }
+
+  const string index = Params::GetString("tide database");
+  carp(CARP_INFO, "Reading index %s", index.c_str());
+  readIndexData(index, &index_data_warm_);
+
+  const string socket_path = Params::GetString("server-socket");
+  LocalSocket* server = LocalSocket::Listen(socket_path);
+  if (server == NULL) {
+    carp(CARP_FATAL, "Could not start the server on %s.", socket_path.c_str());
+  }
+  carp(CARP_INFO, "Listening on %s", socket_path.c_str());
+
+  int num_requests = 0;
+  LocalSocket* client;
+  while ((client = server->Accept()) != NULL) {
+    if (serve(client, index)) {
+      ++num_requests;
+      carp(CARP_INFO, "Finished request %d.", num_requests);
+    }
+    delete client;
+  }
+  carp(CARP_ERROR, "Could not accept a connection on %s.", socket_path.c_str());
+  delete server;
+  return 1;
+}
+
+bool TideServerApplication::serve(LocalSocket* client, const string& index) {
+  // A client that connects but does not finish its request would block all
+  // others, so it gets a limited time to send it.
+  client->SetReceiveTimeout(REQUEST_TIMEOUT);
+  string output_dir;
+  vector<string> spectrum_files;
+  if (!readRequest(client, &output_dir, &spectrum_files)) {
+    client->Write("error malformed request\n");
+    return false;
+  }
+  carp(CARP_INFO, "Request to search %d spectrum files into %s",
+       (int)spectrum_files.size(), output_dir.c_str());
+
+  // A fatal error would stop the server, so check what can be checked here
+  for (vector<string>::const_iterator i = spectrum_files.begin(); i != spectrum_files.end(); ++i) {
+    if (!FileUtils::Exists(*i)) {
+      client->Write("error spectrum file " + *i + " does not exist\n");
+      return false;
+    }
+  }
+  if (!FileUtils::Exists(output_dir) && !FileUtils::Mkdir(output_dir)) {
+    client->Write("error could not create output directory " + output_dir + "\n");
+    return false;
+  }
+  vector<string> result_files = resultFileNames();
+  if (!Params::GetBool("overwrite")) {
+    for (vector<string>::const_iterator i = result_files.begin(); i != result_files.end(); ++i) {
+      string result_file = make_file_path(*i, output_dir);
+      if (FileUtils::Exists(result_file)) {
+        client->Write("error " + result_file + " already exists\n");
+        return false;
+      }
+    }
+  }
+
+  TideSearchApplication search;
+  search.setIndexData(&index_data_warm_);
+  search.setOutputDir(output_dir);
+  if (search.main(spectrum_files, index) != 0) {
+    client->Write("error tide-search failed\n");
+    return false;
+  }
+
+  string reply;
+  for (vector<string>::const_iterator i = result_files.begin(); i != result_files.end(); ++i) {
+    string result_file = make_file_path(*i, output_dir);
+    if (FileUtils::Exists(result_file)) {
+      reply += "ok " + result_file + "\n";
+    }
+  }
+  reply += "done\n";
+  if (!client->Write(reply)) {
+    carp(CARP_WARNING, "The client of the request disconnected.");
+  }
+  return true;
+}
+
+bool TideServerApplication::readRequest(LocalSocket* client, string* output_dir,
+                                        vector<string>* spectrum_files) {
+  string line;
+  if (!client->ReadLine(&line) || !StringUtils::StartsWith(line, "search ") ||
+      line.length() == 7) {
+    return false;
+  }
+  *output_dir = line.substr(7);
+  spectrum_files->clear();
+  bool ended = false;
+  while (client->ReadLine(&line)) {
+    if (line.empty()) {
+      ended = true;
+      break;
+    }
+    spectrum_files->push_back(line);
+  }
+  return ended && !spectrum_files->empty();
+}
+
+vector<string> TideServerApplication::resultFileNames() {
+  string arr[] = {
+    "tide-search.txt",
+    "tide-search.target.txt",
+    "tide-search.decoy.txt",
+    "tide-search.mzTab",
+    "tide-search.target.mzTab",
+    "tide-search.decoy.mzTab",
+    "tide-search.shard-stats.txt"
+  };
+  return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
+}
+
+string TideServerApplication::getName() const {
+  return "tide-server";
+}
+
+string TideServerApplication::getDescription() const {
+  return
+    "[[nohtml:Keep a tide index in memory and search the spectrum files "
+    "sent by tide-client against it.]]"
+    "[[html:<p>Reading the proteins of a large index can take longer than "
+    "searching a small spectrum file. <code>tide-server</code> reads a tide "
+    "index once, then waits for <code>tide-client</code> to send it spectrum "
+    "files, searches them with the parameters it was started with, and "
+    "writes the results to the output directory given to "
+    "<code>tide-client</code>. Requests are searched one at a time. The "
+    "server and its clients communicate through a Unix domain socket, "
+    "given by <code>--server-socket</code>; the server runs until it is "
+    "stopped.</p>]]";
+}
+
+vector<string> TideServerApplication::getArgs() const {
+  string arr[] = {
+    "tide database"
+  };
+  return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
+}
+
+vector<string> TideServerApplication::getOptions() const {
+  vector<string> search_options = TideSearchApplication::getOptions();
+  string excluded[] = {
+    "auto-mz-bin-width",
+    "auto-precursor-window",
+    "checkpoint-interval",
+    "mzid-output",
+    "pepxml-output",
+    "pin-output",
+    "resume",
+    "sqt-output",
+    "store-spectra"
+  };
+  vector<string> options;
+  for (vector<string>::const_iterator i = search_options.begin(); i != search_options.end(); ++i) {
+    if (find(excluded, excluded + sizeof(excluded) / sizeof(string), *i) ==
+        excluded + sizeof(excluded) / sizeof(string)) {
+      options.push_back(*i);
+    }
+  }
+  options.push_back("server-socket");
+  sort(options.begin(), options.end());
+  return options;
+}
+
+vector< pair<string, string> > TideServerApplication::getOutputs() const {
+  vector< pair<string, string> > outputs;
+  outputs.push_back(make_pair("tide-server.params.txt",
+    "a file containing the name and value of all parameters/options for the "
+    "current operation. Not all parameters in the file may have been used in "
+    "the operation. The resulting file can be used with the --parameter-file "
+    "option for other Crux programs."));
+  outputs.push_back(make_pair("tide-server.log.txt",
+    "a log file containing a copy of all messages that were printed to the "
+    "screen during execution, including those of the searches."));
+  return outputs;
+}
+
+COMMAND_T TideServerApplication::getCommand() const {
+  return MISC_COMMAND;
+}
+
+void TideServerApplication::processParams() {
+  // The spectra are not known when the server starts
+  if (Params::GetString("auto-precursor-window") != "false" ||
+      Params::GetString("auto-mz-bin-width") != "false") {
+    carp(CARP_FATAL, "auto-precursor-window and auto-mz-bin-width are not "
+         "supported by tide-server.");
+  }
+  TideSearchApplication::processParams();
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
@@ -0,0 +1,96 @@
+/**
+ * \file TideServerApplication.h
+ * \brief Keeps a tide index loaded and runs the tide-search requests of
+ * tide-client against it.
+ ***********************************************************/
+#ifndef TIDESERVERAPPLICATION_H
+#define TIDESERVERAPPLICATION_H
+
+#include "TideSearchApplication.h"
+#include <string>
+#include <vector>
+
+class LocalSocket;
+
+class TideServerApplication : public TideSearchApplication {
+
+ public:
+
+  /**
+   * Constructor
+   */
+  TideServerApplication();
+
+  /**
+   * Destructor
+   */
+  ~TideServerApplication();
+
+  /**
+   * Main methods
+   */
+  virtual int main(int argc, char** argv);
+
+  /**
+   * Returns the command name
+   */
+  virtual std::string getName() const;
+
+  /**
+   * Returns the command description
+   */
+  virtual std::string getDescription() const;
+
+  /**
+   * Returns the command arguments
+   */
+  virtual std::vector<std::string> getArgs() const;
+
+  /**
+   * Returns the command options
+   */
+  virtual std::vector<std::string> getOptions() const;
+
+  /**
+   * Returns the command outputs
+   */
+  virtual std::vector< std::pair<std::string, std::string> > getOutputs() const;
+
+  /**
+   * Returns the enum of the application
+   */
+  virtual COMMAND_T getCommand() const;
+
+  /**
+   * Processes the parameters
+   */
+  virtual void processParams();
+
+  // The result files tide-search may write, in the order they are reported
+  static std::vector<std::string> resultFileNames();
+
+ protected:
+
+  // Seconds a client has to send each line of its request
+  static const int REQUEST_TIMEOUT = 60;
+
+  // Read the output directory and spectrum files of a request. Returns
+  // false if the request is malformed or cut short.
+  static bool readRequest(LocalSocket* client, std::string* output_dir,
+                          std::vector<std::string>* spectrum_files);
+
+  // Read a request from client and run it. Returns false if the request
+  // could not be run, after telling the client why.
+  bool serve(LocalSocket* client, const std::string& index);
+
+  IndexData index_data_warm_;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
@@ -1,5 +1,6 @@
 // original author: Benjamin Diament
 // subsequently modified by Attila Kertesz-Farkas, Jeff Howbert
+#include <algorithm>
 #include <deque>
 #include <gflags/gflags.h>
 #include "records.h"
@@ -13,15 +14,19 @@
 #include <map> 
 #define CHECK(x) GOOGLE_CHECK((x))
 
-ActivePeptideQueue::ActivePeptideQueue(RecordReader* reader,
+ActivePeptideQueue::ActivePeptideQueue(PeptideReader* reader,
                                        const vector<const pb::Protein*>& proteins, 
                                        vector<const pb::AuxLocation*>* locations, 
                                        bool dia_mode)
-  : reader_(reader),
+  : dia_mode_(dia_mode),
+    reader_(reader),
     proteins_(proteins),
-    theoretical_peak_set_(1000),   // probably overkill, but no harm
     locations_(locations),
-    dia_mode_(dia_mode) {
+    theoretical_peak_set_(1000),   // probably overkill, but no harm
+    fragment_index_(NULL),
+    profile_counters_(NULL),
+    shard_index_(0),
+    num_shards_(1) {
   CHECK(reader_->OK());
   min_candidates_ = 30;
   nPeptides_ = 0;
@@ -31,11 +36,39 @@ ActivePeptideQueue::ActivePeptideQueue(RecordReader* reader,
 }
 
 ActivePeptideQueue::~ActivePeptideQueue() {
+  delete fragment_index_;
+}
+
+void ActivePeptideQueue::ReaderSkipBelow(double mass) {
+  reader_->SkipBelow(mass);
+}
+
+void ActivePeptideQueue::Rewind() {
+  while (!queue_.empty()) {
+    delete queue_.front();
+    queue_.pop_front();
+  }
+  if (fragment_index_ != NULL) {
+    delete fragment_index_;
+    fragment_index_ = new FragmentIndex();
+  }
+  reader_->Rewind();
+  nPeptides_ = 0;
+  nCandPeptides_ = 0;
+  CandPeptidesTarget_ = 0;
+  CandPeptidesDecoy_ = 0;  
+}
+
+void ActivePeptideQueue::EnableFragmentIndex() {
+  if (fragment_index_ == NULL) {
+    fragment_index_ = new FragmentIndex();
+  }
 }
 
 // Compute the theoretical peaks of the peptide in the "back" of the queue
 // (i.e. the one most recently read from disk -- the heaviest).
 void ActivePeptideQueue::ComputeTheoreticalPeaksBack() {
+  ScopedPhaseTimer timer(profile_counters_, SearchProfile::THEORETICAL_PEAKS);
   theoretical_peak_set_.Clear();
   Peptide* peptide = queue_.back();
   peptide->ComputeTheoreticalPeaks(&theoretical_peak_set_, dia_mode_);
@@ -66,6 +99,9 @@ int ActivePeptideQueue::SetActiveRange(vector<double>* min_mass, vector<double>*
     Peptide* peptide = queue_.front();
     queue_.pop_front();
     delete peptide;
+    if (fragment_index_ != NULL && fragment_index_->Size() > 0) {
+      fragment_index_->PopFront();
+    }
   }
   nPeptides_ = 0;
   nCandPeptides_ = 0;
@@ -81,15 +117,21 @@ int ActivePeptideQueue::SetActiveRange(vector<double>* min_mass, vector<double>*
   if (queue_.empty() || queue_.back()->Mass() <= max_range || queue_.size() < min_candidates_) {
     if (!queue_.empty()) {
       ComputeTheoreticalPeaksBack();
+    } else {
+      // nothing queued, so peptides below min_range can be skipped
+      ReaderSkipBelow(min_range);
     }
-    while (!(done = reader_->Done())) {
+    while (!(done = ReaderDone())) {
       // read all peptides lighter than max_range
-      reader_->Read(&current_pb_peptide_);
-      if (current_pb_peptide_.mass() < min_range) {
+      const pb::Peptide* pb_peptide = ReaderNext();
+      if (pb_peptide->mass() < min_range) {
         // we would delete current_pb_peptide_;
         continue; // skip peptides that fall below min_range
       }
-      Peptide* peptide = new Peptide(current_pb_peptide_, proteins_, locations_);
+      if (num_shards_ > 1 && pb_peptide->id() % num_shards_ != shard_index_) {
+        continue; // searched by another shard
+      }
+      Peptide* peptide = new Peptide(*pb_peptide, proteins_, locations_);
       assert(peptide != NULL);
       queue_.push_back(peptide);
       //Modified for tailor score calibration method by AKF
@@ -149,5 +191,13 @@ int ActivePeptideQueue::SetActiveRange(vector<double>* min_mass, vector<double>*
     (*end_)->active_ = false;
     ++nPeptides_;
   }
+  if (fragment_index_ != NULL) {
+    // Index the peptides that entered the active range. Their theoretical
+    // peaks are final; only the peptide behind end_ may still lack them.
+    int indexed_end = end_ - queue_.begin();
+    for (int i = fragment_index_->Size(); i < indexed_end; ++i) {
+      fragment_index_->PushBack(queue_[i]);
+    }
+  }
   return nCandPeptides_;
 }
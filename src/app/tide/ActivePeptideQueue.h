@@ -5,6 +5,9 @@
 #include "fifo_alloc.h"
 #include "spectrum_collection.h"
 #include "io/OutputFiles.h"
+#include "peptide_blocks.h"
+#include "fragment_index.h"
+#include "search_profile.h"
 
 #ifndef ACTIVE_PEPTIDE_QUEUE_H
 #define ACTIVE_PEPTIDE_QUEUE_H
@@ -13,13 +16,20 @@ class TheoreticalPeakCompiler;
 
 class ActivePeptideQueue {
  public:
-  ActivePeptideQueue(RecordReader* reader,
+  // Read peptides from an index on disk, in either encoding (see
+  // peptide_blocks.h).
+  ActivePeptideQueue(PeptideReader* reader,
         const vector<const pb::Protein*>& proteins,
         vector<const pb::AuxLocation*>* locations=NULL, 
         bool dia_mode = false);
 
   ~ActivePeptideQueue();
 
+  // Empty the queue and start over from the lightest peptide, so that the
+  // queue can search another set of spectra in order of mass. The index is
+  // read again from the start.
+  void Rewind();
+
   int SetActiveRange(vector<double>* min_mass, vector<double>* max_mass, 
         double min_range, double max_range); 
 
@@ -27,6 +37,29 @@ class ActivePeptideQueue {
     return *(begin_ + index); 
   }
 
+  // Maintain a fragment-ion index over the queued peptides (see
+  // fragment_index.h). Must be called before the first SetActiveRange().
+  void EnableFragmentIndex();
+
+  // The fragment-ion index, or NULL if it is not enabled. After
+  // SetActiveRange() it covers at least the peptides in [begin_, end_), in
+  // queue order, so position i of the index is queue_[i].
+  FragmentIndex* GetFragmentIndex() { return fragment_index_; }
+
+  // Performance counters of the thread using this queue, or NULL if the
+  // search is not profiled.
+  void SetProfileCounters(SearchProfile::Counters* counters) { profile_counters_ = counters; }
+  SearchProfile::Counters* ProfileCounters() { return profile_counters_; }
+
+  // Only queue the peptides of one shard of the index: those whose id is
+  // shard_index modulo num_shards. Consecutive peptides go to different
+  // shards, so every shard gets about the same share of each spectrum's
+  // candidates.
+  void SetShard(int shard_index, int num_shards) {
+    shard_index_ = shard_index;
+    num_shards_ = num_shards;
+  }
+
   int nPeptides_;
   int nCandPeptides_;
   int CandPeptidesTarget_;
@@ -45,12 +78,28 @@ class ActivePeptideQueue {
 
   void ComputeTheoreticalPeaksBack();    
 
-  RecordReader* reader_;
+  bool ReaderDone() {
+    return reader_->Done();
+  }
+  // Returns the next peptide, which is valid until the next call
+  const pb::Peptide* ReaderNext() {
+    reader_->Read(&current_pb_peptide_);
+    return &current_pb_peptide_;
+  }
+  // Skips peptides lighter than mass; only called when the queue is empty
+  void ReaderSkipBelow(double mass);
+
+  PeptideReader* reader_;
   const vector<const pb::Protein*>& proteins_; 
   vector<const pb::AuxLocation*>* locations_;
   
   TheoreticalPeakSetBYSparse theoretical_peak_set_;
   pb::Peptide current_pb_peptide_;
+
+  FragmentIndex* fragment_index_;
+  SearchProfile::Counters* profile_counters_;
+  int shard_index_;
+  int num_shards_;
 };
 
 #endif
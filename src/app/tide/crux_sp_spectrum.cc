@@ -6,17 +6,27 @@
 #include <math.h>
 #include "crux_sp_spectrum.h"
 
+SpSpectrum::SpSpectrum()
+  : beta_(0.075), max_mz_(0.0), max_intensity_(0.0), last_idx_(0) {
+}
+
 SpSpectrum::SpSpectrum(const Spectrum& spectrum, int charge, double max_mz) 
   : beta_(0.075), max_intensity_(0.0), last_idx_(0) {
-  max_mz_ = MassConstants::mass2bin(max_mz);  
-  intensity_array_ = new double[IntensityArraySize()];
-  memset(intensity_array_, 0, sizeof(double)*IntensityArraySize());
-
-  PreprocessSpectrum(spectrum, charge);
+  Preprocess(spectrum, charge, max_mz);
 }
 
 SpSpectrum::~SpSpectrum() {
-  delete [] intensity_array_;
+}
+
+void SpSpectrum::Preprocess(const Spectrum& spectrum, int charge, double max_mz) {
+  max_mz_ = MassConstants::mass2bin(max_mz);  
+  max_intensity_ = 0.0;
+  last_idx_ = 0;
+  // assign() keeps the capacity, so nothing is allocated once the arrays have
+  // grown to the largest spectrum seen
+  intensity_array_.assign(IntensityArraySize(), 0.0);
+
+  PreprocessSpectrum(spectrum, charge);
 }
 
 void SpSpectrum::PreprocessSpectrum(const Spectrum& spectrum, int charge) {
@@ -102,8 +112,8 @@ void SpSpectrum::NormalizeIntensityArray(double threshold) {
 
 void SpSpectrum::SmoothPeaks() {
   // create a new array, which will replace the original intensity array
-  double* new_array = new double[IntensityArraySize()];
-  memset(new_array, 0, sizeof(double)*IntensityArraySize());
+  std::vector<double>& new_array = new_array_;
+  new_array.assign(IntensityArraySize(), 0.0);
 
   // iterate over all peaks
   for(int idx = 2; idx < IntensityArraySize()-2; ++idx) {
@@ -119,14 +129,13 @@ void SpSpectrum::SmoothPeaks() {
     }
   }
 
-  delete [] intensity_array_;
-  intensity_array_ = new_array;
+  intensity_array_.swap(new_array);
 }
 
 void SpSpectrum::ZeroPeaks() {
   // create a new array, which will replace the original intensity array
-  double* new_array = new double[IntensityArraySize()];
-  memset(new_array, 0, sizeof(double)*IntensityArraySize());
+  std::vector<double>& new_array = new_array_;
+  new_array.assign(IntensityArraySize(), 0.0);
   
   // step 1,
   ZeroPeakMeanStdev(1, new_array);
@@ -134,14 +143,13 @@ void SpSpectrum::ZeroPeaks() {
   // step 2,
   ZeroPeakMeanStdev(2, new_array);
 
-  delete[] intensity_array_;
-  intensity_array_ = new_array;
+  intensity_array_.swap(new_array);
 }
 
 void SpSpectrum::ExtractPeaks(int top_rank) {
   // copy all peaks to temp_array
-  double* temp_array = new double[IntensityArraySize()];
-  memset(temp_array, 0, sizeof(double)*IntensityArraySize());
+  std::vector<double>& temp_array = temp_array_;
+  temp_array.assign(IntensityArraySize(), 0.0);
   int temp_idx = 0;
   for(int idx = 0; idx < IntensityArraySize(); ++idx){
     if(intensity_array_[idx] > 0){
@@ -152,11 +160,11 @@ void SpSpectrum::ExtractPeaks(int top_rank) {
   
   // if there's over top_rank peaks, keep only top_rank peaks
   // std::sort
-  std::sort(temp_array, temp_array + temp_idx, std::greater<double>());
+  std::sort(temp_array.begin(), temp_array.begin() + temp_idx, std::greater<double>());
   
-  // set max and cut_off
+  // set max and cut_off; with fewer than top_rank peaks all of them are kept
   double max_intensity = temp_array[0];
-  double cut_off = temp_array[top_rank-1];
+  double cut_off = top_rank <= temp_idx ? temp_array[top_rank-1] : 0;
   
   // remove peaks bellow cut_off 
   // also, normalize peaks to max_intensity to 100
@@ -171,8 +179,6 @@ void SpSpectrum::ExtractPeaks(int top_rank) {
       }
     }
   }
-  
-  delete [] temp_array;
 }
 
 void SpSpectrum::EqualizePeaks()
@@ -253,7 +259,7 @@ double SpSpectrum::GetIntensityArrayStdev(int peak_idx, double mean,
   return sqrt(variance/peak_count);
 }
 
-void SpSpectrum::ZeroPeakMeanStdev(int step, double* new_array) {
+void SpSpectrum::ZeroPeakMeanStdev(int step, std::vector<double>& new_array) {
   // iterate over all peaks
   double mean = 0;
   double stdev = 0;
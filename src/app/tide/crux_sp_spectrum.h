@@ -36,11 +36,15 @@
 //    "smooth_peaks" function can handle various types of scores represented 
 //    by SCORER_TYPE_T.
 // 6. The "double" data type was used in place of crux's "FLOAT_T".
+// 7. A default constructed SpSpectrum can be filled with Preprocess() and
+//    reused for any number of spectra; its arrays are only reallocated when a
+//    spectrum needs more bins than any spectrum before it.
 
 
 #ifndef CRUX_SP_SPECTRUM_H
 #define CRUX_SP_SPECTRUM_H
 
+#include <vector>
 #include "mass_constants.h"
 #include "spectrum_collection.h"
 #include "spectrum_preprocess.h"
@@ -49,9 +53,13 @@
 
 class SpSpectrum {
  public:
+  SpSpectrum();
   SpSpectrum(const Spectrum& spectrum, int charge, double max_mz);
   ~SpSpectrum();
 
+  // Preprocess a spectrum, replacing the previous one.
+  void Preprocess(const Spectrum& spectrum, int charge, double max_mz);
+
   double Intensity(int index) const { return index < IntensityArraySize() ? intensity_array_[index] : 0; }
   double Beta() const { return beta_; }
   double TotalIonIntensity() {
@@ -95,7 +103,7 @@ class SpSpectrum {
 
   // Helper to "zero and extract peaks". The fact that a peak has removed will 
   // affect the following peaks.
-  void ZeroPeakMeanStdev(int step, double* new_array);
+  void ZeroPeakMeanStdev(int step, std::vector<double>& new_array);
 
   int IntensityArraySize() const {
     return (int)max_mz_ + 1;
@@ -119,7 +127,11 @@ class SpSpectrum {
   double max_mz_; 
 
   // Intensity array that can be indexed using the m/z bin
-  double* intensity_array_; 
+  std::vector<double> intensity_array_; 
+
+  // Scratch arrays of the preprocessing steps, kept to avoid reallocation
+  std::vector<double> new_array_;
+  std::vector<double> temp_array_;
 
   // the max intensity in the intensity array
   double max_intensity_; 
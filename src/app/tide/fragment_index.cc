@@ -0,0 +1,83 @@
+#include <algorithm>
+#include "fragment_index.h"
+
+// Stale postings are dropped from all bins once this many peptides, or as
+// many peptides as are currently indexed, have left the index.
+static const unsigned int kCompactInterval = 65536;
+
+FragmentIndex::FragmentIndex()
+  : front_id_(0), next_id_(0), removed_(0) {
+}
+
+void FragmentIndex::Add(vector<Postings>* postings,
+                        const vector<unsigned int>& peaks, unsigned int id) {
+  for (vector<unsigned int>::const_iterator i = peaks.begin(); i != peaks.end(); ++i) {
+    if (*i >= postings->size()) {
+      postings->resize(*i + 1);
+    }
+    vector<unsigned int>& ids = (*postings)[*i].ids;
+    // a peptide can produce more than one fragment in the same bin
+    if (ids.empty() || ids.back() != id) {
+      ids.push_back(id);
+    }
+  }
+}
+
+void FragmentIndex::PushBack(const Peptide* peptide) {
+  Add(&postings_0_, peptide->peaks_0, next_id_);
+  Add(&postings_1_, peptide->peaks_1, next_id_);
+  ++next_id_;
+}
+
+void FragmentIndex::PopFront() {
+  if (front_id_ == next_id_) {
+    return;
+  }
+  ++front_id_;
+  ++removed_;
+  if (removed_ >= kCompactInterval && removed_ >= next_id_ - front_id_) {
+    Compact(&postings_0_);
+    Compact(&postings_1_);
+    removed_ = 0;
+  }
+}
+
+void FragmentIndex::Compact(vector<Postings>* postings) {
+  for (vector<Postings>::iterator p = postings->begin(); p != postings->end(); ++p) {
+    vector<unsigned int>::iterator live =
+      lower_bound(p->ids.begin(), p->ids.end(), front_id_);
+    p->ids.erase(p->ids.begin(), live);
+  }
+}
+
+void FragmentIndex::Count(const vector<Postings>& postings, const int* cache,
+                          int cache_end, unsigned int first_id,
+                          unsigned int last_id, vector<int>* counts) {
+  int end = min(cache_end, (int)postings.size());
+  for (int bin = 0; bin < end; ++bin) {
+    if (cache[bin] <= 0) {
+      continue;
+    }
+    const vector<unsigned int>& ids = postings[bin].ids;
+    if (ids.empty() || ids.back() < first_id) {
+      continue;
+    }
+    vector<unsigned int>::const_iterator i =
+      lower_bound(ids.begin(), ids.end(), first_id);
+    for (; i != ids.end() && *i < last_id; ++i) {
+      ++(*counts)[*i - first_id];
+    }
+  }
+}
+
+void FragmentIndex::CountSharedPeaks(const int* cache, int cache_end,
+                                     int first, int last, bool use_peaks_1,
+                                     vector<int>* counts) {
+  counts->assign(last - first, 0);
+  unsigned int first_id = front_id_ + first;
+  unsigned int last_id = front_id_ + last;
+  Count(postings_0_, cache, cache_end, first_id, last_id, counts);
+  if (use_peaks_1) {
+    Count(postings_1_, cache, cache_end, first_id, last_id, counts);
+  }
+}
@@ -0,0 +1,66 @@
+// Inverted fragment-ion index over the peptides of an ActivePeptideQueue.
+//
+// For every theoretical peak bin (the same cache indexes that are stored in
+// Peptide::peaks_0 and Peptide::peaks_1) the index keeps the ids of the queued
+// peptides that produce a fragment in that bin. Peptide ids are assigned in
+// the order the peptides enter the queue, so each posting list is sorted, and
+// peptides leaving the front of the queue are dropped lazily by advancing the
+// id of the lightest live peptide.
+//
+// The index therefore always covers the mass slice of the peptide index that
+// is currently held by the queue. With wide precursor windows, as in open
+// modification searches, counting the fragments each candidate shares with a
+// spectrum through the index is much cheaper than computing the XCorr of every
+// candidate, and only the best candidates need to be scored in full.
+
+#ifndef FRAGMENT_INDEX_H
+#define FRAGMENT_INDEX_H
+
+#include <vector>
+#include "peptide.h"
+
+using namespace std;
+
+class FragmentIndex {
+ public:
+  FragmentIndex();
+
+  // Add the peptide behind the most recently added one. Its theoretical peaks
+  // must have been computed.
+  void PushBack(const Peptide* peptide);
+
+  // Remove the lightest (earliest added) peptide.
+  void PopFront();
+
+  // Number of peptides in the index.
+  int Size() const { return (int)(next_id_ - front_id_); }
+
+  // For the peptides at positions [first, last) counted from the front of the
+  // index, count the theoretical peaks that fall into bins of the observed
+  // cache with a positive value. counts[i] receives the count for position
+  // first + i. peaks_1 is only included when use_peaks_1 is set.
+  void CountSharedPeaks(const int* cache, int cache_end, int first, int last,
+                        bool use_peaks_1, vector<int>* counts);
+
+ private:
+  // Each bin holds the sorted ids of the peptides with a fragment in it. Ids
+  // below front_id_ belong to removed peptides and are skipped when counting.
+  struct Postings {
+    vector<unsigned int> ids;
+  };
+
+  static void Add(vector<Postings>* postings,
+                  const vector<unsigned int>& peaks, unsigned int id);
+  static void Count(const vector<Postings>& postings, const int* cache,
+                    int cache_end, unsigned int first_id, unsigned int last_id,
+                    vector<int>* counts);
+  void Compact(vector<Postings>* postings);
+
+  vector<Postings> postings_0_;
+  vector<Postings> postings_1_;
+  unsigned int front_id_;  // id of the lightest peptide in the index
+  unsigned int next_id_;   // id of the next peptide to be added
+  unsigned int removed_;   // peptides removed since the last compaction
+};
+
+#endif // FRAGMENT_INDEX_H
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cmath>
+#include "hyper_score.h"
+#include "mass_constants.h"
+
+HyperScorer::HyperScorer()
+  : intensity_end_(0) {
+  log_factorial_.push_back(0.0);  // ln(0!)
+}
+
+void HyperScorer::Prepare(const Spectrum& spectrum, int charge) {
+  double max_mz = (spectrum.PrecursorMZ() - MASS_PROTON) * charge + MASS_PROTON;
+  size_t end = MassConstants::mass2bin(max_mz, 1) + 1;
+  if (intensity_.size() < end) {
+    intensity_.resize(end);
+  }
+  // Only clear the bins the previous spectrum may have touched.
+  fill(intensity_.begin(), intensity_.begin() + max(end, intensity_end_), 0.0f);
+  intensity_end_ = end;
+
+  float base_peak = 0.0f;
+  for (int i = 0; i < spectrum.Size(); ++i) {
+    double mz = spectrum.M_Z(i);
+    if (mz > max_mz) {
+      continue;
+    }
+    unsigned int bin = MassConstants::mass2bin(mz, 1);
+    float intensity = (float)spectrum.Intensity(i);
+    if (bin < end && intensity > intensity_[bin]) {
+      intensity_[bin] = intensity;
+      base_peak = max(base_peak, intensity);
+    }
+  }
+  if (base_peak > 0.0f) {
+    float scale = 100.0f / base_peak;
+    for (size_t bin = 0; bin < end; ++bin) {
+      intensity_[bin] *= scale;
+    }
+  }
+}
+
+void HyperScorer::Accumulate(const vector<unsigned int>& ions, int* matched,
+                             float* intensity_sum) const {
+  // Branch-free, so the compiler can vectorize the gather over the ion bins.
+  const float* intensity = &intensity_[0];
+  unsigned int end = intensity_end_;
+  int count = 0;
+  float sum = 0.0f;
+  for (size_t i = 0; i < ions.size(); ++i) {
+    unsigned int bin = ions[i] < end ? ions[i] : 0;
+    float value = intensity[bin];
+    sum += value;
+    count += (value > 0.0f);
+  }
+  *matched += count;
+  *intensity_sum += sum;
+}
+
+void HyperScorer::ScoreCandidates(deque<Peptide*>::const_iterator begin,
+                                  deque<Peptide*>::const_iterator end,
+                                  bool use_charge_2, bool score_inactive) {
+  int num_candidates = end - begin;
+  b_matched_.assign(num_candidates, 0);
+  y_matched_.assign(num_candidates, 0);
+  intensity_sum_.assign(num_candidates, 0.0f);
+  if (intensity_end_ == 0) {
+    return;
+  }
+  // Bin 0 is never populated by a peak (mass2bin maps every m/z to a bin of
+  // at least 1), which is what lets Accumulate() map out-of-range ions to it.
+  float bin_0 = intensity_[0];
+  intensity_[0] = 0.0f;
+
+  int cnt = 0;
+  for (deque<Peptide*>::const_iterator iter = begin; iter != end; ++iter, ++cnt) {
+    const Peptide* peptide = *iter;
+    if (!peptide->active_ && !score_inactive) {
+      continue;
+    }
+    Accumulate(peptide->peaks_1b, &b_matched_[cnt], &intensity_sum_[cnt]);
+    Accumulate(peptide->peaks_1y, &y_matched_[cnt], &intensity_sum_[cnt]);
+    if (use_charge_2) {
+      Accumulate(peptide->peaks_2b, &b_matched_[cnt], &intensity_sum_[cnt]);
+      Accumulate(peptide->peaks_2y, &y_matched_[cnt], &intensity_sum_[cnt]);
+    }
+  }
+  intensity_[0] = bin_0;
+}
+
+double HyperScorer::LogFactorial(size_t n) const {
+  while (log_factorial_.size() <= n) {
+    size_t k = log_factorial_.size();
+    log_factorial_.push_back(log_factorial_.back() + log((double)k));
+  }
+  return log_factorial_[n];
+}
+
+double HyperScorer::Score(int i) const {
+  if (intensity_sum_[i] <= 0.0f) {
+    return 0.0;
+  }
+  return LogFactorial(b_matched_[i]) + LogFactorial(y_matched_[i]) + log((double)intensity_sum_[i]);
+}
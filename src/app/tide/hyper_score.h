@@ -0,0 +1,67 @@
+// HyperScore, the score function of X!Tandem:
+//
+//   hyperscore = ln(Nb! * Ny! * sum of the matched peak intensities)
+//
+// where Nb and Ny are the numbers of b and y ions that match a peak of the
+// spectrum. Observed peaks are binned with the same m/z bins that are used for
+// XCorr (mz-bin-width, mz-bin-offset), so the theoretical b and y ion bins of
+// the peptides (Peptide::peaks_1b, peaks_1y, peaks_2b and peaks_2y) index the
+// binned spectrum directly.
+//
+// A HyperScorer holds the binned spectrum and the per-candidate match counts
+// and intensity sums. It is meant to be kept by each search thread and reused
+// for every spectrum, so scoring does not allocate once the buffers have grown
+// to the size of the largest spectrum and candidate set.
+
+#ifndef HYPER_SCORE_H
+#define HYPER_SCORE_H
+
+#include <deque>
+#include <vector>
+#include "peptide.h"
+#include "spectrum_collection.h"
+
+using namespace std;
+
+class HyperScorer {
+ public:
+  HyperScorer();
+
+  // Bin the peaks of the spectrum, keeping the most intense peak of each bin,
+  // and normalize them to a base peak intensity of 100. Peaks heavier than
+  // the singly charged precursor are ignored.
+  void Prepare(const Spectrum& spectrum, int charge);
+
+  // Count the matched b and y ions and sum the matched intensities of the
+  // candidates in [begin, end) in a single pass. Doubly charged fragments are
+  // included when use_charge_2 is set. Candidates that are not active are
+  // skipped unless score_inactive is set; their accumulators are left at 0.
+  void ScoreCandidates(deque<Peptide*>::const_iterator begin,
+                       deque<Peptide*>::const_iterator end,
+                       bool use_charge_2, bool score_inactive);
+
+  // Results of the last ScoreCandidates() call, indexed by the position of
+  // the candidate relative to begin.
+  int BMatched(int i) const { return b_matched_[i]; }
+  int YMatched(int i) const { return y_matched_[i]; }
+  double IntensitySum(int i) const { return intensity_sum_[i]; }
+
+  // The HyperScore of the candidate at position i, 0 if nothing matched.
+  double Score(int i) const;
+
+ private:
+  // Sum the intensities of the bins in ions and count the bins with a peak.
+  inline void Accumulate(const vector<unsigned int>& ions, int* matched,
+                         float* intensity_sum) const;
+
+  double LogFactorial(size_t n) const;
+
+  vector<float> intensity_;  // binned, normalized spectrum
+  size_t intensity_end_;     // bins at or above this one hold no peaks
+  vector<int> b_matched_;
+  vector<int> y_matched_;
+  vector<float> intensity_sum_;
+  mutable vector<double> log_factorial_;
+};
+
+#endif // HYPER_SCORE_H
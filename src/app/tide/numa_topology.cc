@@ -0,0 +1,119 @@
+#include <boost/thread.hpp>
+#include <fstream>
+#include <sstream>
+#include <string>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "numa_topology.h"
+#include "io/carp.h"
+
+// The node directories need not be numbered contiguously
+static const int kMaxNodes = 1024;
+
+// Parse a cpulist such as "0-7,16-23"
+static vector<int> ParseCpuList(const string& list) {
+  vector<int> cpus;
+  stringstream ranges(list);
+  string range;
+  while (getline(ranges, range, ',')) {
+    int first, last;
+    char dash;
+    stringstream in(range);
+    if (!(in >> first)) {
+      continue;
+    }
+    last = first;
+    if (in >> dash >> last && dash != '-') {
+      continue;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+NumaTopology::NumaTopology() : pinnable_(false) {
+#ifdef __linux__
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+    pinnable_ = true;
+    for (int node = 0; node < kMaxNodes; ++node) {
+      stringstream path;
+      path << "/sys/devices/system/node/node" << node << "/cpulist";
+      ifstream in(path.str().c_str());
+      string list;
+      if (!in.good() || !getline(in, list)) {
+        continue;
+      }
+      vector<int> cpus;
+      vector<int> node_cpus = ParseCpuList(list);
+      for (vector<int>::const_iterator i = node_cpus.begin(); i != node_cpus.end(); ++i) {
+        if (*i < CPU_SETSIZE && CPU_ISSET(*i, &allowed)) {
+          cpus.push_back(*i);
+        }
+      }
+      if (!cpus.empty()) {
+        node_cpus_.push_back(cpus);
+      }
+    }
+    if (node_cpus_.empty()) {
+      // No NUMA information, e.g. in some containers
+      vector<int> cpus;
+      for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed)) {
+          cpus.push_back(cpu);
+        }
+      }
+      node_cpus_.push_back(cpus);
+    }
+  }
+#endif
+  if (node_cpus_.empty() || node_cpus_.front().empty()) {
+    pinnable_ = false;
+    node_cpus_.assign(1, vector<int>());
+    int num_cpus = max(1u, boost::thread::hardware_concurrency());
+    for (int cpu = 0; cpu < num_cpus; ++cpu) {
+      node_cpus_.front().push_back(cpu);
+    }
+  }
+  for (size_t node = 0; node < node_cpus_.size(); ++node) {
+    cpus_.insert(cpus_.end(), node_cpus_[node].begin(), node_cpus_[node].end());
+    cpu_nodes_.insert(cpu_nodes_.end(), node_cpus_[node].size(), node);
+  }
+}
+
+bool NumaTopology::PinThread(int thread) const {
+  return SetAffinity(vector<int>(1, CpuOfThread(thread)));
+}
+
+bool NumaTopology::PinToNode(int node) const {
+  return SetAffinity(node_cpus_[node]);
+}
+
+void NumaTopology::Unpin() const {
+  SetAffinity(cpus_);
+}
+
+bool NumaTopology::SetAffinity(const vector<int>& cpus) const {
+  if (!pinnable_) {
+    return false;
+  }
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (vector<int>::const_iterator i = cpus.begin(); i != cpus.end(); ++i) {
+    CPU_SET(*i, &set);
+  }
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+    carp(CARP_DEBUG, "Could not set the affinity of a thread.");
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
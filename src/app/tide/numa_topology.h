@@ -0,0 +1,49 @@
+// The NUMA nodes of the machine and the cores of each, for pinning search
+// threads.
+//
+// Linux places a page on the node of the thread that first writes to it, so a
+// thread pinned to a core before it allocates its workspaces gets them on its
+// own node, and read-only data copied by a thread pinned to a node is local to
+// the threads of that node.
+//
+// The topology is read from /sys/devices/system/node, restricted to the cores
+// the process may run on. Elsewhere, or if it cannot be read, the machine is
+// treated as a single node and threads are not pinned.
+
+#ifndef NUMA_TOPOLOGY_H
+#define NUMA_TOPOLOGY_H
+
+#include <vector>
+
+using namespace std;
+
+class NumaTopology {
+ public:
+  NumaTopology();
+
+  int NumNodes() const { return node_cpus_.size(); }
+  int NumCpus() const { return cpus_.size(); }
+
+  // Threads are placed compactly: thread 0 on the first core of node 0, and
+  // each node is filled before the next one is used. More threads than cores
+  // wrap around.
+  int CpuOfThread(int thread) const { return cpus_[thread % cpus_.size()]; }
+  int NodeOfThread(int thread) const { return cpu_nodes_[thread % cpus_.size()]; }
+
+  // Pin the calling thread to the core of thread, or to any core of node.
+  // Return false if threads cannot be pinned on this system.
+  bool PinThread(int thread) const;
+  bool PinToNode(int node) const;
+  // Let the calling thread run on all the cores again.
+  void Unpin() const;
+
+ private:
+  bool SetAffinity(const vector<int>& cpus) const;
+
+  vector<vector<int> > node_cpus_;
+  vector<int> cpus_;       // all usable cores, node by node
+  vector<int> cpu_nodes_;  // the node of each of cpus_
+  bool pinnable_;
+};
+
+#endif // NUMA_TOPOLOGY_H
@@ -0,0 +1,630 @@
+// Block-compressed peptide index. See peptide_blocks.h for the file layout.
+
+#include <string.h>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include "peptide_blocks.h"
+#include "util/FileUtils.h"
+
+namespace {
+
+bool HasFullLocation(const pb::Peptide& peptide) {
+  return peptide.has_first_location() &&
+    peptide.first_location().has_protein_id() &&
+    peptide.first_location().has_pos();
+}
+
+enum PeptideFieldFlags {
+  FLAG_LOCATION = 1,
+  FLAG_DECOY_INDEX = 2,
+  FLAG_NTERM_MOD = 4,
+  FLAG_CTERM_MOD = 8,
+  FLAG_RESIDUAL = 16
+};
+
+template<class T>
+void WriteRaw(ostream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<class T>
+bool ReadRaw(istream& in, T* value) {
+  in.read(reinterpret_cast<char*>(value), sizeof(T));
+  return in.good();
+}
+
+unsigned long long ZigZag(long long value) {
+  return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+long long UnZigZag(unsigned long long value) {
+  return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+unsigned long long MassBits(double mass) {
+  unsigned long long bits;
+  memcpy(&bits, &mass, sizeof(bits));
+  return bits;
+}
+
+double BitsMass(unsigned long long bits) {
+  double mass;
+  memcpy(&mass, &bits, sizeof(mass));
+  return mass;
+}
+
+int BitWidth(unsigned int max_value) {
+  int width = 0;
+  while (max_value > 0) {
+    ++width;
+    max_value >>= 1;
+  }
+  return width;
+}
+
+class ColumnWriter {
+ public:
+  explicit ColumnWriter(string* out) : out_(out), acc_(0), nbits_(0) {}
+
+  void PutVarint(unsigned long long value) {
+    while (value >= 0x80) {
+      out_->push_back((char)(value | 0x80));
+      value >>= 7;
+    }
+    out_->push_back((char)value);
+  }
+
+  void PutBits(unsigned int value, int width) {
+    for (int i = 0; i < width; ++i) {
+      acc_ |= ((value >> i) & 1u) << nbits_;
+      if (++nbits_ == 8) {
+        out_->push_back((char)acc_);
+        acc_ = 0;
+        nbits_ = 0;
+      }
+    }
+  }
+
+  // Pad the current bit-packed column to a byte boundary.
+  void AlignBits() {
+    if (nbits_ > 0) {
+      out_->push_back((char)acc_);
+      acc_ = 0;
+      nbits_ = 0;
+    }
+  }
+
+ private:
+  string* out_;
+  unsigned int acc_;
+  int nbits_;
+};
+
+class ColumnReader {
+ public:
+  ColumnReader(const char* begin, const char* end)
+    : pos_((const unsigned char*)begin), end_((const unsigned char*)end),
+    nbits_(0), ok_(true) {}
+
+  bool OK() const { return ok_; }
+
+  unsigned long long GetVarint() {
+    unsigned long long value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (pos_ >= end_) {
+        ok_ = false;
+        return 0;
+      }
+      unsigned char byte = *pos_++;
+      value |= (unsigned long long)(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return value;
+      }
+    }
+    ok_ = false;
+    return 0;
+  }
+
+  unsigned int GetBits(int width) {
+    unsigned int value = 0;
+    for (int i = 0; i < width; ++i) {
+      if (nbits_ == 0) {
+        if (pos_ >= end_) {
+          ok_ = false;
+          return 0;
+        }
+        ++pos_;
+        nbits_ = 8;
+      }
+      value |= ((*(pos_ - 1) >> (8 - nbits_)) & 1u) << i;
+      --nbits_;
+    }
+    return value;
+  }
+
+  void AlignBits() { nbits_ = 0; }
+
+  const char* GetBytes(size_t size) {
+    if ((size_t)(end_ - pos_) < size) {
+      ok_ = false;
+      return NULL;
+    }
+    const char* bytes = (const char*)pos_;
+    pos_ += size;
+    return bytes;
+  }
+
+ private:
+  const unsigned char* pos_;
+  const unsigned char* end_;
+  int nbits_;
+  bool ok_;
+};
+
+string Compress(const string& raw) {
+  string compressed;
+  boost::iostreams::filtering_ostream out;
+  out.push(boost::iostreams::zlib_compressor(
+    boost::iostreams::zlib_params(boost::iostreams::zlib::best_speed)));
+  out.push(boost::iostreams::back_inserter(compressed));
+  out.write(raw.data(), raw.size());
+  out.reset();  // flush the compressor
+  return compressed;
+}
+
+bool Decompress(const string& compressed, size_t raw_size, string* raw) {
+  raw->resize(raw_size);
+  if (raw_size == 0) {
+    return true;
+  }
+  try {
+    boost::iostreams::filtering_istream in;
+    in.push(boost::iostreams::zlib_decompressor());
+    in.push(boost::iostreams::array_source(compressed.data(), compressed.size()));
+    in.read(&(*raw)[0], raw_size);
+    return (size_t)in.gcount() == raw_size;
+  } catch (const boost::iostreams::zlib_error&) {
+    return false;
+  }
+}
+
+// Lay out the peptides of one block column by column.
+void EncodeBlock(const vector<pb::Peptide>& peptides, string* raw) {
+  unsigned int max_len = 0, max_prot = 0, max_pos = 0, max_nmods = 0;
+  for (vector<pb::Peptide>::const_iterator i = peptides.begin(); i != peptides.end(); ++i) {
+    max_len = max(max_len, (unsigned int)i->length());
+    max_nmods = max(max_nmods, (unsigned int)i->modifications_size());
+    if (HasFullLocation(*i)) {
+      max_prot = max(max_prot, (unsigned int)i->first_location().protein_id());
+      max_pos = max(max_pos, (unsigned int)i->first_location().pos());
+    }
+  }
+  int w_len = BitWidth(max_len);
+  int w_prot = BitWidth(max_prot);
+  int w_pos = BitWidth(max_pos);
+  int w_nmods = BitWidth(max_nmods);
+
+  ColumnWriter col(raw);
+  col.PutVarint(peptides.size());
+  col.PutVarint(w_len);
+  col.PutVarint(w_prot);
+  col.PutVarint(w_pos);
+  col.PutVarint(w_nmods);
+
+  long long last_id = 0;
+  for (vector<pb::Peptide>::const_iterator i = peptides.begin(); i != peptides.end(); ++i) {
+    col.PutVarint(ZigZag(i->id() - last_id));
+    last_id = i->id();
+  }
+  unsigned long long last_mass = 0;
+  for (vector<pb::Peptide>::const_iterator i = peptides.begin(); i != peptides.end(); ++i) {
+    unsigned long long bits = MassBits(i->mass());
+    col.PutVarint(ZigZag((long long)(bits - last_mass)));
+    last_mass = bits;
+  }
+
+  vector<string> residuals(peptides.size());
+  for (size_t k = 0; k < peptides.size(); ++k) {
+    const pb::Peptide& peptide = peptides[k];
+    pb::Peptide residual(peptide);
+    residual.clear_id();
+    residual.clear_mass();
+    residual.clear_length();
+    if (HasFullLocation(peptide)) {
+      residual.clear_first_location();
+    }
+    residual.clear_modifications();
+    residual.clear_decoy_index();
+    residual.clear_nterm_mod();
+    residual.clear_cterm_mod();
+    unsigned char flags = 0;
+    if (HasFullLocation(peptide)) flags |= FLAG_LOCATION;
+    if (peptide.has_decoy_index()) flags |= FLAG_DECOY_INDEX;
+    if (peptide.has_nterm_mod()) flags |= FLAG_NTERM_MOD;
+    if (peptide.has_cterm_mod()) flags |= FLAG_CTERM_MOD;
+    if (residual.ByteSizeLong() > 0) {
+      flags |= FLAG_RESIDUAL;
+      residual.SerializeToString(&residuals[k]);
+    }
+    raw->push_back((char)flags);
+  }
+
+  for (vector<pb::Peptide>::const_iterator i = peptides.begin(); i != peptides.end(); ++i) {
+    col.PutBits(i->length(), w_len);
+  }
+  col.AlignBits();
+  for (vector<pb::Peptide>::const_iterator i = peptides.begin(); i != peptides.end(); ++i) {
+    if (HasFullLocation(*i)) {
+      col.PutBits(i->first_location().protein_id(), w_prot);
+    }
+  }
+  col.AlignBits();
+  for (vector<pb::Peptide>::const_iterator i = peptides.begin(); i != peptides.end(); ++i) {
+    if (HasFullLocation(*i)) {
+      col.PutBits(i->first_location().pos(), w_pos);
+    }
+  }
+  col.AlignBits();
+  for (vector<pb::Peptide>::const_iterator i = peptides.begin(); i != peptides.end(); ++i) {
+    col.PutBits(i->modifications_size(), w_nmods);
+  }
+  col.AlignBits();
+  for (vector<pb::Peptide>::const_iterator i = peptides.begin(); i != peptides.end(); ++i) {
+    for (int m = 0; m < i->modifications_size(); ++m) {
+      col.PutVarint(ZigZag(i->modifications(m)));
+    }
+  }
+  for (vector<pb::Peptide>::const_iterator i = peptides.begin(); i != peptides.end(); ++i) {
+    if (i->has_decoy_index()) {
+      col.PutVarint(ZigZag(i->decoy_index()));
+    }
+  }
+  for (vector<pb::Peptide>::const_iterator i = peptides.begin(); i != peptides.end(); ++i) {
+    if (i->has_nterm_mod()) {
+      col.PutVarint(ZigZag(i->nterm_mod()));
+    }
+  }
+  for (vector<pb::Peptide>::const_iterator i = peptides.begin(); i != peptides.end(); ++i) {
+    if (i->has_cterm_mod()) {
+      col.PutVarint(ZigZag(i->cterm_mod()));
+    }
+  }
+  for (vector<string>::const_iterator i = residuals.begin(); i != residuals.end(); ++i) {
+    if (!i->empty()) {
+      col.PutVarint(i->size());
+      raw->append(*i);
+    }
+  }
+}
+
+bool DecodeBlock(const string& raw, vector<pb::Peptide>* peptides) {
+  ColumnReader col(raw.data(), raw.data() + raw.size());
+  size_t n = col.GetVarint();
+  int w_len = col.GetVarint();
+  int w_prot = col.GetVarint();
+  int w_pos = col.GetVarint();
+  int w_nmods = col.GetVarint();
+  if (!col.OK() || w_len > 32 || w_prot > 32 || w_pos > 32 || w_nmods > 32) {
+    return false;
+  }
+  peptides->clear();
+  peptides->resize(n);
+
+  long long id = 0;
+  for (size_t k = 0; k < n; ++k) {
+    id += UnZigZag(col.GetVarint());
+    (*peptides)[k].set_id(id);
+  }
+  unsigned long long mass = 0;
+  for (size_t k = 0; k < n; ++k) {
+    mass += (unsigned long long)UnZigZag(col.GetVarint());
+    (*peptides)[k].set_mass(BitsMass(mass));
+  }
+  const char* flags = col.GetBytes(n);
+  if (!col.OK()) {
+    return false;
+  }
+
+  for (size_t k = 0; k < n; ++k) {
+    (*peptides)[k].set_length(col.GetBits(w_len));
+  }
+  col.AlignBits();
+  for (size_t k = 0; k < n; ++k) {
+    if (flags[k] & FLAG_LOCATION) {
+      (*peptides)[k].mutable_first_location()->set_protein_id(col.GetBits(w_prot));
+    }
+  }
+  col.AlignBits();
+  for (size_t k = 0; k < n; ++k) {
+    if (flags[k] & FLAG_LOCATION) {
+      (*peptides)[k].mutable_first_location()->set_pos(col.GetBits(w_pos));
+    }
+  }
+  col.AlignBits();
+  vector<int> nmods(n);
+  for (size_t k = 0; k < n; ++k) {
+    nmods[k] = col.GetBits(w_nmods);
+  }
+  col.AlignBits();
+  for (size_t k = 0; k < n; ++k) {
+    for (int m = 0; m < nmods[k]; ++m) {
+      (*peptides)[k].add_modifications(UnZigZag(col.GetVarint()));
+    }
+  }
+  for (size_t k = 0; k < n; ++k) {
+    if (flags[k] & FLAG_DECOY_INDEX) {
+      (*peptides)[k].set_decoy_index(UnZigZag(col.GetVarint()));
+    }
+  }
+  for (size_t k = 0; k < n; ++k) {
+    if (flags[k] & FLAG_NTERM_MOD) {
+      (*peptides)[k].set_nterm_mod(UnZigZag(col.GetVarint()));
+    }
+  }
+  for (size_t k = 0; k < n; ++k) {
+    if (flags[k] & FLAG_CTERM_MOD) {
+      (*peptides)[k].set_cterm_mod(UnZigZag(col.GetVarint()));
+    }
+  }
+  for (size_t k = 0; k < n; ++k) {
+    if (flags[k] & FLAG_RESIDUAL) {
+      size_t size = col.GetVarint();
+      const char* bytes = col.GetBytes(size);
+      if (!col.OK() || !(*peptides)[k].MergeFromString(string(bytes, size))) {
+        return false;
+      }
+    }
+  }
+  return col.OK();
+}
+
+} // namespace
+
+PeptideBlockWriter::PeptideBlockWriter(const string& filename)
+  : out_(filename.c_str(), ios::out | ios::binary | ios::trunc), closed_(false) {
+  if (!out_.good()) {
+    carp(CARP_FATAL, "Couldn't open file %s for write.", filename.c_str());
+    return;
+  }
+  unsigned int magic = PEPTIDE_BLOCKS_MAGIC_NUMBER;
+  WriteRaw(out_, magic);
+  pending_.reserve(kPeptidesPerBlock);
+}
+
+PeptideBlockWriter::~PeptideBlockWriter() {
+  Close();
+}
+
+bool PeptideBlockWriter::Write(const pb::Peptide* peptide) {
+  pending_.push_back(*peptide);
+  if (pending_.size() >= kPeptidesPerBlock) {
+    FlushBlock();
+  }
+  return out_.good();
+}
+
+void PeptideBlockWriter::FlushBlock() {
+  if (pending_.empty()) {
+    return;
+  }
+  string raw;
+  EncodeBlock(pending_, &raw);
+  string compressed = Compress(raw);
+
+  DirectoryEntry entry;
+  entry.offset = (unsigned long long)out_.tellp();
+  entry.num_peptides = pending_.size();
+  entry.min_mass = pending_.front().mass();
+  entry.max_mass = pending_.back().mass();
+  directory_.push_back(entry);
+
+  WriteRaw(out_, entry.num_peptides);
+  WriteRaw(out_, (unsigned int)raw.size());
+  WriteRaw(out_, (unsigned int)compressed.size());
+  WriteRaw(out_, entry.min_mass);
+  WriteRaw(out_, entry.max_mass);
+  out_.write(compressed.data(), compressed.size());
+  pending_.clear();
+}
+
+bool PeptideBlockWriter::Close() {
+  if (closed_) {
+    return out_.good();
+  }
+  closed_ = true;
+  FlushBlock();
+  unsigned long long directory_offset = (unsigned long long)out_.tellp();
+  WriteRaw(out_, (unsigned int)directory_.size());
+  for (vector<DirectoryEntry>::const_iterator i = directory_.begin(); i != directory_.end(); ++i) {
+    WriteRaw(out_, i->offset);
+    WriteRaw(out_, i->num_peptides);
+    WriteRaw(out_, i->min_mass);
+    WriteRaw(out_, i->max_mass);
+  }
+  WriteRaw(out_, directory_offset);
+  unsigned int magic = PEPTIDE_BLOCKS_MAGIC_NUMBER;
+  WriteRaw(out_, magic);
+  out_.close();
+  return !out_.fail();
+}
+
+bool PeptideBlockWriter::ConvertRecords(const string& pepix_file) {
+  pb::Header header;
+  unsigned long long count = 0;
+  {
+    HeadedRecordReader reader(pepix_file, &header);
+    if (header.file_type() != pb::Header::PEPTIDES || !header.has_peptides_header()) {
+      return false;
+    }
+    PeptideBlockWriter writer(BlocksFileName(pepix_file));
+    if (!writer.OK()) {
+      return false;
+    }
+    pb::Peptide peptide;
+    while (!reader.Done()) {
+      if (!reader.Read(&peptide) || !writer.Write(&peptide)) {
+        return false;
+      }
+      ++count;
+    }
+    if (!reader.OK() || !writer.Close()) {
+      return false;
+    }
+  }
+  header.mutable_peptides_header()->set_block_encoded(true);
+  string header_file = pepix_file + ".header.tmp";
+  {
+    HeadedRecordWriter writer(header_file, header);
+    if (!writer.OK()) {
+      return false;
+    }
+  }
+  FileUtils::Remove(pepix_file);
+  FileUtils::Rename(header_file, pepix_file);
+  carp(CARP_INFO, "Stored %llu peptides in %d-peptide compressed blocks.",
+       count, kPeptidesPerBlock);
+  return true;
+}
+
+PeptideBlockReader::PeptideBlockReader(const string& filename)
+  : in_(filename.c_str(), ios::in | ios::binary),
+    next_block_(0), next_peptide_(0), blocks_skipped_(0), valid_(false) {
+  unsigned int magic = 0;
+  if (!ReadRaw(in_, &magic) || magic != PEPTIDE_BLOCKS_MAGIC_NUMBER) {
+    return;
+  }
+  // The trailer holds the directory offset followed by the magic number.
+  unsigned long long directory_offset = 0;
+  in_.seekg(-(streamoff)(sizeof(directory_offset) + sizeof(magic)), ios::end);
+  if (!ReadRaw(in_, &directory_offset) || !ReadRaw(in_, &magic) ||
+      magic != PEPTIDE_BLOCKS_MAGIC_NUMBER) {
+    return;
+  }
+  in_.seekg((streamoff)directory_offset, ios::beg);
+  unsigned int num_blocks = 0;
+  if (!ReadRaw(in_, &num_blocks)) {
+    return;
+  }
+  directory_.resize(num_blocks);
+  for (vector<DirectoryEntry>::iterator i = directory_.begin(); i != directory_.end(); ++i) {
+    if (!ReadRaw(in_, &i->offset) || !ReadRaw(in_, &i->num_peptides) ||
+        !ReadRaw(in_, &i->min_mass) || !ReadRaw(in_, &i->max_mass)) {
+      return;
+    }
+  }
+  valid_ = true;
+}
+
+bool PeptideBlockReader::Done() {
+  if (!valid_) {
+    return true;
+  }
+  while (next_peptide_ >= block_.size()) {
+    if (next_block_ >= (int)directory_.size()) {
+      return true;
+    }
+    if (!LoadBlock(next_block_++)) {
+      valid_ = false;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PeptideBlockReader::Read(pb::Peptide* peptide) {
+  if (!valid_ || next_peptide_ >= block_.size()) {
+    return false;
+  }
+  peptide->Swap(&block_[next_peptide_++]);
+  return true;
+}
+
+void PeptideBlockReader::SkipBelow(double mass) {
+  if (!valid_ || next_peptide_ < block_.size()) {
+    return;
+  }
+  while (next_block_ < (int)directory_.size() &&
+         directory_[next_block_].max_mass < mass) {
+    ++next_block_;
+    ++blocks_skipped_;
+  }
+}
+
+void PeptideBlockReader::Rewind() {
+  block_.clear();
+  next_block_ = 0;
+  next_peptide_ = 0;
+}
+
+bool PeptideBlockReader::LoadBlock(int block) {
+  const DirectoryEntry& entry = directory_[block];
+  in_.clear();
+  in_.seekg((streamoff)entry.offset, ios::beg);
+  unsigned int num_peptides, raw_size, compressed_size;
+  double min_mass, max_mass;
+  if (!ReadRaw(in_, &num_peptides) || !ReadRaw(in_, &raw_size) ||
+      !ReadRaw(in_, &compressed_size) || !ReadRaw(in_, &min_mass) ||
+      !ReadRaw(in_, &max_mass) || num_peptides != entry.num_peptides) {
+    return false;
+  }
+  string compressed(compressed_size, '\0');
+  if (compressed_size > 0) {
+    in_.read(&compressed[0], compressed_size);
+    if (!in_.good()) {
+      return false;
+    }
+  }
+  string raw;
+  if (!Decompress(compressed, raw_size, &raw) || !DecodeBlock(raw, &block_)) {
+    return false;
+  }
+  next_peptide_ = 0;
+  return block_.size() == num_peptides;
+}
+
+PeptideReader::PeptideReader(const string& pepix_file)
+  : pepix_file_(pepix_file), record_reader_(NULL), block_reader_(NULL) {
+  record_reader_ = new HeadedRecordReader(pepix_file, &header_);
+  if (header_.has_peptides_header() && header_.peptides_header().block_encoded()) {
+    // the pepix file only holds the header
+    delete record_reader_;
+    record_reader_ = NULL;
+    block_reader_ = new PeptideBlockReader(PeptideBlockWriter::BlocksFileName(pepix_file));
+  }
+}
+
+PeptideReader::~PeptideReader() {
+  delete record_reader_;
+  delete block_reader_;
+}
+
+bool PeptideReader::OK() const {
+  return block_reader_ ? block_reader_->OK() : record_reader_->OK();
+}
+
+bool PeptideReader::Done() {
+  return block_reader_ ? block_reader_->Done() : record_reader_->Done();
+}
+
+bool PeptideReader::Read(pb::Peptide* peptide) {
+  return block_reader_ ? block_reader_->Read(peptide) : record_reader_->Read(peptide);
+}
+
+void PeptideReader::SkipBelow(double mass) {
+  if (block_reader_) {
+    // only whole blocks are skipped
+    block_reader_->SkipBelow(mass);
+  }
+}
+
+void PeptideReader::Rewind() {
+  if (block_reader_) {
+    block_reader_->Rewind();
+  } else {
+    // records are only read forward, so read the file again
+    delete record_reader_;
+    record_reader_ = new HeadedRecordReader(pepix_file_, &header_);
+  }
+}
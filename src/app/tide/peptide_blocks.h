@@ -0,0 +1,156 @@
+// Block-compressed storage for the peptide index.
+//
+// A plain pepix file stores one varint-prefixed pb::Peptide record after
+// another (see records.h). For indexes with many decoys and modifications
+// this file can grow to hundreds of GB and reading it dominates search time.
+// The block encoding stores the same peptides, in the same (mass-sorted)
+// order, in a sidecar file "pepix.blocks":
+//
+//   magic number (4 bytes)
+//   block 0 .. block n-1
+//   block directory
+//   directory offset (8 bytes), magic number (4 bytes)
+//
+// Each block holds up to kPeptidesPerBlock peptides. Inside a block the fields
+// are stored column by column: ids and masses are delta-encoded as zig-zag
+// varints (masses through their IEEE bit pattern, which keeps the encoding
+// lossless and the deltas small since the masses are sorted), lengths,
+// protein ids, positions and modification counts are bit-packed with a
+// per-block bit width, and modification codes are varints. The remaining,
+// rarely populated fields (decoy sequences, aux locations, ...) are kept as a
+// serialized residual pb::Peptide. The whole column set is then compressed
+// with zlib at its fastest setting.
+//
+// Every block header and the directory at the end of the file carry the
+// block's mass range, so a reader can skip blocks that are lighter than the
+// lowest precursor mass it will ever ask for without decompressing them.
+//
+// The pepix file of a block-encoded index keeps only its header record, with
+// PeptidesHeader.block_encoded set, so all code that inspects the header keeps
+// working unchanged.
+
+#ifndef PEPTIDE_BLOCKS_H
+#define PEPTIDE_BLOCKS_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "peptides.pb.h"
+#include "records.h"
+
+using namespace std;
+
+#define PEPTIDE_BLOCKS_MAGIC_NUMBER 0xfead1235ul
+
+class PeptideBlockWriter {
+ public:
+  static const int kPeptidesPerBlock = 4096;
+
+  explicit PeptideBlockWriter(const string& filename);
+  ~PeptideBlockWriter();
+
+  // client should check once after construction
+  bool OK() const { return out_.good(); }
+
+  // Peptides must be written in order of non-decreasing mass.
+  bool Write(const pb::Peptide* peptide);
+
+  // Flush the last block and write the block directory.
+  bool Close();
+
+  // Rewrite the peptide records in pepix_file into the block encoding. On
+  // success, pepix_file is replaced by a header-only file that points to
+  // pepix_file + ".blocks".
+  static bool ConvertRecords(const string& pepix_file);
+
+  static string BlocksFileName(const string& pepix_file) {
+    return pepix_file + ".blocks";
+  }
+
+ private:
+  struct DirectoryEntry {
+    unsigned long long offset;
+    unsigned int num_peptides;
+    double min_mass;
+    double max_mass;
+  };
+
+  void FlushBlock();
+
+  ofstream out_;
+  vector<pb::Peptide> pending_;
+  vector<DirectoryEntry> directory_;
+  bool closed_;
+};
+
+class PeptideBlockReader {
+ public:
+  explicit PeptideBlockReader(const string& filename);
+
+  bool OK() const { return valid_; }
+
+  // Same contract as RecordReader: Done() must be called before each Read().
+  bool Done();
+  bool Read(pb::Peptide* peptide);
+
+  // Drop whole blocks whose heaviest peptide is lighter than mass. Only skips
+  // at block boundaries, so peptides lighter than mass may still be returned
+  // and callers must keep filtering as they would for a plain record reader.
+  void SkipBelow(double mass);
+
+  // Start over from the first block.
+  void Rewind();
+
+  int NumBlocks() const { return (int)directory_.size(); }
+  int BlocksSkipped() const { return blocks_skipped_; }
+
+ private:
+  struct DirectoryEntry {
+    unsigned long long offset;
+    unsigned int num_peptides;
+    double min_mass;
+    double max_mass;
+  };
+
+  bool LoadBlock(int block);
+
+  ifstream in_;
+  vector<DirectoryEntry> directory_;
+  vector<pb::Peptide> block_;
+  int next_block_;
+  size_t next_peptide_;
+  int blocks_skipped_;
+  bool valid_;
+};
+
+// Reads the peptides of an index from its pepix file, or from the block
+// encoding the pepix file points to, so that callers need not care which one
+// the index uses.
+class PeptideReader {
+ public:
+  explicit PeptideReader(const string& pepix_file);
+  ~PeptideReader();
+
+  // client should check once after construction
+  bool OK() const;
+  const pb::Header& Header() const { return header_; }
+
+  // Same contract as RecordReader: Done() must be called before each Read().
+  bool Done();
+  bool Read(pb::Peptide* peptide);
+
+  // Skip peptides lighter than mass where the encoding allows it; callers
+  // must keep filtering, as for PeptideBlockReader::SkipBelow.
+  void SkipBelow(double mass);
+
+  // Start over from the lightest peptide.
+  void Rewind();
+
+ private:
+  string pepix_file_;
+  pb::Header header_;
+  HeadedRecordReader* record_reader_;
+  PeptideBlockReader* block_reader_;
+};
+
+#endif // PEPTIDE_BLOCKS_H
@@ -0,0 +1,193 @@
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include "search_checkpoint.h"
+#include "io/carp.h"
+#include "util/FileUtils.h"
+
+// Journal format, one record per line:
+//
+//   tide-search-checkpoint 1
+//   fingerprint <hash>
+//   spectrumrecords <file> <keep> <path>
+//   output <length> <path>
+//   watermark <sequence>
+//   done <sequence> ...
+//   end
+//
+// The end line tells a complete journal from one cut short.
+
+static const char* kMagic = "tide-search-checkpoint";
+static const int kVersion = 1;
+
+SearchCheckpoint::SearchCheckpoint(const string& path, int interval, const string& fingerprint)
+  : path_(path), interval_(interval), fingerprint_(fingerprint), resuming_(false),
+    watermark_(0), since_write_(0) {
+}
+
+bool SearchCheckpoint::Load() {
+  ifstream in(path_.c_str());
+  if (!in.good()) {
+    return false;
+  }
+  string magic, key;
+  int version = 0;
+  in >> magic >> version;
+  if (magic != kMagic || version != kVersion) {
+    carp(CARP_FATAL, "%s is not a tide-search checkpoint.", path_.c_str());
+  }
+  bool complete = false;
+  while (in >> key) {
+    if (key == "fingerprint") {
+      string fingerprint;
+      in >> fingerprint;
+      if (fingerprint != fingerprint_) {
+        carp(CARP_FATAL, "The checkpoint %s was written by a search with different "
+             "input files or parameters; it cannot be resumed.", path_.c_str());
+      }
+    } else if (key == "spectrumrecords") {
+      int file;
+      bool keep;
+      string records;
+      in >> file >> keep >> ws;
+      getline(in, records);
+      spectrum_records_[file] = make_pair(records, keep);
+    } else if (key == "output") {
+      unsigned long long length;
+      string output;
+      in >> length >> ws;
+      getline(in, output);
+      output_lengths_[output] = length;
+    } else if (key == "watermark") {
+      in >> watermark_;
+    } else if (key == "done") {
+      unsigned long long sequence;
+      while (in.peek() != '\n' && in >> sequence) {
+        done_.insert(sequence);
+      }
+    } else if (key == "end") {
+      complete = true;
+      break;
+    } else {
+      break;
+    }
+  }
+  if (!complete) {
+    carp(CARP_FATAL, "The checkpoint %s is corrupt.", path_.c_str());
+  }
+  resuming_ = true;
+  carp(CARP_INFO, "Resuming the search from %s: %llu spectrum-charge combinations "
+       "were searched.", path_.c_str(), NumDone());
+  return true;
+}
+
+void SearchCheckpoint::SetSpectrumRecords(int file, const string& records, bool keep) {
+  boost::mutex::scoped_lock lock(mutex_);
+  spectrum_records_[file] = make_pair(records, keep);
+}
+
+bool SearchCheckpoint::GetSpectrumRecords(int file, string* records, bool* keep) const {
+  boost::mutex::scoped_lock lock(mutex_);
+  map<int, pair<string, bool> >::const_iterator i = spectrum_records_.find(file);
+  if (!resuming_ || i == spectrum_records_.end() ||
+      !FileUtils::Exists(i->second.first)) {
+    return false;
+  }
+  *records = i->second.first;
+  *keep = i->second.second;
+  return true;
+}
+
+void SearchCheckpoint::AddOutput(const string& path, ofstream* stream) {
+  outputs_.push_back(make_pair(path, stream));
+}
+
+bool SearchCheckpoint::OutputLength(const string& path, unsigned long long* length) const {
+  map<string, unsigned long long>::const_iterator i = output_lengths_.find(path);
+  if (!resuming_ || i == output_lengths_.end()) {
+    return false;
+  }
+  *length = i->second;
+  return true;
+}
+
+bool SearchCheckpoint::Done(unsigned long long sequence) const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return sequence < watermark_ || done_.count(sequence) > 0;
+}
+
+unsigned long long SearchCheckpoint::NumDone() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return watermark_ + done_.size();
+}
+
+void SearchCheckpoint::SetDone(unsigned long long sequence) {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (sequence == watermark_) {
+    ++watermark_;
+    set<unsigned long long>::iterator i = done_.begin();
+    while (i != done_.end() && *i == watermark_) {
+      ++watermark_;
+      done_.erase(i++);
+    }
+  } else {
+    done_.insert(sequence);
+  }
+  if (++since_write_ >= interval_) {
+    WriteJournal();
+  }
+}
+
+void SearchCheckpoint::Write() {
+  boost::mutex::scoped_lock lock(mutex_);
+  WriteJournal();
+}
+
+void SearchCheckpoint::WriteJournal() {
+  since_write_ = 0;
+  string temp_path = path_ + ".tmp";
+  ofstream out(temp_path.c_str());
+  if (!out.good()) {
+    carp(CARP_ERROR, "Could not write the checkpoint %s.", temp_path.c_str());
+    return;
+  }
+  out << kMagic << ' ' << kVersion << '\n'
+      << "fingerprint " << fingerprint_ << '\n';
+  for (map<int, pair<string, bool> >::const_iterator i = spectrum_records_.begin();
+       i != spectrum_records_.end(); ++i) {
+    out << "spectrumrecords " << i->first << ' ' << i->second.second << ' '
+        << i->second.first << '\n';
+  }
+  for (vector<pair<string, ofstream*> >::const_iterator i = outputs_.begin();
+       i != outputs_.end(); ++i) {
+    i->second->flush();
+    out << "output " << (unsigned long long)i->second->tellp() << ' ' << i->first << '\n';
+  }
+  out << "watermark " << watermark_ << '\n'
+      << "done";
+  for (set<unsigned long long>::const_iterator i = done_.begin(); i != done_.end(); ++i) {
+    out << ' ' << *i;
+  }
+  out << '\n'
+      << "end\n";
+  out.close();
+  if (out.fail() || rename(temp_path.c_str(), path_.c_str()) != 0) {
+    carp(CARP_ERROR, "Could not write the checkpoint %s.", path_.c_str());
+  }
+}
+
+void SearchCheckpoint::Remove() {
+  remove(path_.c_str());
+}
+
+string SearchCheckpoint::Hash(const string& text) {
+  // 64-bit FNV-1a
+  unsigned long long hash = 14695981039346656037ULL;
+  for (string::const_iterator i = text.begin(); i != text.end(); ++i) {
+    hash ^= (unsigned char)*i;
+    hash *= 1099511628211ULL;
+  }
+  ostringstream out;
+  out << hex << setw(16) << setfill('0') << hash;
+  return out.str();
+}
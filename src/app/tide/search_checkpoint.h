@@ -0,0 +1,94 @@
+// Checkpoints of a tide-search, so an interrupted search can be resumed.
+//
+// Spectra are taken from the spectrum heap in order of neutral mass, which
+// depends only on the input files, so every spectrum gets the same sequence
+// number in every run over the same inputs. Threads finish spectra out of
+// order, so the journal records the sequence number below which all spectra
+// are done (the watermark), the spectra done above it, and the length of each
+// output file. Since a spectrum is marked done in the same critical section in
+// which its results are written, the output up to those lengths holds exactly
+// the results of the spectra in the journal.
+//
+// When resuming, the output files are truncated to the journaled lengths and
+// appended to, the spectra in the journal are skipped, and the spectrumrecords
+// files converted by the interrupted run are reused.
+//
+// The journal is a small text file, replaced atomically (written to a
+// temporary file and renamed) every checkpoint interval.
+//
+// Spectra are marked done and files converted on different threads, under
+// different locks of the search, so the checkpoint guards its state with its
+// own mutex.
+
+#ifndef SEARCH_CHECKPOINT_H
+#define SEARCH_CHECKPOINT_H
+
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+using namespace std;
+
+class SearchCheckpoint {
+ public:
+  // Checkpoint to the journal at path every interval spectra. The fingerprint
+  // identifies the inputs and parameters of the search; a journal with a
+  // different fingerprint cannot be resumed.
+  SearchCheckpoint(const string& path, int interval, const string& fingerprint);
+
+  // Read the journal of an interrupted search. Returns false if there is no
+  // journal; fails if it belongs to a different search.
+  bool Load();
+  bool Resuming() const { return resuming_; }
+
+  // The spectrumrecords file that input file was converted to. Get returns
+  // false unless the interrupted search converted it and the file still
+  // exists.
+  void SetSpectrumRecords(int file, const string& records, bool keep);
+  bool GetSpectrumRecords(int file, string* records, bool* keep) const;
+
+  // Output files are recorded by path. OutputLength returns false if the
+  // interrupted search did not write path.
+  void AddOutput(const string& path, ofstream* stream);
+  bool OutputLength(const string& path, unsigned long long* length) const;
+
+  // Whether the spectrum was searched by the interrupted search.
+  bool Done(unsigned long long sequence) const;
+  unsigned long long NumDone() const;
+
+  // Mark a spectrum as searched, once its results have been written. Writes
+  // a checkpoint every interval spectra. The caller must hold the lock on the
+  // output files, so the journaled lengths match the journaled spectra.
+  void SetDone(unsigned long long sequence);
+
+  // Flush the outputs and write the journal.
+  void Write();
+
+  // Delete the journal, once the search has completed.
+  void Remove();
+
+  // A short, stable hash of text, for the fingerprint.
+  static string Hash(const string& text);
+
+ private:
+  void WriteJournal();  // Write, with mutex_ held
+
+  mutable boost::mutex mutex_;
+  string path_;
+  int interval_;
+  string fingerprint_;
+  bool resuming_;
+
+  map<int, pair<string, bool> > spectrum_records_;
+  vector<pair<string, ofstream*> > outputs_;
+  map<string, unsigned long long> output_lengths_;  // from the journal
+
+  unsigned long long watermark_;
+  set<unsigned long long> done_;  // done spectra at or above watermark_
+  int since_write_;
+};
+
+#endif // SEARCH_CHECKPOINT_H
@@ -0,0 +1,122 @@
+#include <fstream>
+#include <iomanip>
+#include "search_profile.h"
+#include "io/carp.h"
+
+SearchProfile::Counters::Counters() {
+  for (int i = 0; i < NUMBER_PHASES; ++i) {
+    time_[i] = chrono::steady_clock::duration::zero();
+    calls_[i] = 0;
+  }
+  for (int i = 0; i < kHistogramBuckets; ++i) {
+    candidates_[i] = 0;
+    queue_sizes_[i] = 0;
+  }
+}
+
+int SearchProfile::Counters::Bucket(int value) {
+  int bucket = 0;
+  for (unsigned int v = value > 0 ? value : 0; v > 0 && bucket < kHistogramBuckets - 1; v >>= 1) {
+    ++bucket;
+  }
+  return bucket;
+}
+
+SearchProfile::SearchProfile() {
+}
+
+SearchProfile::~SearchProfile() {
+  for (vector<Counters*>::iterator i = counters_.begin(); i != counters_.end(); ++i) {
+    delete *i;
+  }
+}
+
+SearchProfile::Counters* SearchProfile::NewCounters() {
+  boost::mutex::scoped_lock lock(mutex_);
+  counters_.push_back(new Counters());
+  return counters_.back();
+}
+
+const char* SearchProfile::PhaseName(Phase phase) {
+  switch (phase) {
+    case SPECTRUM_READING:           return "spectrum_reading";
+    case LOCK_WAIT_SPECTRUM_READING: return "lock_wait_spectrum_reading";
+    case LOCK_WAIT_CANDIDATES:       return "lock_wait_candidates";
+    case LOCK_WAIT_RESULTS:          return "lock_wait_results";
+    case ACTIVE_RANGE:               return "set_active_range";
+    case THEORETICAL_PEAKS:          return "theoretical_peaks";
+    case PREPROCESSING:              return "preprocessing";
+    case SCORING:                    return "scoring";
+    case TOP_K:                      return "top_k_selection";
+    case ADDITIONAL_SCORES:          return "additional_scores";
+    case OUTPUT:                     return "output";
+    default:                         return "unknown";
+  }
+}
+
+void SearchProfile::WriteHistogram(ostream& out, const unsigned long long* buckets) {
+  // Only write up to the last non-empty bucket
+  int end = kHistogramBuckets;
+  while (end > 0 && buckets[end - 1] == 0) {
+    --end;
+  }
+  out << "[";
+  for (int i = 0; i < end; ++i) {
+    unsigned long long lower = i == 0 ? 0 : 1ULL << (i - 1);
+    unsigned long long upper = i == 0 ? 0 : (1ULL << i) - 1;
+    out << (i > 0 ? ", " : "")
+        << "{\"min\": " << lower << ", \"max\": " << upper
+        << ", \"count\": " << buckets[i] << "}";
+  }
+  out << "]";
+}
+
+void SearchProfile::Write(const string& path, double wall_seconds, int threads,
+                          unsigned long long spectra_searched) const {
+  Counters total;
+  for (vector<Counters*>::const_iterator c = counters_.begin(); c != counters_.end(); ++c) {
+    for (int i = 0; i < NUMBER_PHASES; ++i) {
+      total.time_[i] += (*c)->time_[i];
+      total.calls_[i] += (*c)->calls_[i];
+    }
+    for (int i = 0; i < kHistogramBuckets; ++i) {
+      total.candidates_[i] += (*c)->candidates_[i];
+      total.queue_sizes_[i] += (*c)->queue_sizes_[i];
+    }
+  }
+
+  ofstream out(path.c_str());
+  if (!out.good()) {
+    carp(CARP_ERROR, "Could not write the search profile to %s.", path.c_str());
+    return;
+  }
+  out << setprecision(6) << fixed;
+  out << "{\n"
+      << "  \"wall_time_seconds\": " << wall_seconds << ",\n"
+      << "  \"threads\": " << threads << ",\n"
+      << "  \"spectra_searched\": " << spectra_searched << ",\n"
+      << "  \"phases\": {\n";
+  for (int i = 0; i < NUMBER_PHASES; ++i) {
+    double seconds = chrono::duration<double>(total.time_[i]).count();
+    out << "    \"" << PhaseName((Phase)i) << "\": {\"seconds\": " << seconds
+        << ", \"calls\": " << total.calls_[i] << "}"
+        << (i < NUMBER_PHASES - 1 ? ",\n" : "\n");
+  }
+  out << "  },\n"
+      << "  \"threads_seconds\": [\n";
+  for (size_t c = 0; c < counters_.size(); ++c) {
+    out << "    {";
+    for (int i = 0; i < NUMBER_PHASES; ++i) {
+      out << (i > 0 ? ", " : "") << "\"" << PhaseName((Phase)i) << "\": "
+          << chrono::duration<double>(counters_[c]->time_[i]).count();
+    }
+    out << "}" << (c < counters_.size() - 1 ? ",\n" : "\n");
+  }
+  out << "  ],\n"
+      << "  \"candidates_per_spectrum\": ";
+  WriteHistogram(out, total.candidates_);
+  out << ",\n"
+      << "  \"active_queue_size\": ";
+  WriteHistogram(out, total.queue_sizes_);
+  out << "\n}\n";
+}
@@ -0,0 +1,115 @@
+// Per-phase performance counters of a search.
+//
+// Every search thread owns one SearchProfile::Counters, obtained from
+// NewCounters() before it starts, and is the only one to write to it, so
+// recording a phase is a clock read and an addition, with no locks or atomic
+// operations. The counters of all threads are only summed up by Write(), once
+// the threads have been joined, and written to a JSON file.
+//
+// A phase is timed by putting a ScopedPhaseTimer on the stack, which records
+// it at the end of the scope or at Stop(), whichever comes first. A timer with
+// NULL counters does nothing, so instrumented code runs unchanged when the
+// profile is not enabled.
+
+#ifndef SEARCH_PROFILE_H
+#define SEARCH_PROFILE_H
+
+#include <boost/thread/mutex.hpp>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class SearchProfile {
+ public:
+  enum Phase {
+    SPECTRUM_READING,          // reading and decoding spectrum records
+    LOCK_WAIT_SPECTRUM_READING,
+    LOCK_WAIT_CANDIDATES,
+    LOCK_WAIT_RESULTS,
+    ACTIVE_RANGE,              // SetActiveRange(), including THEORETICAL_PEAKS
+    THEORETICAL_PEAKS,         // theoretical peaks of peptides entering the queue
+    PREPROCESSING,             // observed spectrum preprocessing
+    SCORING,
+    TOP_K,                     // selection of the top-N target and decoy PSMs
+    ADDITIONAL_SCORES,         // delta scores, Tailor, Sp of the top-N PSMs
+    OUTPUT,                    // formatting and writing the results
+    NUMBER_PHASES
+  };
+
+  // Histograms use power of two buckets: bucket 0 counts the value 0 and
+  // bucket i > 0 counts the values in [2^(i-1), 2^i).
+  static const int kHistogramBuckets = 32;
+
+  class Counters {
+   public:
+    Counters();
+
+    void AddTime(Phase phase, chrono::steady_clock::duration elapsed) {
+      time_[phase] += elapsed;
+      ++calls_[phase];
+    }
+    void AddCandidates(int candidates) {
+      ++candidates_[Bucket(candidates)];
+    }
+    void AddQueueSize(int queue_size) {
+      ++queue_sizes_[Bucket(queue_size)];
+    }
+
+    chrono::steady_clock::duration time_[NUMBER_PHASES];
+    unsigned long long calls_[NUMBER_PHASES];
+    unsigned long long candidates_[kHistogramBuckets];
+    unsigned long long queue_sizes_[kHistogramBuckets];
+
+   private:
+    static int Bucket(int value);
+  };
+
+  SearchProfile();
+  ~SearchProfile();
+
+  // Counters for a new search thread. Thread safe.
+  Counters* NewCounters();
+
+  // Sum the counters of all threads and write them to a JSON file. Must only
+  // be called when no thread is recording anymore.
+  void Write(const string& path, double wall_seconds, int threads,
+             unsigned long long spectra_searched) const;
+
+  static const char* PhaseName(Phase phase);
+
+ private:
+  static void WriteHistogram(ostream& out, const unsigned long long* buckets);
+
+  vector<Counters*> counters_;
+  boost::mutex mutex_;
+};
+
+class ScopedPhaseTimer {
+ public:
+  ScopedPhaseTimer(SearchProfile::Counters* counters, SearchProfile::Phase phase)
+    : counters_(counters), phase_(phase) {
+    if (counters_ != NULL) {
+      start_ = chrono::steady_clock::now();
+    }
+  }
+  ~ScopedPhaseTimer() {
+    Stop();
+  }
+
+  // Record the phase now rather than at the end of the scope.
+  void Stop() {
+    if (counters_ != NULL) {
+      counters_->AddTime(phase_, chrono::steady_clock::now() - start_);
+      counters_ = NULL;
+    }
+  }
+
+ private:
+  SearchProfile::Counters* counters_;
+  SearchProfile::Phase phase_;
+  chrono::steady_clock::time_point start_;
+};
+
+#endif // SEARCH_PROFILE_H
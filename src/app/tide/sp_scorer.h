@@ -27,6 +27,15 @@
 // 
 // num_ions:
 // The total number of ions we tried to match with the spectrum.
+//
+// The b and y ions are not recomputed from the peptide sequence. Their m/z
+// bins have already been computed for XCorr (Peptide::peaks_1b, peaks_1y,
+// peaks_2b and peaks_2y, in ion series order), and are used to index the
+// preprocessed intensity array directly. Doubly charged ions are included
+// when the precursor charge is above 2.
+//
+// An SpScorer can be default constructed and reused for any number of
+// spectra by calling Prepare(), so that a search thread needs only one.
 
 
 #ifndef SP_SCORER_H
@@ -67,14 +76,27 @@ class SpScorer {
     }
   };
   
+  SpScorer();
   SpScorer(const Spectrum& spectrum, 
            int charge, double max_mz);
 
+  // Preprocess the spectrum that the following Score() calls will use.
+  void Prepare(const Spectrum& spectrum, int charge, double max_mz);
+
+  // The max m/z that crux used for the Sp intensity array of a spectrum.
+  static double MaxMz(const Spectrum& spectrum, int charge);
+
   void Score(const Peptide &peptide, SpScoreData& sp_score_data);
   void RankSpScores(vector<SpScoreData>& scores, 
                     double* smallest_score = NULL);
   double TotalIonIntensity() {return sp_spectrum_.TotalIonIntensity();}
 
+  // Workspace for ranking the top PSMs of a spectrum by Sp, one entry per
+  // decoy set (targets first). The vectors are cleared, not freed, between
+  // spectra, so a search thread allocates them only once.
+  vector<vector<SpScoreData> > set_scores_;
+  vector<vector<size_t> > set_psms_;
+
  private:
   typedef pair<double, int> SpScoreMatchPair;
   
@@ -85,17 +107,11 @@ class SpScorer {
     return false;
   }
 
-  int GetBin(double mass, int charge) {
-    return MassConstants::mass2bin(mass, charge);
-  }
-
-  bool IonLookup(double mass, int charge, bool previous_ion_matched,
-                 SpScoreData& sp_score_data);
+  void IonSeriesLookup(const vector<unsigned int>& bins,
+                       SpScoreData& sp_score_data) const;
 
-  const Spectrum& spectrum_;
   SpSpectrum sp_spectrum_;
   int charge_;
-  double max_mz_;
 };
 
 #endif // SP_SCORER_H
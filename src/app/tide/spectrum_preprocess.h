@@ -202,6 +202,8 @@ void addEvidToResEvMatrix(vector<double>& ionMass,
   int LargestMzbin() const { return largest_mzbin_; };
   int SmallestMzbin() const { return smallest_mzbin_; };
   vector<pair<int, double>>& FilteredPeakTuples() { return dyn_filtered_peak_tuples_; }
+  // The intensities of FilteredPeakTuples() indexed by mzbin, 0 where no peak was kept
+  const vector<double>& FilteredPeakIntensities() const { return dyn_filtered_peak_intensities_; }
   int getBackgroundBinEnd() {return background_bin_end_; }
   int getCacheEnd() {return cache_end_; }
 
@@ -221,6 +223,7 @@ void addEvidToResEvMatrix(vector<double>& ionMass,
 
   // added by Yang
   vector<pair<int, double>> dyn_filtered_peak_tuples_;
+  vector<double> dyn_filtered_peak_intensities_;
   int largest_mzbin_, smallest_mzbin_;
 
   friend class ObservedPeakTester;
@@ -91,6 +91,7 @@ void ObservedPeakSet::PreprocessSpectrum(const Spectrum& spectrum, int charge,
   largest_mzbin_ = 0;
   smallest_mzbin_ = MassConstants::mass2bin(max_peak_mz);
   dyn_filtered_peak_tuples_.clear();
+  dyn_filtered_peak_intensities_.clear();
 
   if (Params::GetBool("skip-preprocessing")) {
     for (int i = 0; i < spectrum.Size(); ++i) {
@@ -211,6 +212,13 @@ void ObservedPeakSet::PreprocessSpectrum(const Spectrum& spectrum, int charge,
     }
     if (dia_mode) {
       sort(dyn_filtered_peak_tuples_.begin(), dyn_filtered_peak_tuples_.end(), [](const pair<int, double> &left, const pair<int, double> &right) { return left.first < right.first; });
+      // lets the MS2 p-values look up the peak of a bin directly
+      if (!dyn_filtered_peak_tuples_.empty()) {
+        dyn_filtered_peak_intensities_.assign(dyn_filtered_peak_tuples_.back().first + 1, 0.0);
+      }
+      for (vector<pair<int, double>>::const_iterator peak = dyn_filtered_peak_tuples_.begin(); peak != dyn_filtered_peak_tuples_.end(); ++peak) {
+        dyn_filtered_peak_intensities_[peak->first] = peak->second;
+      }
     }
 
   }
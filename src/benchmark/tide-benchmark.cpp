@@ -0,0 +1,449 @@
+// tide-benchmark: micro-benchmarks of the tide-search hot paths.
+//
+// Every benchmark runs on synthetic, deterministic data (random proteins,
+// their tryptic peptides and spectra made of the b and y ions of some of those
+// peptides plus noise peaks), so no index or spectrum file is needed and two
+// builds of the same source tree measure the same work. Each benchmark is
+// repeated until it has run for at least --min-time seconds and the results are
+// written as one tab-delimited line per benchmark:
+//
+//   benchmark  iterations  items_per_iteration  ns_per_iteration  ns_per_item
+//
+// The benchmark names and columns are stable, so the files of two commits can
+// be compared line by line.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "app/TideSearchApplication.h"
+#include "app/TideMatchSet.h"
+#include "app/tide/ActivePeptideQueue.h"
+#include "app/tide/mass_constants.h"
+#include "app/tide/peptide.h"
+#include "app/tide/records.h"
+#include "app/tide/spectrum_collection.h"
+#include "app/tide/spectrum_preprocess.h"
+#include "app/tide/theoretical_peak_set.h"
+#include "io/carp.h"
+#include "util/Params.h"
+
+using namespace std;
+
+namespace {
+
+const unsigned int kSeed = 20240601;
+const char kAminoAcids[] = "ACDEFGHIKLMNPQRSTVWY";
+const int kNumProteins = 500;
+const int kProteinLength = 400;
+const int kNumSpectra = 200;
+const int kNoisePeaks = 150;
+const double kPrecursorWindow = 3.0;  // Da, +/- around the neutral mass
+
+struct Options {
+  Options() : min_time(1.0), output("-"), work_dir(".") {}
+  double min_time;
+  string filter;
+  string output;
+  string work_dir;
+};
+
+// The synthetic data set shared by all benchmarks.
+struct Data {
+  vector<pb::Protein*> pb_proteins;
+  vector<const pb::Protein*> proteins;
+  vector<pb::Peptide> peptides;     // sorted by mass
+  vector<pb::Spectrum> pb_spectra;  // sorted by neutral mass
+  vector<Spectrum*> spectra;
+  vector<double> neutral_masses;
+  vector<int> charges;
+  string peptide_file;
+  string spectrum_file;
+
+  ~Data() {
+    for (size_t i = 0; i < pb_proteins.size(); ++i) {
+      delete pb_proteins[i];
+    }
+    for (size_t i = 0; i < spectra.size(); ++i) {
+      delete spectra[i];
+    }
+    boost::filesystem::remove(peptide_file);
+    boost::filesystem::remove(spectrum_file);
+  }
+};
+
+double ResidueMass(const string& seq, size_t begin, size_t end) {
+  double mass = 0.0;
+  for (size_t i = begin; i < end; ++i) {
+    mass += MassConstants::mono_table[(int)seq[i]];
+  }
+  return mass;
+}
+
+bool PeptideMassLess(const pb::Peptide& x, const pb::Peptide& y) {
+  return x.mass() < y.mass();
+}
+
+void MakePeptides(mt19937& rng, Data* data) {
+  uniform_int_distribution<int> aa(0, (int)strlen(kAminoAcids) - 1);
+  for (int p = 0; p < kNumProteins; ++p) {
+    pb::Protein* protein = new pb::Protein;
+    protein->set_id(p);
+    protein->set_name("protein_" + to_string(p));
+    string residues;
+    for (int i = 0; i < kProteinLength; ++i) {
+      residues += kAminoAcids[aa(rng)];
+    }
+    protein->set_residues(residues);
+    data->pb_proteins.push_back(protein);
+    data->proteins.push_back(protein);
+
+    // Fully tryptic peptides of 6 to 40 residues, each with a reversed decoy
+    // sharing the same location.
+    size_t start = 0;
+    for (size_t i = 0; i < residues.size(); ++i) {
+      if (residues[i] != 'K' && residues[i] != 'R' && i + 1 < residues.size()) {
+        continue;
+      }
+      size_t length = i + 1 - start;
+      if (length >= 6 && length <= 40) {
+        pb::Peptide target;
+        target.set_mass(ResidueMass(residues, start, i + 1) + MassConstants::mono_h2o);
+        target.set_length(length);
+        target.mutable_first_location()->set_protein_id(p);
+        target.mutable_first_location()->set_pos(start);
+        pb::Peptide decoy = target;
+        string decoy_seq = residues.substr(start, length - 1);
+        reverse(decoy_seq.begin(), decoy_seq.end());
+        decoy.set_decoy_sequence(decoy_seq + residues[i]);
+        decoy.set_decoy_index(0);
+        data->peptides.push_back(target);
+        data->peptides.push_back(decoy);
+      }
+      start = i + 1;
+    }
+  }
+  stable_sort(data->peptides.begin(), data->peptides.end(), PeptideMassLess);
+  for (size_t i = 0; i < data->peptides.size(); ++i) {
+    data->peptides[i].set_id(i);
+  }
+}
+
+void MakeSpectra(mt19937& rng, Data* data) {
+  uniform_int_distribution<size_t> pick(0, data->peptides.size() - 1);
+  uniform_int_distribution<int> charge(2, 3);
+  uniform_real_distribution<double> noise_mz(100.0, 2000.0);
+  uniform_real_distribution<double> intensity(10.0, 1000.0);
+  vector<pair<double, pb::Spectrum> > spectra;
+  while (spectra.size() < kNumSpectra) {
+    const pb::Peptide& peptide = data->peptides[pick(rng)];
+    if (peptide.has_decoy_index()) {
+      continue;
+    }
+    const string& residues = data->proteins[peptide.first_location().protein_id()]->residues();
+    size_t pos = peptide.first_location().pos();
+    int z = charge(rng);
+
+    vector<pair<double, double> > peaks;
+    double b = MASS_PROTON;
+    for (int i = 0; i < peptide.length() - 1; ++i) {
+      b += MassConstants::mono_table[(int)residues[pos + i]];
+      peaks.push_back(make_pair(b, intensity(rng)));
+      peaks.push_back(make_pair(peptide.mass() + 2 * MASS_PROTON - b, intensity(rng)));
+    }
+    for (int i = 0; i < kNoisePeaks; ++i) {
+      peaks.push_back(make_pair(noise_mz(rng), intensity(rng) / 4));
+    }
+    sort(peaks.begin(), peaks.end());
+
+    pb::Spectrum spectrum;
+    spectrum.set_scan_id(spectra.size() + 1);
+    spectrum.set_precursor_m_z((peptide.mass() + z * MASS_PROTON) / z);
+    spectrum.set_neutral_mass(peptide.mass());
+    spectrum.add_charge_state(z);
+    spectrum.set_peak_m_z_denominator(10000);
+    spectrum.set_peak_intensity_denominator(100);
+    for (size_t i = 0; i < peaks.size(); ++i) {
+      spectrum.add_peak_m_z((long long)(peaks[i].first * 10000 + 0.5));
+      spectrum.add_peak_intensity((long long)(peaks[i].second * 100 + 0.5));
+    }
+    spectra.push_back(make_pair(peptide.mass(), spectrum));
+  }
+  stable_sort(spectra.begin(), spectra.end(),
+              [](const pair<double, pb::Spectrum>& x, const pair<double, pb::Spectrum>& y) {
+                return x.first < y.first;
+              });
+  for (size_t i = 0; i < spectra.size(); ++i) {
+    data->pb_spectra.push_back(spectra[i].second);
+    data->spectra.push_back(new Spectrum(spectra[i].second));
+    data->neutral_masses.push_back(spectra[i].first);
+    data->charges.push_back(spectra[i].second.charge_state(0));
+  }
+}
+
+void WriteRecords(const Options& options, Data* data) {
+  boost::filesystem::path dir(options.work_dir);
+  data->peptide_file = (dir / boost::filesystem::unique_path(
+    "tide-benchmark-%%%%-%%%%.peptides")).string();
+  data->spectrum_file = (dir / boost::filesystem::unique_path(
+    "tide-benchmark-%%%%-%%%%.spectrumrecords")).string();
+  {
+    RecordWriter writer(data->peptide_file);
+    if (!writer.OK()) {
+      carp(CARP_FATAL, "Could not write %s.", data->peptide_file.c_str());
+    }
+    for (size_t i = 0; i < data->peptides.size(); ++i) {
+      writer.Write(&data->peptides[i]);
+    }
+  }
+  {
+    RecordWriter writer(data->spectrum_file);
+    if (!writer.OK()) {
+      carp(CARP_FATAL, "Could not write %s.", data->spectrum_file.c_str());
+    }
+    for (size_t i = 0; i < data->pb_spectra.size(); ++i) {
+      writer.Write(&data->pb_spectra[i]);
+    }
+  }
+}
+
+// A peptide queue over the whole peptide file, positioned on the candidates of
+// one spectrum.
+class Queue {
+ public:
+  Queue(const Data& data)
+    : reader_(data.peptide_file), queue_(&reader_, data.proteins) {
+  }
+  int SetActiveRange(double neutral_mass) {
+    vector<double> min_mass(1, neutral_mass - kPrecursorWindow);
+    vector<double> max_mass(1, neutral_mass + kPrecursorWindow);
+    return queue_.SetActiveRange(&min_mass, &max_mass, min_mass.front(), max_mass.back());
+  }
+  ActivePeptideQueue* Get() { return &queue_; }
+
+ private:
+  RecordReader reader_;
+  ActivePeptideQueue queue_;
+};
+
+// Exposes the p-value dynamic programming of tide-search.
+class ScoreCountBenchmark : public TideSearchApplication {
+ public:
+  ScoreCountBenchmark() {
+    for (const char* aa = kAminoAcids; *aa != '\0'; ++aa) {
+      iAAMass_.push_back(MassConstants::mass2bin(MassConstants::mono_table[(int)*aa]));
+    }
+    sort(iAAMass_.begin(), iAAMass_.end());
+    iAAMass_.erase(unique(iAAMass_.begin(), iAAMass_.end()), iAAMass_.end());
+    dAAFreqN_.assign(iAAMass_.size(), 1.0 / iAAMass_.size());
+    dAAFreqI_ = dAAFreqN_;
+    dAAFreqC_ = dAAFreqN_;
+  }
+  int Run(vector<int>& masses, vector<vector<int> >& evidence, vector<double>& null_distribution) {
+    return calcScoreCount(masses, evidence, null_distribution);
+  }
+};
+
+class Runner {
+ public:
+  Runner(const Options& options, ostream& out) : options_(options), out_(out) {
+    out_ << "benchmark\titerations\titems_per_iteration\tns_per_iteration\tns_per_item" << endl;
+  }
+
+  // Run body, which returns the number of items it processed, until it has
+  // taken min_time seconds. setup, if given, runs untimed before each call.
+  void Run(const string& name, const function<long()>& body,
+           const function<void()>& setup = function<void()>()) {
+    if (!options_.filter.empty() && name.find(options_.filter) == string::npos) {
+      return;
+    }
+    chrono::steady_clock::duration elapsed = chrono::steady_clock::duration::zero();
+    long iterations = 0;
+    long items = 0;
+    do {
+      if (setup) {
+        setup();
+      }
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      items = body();
+      elapsed += chrono::steady_clock::now() - start;
+      ++iterations;
+    } while (chrono::duration<double>(elapsed).count() < options_.min_time);
+    double ns = chrono::duration<double, nano>(elapsed).count() / iterations;
+    out_ << name << '\t' << iterations << '\t' << items << '\t'
+         << fixed << setprecision(1) << ns << '\t'
+         << setprecision(3) << (items > 0 ? ns / items : ns) << endl;
+    carp(CARP_INFO, "%s: %.1f ns per iteration", name.c_str(), ns);
+  }
+
+ private:
+  const Options& options_;
+  ostream& out_;
+};
+
+void RunBenchmarks(Data& data, Runner& runner) {
+  runner.Run("record_reader_read", [&]() {
+    RecordReader reader(data.spectrum_file);
+    pb::Spectrum spectrum;
+    long records = 0;
+    while (!reader.Done()) {
+      reader.Read(&spectrum);
+      ++records;
+    }
+    return records;
+  });
+
+  ObservedPeakSet observed;
+  runner.Run("preprocess_spectrum", [&]() {
+    for (size_t i = 0; i < data.spectra.size(); ++i) {
+      observed.PreprocessSpectrum(*data.spectra[i], data.charges[i]);
+    }
+    return (long)data.spectra.size();
+  });
+
+  vector<Peptide*> peptides;
+  for (size_t i = 0; i < data.peptides.size() && i < 5000; ++i) {
+    peptides.push_back(new Peptide(data.peptides[i], data.proteins));
+  }
+  TheoreticalPeakSetBYSparse workspace(1000);
+  runner.Run("compute_theoretical_peaks", [&]() {
+    for (size_t i = 0; i < peptides.size(); ++i) {
+      workspace.Clear();
+      peptides[i]->ComputeTheoreticalPeaks(&workspace);
+    }
+    return (long)peptides.size();
+  });
+  for (size_t i = 0; i < peptides.size(); ++i) {
+    delete peptides[i];
+  }
+
+  // Sweep the queue through the spectra, as a search thread does.
+  runner.Run("set_active_range", [&]() {
+    Queue queue(data);
+    for (size_t i = 0; i < data.neutral_masses.size(); ++i) {
+      queue.SetActiveRange(data.neutral_masses[i]);
+    }
+    return (long)data.neutral_masses.size();
+  });
+
+  // The scoring benchmarks use the spectrum in the middle of the mass range.
+  size_t middle = data.spectra.size() / 2;
+  const Spectrum& spectrum = *data.spectra[middle];
+  int charge = data.charges[middle];
+  Queue queue(data);
+  long candidates = queue.SetActiveRange(data.neutral_masses[middle]);
+  ActivePeptideQueue* active_peptide_queue = queue.Get();
+  observed.PreprocessSpectrum(spectrum, charge);
+
+  runner.Run("peak_matching", [&]() {
+    long peaks = 0;
+    int match_cnt = 0;
+    int repeat = 0;
+    for (deque<Peptide*>::const_iterator i = active_peptide_queue->begin_;
+         i != active_peptide_queue->end_; ++i) {
+      TideSearchApplication::PeakMatching(observed, (*i)->peaks_0, match_cnt, repeat);
+      peaks += (*i)->peaks_0.size();
+    }
+    return peaks;
+  });
+
+  runner.Run("xcorr_scoring", [&]() {
+    TideMatchSet psm_scores(active_peptide_queue, &observed);
+    TideSearchApplication::XCorrScoring(charge, observed, active_peptide_queue, psm_scores);
+    return (long)active_peptide_queue->nPeptides_;
+  });
+
+  TideMatchSet::curScoreFunction_ = XCORR_SCORE;
+  TideMatchSet::top_matches_ = 5;
+  TideMatchSet::decoy_num_ = 1;
+  TideMatchSet::concat_ = false;
+  TideMatchSet scored(active_peptide_queue, &observed);
+  TideSearchApplication::XCorrScoring(charge, observed, active_peptide_queue, scored);
+  TideMatchSet::PSMScores scored_psms = scored.psm_scores_;
+  TideMatchSet gather(active_peptide_queue, &observed);
+  runner.Run("gather_targets_decoys", [&]() {
+    gather.gatherTargetsDecoys();
+    return (long)scored_psms.size();
+  }, [&]() {
+    gather.psm_scores_ = scored_psms;
+    gather.psm_scores_processed_ = false;
+  });
+
+  ScoreCountBenchmark score_count;
+  int max_precursor_bin = MassConstants::mass2bin(data.neutral_masses[middle] + 250);
+  vector<int> masses(1, MassConstants::mass2bin(data.neutral_masses[middle]));
+  mt19937 rng(kSeed);
+  uniform_int_distribution<int> evidence_value(-5, 20);
+  vector<vector<int> > evidence(1, vector<int>(max_precursor_bin, 0));
+  for (int i = 0; i < max_precursor_bin; ++i) {
+    evidence[0][i] = evidence_value(rng);
+  }
+  runner.Run("calc_score_count", [&]() {
+    vector<double> null_distribution;
+    score_count.Run(masses, evidence, null_distribution);
+    return (long)null_distribution.size();
+  });
+
+  carp(CARP_DEBUG, "%ld candidates for the scoring benchmarks", candidates);
+}
+
+void Usage() {
+  cerr << "Usage: tide-benchmark [--min-time <seconds>] [--filter <substring>]" << endl
+       << "                      [--output <file>] [--work-dir <dir>]" << endl;
+  exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (i + 1 >= argc) {
+      Usage();
+    }
+    if (arg == "--min-time") {
+      options.min_time = atof(argv[++i]);
+    } else if (arg == "--filter") {
+      options.filter = argv[++i];
+    } else if (arg == "--output") {
+      options.output = argv[++i];
+    } else if (arg == "--work-dir") {
+      options.work_dir = argv[++i];
+    } else {
+      Usage();
+    }
+  }
+
+  pb::ModTable mods, nterm_mods, cterm_mods, nprotterm_mods, cprotterm_mods;
+  MassConstants::Init(&mods, &nterm_mods, &cterm_mods, &nprotterm_mods, &cprotterm_mods,
+                      Params::GetDouble("mz-bin-width"), Params::GetDouble("mz-bin-offset"));
+
+  Data data;
+  mt19937 rng(kSeed);
+  MakePeptides(rng, &data);
+  MakeSpectra(rng, &data);
+  WriteRecords(options, &data);
+  carp(CARP_INFO, "%d proteins, %d peptides, %d spectra",
+       (int)data.proteins.size(), (int)data.peptides.size(), (int)data.spectra.size());
+
+  ofstream file;
+  if (options.output != "-") {
+    file.open(options.output.c_str());
+    if (!file.good()) {
+      carp(CARP_FATAL, "Could not write %s.", options.output.c_str());
+    }
+  }
+  Runner runner(options, options.output == "-" ? cout : file);
+  RunBenchmarks(data, runner);
+  return 0;
+}
@@ -38,6 +38,9 @@
 #include "app/CascadeSearchApplication.h"
 #include "app/AssignConfidenceApplication.h"
 #include "app/SubtractIndexApplication.h"
+#include "app/MergeSearchResultsApplication.h"
+#include "app/TideClientApplication.h"
+#include "app/TideServerApplication.h"
 #include "app/SpectrumConvertApplication.h"
 #include "app/DIAmeterApplication.h"
 #include "app/KojakApplication.h"
@@ -94,6 +97,9 @@ int main(int argc, char** argv) {
     applications.add(new PrintVersion());
     applications.add(new PSMConvertApplication());
     applications.add(new SubtractIndexApplication());
+    applications.add(new MergeSearchResultsApplication());
+    applications.add(new TideServerApplication());
+    applications.add(new TideClientApplication());
     applications.add(new LocalizeModificationApplication());
 
 
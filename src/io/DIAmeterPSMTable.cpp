@@ -0,0 +1,250 @@
+#include "DIAmeterPSMTable.h"
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include "carp.h"
+#include "util/crux-utils.h"
+#include "util/MathUtil.h"
+#include "util/Params.h"
+#include "util/StringUtils.h"
+
+using namespace std;
+
+// The value of a cell, as DelimitedFileReader::getDouble reads it
+static double parseDouble(const string& cell) {
+  if (cell == "") {
+    return 0.0;
+  } else if (cell == "Inf") {
+    return numeric_limits<double>::infinity();
+  } else if (cell == "-Inf") {
+    return -numeric_limits<double>::infinity();
+  } else if (StringUtils::ToLower(cell) == "nan") {
+    return 0.0;
+  }
+  return StringUtils::FromString<double>(cell);
+}
+
+DIAmeterPSMTable::DIAmeterPSMTable(const string& header) {
+  column_names_ = StringUtils::Split(StringUtils::Trim(header), '\t');
+  parseHeader();
+}
+
+void DIAmeterPSMTable::parseHeader() {
+  map<string, int> column_indices;
+  for (int idx = column_names_.size() - 1; idx >= 0; idx--) {
+    column_indices[column_names_[idx]] = idx;
+  }
+  map<MATCH_COLUMNS_T, int> feature_indices;
+
+  MATCH_COLUMNS_T toscale_columns_[] = { PRECURSOR_INTENSITY_RANK_M0_COL, PRECURSOR_INTENSITY_RANK_M1_COL, PRECURSOR_INTENSITY_RANK_M2_COL, DYN_FRAGMENT_PVALUE_COL, STA_FRAGMENT_PVALUE_COL };
+  MATCH_COLUMNS_T toagg_columns_[] = { TAILOR_COL, RT_DIFF_COL, PRECURSOR_INTENSITY_RANK_M0_COL, DYN_FRAGMENT_PVALUE_COL, COELUTE_MS1_COL };
+  double toagg_coeffs_[] = { 1.0, -Params::GetDouble("coeff-rtdiff"), -Params::GetDouble("coeff-precursor"), Params::GetDouble("coeff-fragment"), Params::GetDouble("coeff-elution") };
+
+  for (size_t idx = 0; idx < sizeof(toscale_columns_)/sizeof(toscale_columns_[0]); idx++) {
+    map<string, int>::const_iterator column = column_indices.find(get_column_header(toscale_columns_[idx]));
+    if (column != column_indices.end()) {
+      Feature feature;
+      feature.column_id_ = toscale_columns_[idx];
+      feature.column_idx_ = column->second;
+      feature.scaled_ = true;
+      feature.coeff_ = 0.0;
+      feature_indices[feature.column_id_] = features_.size();
+      features_.push_back(feature);
+    }
+  }
+  for (size_t idx = 0; idx < sizeof(toagg_columns_)/sizeof(toagg_columns_[0]); idx++) {
+    map<string, int>::const_iterator column = column_indices.find(get_column_header(toagg_columns_[idx]));
+    if (column == column_indices.end()) {
+      continue;
+    }
+    map<MATCH_COLUMNS_T, int>::const_iterator scaled = feature_indices.find(toagg_columns_[idx]);
+    if (scaled == feature_indices.end()) {
+      Feature feature;
+      feature.column_id_ = toagg_columns_[idx];
+      feature.column_idx_ = column->second;
+      feature.scaled_ = false;
+      feature.coeff_ = toagg_coeffs_[idx];
+      aggregated_.push_back(features_.size());
+      features_.push_back(feature);
+    } else {
+      features_[scaled->second].coeff_ = toagg_coeffs_[idx];
+      aggregated_.push_back(scaled->second);
+    }
+  }
+
+  const char* id_columns[] = { get_column_header(ENSEMBLE_SCORE_COL), get_column_header(SCAN_COL), get_column_header(CHARGE_COL), get_column_header(XCORR_SCORE_COL) };
+  int* id_indices[] = { &agg_idx_, &scan_idx_, &charge_idx_, &xcorr_idx_ };
+  for (int idx = 0; idx < 4; idx++) {
+    map<string, int>::const_iterator column = column_indices.find(id_columns[idx]);
+    if (column == column_indices.end()) {
+      carp(CARP_FATAL, "Column %s is missing from the DIAmeter results.", id_columns[idx]);
+    }
+    *id_indices[idx] = column->second;
+  }
+}
+
+void DIAmeterPSMTable::addRows(const string& text) {
+  size_t begin = 0, end;
+  while ((end = text.find('\n', begin)) != string::npos) {
+    row_offsets_.push_back(text_.size() + begin);
+    begin = end + 1;
+  }
+  text_ += text;
+  if (begin < text.size()) {
+    row_offsets_.push_back(text_.size() - (text.size() - begin));
+    text_ += '\n';
+  }
+}
+
+size_t DIAmeterPSMTable::size() const {
+  return row_offsets_.size();
+}
+
+void DIAmeterPSMTable::getCells(size_t row, vector<string>* cells) const {
+  size_t begin = row_offsets_[row];
+  size_t end = text_.find('\n', begin);
+  *cells = StringUtils::Split(text_.substr(begin, end - begin), '\t');
+  while (cells->size() < column_names_.size()) {
+    cells->push_back("");
+  }
+}
+
+void DIAmeterPSMTable::scaleFeatures(int num_threads, double quantile_low, double quantile_high) {
+  size_t num_rows = size();
+  for (vector<Feature>::iterator feature = features_.begin(); feature != features_.end(); ++feature) {
+    feature->values_.resize(num_rows);
+  }
+  scans_.resize(num_rows);
+  charges_.resize(num_rows);
+  xcorrs_.resize(num_rows);
+  ensembles_.resize(num_rows);
+
+  size_t num_workers = max(1, num_threads);
+  boost::thread_group parsers;
+  for (size_t t = 1; t < num_workers; ++t) {
+    parsers.add_thread(new boost::thread(boost::bind(&DIAmeterPSMTable::parseRows, this, t, num_workers)));
+  }
+  parseRows(0, num_workers);
+  parsers.join_all();
+
+  carp(CARP_DETAILED_DEBUG, "Record:%d ", (int)num_rows);
+  boost::thread_group sorters;
+  for (size_t t = 1; t < num_workers; ++t) {
+    sorters.add_thread(new boost::thread(boost::bind(&DIAmeterPSMTable::calcQuantiles, this,
+      t, num_workers, quantile_low, quantile_high)));
+  }
+  calcQuantiles(0, num_workers, quantile_low, quantile_high);
+  sorters.join_all();
+
+  boost::thread_group scalers;
+  for (size_t t = 1; t < num_workers; ++t) {
+    scalers.add_thread(new boost::thread(boost::bind(&DIAmeterPSMTable::scaleRows, this, t, num_workers)));
+  }
+  scaleRows(0, num_workers);
+  scalers.join_all();
+}
+
+void DIAmeterPSMTable::parseRows(size_t first, size_t step) {
+  vector<string> cells;
+  for (size_t row = first; row < size(); row += step) {
+    getCells(row, &cells);
+    for (vector<Feature>::iterator feature = features_.begin(); feature != features_.end(); ++feature) {
+      feature->values_[row] = parseDouble(cells[feature->column_idx_]);
+    }
+    scans_[row] = StringUtils::FromString<int>(cells[scan_idx_]);
+    charges_[row] = StringUtils::FromString<int>(cells[charge_idx_]);
+    xcorrs_[row] = parseDouble(cells[xcorr_idx_]);
+  }
+}
+
+void DIAmeterPSMTable::calcQuantile(Feature* feature, double quantile_low, double quantile_high) {
+  vector<double> sorted_values(feature->values_);
+  sort(sorted_values.begin(), sorted_values.end());
+
+  if (sorted_values.size() <= 0) {
+    feature->quantile_low_ = 0.0;
+    feature->quantile_high_ = 1.0;
+  } else {
+    int quantile_low_pos = (int)(quantile_low*(double)sorted_values.size()+0.5); // +0.5 is for rounding purpose
+    int quantile_high_pos = (int)(quantile_high*(double)sorted_values.size()+0.5);
+    feature->quantile_low_ = sorted_values.at(quantile_low_pos);
+    feature->quantile_high_ = sorted_values.at(quantile_high_pos);
+    carp(CARP_DETAILED_DEBUG, "ColumnIndex:%d \t ColumnName:%s \t Size:%d \t quantile_low:%f \t quantile_high:%f",
+         feature->column_idx_, get_column_header(feature->column_id_), (int)sorted_values.size(),
+         feature->quantile_low_, feature->quantile_high_);
+  }
+}
+
+void DIAmeterPSMTable::calcQuantiles(size_t first, size_t step, double quantile_low, double quantile_high) {
+  for (size_t idx = first; idx < features_.size() && features_[idx].scaled_; idx += step) {
+    calcQuantile(&features_[idx], quantile_low, quantile_high);
+  }
+}
+
+void DIAmeterPSMTable::scaleRows(size_t first, size_t step) {
+  for (size_t row = first; row < size(); row += step) {
+    for (vector<Feature>::iterator feature = features_.begin(); feature != features_.end(); ++feature) {
+      if (!feature->scaled_) {
+        continue;
+      }
+      double denominator = feature->quantile_high_ - feature->quantile_low_;
+      if (!MathUtil::AlmostEqual(denominator, 0.0, 4)) {
+        feature->values_[row] = (feature->values_[row] - feature->quantile_low_) / denominator;
+      }
+    }
+
+    // the ensemble score is computed from the features as they are written
+    double ensemble = 0.0;
+    for (vector<int>::const_iterator idx = aggregated_.begin(); idx != aggregated_.end(); ++idx) {
+      const Feature& feature = features_[*idx];
+      double column_val = feature.values_[row];
+      if (feature.scaled_) {
+        column_val = parseDouble(StringUtils::ToString<double>(column_val, 6));
+      }
+      ensemble += column_val * feature.coeff_;
+    }
+    ensembles_[row] = ensemble;
+  }
+}
+
+void DIAmeterPSMTable::write(const char* scaled_file_name, const char* filtered_file_name, bool filter) {
+  // the (XCorr, ensemble score) of the best PSM of each (scan, charge)
+  map<int, boost::tuple<double, double> > scan_charge_scores_map;
+  for (size_t row = 0; row < size(); ++row) {
+    int key = 10*scans_[row] + charges_[row];
+    map<int, boost::tuple<double, double> >::iterator baselineIter = scan_charge_scores_map.find(key);
+    if (baselineIter == scan_charge_scores_map.end() || baselineIter->second.get<0>() < xcorrs_[row]) {
+      scan_charge_scores_map[key] = boost::make_tuple(xcorrs_[row], ensembles_[row]);
+    }
+  }
+
+  ofstream* scaled_file = create_stream_in_path(scaled_file_name, NULL, Params::GetBool("overwrite"));
+  ofstream* filtered_file = create_stream_in_path(filtered_file_name, NULL, Params::GetBool("overwrite"));
+  string header = StringUtils::Join(column_names_, '\t');
+  *scaled_file << header << '\n';
+  *filtered_file << header << '\n';
+
+  vector<string> cells;
+  for (size_t row = 0; row < size(); ++row) {
+    getCells(row, &cells);
+    for (vector<Feature>::const_iterator feature = features_.begin(); feature != features_.end(); ++feature) {
+      if (feature->scaled_) {
+        cells[feature->column_idx_] = StringUtils::ToString<double>(feature->values_[row], 6);
+      }
+    }
+    *scaled_file << StringUtils::Join(cells, '\t') << '\n';
+
+    double ensemble_baseline = scan_charge_scores_map[10*scans_[row] + charges_[row]].get<1>() - 0.000001;
+    if ((!filter) || (ensembles_[row] >= ensemble_baseline)) {
+      cells[agg_idx_] = StringUtils::ToString<double>(ensembles_[row], 6);
+      *filtered_file << StringUtils::Join(cells, '\t') << '\n';
+    }
+  }
+
+  scaled_file->close();
+  delete scaled_file;
+  filtered_file->close();
+  delete filtered_file;
+}
@@ -0,0 +1,70 @@
+/**
+ * DIAmeterPSMTable.h
+ * DESCRIPTION: The PSM features of a DIAmeter search, kept in memory to be
+ * scaled and filtered without writing and reparsing intermediate files.
+ **************************************************************************/
+
+#ifndef DIAMETERPSMTABLE_H
+#define DIAMETERPSMTABLE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "MatchColumns.h"
+#include "boost/tuple/tuple.hpp"
+
+// The rows are kept as text, one after another, and the features that are
+// scaled or aggregated are parsed into one array per column. Each scaled
+// feature is mapped linearly so that its low and high quantiles become 0
+// and 1. The ensemble score is the weighted sum of the aggregated features,
+// and filtering keeps the PSMs whose ensemble score is at least that of
+// the highest-XCorr PSM of the same scan and charge.
+class DIAmeterPSMTable {
+  protected:
+    struct Feature {
+      MATCH_COLUMNS_T column_id_;
+      int column_idx_;
+      bool scaled_;
+      double coeff_;  // in the ensemble score, or 0 if not aggregated
+      std::vector<double> values_;  // scaled in place
+      double quantile_low_, quantile_high_;
+    };
+
+    std::vector<std::string> column_names_;
+    std::string text_;  // the rows, each ended by a newline
+    std::vector<size_t> row_offsets_;
+
+    std::vector<Feature> features_;  // the scaled ones first
+    std::vector<int> aggregated_;  // the features in the ensemble score, in order
+    int agg_idx_, scan_idx_, charge_idx_, xcorr_idx_;
+    std::vector<int> scans_, charges_;
+    std::vector<double> xcorrs_, ensembles_;
+
+    void parseHeader();
+    // The cells of a row, padded to the number of columns
+    void getCells(size_t row, std::vector<std::string>* cells) const;
+    // Parse the features, scan, charge and XCorr of every step-th row from first
+    void parseRows(size_t first, size_t step);
+    void calcQuantile(Feature* feature, double quantile_low, double quantile_high);
+    // Compute the quantiles of every step-th scaled feature from first
+    void calcQuantiles(size_t first, size_t step, double quantile_low, double quantile_high);
+    // Scale the features of every step-th row from first and compute its ensemble score
+    void scaleRows(size_t first, size_t step);
+
+  public:
+    // header holds the tab-delimited column names
+    explicit DIAmeterPSMTable(const std::string& header);
+
+    // Add the rows of text, one per line
+    void addRows(const std::string& text);
+    size_t size() const;
+
+    // Scale the features to the given quantiles, and compute the ensemble
+    // scores from the scaled features, on num_threads threads
+    void scaleFeatures(int num_threads, double quantile_low=0.01, double quantile_high=0.99);
+    // Write the scaled PSMs to scaled_file_name and, with their ensemble
+    // scores, those not filtered out to filtered_file_name
+    void write(const char* scaled_file_name, const char* filtered_file_name, bool filter=true);
+};
+
+#endif //DIAMETERPSMTABLE_H
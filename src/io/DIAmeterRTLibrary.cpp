@@ -0,0 +1,180 @@
+#include "DIAmeterRTLibrary.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifndef _MSC_VER
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <boost/filesystem.hpp>
+#include "carp.h"
+#include "util/FileUtils.h"
+#include "util/StringUtils.h"
+
+using namespace std;
+
+static const char RTLIBRARY_TAG[8] = { 'C', 'R', 'U', 'X', 'R', 'T', 'L', '2' };
+static const size_t RTLIBRARY_HEADER_SIZE = 24;  // the tag, the source fingerprint and the number of peptides
+
+DIAmeterRTLibrary::DIAmeterRTLibrary()
+  : hashes_(NULL), predrts_(NULL), size_(0), source_fingerprint_(0), mapped_(NULL), mapped_size_(0) {
+}
+
+DIAmeterRTLibrary::~DIAmeterRTLibrary() {
+  unmap();
+}
+
+void DIAmeterRTLibrary::unmap() {
+  if (mapped_ != NULL) {
+#ifdef _MSC_VER
+    stub_unmmap(&unmap_info_);
+#else
+    munmap(mapped_, mapped_size_);
+#endif
+    mapped_ = NULL;
+    mapped_size_ = 0;
+  }
+}
+
+unsigned long long DIAmeterRTLibrary::hash(const string& peptide) {
+  // 64-bit FNV-1a
+  unsigned long long hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < peptide.length(); ++i) {
+    hash ^= (unsigned char)peptide[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+unsigned long long DIAmeterRTLibrary::fingerprint(const vector<string>& source_files) {
+  string sources;
+  for (vector<string>::const_iterator i = source_files.begin(); i != source_files.end(); ++i) {
+    if (i->empty()) {
+      continue;
+    }
+    sources += FileUtils::AbsPath(*i) + '|';
+    if (FileUtils::IsRegularFile(*i)) {
+      sources += StringUtils::ToString(FileUtils::Size(*i)) + '|' +
+        StringUtils::ToString((long long)boost::filesystem::last_write_time(*i));
+    } else {
+      sources += "missing";
+    }
+    sources += '\n';
+  }
+  return hash(sources);
+}
+
+void DIAmeterRTLibrary::build(const map<string, double>& predrts, unsigned long long source_fingerprint) {
+  unmap();
+  vector<pair<unsigned long long, double> > entries;
+  entries.reserve(predrts.size());
+  for (map<string, double>::const_iterator i = predrts.begin(); i != predrts.end(); ++i) {
+    entries.push_back(make_pair(hash(i->first), i->second));
+  }
+  sort(entries.begin(), entries.end());
+
+  built_hashes_.clear();
+  built_predrts_.clear();
+  for (vector<pair<unsigned long long, double> >::const_iterator i = entries.begin(); i != entries.end(); ++i) {
+    if (!built_hashes_.empty() && built_hashes_.back() == i->first) {
+      carp(CARP_WARNING, "Two peptides in the predicted retention times have the same hash; "
+           "one of them is given the retention time of the other.");
+      continue;
+    }
+    built_hashes_.push_back(i->first);
+    built_predrts_.push_back(i->second);
+  }
+  hashes_ = built_hashes_.empty() ? NULL : &built_hashes_[0];
+  predrts_ = built_predrts_.empty() ? NULL : &built_predrts_[0];
+  size_ = built_hashes_.size();
+  source_fingerprint_ = source_fingerprint;
+}
+
+bool DIAmeterRTLibrary::write(const string& file_name) const {
+  ofstream file(file_name.c_str(), ios::out | ios::binary | ios::trunc);
+  unsigned long long num_peptides = size_;
+  file.write(RTLIBRARY_TAG, sizeof(RTLIBRARY_TAG));
+  file.write((const char*)&source_fingerprint_, sizeof(source_fingerprint_));
+  file.write((const char*)&num_peptides, sizeof(num_peptides));
+  if (size_ > 0) {
+    file.write((const char*)hashes_, size_ * sizeof(unsigned long long));
+    file.write((const char*)predrts_, size_ * sizeof(double));
+  }
+  file.close();
+  if (!file) {
+    carp(CARP_ERROR, "Could not write the retention time library %s", file_name.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool DIAmeterRTLibrary::open(const string& file_name) {
+  unmap();
+  hashes_ = NULL;
+  predrts_ = NULL;
+  size_ = 0;
+  struct stat file_info;
+  if (stat(file_name.c_str(), &file_info) == -1 || (size_t)file_info.st_size < RTLIBRARY_HEADER_SIZE) {
+    carp(CARP_ERROR, "%s is not a retention time library.", file_name.c_str());
+    return false;
+  }
+  size_t file_size = file_info.st_size;
+
+#ifdef _MSC_VER
+  void* data = stub_mmap(file_name.c_str(), &unmap_info_);
+  if (data == NULL) {
+    carp(CARP_ERROR, "Failed to memory-map the retention time library %s", file_name.c_str());
+    return false;
+  }
+#else
+  int file_d = ::open(file_name.c_str(), O_RDONLY);
+  if (file_d < 0) {
+    carp(CARP_ERROR, "Could not open the retention time library %s", file_name.c_str());
+    return false;
+  }
+  void* data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, file_d, 0);
+  close(file_d);
+  if (data == MAP_FAILED) {
+    carp(CARP_ERROR, "Failed to memory-map the retention time library %s", file_name.c_str());
+    return false;
+  }
+#endif
+  mapped_ = data;
+  mapped_size_ = file_size;
+
+  const char* bytes = (const char*)data;
+  unsigned long long source_fingerprint, num_peptides;
+  memcpy(&source_fingerprint, bytes + sizeof(RTLIBRARY_TAG), sizeof(source_fingerprint));
+  memcpy(&num_peptides, bytes + sizeof(RTLIBRARY_TAG) + sizeof(source_fingerprint), sizeof(num_peptides));
+  if (memcmp(bytes, RTLIBRARY_TAG, sizeof(RTLIBRARY_TAG)) != 0 ||
+      file_size != RTLIBRARY_HEADER_SIZE + num_peptides * (sizeof(unsigned long long) + sizeof(double))) {
+    carp(CARP_ERROR, "%s is not a retention time library.", file_name.c_str());
+    return false;
+  }
+  hashes_ = (const unsigned long long*)(bytes + RTLIBRARY_HEADER_SIZE);
+  predrts_ = (const double*)(bytes + RTLIBRARY_HEADER_SIZE + num_peptides * sizeof(unsigned long long));
+  size_ = num_peptides;
+  source_fingerprint_ = source_fingerprint;
+  return true;
+}
+
+bool DIAmeterRTLibrary::find(const string& peptide, double* predrt) const {
+  unsigned long long key = hash(peptide);
+  const unsigned long long* found = lower_bound(hashes_, hashes_ + size_, key);
+  if (found == hashes_ + size_ || *found != key) {
+    return false;
+  }
+  *predrt = predrts_[found - hashes_];
+  return true;
+}
+
+size_t DIAmeterRTLibrary::size() const {
+  return size_;
+}
+
+unsigned long long DIAmeterRTLibrary::sourceFingerprint() const {
+  return source_fingerprint_;
+}
@@ -0,0 +1,66 @@
+/**
+ * DIAmeterRTLibrary.h
+ * DESCRIPTION: The predicted retention times of the peptides searched by
+ * DIAmeter, indexed by a hash of the modified sequence.
+ **************************************************************************/
+
+#ifndef DIAMETERRTLIBRARY_H
+#define DIAMETERRTLIBRARY_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+#ifdef _MSC_VER
+#include "util/WinCrux.h"
+#endif
+
+// The library is a sorted array of 64-bit FNV-1a hashes of the modified
+// sequences and an array of the normalized retention times in the same
+// order. It is built from the predictions in memory, and can be written to
+// a binary file, which later runs memory-map instead of parsing and
+// normalizing the predictions again. The file holds an 8-byte tag, the
+// fingerprint of the prediction files it was built from, the number of
+// peptides, the hashes and the retention times.
+class DIAmeterRTLibrary {
+  public:
+    DIAmeterRTLibrary();
+    ~DIAmeterRTLibrary();
+
+    // Index the normalized retention times of the peptides, parsed from the
+    // prediction files with the given fingerprint
+    void build(const std::map<std::string, double>& predrts, unsigned long long source_fingerprint);
+    bool write(const std::string& file_name) const;
+    // Memory-map a library written by write
+    bool open(const std::string& file_name);
+
+    // Set predrt to the retention time of peptide, if it is in the library
+    bool find(const std::string& peptide, double* predrt) const;
+    size_t size() const;
+
+    // The fingerprint of the prediction files the library was built from
+    unsigned long long sourceFingerprint() const;
+
+    static unsigned long long hash(const std::string& peptide);
+    // A hash of the paths, sizes and modification times of the prediction
+    // files, which changes whenever one of them is replaced or edited
+    static unsigned long long fingerprint(const std::vector<std::string>& source_files);
+
+  protected:
+    std::vector<unsigned long long> built_hashes_;
+    std::vector<double> built_predrts_;
+
+    const unsigned long long* hashes_;
+    const double* predrts_;
+    size_t size_;
+    unsigned long long source_fingerprint_;
+
+    void unmap();
+    void* mapped_;  // NULL unless the library was opened from a file
+    size_t mapped_size_;
+#ifdef _MSC_VER
+    SIMPLE_UNMMAP unmap_info_;
+#endif
+};
+
+#endif //DIAMETERRTLIBRARY_H
@@ -0,0 +1,129 @@
+#include "DIAmeterXicStore.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+DIAmeterXicStore::DIAmeterXicStore() {
+}
+
+void DIAmeterXicStore::addScan(int scan_num, const double* mz_arr, const double* intensity_arr, int peak_num) {
+  Scan scan;
+  scan.mz_arr_ = mz_arr;
+  scan.intensity_arr_ = intensity_arr;
+  scan.peak_num_ = max(peak_num, 0);
+  scan.min_bin_ = 0;
+  scan.num_bins_ = 0;
+  scan.bin_offset_ = bins_.size();
+  if (scan.peak_num_ > 0) {
+    scan.min_bin_ = (int)floor(mz_arr[0]);
+    scan.num_bins_ = (int)floor(mz_arr[scan.peak_num_ - 1]) - scan.min_bin_ + 1;
+  }
+  // bins_[bin_offset_ + b] is the first peak whose integer m/z is at least min_bin_ + b
+  int peak_idx = 0;
+  for (int bin = 0; bin < scan.num_bins_; ++bin) {
+    while (peak_idx < scan.peak_num_ && floor(mz_arr[peak_idx]) < scan.min_bin_ + bin) {
+      ++peak_idx;
+    }
+    bins_.push_back(peak_idx);
+  }
+  bins_.push_back(scan.peak_num_);
+
+  scan_nums_.push_back(scan_num);
+  scans_.push_back(scan);
+}
+
+int DIAmeterXicStore::find(int scan_num) const {
+  vector<int>::const_iterator i = lower_bound(scan_nums_.begin(), scan_nums_.end(), scan_num);
+  if (i == scan_nums_.end() || *i != scan_num) {
+    return -1;
+  }
+  return i - scan_nums_.begin();
+}
+
+double DIAmeterXicStore::closestPPMIntensity(int pos, double query_mz, int ppm_tol) const {
+  const Scan& scan = scans_[pos];
+  if (scan.peak_num_ <= 0) {
+    return 0;
+  }
+  const double* mz_arr = scan.mz_arr_;
+
+  // the first peak at or above query_mz, found within the bin of query_mz
+  int idx;
+  int bin = (int)floor(query_mz) - scan.min_bin_;
+  if (bin < 0) {
+    idx = 0;
+  } else if (bin >= scan.num_bins_) {
+    idx = scan.peak_num_;
+  } else {
+    const int* bin_begin = &bins_[scan.bin_offset_ + bin];
+    idx = lower_bound(mz_arr + bin_begin[0], mz_arr + bin_begin[1], query_mz) - mz_arr;
+  }
+  // the closest peak, the upper one on ties, as MathUtil::binarySearch
+  if (idx == scan.peak_num_) {
+    --idx;
+  } else if (idx > 0 && mz_arr[idx] != query_mz && query_mz - mz_arr[idx - 1] < mz_arr[idx] - query_mz) {
+    --idx;
+  }
+
+  double matched_mz = mz_arr[idx];
+  double ppm = fabs(query_mz - matched_mz) * 1000000 / max(query_mz, matched_mz);
+  if (ppm > ppm_tol) {
+    return 0;
+  }
+  return scan.intensity_arr_[idx];
+}
+
+DIAmeterXicWindow::DIAmeterXicWindow(const DIAmeterXicStore* ms1_store, const DIAmeterXicStore* ms2_store,
+                                     int prec_ppm, int frag_ppm)
+  : ms1_store_(ms1_store), ms2_store_(ms2_store), prec_ppm_(prec_ppm), frag_ppm_(frag_ppm) {
+}
+
+void DIAmeterXicWindow::addScans(int ms1_pos, int ms2_pos) {
+  ms1_positions_.push_back(ms1_pos);
+  ms2_positions_.push_back(ms2_pos);
+}
+
+int DIAmeterXicWindow::size() const {
+  return ms1_positions_.size();
+}
+
+void DIAmeterXicWindow::precursorChroms(const vector<double>& mzs, vector<double*>* chroms) {
+  extract(ms1_store_, ms1_positions_, prec_ppm_, &ms1_chroms_, mzs, chroms);
+}
+
+void DIAmeterXicWindow::fragmentChroms(const vector<double>& mzs, vector<double*>* chroms) {
+  extract(ms2_store_, ms2_positions_, frag_ppm_, &ms2_chroms_, mzs, chroms);
+}
+
+void DIAmeterXicWindow::extract(const DIAmeterXicStore* store, const vector<int>& positions, int ppm_tol,
+                                map<double, vector<double> >* cache,
+                                const vector<double>& mzs, vector<double*>* chroms) {
+  vector<double> missing;
+  for (vector<double>::const_iterator mz = mzs.begin(); mz != mzs.end(); ++mz) {
+    if (cache->find(*mz) == cache->end()) {
+      missing.push_back(*mz);
+    }
+  }
+  sort(missing.begin(), missing.end());
+  missing.erase(unique(missing.begin(), missing.end()), missing.end());
+
+  // extract the new chromatograms together, scan by scan, in increasing m/z
+  vector<vector<double>*> new_chroms;
+  for (vector<double>::const_iterator mz = missing.begin(); mz != missing.end(); ++mz) {
+    vector<double>* chrom = &(*cache)[*mz];
+    chrom->resize(positions.size());
+    new_chroms.push_back(chrom);
+  }
+  for (size_t scan_idx = 0; scan_idx < positions.size(); ++scan_idx) {
+    for (size_t mz_idx = 0; mz_idx < missing.size(); ++mz_idx) {
+      (*new_chroms[mz_idx])[scan_idx] = store->closestPPMIntensity(positions[scan_idx], missing[mz_idx], ppm_tol);
+    }
+  }
+
+  chroms->clear();
+  for (vector<double>::const_iterator mz = mzs.begin(); mz != mzs.end(); ++mz) {
+    vector<double>& chrom = (*cache)[*mz];
+    chroms->push_back(chrom.empty() ? NULL : &chrom[0]);
+  }
+}
@@ -0,0 +1,77 @@
+/**
+ * DIAmeterXicStore.h
+ * DESCRIPTION: Extracted-ion chromatograms for the precursor-fragment
+ * coelution features of DIAmeter.
+ **************************************************************************/
+
+#ifndef DIAMETERXICSTORE_H
+#define DIAMETERXICSTORE_H
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+// The centroided peaks of a set of scans, indexed by scan number and, within
+// each scan, by whole m/z: one flat table holds, for every scan, the first
+// peak at or above each integer m/z, so finding the peak closest to an m/z
+// searches a single bin instead of the whole scan. It is built once for the
+// MS1 scans of a run and once for the MS2 scans of an isolation window.
+class DIAmeterXicStore {
+  public:
+    DIAmeterXicStore();
+
+    // Index a scan; scans must be added in increasing scan number. The peak
+    // arrays are not copied, and must stay valid as long as the store is used.
+    void addScan(int scan_num, const double* mz_arr, const double* intensity_arr, int peak_num);
+    // The position of scan_num in the store, or -1 if it was not added
+    int find(int scan_num) const;
+    // The intensity of the peak closest to query_mz in the scan at pos, or 0
+    // if that peak is more than ppm_tol away; the same as closestPPMValue.
+    double closestPPMIntensity(int pos, double query_mz, int ppm_tol) const;
+
+  protected:
+    struct Scan {
+      const double* mz_arr_;
+      const double* intensity_arr_;
+      int peak_num_;
+      int min_bin_;  // integer m/z of the first peak
+      int num_bins_;
+      size_t bin_offset_;  // of the num_bins_ + 1 entries of the scan in bins_
+    };
+    std::vector<int> scan_nums_;
+    std::vector<Scan> scans_;
+    std::vector<int> bins_;
+};
+
+// The chromatograms over the (MS1, MS2) scan pairs of one coelution window.
+// Chromatograms are extracted for many m/z at once, one scan at a time, and
+// kept by m/z, so the precursor isotopes and fragments that the candidates
+// of a spectrum have in common are extracted once.
+class DIAmeterXicWindow {
+  public:
+    DIAmeterXicWindow(const DIAmeterXicStore* ms1_store, const DIAmeterXicStore* ms2_store,
+                      int prec_ppm, int frag_ppm);
+
+    // Add a scan pair, given by the positions of the scans in their stores
+    void addScans(int ms1_pos, int ms2_pos);
+    // The number of scan pairs, i.e. the length of each chromatogram
+    int size() const;
+
+    // The chromatograms of the MS1 and MS2 signals at mzs, in the order of
+    // mzs. They are owned by the window.
+    void precursorChroms(const std::vector<double>& mzs, std::vector<double*>* chroms);
+    void fragmentChroms(const std::vector<double>& mzs, std::vector<double*>* chroms);
+
+  protected:
+    void extract(const DIAmeterXicStore* store, const std::vector<int>& positions, int ppm_tol,
+                 std::map<double, std::vector<double> >* cache,
+                 const std::vector<double>& mzs, std::vector<double*>* chroms);
+
+    const DIAmeterXicStore* ms1_store_;
+    const DIAmeterXicStore* ms2_store_;
+    int prec_ppm_, frag_ppm_;
+    std::vector<int> ms1_positions_, ms2_positions_;
+    std::map<double, std::vector<double> > ms1_chroms_, ms2_chroms_;
+};
+
+#endif //DIAMETERXICSTORE_H
@@ -5,6 +5,8 @@
 
 #include "DelimitedFileReader.h"
 
+#include <algorithm>
+#include <cctype>
 #include <fstream>
 
 #include <iostream>
@@ -20,7 +22,8 @@ using namespace std;
  * \returns a DelimitedFileReader object
  */  
 DelimitedFileReader::DelimitedFileReader():
-  num_rows_valid_(false), istream_ptr_(NULL), delimiter_('\t'), owns_stream_(false) {
+  num_rows_valid_(false), istream_ptr_(NULL), delimiter_('\t'), owns_stream_(false),
+  mapped_file_(NULL) {
 }
 
 /**
@@ -31,7 +34,8 @@ DelimitedFileReader::DelimitedFileReader(
   const char *file_name, ///< the path of the file to read
   bool has_header, ///< indicates whether the header exists (default true).
   char delimiter ///< the delimiter to use (default tab).
-): istream_ptr_(NULL), num_rows_valid_(false), delimiter_(delimiter) {
+): istream_ptr_(NULL), num_rows_valid_(false), delimiter_(delimiter), owns_stream_(false),
+  mapped_file_(NULL) {
   loadData(file_name, has_header);
 }
 
@@ -43,7 +47,7 @@ DelimitedFileReader::DelimitedFileReader(
   const std::string& file_name, ///< the path of the file  to read
   bool has_header, ///< indicates whether the header exists (default true).
   char delimiter ///< the delimiter to use (default tab)
-): istream_ptr_(NULL), delimiter_(delimiter) {
+): istream_ptr_(NULL), delimiter_(delimiter), owns_stream_(false), mapped_file_(NULL) {
   loadData(file_name, has_header);
 }
 
@@ -56,7 +60,7 @@ DelimitedFileReader::DelimitedFileReader(
   bool has_header, ///<indicates whether header exists
   char delimiter ///< the delimiter to use (default tab)
 ): istream_ptr_(istream_ptr), istream_begin_(istream_ptr->tellg()), delimiter_(delimiter),
-has_header_(has_header), owns_stream_(false) {
+has_header_(has_header), owns_stream_(false), mapped_file_(NULL) {
   loadData();
 }
 
@@ -68,13 +72,20 @@ DelimitedFileReader::~DelimitedFileReader() {
   if (istream_ptr_ != NULL && owns_stream_) {
     delete istream_ptr_;
   }
+  delete mapped_file_;
 }
 
 /**
  * \returns the number of rows, assuming a square matrix
  */
 unsigned int DelimitedFileReader::numRows() {
-  if (!num_rows_valid_) {
+  if (!num_rows_valid_ && mapped_file_ != NULL) {
+    num_rows_ = mapped_file_->numRows();
+    if (has_header_ && num_rows_ > 0) {
+      num_rows_--;
+    }
+    num_rows_valid_ = true;
+  } else if (!num_rows_valid_) {
     num_rows_ = 0;
 
     streampos last_pos = istream_ptr_->tellg();
@@ -140,7 +151,7 @@ string DelimitedFileReader::getHeaderString() {
 
 
 void DelimitedFileReader::loadData() {
-  if (!istream_ptr_->good()) {
+  if (mapped_file_ == NULL && !istream_ptr_->good()) {
     carp(CARP_ERROR, "Stream is not good!");
     carp(CARP_ERROR, "Filename:%s", file_name_.c_str());
     carp(CARP_ERROR, "EOF:%i", istream_ptr_ -> eof());
@@ -151,15 +162,21 @@ void DelimitedFileReader::loadData() {
   current_row_ = 0;
   num_rows_valid_ = false;
   has_current_ = false;
+  row_copied_ = true;
   column_mismatch_warned_ = false;
-  istream_begin_ = istream_ptr_->tellg(); 
+  if (mapped_file_ != NULL) {
+    mapped_lines_ = mapped_file_->getRows();
+  } else {
+    istream_begin_ = istream_ptr_->tellg();
+  }
 
-  has_next_ = !getline(*istream_ptr_, next_data_string_).fail();
+  has_next_ = readLine(next_data_string_);
   next_data_string_ = StringUtils::Trim(next_data_string_);
   if (has_header_) {
     if (has_next_) {
       column_names_ = StringUtils::Split(next_data_string_, delimiter_);
-      has_next_ = !getline(*istream_ptr_, next_data_string_).fail();
+      // the rows of a mapped file are read by next()
+      has_next_ = mapped_file_ != NULL ? mapped_lines_.hasNext() : readLine(next_data_string_);
     } else {
       carp(CARP_WARNING, "No data/headers found!");
       return;
@@ -185,14 +202,22 @@ void DelimitedFileReader::loadData(
 
   file_name_ = string(file_name);
   has_header_ = has_header;
+  delete mapped_file_;
+  mapped_file_ = NULL;
 
   //special case, if filename is '-', then use standard input.
   if (file_name_ == "-") {
     istream_ptr_ = &cin;
     owns_stream_ = false;
   } else {
-    istream_ptr_ = new ifstream(file_name, ios::in);
-    owns_stream_ = true;
+    // map the file if possible, otherwise fall back to a stream
+    mapped_file_ = new MappedDelimitedFile();
+    if (!mapped_file_->open(file_name_, false, delimiter_)) {
+      delete mapped_file_;
+      mapped_file_ = NULL;
+      istream_ptr_ = new ifstream(file_name, ios::in);
+      owns_stream_ = true;
+    }
   }
   loadData();
 
@@ -251,6 +276,7 @@ const vector<string>& DelimitedFileReader::getColumnNames() {
 
 const std::vector<std::string>& DelimitedFileReader::getCurrentRowData() {
   if (!has_current_) { carp(CARP_FATAL, "End of file!"); }
+  copyMappedRow();
   return data_;
 }
 
@@ -270,6 +296,7 @@ const string& DelimitedFileReader::getString() {
   if (!has_current_) {
     carp(CARP_FATAL, "End of file!");
   }
+  copyMappedRow();
   return current_data_string_;
 }
 
@@ -279,6 +306,7 @@ const string& DelimitedFileReader::getString() {
 const string& DelimitedFileReader::getString(
   unsigned int col_idx ///< the column index
   ) {
+  copyMappedRow();
   if (col_idx >= data_.size()) {
     carp(CARP_FATAL, "col idx:%i is out of bounds! (0,%i,%i)",
          col_idx, (column_names_.size()-1), (data_.size()-1));
@@ -286,6 +314,56 @@ const string& DelimitedFileReader::getString(
   return data_.at(col_idx);
 }
 
+/**
+ * points to the text of a cell of the current row. A mapped row is
+ * read from the mapping, where a missing cell is empty just as it
+ * would be after the row is padded to the header.
+ */
+void DelimitedFileReader::getCell(
+  unsigned int col_idx, ///< the column index
+  const char** begin, ///< the first character of the cell -out
+  size_t* length ///< the length of the cell -out
+  ) {
+  if (row_copied_) {
+    const string& cell = getString(col_idx);
+    *begin = cell.data();
+    *length = cell.length();
+    return;
+  }
+  size_t num_cells = max(mapped_lines_.numCells(), column_names_.size());
+  if (col_idx >= num_cells) {
+    carp(CARP_FATAL, "col idx:%i is out of bounds! (0,%i,%i)",
+         col_idx, (column_names_.size()-1), (num_cells-1));
+  }
+  const MappedDelimitedFile::Cell& cell = mapped_lines_.getCell(col_idx);
+  *begin = cell.begin_;
+  *length = cell.length_;
+}
+
+/**
+ * \returns whether the cell is the given text, ignoring case if
+ * ignore_case is set
+ */
+static bool cellEquals(
+  const char* begin, ///< the first character of the cell
+  size_t length, ///< the length of the cell
+  const char* text, ///< the text to compare to
+  bool ignore_case = false ///< whether to ignore case
+  ) {
+  size_t idx = 0;
+  for (; idx < length && text[idx] != '\0'; idx++) {
+    char x = begin[idx], y = text[idx];
+    if (ignore_case) {
+      x = tolower(x);
+      y = tolower(y);
+    }
+    if (x != y) {
+      return false;
+    }
+  }
+  return idx == length && text[idx] == '\0';
+}
+
 /** 
  * \returns the string value of the cell.
  */
@@ -317,13 +395,17 @@ TValue DelimitedFileReader::getValue(
 FLOAT_T DelimitedFileReader::getFloat(
   unsigned int col_idx ///< the column index
   ) {
-  const string& string_ans = getString(col_idx);
-  if (string_ans == "Inf") {
+  const char* begin;
+  size_t length;
+  getCell(col_idx, &begin, &length);
+  if (cellEquals(begin, length, "Inf")) {
     return numeric_limits<FLOAT_T>::infinity();
-  } else if (string_ans == "-Inf") {
+  } else if (cellEquals(begin, length, "-Inf")) {
     return -numeric_limits<FLOAT_T>::infinity();
   } else {
-    return getValue<FLOAT_T>(col_idx);
+    FLOAT_T value;
+    MappedDelimitedFile::parseCell(begin, length, &value);
+    return value;
   }
 }
 
@@ -350,17 +432,21 @@ FLOAT_T DelimitedFileReader::getFloat(
 double DelimitedFileReader::getDouble(
   unsigned int col_idx ///< the column index 
   ) {
-  const string& string_ans = getString(col_idx);
-  if (string_ans == "") {
+  const char* begin;
+  size_t length;
+  getCell(col_idx, &begin, &length);
+  if (length == 0) {
     return 0.0;
-  } else if (string_ans == "Inf") {
+  } else if (cellEquals(begin, length, "Inf")) {
     return numeric_limits<double>::infinity();
-  } else if (string_ans == "-Inf") {
+  } else if (cellEquals(begin, length, "-Inf")) {
     return -numeric_limits<double>::infinity();
-  } else if (StringUtils::ToLower(string_ans) == "nan") {
-	return 0.0;
+  } else if (cellEquals(begin, length, "nan", true)) {
+    return 0.0;
   } else {
-    return getValue<double>(col_idx);
+    double value;
+    MappedDelimitedFile::parseCell(begin, length, &value);
+    return value;
   }
 }
 
@@ -386,8 +472,12 @@ double DelimitedFileReader::getDouble(
 int DelimitedFileReader::getInteger(
   unsigned int col_idx ///< the column index 
   ) {
-  //TODO : check the string for a valid integer.
-  return getValue<int>(col_idx);
+  const char* begin;
+  size_t length;
+  getCell(col_idx, &begin, &length);
+  int value;
+  MappedDelimitedFile::parseCell(begin, length, &value);
+  return value;
 }
 
 /**
@@ -466,8 +556,10 @@ void DelimitedFileReader::getDoubleVectorFromCell(
  * resets the file pointer to the beginning of the file.
  */
 void DelimitedFileReader::reset() {
-  istream_ptr_->clear();
-  istream_ptr_->seekg(istream_begin_, ios::beg);
+  if (mapped_file_ == NULL) {
+    istream_ptr_->clear();
+    istream_ptr_->seekg(istream_begin_, ios::beg);
+  }
   loadData();
 }
 
@@ -475,11 +567,27 @@ void DelimitedFileReader::reset() {
  * parses the next line in the file. 
  */
 void DelimitedFileReader::next() {
-  if (has_next_) {
+  if (has_next_ && mapped_file_ != NULL && (has_header_ || current_row_ > 0)) {
+    // The cells are read from the mapping, and the row is only copied
+    // if it is asked for as strings.
+    current_row_++;
+    mapped_lines_.next();
+    row_copied_ = false;
+    if (mapped_lines_.numCells() < column_names_.size() && !column_mismatch_warned_) {
+      carp(CARP_WARNING, "Column count %d for line %d is less than header %d",
+           mapped_lines_.numCells(), current_row_, column_names_.size());
+      carp(CARP_WARNING, "%s",
+           string(mapped_lines_.lineBegin(), mapped_lines_.lineLength()).c_str());
+      carp(CARP_WARNING, "Suppressing warnings, other mismatches may exist!");
+      column_mismatch_warned_ = true;
+    }
+    has_next_ = mapped_lines_.hasNext();
+    has_current_ = true;
+  } else if (has_next_) {
     current_row_++;
-    current_data_string_ = next_data_string_;
-    //parse next_data_string_ into data_
-    data_ = StringUtils::Split(current_data_string_, delimiter_);
+    current_data_string_.swap(next_data_string_);
+    //parse current_data_string_ into data_
+    splitCurrentData();
     //make sure data has the right number of columns for the header.
     if (data_.size() < column_names_.size()) {
       if (!column_mismatch_warned_) {
@@ -495,13 +603,71 @@ void DelimitedFileReader::next() {
     }
 
     //read next line
-    has_next_ = !getline(*istream_ptr_, next_data_string_).fail();
+    row_copied_ = true;
+    has_next_ = mapped_file_ != NULL ? mapped_lines_.hasNext() : readLine(next_data_string_);
     has_current_ = true;
   } else {
     has_current_ = false;
   }
 }
 
+/**
+ * reads the next line from the mapped file or the stream
+ * \returns false if there are no more lines
+ */
+bool DelimitedFileReader::readLine(
+  string& line ///< the line read
+  ) {
+  if (mapped_file_ != NULL) {
+    if (!mapped_lines_.next()) {
+      return false;
+    }
+    line.assign(mapped_lines_.lineBegin(), mapped_lines_.lineLength());
+    return true;
+  }
+  return !getline(*istream_ptr_, line).fail();
+}
+
+/**
+ * splits the current data string into data_ the same way
+ * StringUtils::Split does, but assigning to the strings of
+ * the previous row instead of allocating new ones.
+ */
+void DelimitedFileReader::splitCurrentData() {
+  size_t num_cells = 0;
+  size_t from = 0;
+  size_t found;
+  do {
+    found = current_data_string_.find(delimiter_, from);
+    size_t to = found == string::npos ? current_data_string_.length() : found;
+    if (num_cells == data_.size()) {
+      data_.push_back(string());
+    }
+    data_[num_cells++].assign(current_data_string_, from, to - from);
+    from = to + 1;
+  } while (found != string::npos);
+  data_.resize(num_cells);
+}
+
+/**
+ * copies the current line of the mapped file into current_data_string_
+ * and data_, padded to the number of columns of the header, unless they
+ * already hold it
+ */
+void DelimitedFileReader::copyMappedRow() {
+  if (row_copied_) {
+    return;
+  }
+  current_data_string_.assign(mapped_lines_.lineBegin(), mapped_lines_.lineLength());
+  size_t num_cells = mapped_lines_.numCells();
+  data_.resize(max(num_cells, column_names_.size()));
+  for (size_t idx = 0; idx < data_.size(); idx++) {
+    const MappedDelimitedFile::Cell& cell = mapped_lines_.getCell(idx);
+    data_[idx].assign(cell.begin_, cell.length_);
+  }
+  row_copied_ = true;
+}
+
 /**
  * \returns whether there are more rows to 
  * iterate through
@@ -23,6 +23,7 @@
 #include <string>
 #include <vector>
 
+#include "MappedDelimitedFile.h"
 #include "parameter.h"
 #include "util/Params.h"
 
@@ -54,6 +55,10 @@ class DelimitedFileReader {
 
   std::string file_name_; ///<file name that the stream is open on.
 
+  MappedDelimitedFile* mapped_file_; ///<the file, if it is read from a mapping rather than the stream
+  MappedDelimitedFile::Cursor mapped_lines_; ///<the current line of the mapped file
+  bool row_copied_; ///<indicator of whether current_data_string_ and data_ hold the current row
+
   bool num_rows_valid_; ///<indicator whether the number of rows is valid
   unsigned int num_rows_; ///<number of rows in the file.
 
@@ -68,6 +73,35 @@ class DelimitedFileReader {
    */
   void loadData();
 
+  /**
+   * reads the next line from the mapped file or the stream
+   * \returns false if there are no more lines
+   */
+  bool readLine(
+    std::string& line ///< the line read
+  );
+
+  /**
+   * splits the current data string into data_, reusing its strings
+   */
+  void splitCurrentData();
+
+  /**
+   * copies the current line of the mapped file into
+   * current_data_string_ and data_
+   */
+  void copyMappedRow();
+
+  /**
+   * points to the text of a cell of the current row, in the mapping
+   * if the row has not been copied
+   */
+  void getCell(
+    unsigned int col_idx, ///< the column index
+    const char** begin, ///< the first character of the cell -out
+    size_t* length ///< the length of the cell -out
+  );
+
   virtual void loadData(
     const char *file_name, ///< the file path
     bool has_header = true ///< header indicator
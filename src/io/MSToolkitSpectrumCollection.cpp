@@ -72,8 +72,10 @@ bool MSToolkitSpectrumCollection::parse(int ms_level, bool dia_mode) {
     }
     Crux::Spectrum* parsed_spectrum = new Crux::Spectrum();
     if (parsed_spectrum->parseMstoolkitSpectrum(mst_spectrum, filename_.c_str())) {
+      if (handler_ == NULL) {
+        spectraByScan_[first_scan] = parsed_spectrum;
+      }
       addSpectrumToEnd(parsed_spectrum);
-      spectraByScan_[first_scan] = parsed_spectrum;
     } else {
       delete parsed_spectrum;
     }
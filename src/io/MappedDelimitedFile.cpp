@@ -0,0 +1,325 @@
+/*************************************************************************
+ * \file MappedDelimitedFile.cpp
+ * \brief A memory-mapped delimited file
+ *************************************************************************/
+
+#include "MappedDelimitedFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifndef _MSC_VER
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "carp.h"
+#include "util/StringUtils.h"
+
+using namespace std;
+
+// Cells longer than this are left to StringUtils::FromString
+static const size_t MAX_NUMBER_LENGTH = 63;
+
+/**
+ * \returns whether the cell is [+-]digits[.digits][(e|E)[+-]digits], with
+ * at least one digit before the exponent. strtod and a stream read such a
+ * cell whole and to the same value; for anything else, such as whitespace
+ * or "inf", they may not, so it is left to StringUtils::FromString.
+ */
+static bool isPlainNumber(const char* begin, size_t length, bool allow_fraction) {
+  const char* end = begin + length;
+  const char* pos = begin;
+  if (pos < end && (*pos == '+' || *pos == '-')) {
+    ++pos;
+  }
+  size_t num_digits = 0;
+  for (; pos < end && *pos >= '0' && *pos <= '9'; ++pos) {
+    ++num_digits;
+  }
+  if (!allow_fraction) {
+    return pos == end && num_digits > 0;
+  }
+  if (pos < end && *pos == '.') {
+    for (++pos; pos < end && *pos >= '0' && *pos <= '9'; ++pos) {
+      ++num_digits;
+    }
+  }
+  if (num_digits == 0) {
+    return false;
+  }
+  if (pos < end && (*pos == 'e' || *pos == 'E')) {
+    ++pos;
+    if (pos < end && (*pos == '+' || *pos == '-')) {
+      ++pos;
+    }
+    const char* exponent = pos;
+    for (; pos < end && *pos >= '0' && *pos <= '9'; ++pos) {}
+    if (pos == exponent) {
+      return false;
+    }
+  }
+  return pos == end;
+}
+
+MappedDelimitedFile::Cursor::Cursor()
+  : pos_(NULL), end_(NULL), line_begin_(NULL), line_end_(NULL),
+    delimiter_('\t'), num_cells_(0) {
+  empty_cell_.begin_ = "";
+  empty_cell_.length_ = 0;
+}
+
+MappedDelimitedFile::Cursor::Cursor(
+  const char* begin,
+  const char* end,
+  char delimiter,
+  size_t num_cells
+) : pos_(begin), end_(end), line_begin_(begin), line_end_(begin),
+    delimiter_(delimiter), num_cells_(num_cells) {
+  empty_cell_.begin_ = "";
+  empty_cell_.length_ = 0;
+}
+
+bool MappedDelimitedFile::Cursor::next() {
+  cells_.clear();
+  if (pos_ >= end_) {
+    return false;
+  }
+  line_begin_ = pos_;
+  const char* newline = (const char*)memchr(pos_, '\n', end_ - pos_);
+  if (newline == NULL) {
+    line_end_ = pos_ = end_;
+  } else {
+    line_end_ = newline;
+    pos_ = newline + 1;
+  }
+  if (num_cells_ > 0) {
+    splitLine();
+  }
+  return true;
+}
+
+/**
+ * splits the current line into cells the same way StringUtils::Split does,
+ * stopping after num_cells_ cells
+ */
+void MappedDelimitedFile::Cursor::splitLine() {
+  const char* cell_begin = line_begin_;
+  while (cells_.size() < num_cells_) {
+    const char* delimiter = (const char*)memchr(cell_begin, delimiter_, line_end_ - cell_begin);
+    Cell cell;
+    cell.begin_ = cell_begin;
+    cell.length_ = (delimiter == NULL ? line_end_ : delimiter) - cell_begin;
+    cells_.push_back(cell);
+    if (delimiter == NULL) {
+      break;
+    }
+    cell_begin = delimiter + 1;
+  }
+}
+
+bool MappedDelimitedFile::Cursor::hasNext() const {
+  return pos_ < end_;
+}
+
+const char* MappedDelimitedFile::Cursor::lineBegin() const {
+  return line_begin_;
+}
+
+size_t MappedDelimitedFile::Cursor::lineLength() const {
+  return line_end_ - line_begin_;
+}
+
+size_t MappedDelimitedFile::Cursor::numCells() const {
+  return cells_.size();
+}
+
+const MappedDelimitedFile::Cell& MappedDelimitedFile::Cursor::getCell(size_t col_idx) const {
+  return col_idx < cells_.size() ? cells_[col_idx] : empty_cell_;
+}
+
+MappedDelimitedFile::MappedDelimitedFile()
+  : delimiter_('\t'), data_(NULL), size_(0), rows_begin_(NULL) {
+}
+
+MappedDelimitedFile::~MappedDelimitedFile() {
+  close();
+}
+
+void MappedDelimitedFile::close() {
+  if (data_ != NULL) {
+#ifdef _MSC_VER
+    stub_unmmap(&unmap_info_);
+#else
+    munmap((void*)data_, size_);
+#endif
+  }
+  data_ = rows_begin_ = NULL;
+  size_ = 0;
+  column_names_.clear();
+}
+
+bool MappedDelimitedFile::open(
+  const string& file_name,
+  bool has_header,
+  char delimiter
+) {
+  close();
+  delimiter_ = delimiter;
+
+  // pipes and the like are left to a stream
+  struct stat file_info;
+  if (stat(file_name.c_str(), &file_info) == -1 ||
+      (file_info.st_mode & S_IFMT) != S_IFREG) {
+    return false;
+  }
+  size_t file_size = file_info.st_size;
+
+  // an empty file cannot be mapped, but has no lines to read either
+  if (file_size > 0) {
+#ifdef _MSC_VER
+    void* data = stub_mmap(file_name.c_str(), &unmap_info_);
+    if (data == NULL) {
+      carp(CARP_DEBUG, "Failed to memory-map %s", file_name.c_str());
+      return false;
+    }
+#else
+    int file_d = ::open(file_name.c_str(), O_RDONLY);
+    if (file_d < 0) {
+      return false;
+    }
+    void* data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, file_d, 0);
+    ::close(file_d);
+    if (data == MAP_FAILED) {
+      carp(CARP_DEBUG, "Failed to memory-map %s", file_name.c_str());
+      return false;
+    }
+    madvise(data, file_size, MADV_SEQUENTIAL);
+#endif
+    data_ = (const char*)data;
+    size_ = file_size;
+  }
+  rows_begin_ = data_;
+
+  if (has_header) {
+    Cursor header(data_, data_ + size_, delimiter_, 0);
+    if (header.next()) {
+      column_names_ = StringUtils::Split(
+        StringUtils::Trim(string(header.lineBegin(), header.lineLength())), delimiter_);
+      rows_begin_ = header.lineBegin() + header.lineLength();
+      if (rows_begin_ < data_ + size_) {
+        ++rows_begin_;
+      }
+    }
+  }
+  return true;
+}
+
+const vector<string>& MappedDelimitedFile::getColumnNames() const {
+  return column_names_;
+}
+
+int MappedDelimitedFile::findColumn(const string& column_name) const {
+  for (size_t col_idx = 0; col_idx < column_names_.size(); col_idx++) {
+    if (column_names_[col_idx] == column_name) {
+      return col_idx;
+    }
+  }
+  return -1;
+}
+
+size_t MappedDelimitedFile::numRows() const {
+  const char* end = data_ + size_;
+  size_t num_rows = 0;
+  for (const char* pos = rows_begin_; pos < end; ++num_rows) {
+    const char* newline = (const char*)memchr(pos, '\n', end - pos);
+    pos = newline == NULL ? end : newline + 1;
+  }
+  return num_rows;
+}
+
+MappedDelimitedFile::Cursor MappedDelimitedFile::getRows(size_t num_cells) const {
+  return Cursor(rows_begin_, data_ + size_, delimiter_, num_cells);
+}
+
+void MappedDelimitedFile::getChunks(
+  size_t num_chunks,
+  size_t num_cells,
+  vector<Cursor>* chunks
+) const {
+  chunks->clear();
+  const char* end = data_ + size_;
+  if (num_chunks == 0) {
+    num_chunks = 1;
+  }
+  size_t chunk_size = (end - rows_begin_) / num_chunks + 1;
+  const char* chunk_begin = rows_begin_;
+  while (chunk_begin < end) {
+    // each chunk but the last ends just after a newline
+    const char* chunk_end = chunk_begin + min(chunk_size, (size_t)(end - chunk_begin));
+    if (chunk_end < end) {
+      const char* newline = (const char*)memchr(chunk_end - 1, '\n', end - chunk_end + 1);
+      chunk_end = newline == NULL ? end : newline + 1;
+    }
+    chunks->push_back(Cursor(chunk_begin, chunk_end, delimiter_, num_cells));
+    chunk_begin = chunk_end;
+  }
+}
+
+void MappedDelimitedFile::parseCell(const char* begin, size_t length, double* value) {
+  if (length <= MAX_NUMBER_LENGTH && isPlainNumber(begin, length, true)) {
+    char buffer[MAX_NUMBER_LENGTH + 1];
+    memcpy(buffer, begin, length);
+    buffer[length] = '\0';
+    errno = 0;
+    *value = strtod(buffer, NULL);
+    if (errno != ERANGE) {
+      return;
+    }
+  }
+  *value = StringUtils::FromString<double>(string(begin, length));
+}
+
+void MappedDelimitedFile::parseCell(const char* begin, size_t length, float* value) {
+  if (length <= MAX_NUMBER_LENGTH && isPlainNumber(begin, length, true)) {
+    char buffer[MAX_NUMBER_LENGTH + 1];
+    memcpy(buffer, begin, length);
+    buffer[length] = '\0';
+    errno = 0;
+    *value = strtof(buffer, NULL);
+    if (errno != ERANGE) {
+      return;
+    }
+  }
+  *value = StringUtils::FromString<float>(string(begin, length));
+}
+
+void MappedDelimitedFile::parseCell(const char* begin, size_t length, int* value) {
+  // nine digits cannot overflow an int
+  if (length <= 10 && isPlainNumber(begin, length, false) &&
+      (length <= 9 || *begin == '+' || *begin == '-')) {
+    const char* pos = begin;
+    bool negative = *pos == '-';
+    if (*pos == '+' || *pos == '-') {
+      ++pos;
+    }
+    int parsed = 0;
+    for (; pos < begin + length; ++pos) {
+      parsed = parsed * 10 + (*pos - '0');
+    }
+    *value = negative ? -parsed : parsed;
+    return;
+  }
+  *value = StringUtils::FromString<int>(string(begin, length));
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
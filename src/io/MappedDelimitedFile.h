@@ -0,0 +1,158 @@
+/**
+ * \file MappedDelimitedFile.h
+ * \brief A delimited file that is memory-mapped rather than read through a
+ * stream. Lines and cells are returned as pointers into the mapping instead
+ * of being copied into strings, only the cells up to the last column that is
+ * needed are split out of each line, and the rows can be divided into chunks
+ * at line boundaries to be parsed on several threads.
+ ****************************************************************************/
+#ifndef MAPPEDDELIMITEDFILE_H
+#define MAPPEDDELIMITEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#ifdef _MSC_VER
+#include "util/WinCrux.h"
+#endif
+
+class MappedDelimitedFile {
+ public:
+  static const size_t ALL_CELLS = (size_t)-1;
+
+  /**
+   * A cell of a line. It points into the mapping, and is valid as long as
+   * the file is.
+   */
+  struct Cell {
+    const char* begin_;
+    size_t length_;
+
+    bool empty() const { return length_ == 0; }
+    std::string str() const { return std::string(begin_, length_); }
+  };
+
+  /**
+   * Reads the lines of a range of the file one at a time, the way getline
+   * would. Only the first num_cells cells of each line are split out.
+   */
+  class Cursor {
+   public:
+    Cursor();
+    Cursor(
+      const char* begin, ///< the first line of the range
+      const char* end, ///< the end of the range, at the end of a line
+      char delimiter, ///< the delimiter between cells
+      size_t num_cells ///< the number of cells to split out of each line
+    );
+
+    /**
+     * moves to the next line
+     * \returns false if there are no more lines
+     */
+    bool next();
+
+    /**
+     * \returns whether next() would move to another line
+     */
+    bool hasNext() const;
+
+    const char* lineBegin() const;
+    size_t lineLength() const;
+
+    /**
+     * \returns the number of cells split out of the current line
+     */
+    size_t numCells() const;
+
+    /**
+     * \returns the cell of the current line, or an empty cell if the line
+     * has fewer cells or the cell was not split out
+     */
+    const Cell& getCell(size_t col_idx) const;
+
+   protected:
+    void splitLine();
+
+    const char* pos_;
+    const char* end_;
+    const char* line_begin_;
+    const char* line_end_;
+    char delimiter_;
+    size_t num_cells_;
+    std::vector<Cell> cells_;
+    Cell empty_cell_;
+  };
+
+  MappedDelimitedFile();
+  ~MappedDelimitedFile();
+
+  /**
+   * maps file_name and parses the header if there is one
+   * \returns false if the file could not be mapped
+   */
+  bool open(
+    const std::string& file_name, ///< the path of the file to read
+    bool has_header = true, ///< indicates whether the header exists
+    char delimiter = '\t' ///< the delimiter to use
+  );
+
+  const std::vector<std::string>& getColumnNames() const;
+
+  /**
+   * finds the index of a column
+   *\returns the column index, -1 if not found.
+   */
+  int findColumn(const std::string& column_name) const;
+
+  /**
+   *\returns the number of rows, not counting the header
+   */
+  size_t numRows() const;
+
+  /**
+   * \returns a cursor over all the rows
+   */
+  Cursor getRows(size_t num_cells = ALL_CELLS) const;
+
+  /**
+   * Divides the rows into at most num_chunks cursors of about the same
+   * size, which together read every row once, in order.
+   */
+  void getChunks(
+    size_t num_chunks, ///< the number of chunks to divide the rows into
+    size_t num_cells, ///< the number of cells to split out of each line
+    std::vector<Cursor>* chunks ///< the cursors
+  ) const;
+
+  /**
+   * parses a cell to the same value as StringUtils::FromString would, but
+   * without copying it into a stream, and throws the same error if it is
+   * not a number
+   */
+  static void parseCell(const char* begin, size_t length, double* value);
+  static void parseCell(const char* begin, size_t length, float* value);
+  static void parseCell(const char* begin, size_t length, int* value);
+
+ protected:
+  void close();
+
+  char delimiter_;
+  std::vector<std::string> column_names_;
+
+  const char* data_; ///< the mapped file
+  size_t size_;
+  const char* rows_begin_; ///< the first line after the header
+#ifdef _MSC_VER
+  SIMPLE_UNMMAP unmap_info_;
+#endif
+};
+
+#endif //MAPPEDDELIMITEDFILE_H
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
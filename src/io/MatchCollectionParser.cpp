@@ -170,7 +170,8 @@ Protein* MatchCollectionParser::getProtein(
  */
 MatchCollection* MatchCollectionParser::create(
   const string& match_path, ///< path to the file of matches 
-  const string& fasta_path ///< path to the protein database
+  const string& fasta_path, ///< path to the protein database
+  int attributes ///< MATCH_ATTRIBUTE_* flags of what to build
   ) {
   carp(CARP_DEBUG, "match path:%s", match_path.c_str());
   if (!fasta_path.empty()) {
@@ -180,7 +181,12 @@ MatchCollection* MatchCollectionParser::create(
     carp(CARP_FATAL, "The file %s does not exist. \n", match_path.c_str());
   }
   
-  if (database_ == NULL || decoy_database_ == NULL) {
+  // only the tab-delimited reader can leave out the proteins
+  bool tab_delimited = !StringUtils::IEndsWith(match_path, ".xml") &&
+    !StringUtils::IEndsWith(match_path, ".sqt") &&
+    !StringUtils::IEndsWith(match_path, ".mzid");
+  if ((!tab_delimited || (attributes & MATCH_ATTRIBUTE_PROTEINS)) &&
+      (database_ == NULL || decoy_database_ == NULL)) {
     loadDatabase(fasta_path, database_, decoy_database_);
   }
   MatchCollection* collection = NULL;
@@ -194,7 +200,7 @@ MatchCollection* MatchCollectionParser::create(
   } else if (StringUtils::IEndsWith(match_path, ".mzid")) {
     collection = MzIdentMLReader::parse(match_path, database_, decoy_database_);
   } else {
-    collection = MatchFileReader::parse(match_path, database_, decoy_database_);
+    collection = MatchFileReader::parse(match_path, database_, decoy_database_, attributes);
   }
   
   //  Test if collection already has file path set, otherwise set it.
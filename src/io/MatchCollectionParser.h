@@ -10,6 +10,7 @@
 
 #include "model/MatchCollection.h"
 #include "model/Protein.h"
+#include "PSMReader.h"
 
 /**
  * Instantiates a MatchCollection based on the extension of the
@@ -27,11 +28,15 @@ class MatchCollectionParser {
   ~MatchCollectionParser();
  
   /**
-   * \returns a MatchCollection object using the file and protein database
+   * \returns a MatchCollection object using the file and protein database.
+   * For tab-delimited files, only the parts of each match given by
+   * attributes are built, and the database is not loaded unless proteins
+   * are wanted. Other formats are always read in full.
    */
   MatchCollection* create(
     const std::string& match_path, ///< path to the file of matches
-    const std::string& fasta_path  ///< path to the protein database
+    const std::string& fasta_path, ///< path to the protein database
+    int attributes = MATCH_ATTRIBUTE_ALL ///< MATCH_ATTRIBUTE_* flags of what to build
   );
 
 
@@ -0,0 +1,318 @@
+/*************************************************************************
+ * \file MatchColumnTable.cpp
+ * \brief The columns of a tab-delimited PSM file, read into arrays
+ *************************************************************************/
+
+#include "MatchColumnTable.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "carp.h"
+#include "MatchFileReader.h"
+#include "model/Peptide.h"
+#include "util/Params.h"
+#include "util/StringUtils.h"
+
+using namespace std;
+
+typedef MappedDelimitedFile::Cell Cell;
+typedef MappedDelimitedFile::Cursor Cursor;
+
+struct MatchColumnTable::Chunk {
+  Cursor rows_;
+  vector<FLOAT_T> scores_;
+  vector<int> scans_;
+  vector<int> charges_;
+  vector<int> ranks_;
+  vector<char> decoys_;
+  vector<int> file_indices_;
+  vector<string> file_names_;
+  vector<Cell> peptides_;
+  vector<Cell> peptide_mods_;
+  vector<const char*> lines_;
+  vector<unsigned int> line_lengths_;
+  bool multiple_decoys_;
+};
+
+/**
+ * The cell of a column in the current row, as MatchFileReader sees it:
+ * NULL if the file does not have the column.
+ */
+static const Cell* getCell(const int* match_indices, const Cursor& row, MATCH_COLUMNS_T col_type) {
+  int idx = match_indices[col_type];
+  return idx == -1 ? NULL : &row.getCell(idx);
+}
+
+/**
+ * \returns whether the column is missing or empty, as MatchFileReader::empty
+ */
+static bool isEmpty(const int* match_indices, const Cursor& row, MATCH_COLUMNS_T col_type) {
+  const Cell* cell = getCell(match_indices, row, col_type);
+  return cell == NULL || cell->empty();
+}
+
+/**
+ * \returns the integer value of a cell, or -1 if the column is missing, as
+ * MatchFileReader::getInteger
+ */
+static int getInteger(const int* match_indices, const Cursor& row, MATCH_COLUMNS_T col_type) {
+  const Cell* cell = getCell(match_indices, row, col_type);
+  if (cell == NULL) {
+    return -1;
+  }
+  int value;
+  MappedDelimitedFile::parseCell(cell->begin_, cell->length_, &value);
+  return value;
+}
+
+/**
+ * \returns the FLOAT_T value of a cell, or -1 if the column is missing, as
+ * MatchFileReader::getFloat
+ */
+static FLOAT_T getFloat(const int* match_indices, const Cursor& row, MATCH_COLUMNS_T col_type) {
+  const Cell* cell = getCell(match_indices, row, col_type);
+  if (cell == NULL) {
+    return -1;
+  }
+  if (cell->length_ == 3 && strncmp(cell->begin_, "Inf", 3) == 0) {
+    return numeric_limits<FLOAT_T>::infinity();
+  } else if (cell->length_ == 4 && strncmp(cell->begin_, "-Inf", 4) == 0) {
+    return -numeric_limits<FLOAT_T>::infinity();
+  }
+  FLOAT_T value;
+  MappedDelimitedFile::parseCell(cell->begin_, cell->length_, &value);
+  return value;
+}
+
+MatchColumnTable::MatchColumnTable()
+  : score_col_(XCORR_SCORE_COL), score_rank_col_(XCORR_RANK_COL), read_peptides_(false),
+    multiple_decoys_(false) {
+  for (int idx = 0; idx < NUMBER_MATCH_COLUMNS; idx++) {
+    match_indices_[idx] = -1;
+  }
+}
+
+bool MatchColumnTable::open(const string& file_name) {
+  if (!file_.open(file_name, true, '\t')) {
+    return false;
+  }
+  for (int idx = 0; idx < NUMBER_MATCH_COLUMNS; idx++) {
+    match_indices_[idx] = file_.findColumn(get_column_header(idx));
+  }
+  return true;
+}
+
+const vector<string>& MatchColumnTable::getColumnNames() const {
+  return file_.getColumnNames();
+}
+
+bool MatchColumnTable::hasColumn(MATCH_COLUMNS_T col_type) const {
+  return match_indices_[col_type] != -1;
+}
+
+bool MatchColumnTable::hasValue(MATCH_COLUMNS_T col_type) const {
+  Cursor rows = file_.getRows();
+  return rows.next() && !isEmpty(match_indices_, rows, col_type);
+}
+
+void MatchColumnTable::load(
+  MATCH_COLUMNS_T score_col,
+  MATCH_COLUMNS_T score_rank_col,
+  int num_threads,
+  unordered_map<string, int>* peptide_ids
+) {
+  score_col_ = score_col;
+  score_rank_col_ = score_rank_col;
+  decoy_prefix_ = Params::GetString("decoy-prefix");
+  read_peptides_ = peptide_ids != NULL;
+
+  // only the cells up to the last column that is read are split out
+  size_t num_cells = 0;
+  for (int idx = 0; idx < NUMBER_MATCH_COLUMNS; idx++) {
+    num_cells = max(num_cells, (size_t)(match_indices_[idx] + 1));
+  }
+
+  vector<Cursor> cursors;
+  file_.getChunks(max(1, num_threads), num_cells, &cursors);
+  vector<Chunk> chunks(cursors.size());
+  for (size_t i = 0; i < chunks.size(); i++) {
+    chunks[i].rows_ = cursors[i];
+    chunks[i].multiple_decoys_ = false;
+  }
+  boost::thread_group parsers;
+  for (size_t i = 1; i < chunks.size(); i++) {
+    parsers.add_thread(new boost::thread(boost::bind(&MatchColumnTable::parseChunk, this, &chunks[i])));
+  }
+  if (!chunks.empty()) {
+    parseChunk(&chunks[0]);
+  }
+  parsers.join_all();
+
+  // concatenate the chunks in file order
+  size_t num_rows = 0;
+  for (size_t i = 0; i < chunks.size(); i++) {
+    num_rows += chunks[i].scores_.size();
+  }
+  scores_.reserve(num_rows);
+  scans_.reserve(num_rows);
+  charges_.reserve(num_rows);
+  ranks_.reserve(num_rows);
+  decoys_.reserve(num_rows);
+  file_indices_.reserve(num_rows);
+  lines_.reserve(num_rows);
+  line_lengths_.reserve(num_rows);
+  map<string, int> file_ids;
+  unordered_map<string, string> peptide_names;  // by sequence and modifications cells
+  for (size_t i = 0; i < chunks.size(); i++) {
+    Chunk& chunk = chunks[i];
+    scores_.insert(scores_.end(), chunk.scores_.begin(), chunk.scores_.end());
+    scans_.insert(scans_.end(), chunk.scans_.begin(), chunk.scans_.end());
+    charges_.insert(charges_.end(), chunk.charges_.begin(), chunk.charges_.end());
+    ranks_.insert(ranks_.end(), chunk.ranks_.begin(), chunk.ranks_.end());
+    decoys_.insert(decoys_.end(), chunk.decoys_.begin(), chunk.decoys_.end());
+    lines_.insert(lines_.end(), chunk.lines_.begin(), chunk.lines_.end());
+    line_lengths_.insert(line_lengths_.end(), chunk.line_lengths_.begin(), chunk.line_lengths_.end());
+    multiple_decoys_ = multiple_decoys_ || chunk.multiple_decoys_;
+
+    vector<int> chunk_file_ids(chunk.file_names_.size());
+    for (size_t j = 0; j < chunk.file_names_.size(); j++) {
+      map<string, int>::const_iterator found = file_ids.find(chunk.file_names_[j]);
+      if (found == file_ids.end()) {
+        found = file_ids.insert(make_pair(chunk.file_names_[j], (int)file_names_.size())).first;
+        file_names_.push_back(chunk.file_names_[j]);
+      }
+      chunk_file_ids[j] = found->second;
+    }
+    for (vector<int>::const_iterator j = chunk.file_indices_.begin(); j != chunk.file_indices_.end(); ++j) {
+      file_indices_.push_back(chunk_file_ids[*j]);
+    }
+
+    // name the peptides as AssignConfidenceApplication::getPeptideSeq does,
+    // from the peptide MatchFileReader would read
+    if (peptide_ids != NULL) {
+      bool combine_modified = Params::GetBool("combine-modified-peptides");
+      bool combine_charges = Params::GetBool("combine-charge-states");
+      size_t first_row = peptide_indices_.size();
+      for (size_t j = 0; j < chunk.peptides_.size(); j++) {
+        string cells = chunk.peptides_[j].str() + '\t' + chunk.peptide_mods_[j].str();
+        unordered_map<string, string>::const_iterator name = peptide_names.find(cells);
+        if (name == peptide_names.end()) {
+          Crux::Peptide peptide;
+          MatchFileReader::setPeptideSequence(&peptide, chunk.peptides_[j].str(), chunk.peptide_mods_[j].str());
+          string peptide_name;
+          if (combine_modified) {
+            char* unmodified = peptide.getSequence();
+            peptide_name = unmodified;
+            free(unmodified);
+          } else {
+            peptide_name = peptide.getModifiedSequenceWithMasses();
+          }
+          name = peptide_names.insert(make_pair(cells, peptide_name)).first;
+        }
+        string seq = name->second;
+        if (combine_charges) {
+          seq += StringUtils::ToString(charges_[first_row + j]);
+        }
+        unordered_map<string, int>::const_iterator found = peptide_ids->find(seq);
+        if (found == peptide_ids->end()) {
+          found = peptide_ids->insert(make_pair(seq, (int)peptide_ids->size())).first;
+        }
+        peptide_indices_.push_back(found->second);
+      }
+    }
+    chunk = Chunk();
+  }
+}
+
+/**
+ * parses the rows of a chunk, on its own thread
+ */
+void MatchColumnTable::parseChunk(Chunk* chunk) const {
+  const int* indices = match_indices_;
+  int max_rank = Params::GetInt("top-match-in");
+  Cursor& row = chunk->rows_;
+  string file_name;
+  int file_index = -1;
+
+  while (row.next()) {
+    // the same rank column as MatchFileReader::parse
+    MATCH_COLUMNS_T rank_col = get_rank_column(
+      [&indices, &row](MATCH_COLUMNS_T col) { return !isEmpty(indices, row, col); });
+    if (rank_col == INVALID_COL) {
+      carp(CARP_FATAL, "Input file does not contain any reconized rank column.");
+    }
+    if (max_rank != 0 && getInteger(indices, row, rank_col) > max_rank) {
+      continue;
+    }
+
+    chunk->scores_.push_back(getFloat(indices, row, score_col_));
+    chunk->scans_.push_back(getInteger(indices, row, SCAN_COL));
+    chunk->charges_.push_back(getInteger(indices, row, CHARGE_COL));
+    chunk->ranks_.push_back(getInteger(indices, row, score_rank_col_));
+
+    const Cell* protein = getCell(indices, row, PROTEIN_ID_COL);
+    chunk->decoys_.push_back(protein != NULL && protein->length_ >= decoy_prefix_.length() &&
+      strncmp(protein->begin_, decoy_prefix_.c_str(), decoy_prefix_.length()) == 0);
+    if (!isEmpty(indices, row, DECOY_INDEX_COL) && getInteger(indices, row, DECOY_INDEX_COL) > 0) {
+      chunk->multiple_decoys_ = true;
+    }
+
+    // the file column rarely changes from one row to the next
+    const Cell* file = getCell(indices, row, FILE_COL);
+    size_t file_length = file == NULL ? 0 : file->length_;
+    if (file_index == -1 || file_name.compare(0, string::npos, file_length == 0 ? "" : file->begin_, file_length) != 0) {
+      file_name.assign(file_length == 0 ? "" : file->begin_, file_length);
+      vector<string>::const_iterator found =
+        find(chunk->file_names_.begin(), chunk->file_names_.end(), file_name);
+      file_index = found - chunk->file_names_.begin();
+      if (found == chunk->file_names_.end()) {
+        chunk->file_names_.push_back(file_name);
+      }
+    }
+    chunk->file_indices_.push_back(file_index);
+
+    if (read_peptides_) {
+      const Cell* peptide = getCell(indices, row, SEQUENCE_COL);
+      if (peptide == NULL || peptide->empty()) {
+        peptide = getCell(indices, row, POUT_PERC_PEPTIDE_COL);
+      }
+      if (peptide == NULL || peptide->empty()) {
+        carp(CARP_FATAL, "No peptide sequence found.");
+      }
+      chunk->peptides_.push_back(*peptide);
+      const Cell* mods = getCell(indices, row, MODIFICATIONS_COL);
+      chunk->peptide_mods_.push_back(mods == NULL ? Cell() : *mods);
+    }
+
+    chunk->lines_.push_back(row.lineBegin());
+    chunk->line_lengths_.push_back(row.lineLength());
+  }
+}
+
+const vector<string>& MatchColumnTable::getFileNames() const {
+  return file_names_;
+}
+
+bool MatchColumnTable::hasMultipleDecoys() const {
+  return multiple_decoys_;
+}
+
+void MatchColumnTable::writeRow(ostream& output, size_t row) const {
+  size_t length = line_lengths_[row];
+  if (length > 0 && lines_[row][length - 1] == '\r') {
+    length--;
+  }
+  output.write(lines_[row], length);
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
@@ -0,0 +1,113 @@
+/**
+ * \file MatchColumnTable.h
+ * \brief The columns of a tab-delimited PSM file that q-value estimation
+ * needs, read into one array per column rather than into Match objects.
+ * The file stays memory-mapped, so each row can be written back unchanged.
+ ****************************************************************************/
+#ifndef MATCHCOLUMNTABLE_H
+#define MATCHCOLUMNTABLE_H
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MappedDelimitedFile.h"
+#include "MatchColumns.h"
+#include "util/utils.h"
+
+class MatchColumnTable {
+ public:
+  MatchColumnTable();
+
+  /**
+   * maps a tab-delimited file of PSMs
+   * \returns false if it could not be mapped
+   */
+  bool open(const std::string& file_name);
+
+  const std::vector<std::string>& getColumnNames() const;
+
+  /**
+   * \returns whether the file has the column
+   */
+  bool hasColumn(MATCH_COLUMNS_T col_type) const;
+
+  /**
+   * \returns whether the column has a value in the first row
+   */
+  bool hasValue(MATCH_COLUMNS_T col_type) const;
+
+  /**
+   * Reads the score, scan, charge, ranks, decoy label, decoy index and file
+   * of every row, on num_threads threads. Rows are skipped by top-match-in
+   * the same way MatchFileReader::parse skips them. If peptide_ids is given,
+   * each peptide, as AssignConfidenceApplication::getPeptideSeq names it, is
+   * also given an index in it.
+   */
+  void load(
+    MATCH_COLUMNS_T score_col, ///< the score column
+    MATCH_COLUMNS_T score_rank_col, ///< the rank that goes with the score
+    int num_threads, ///< the number of threads to parse on
+    std::unordered_map<std::string, int>* peptide_ids = NULL ///< the indices of the peptides
+  );
+
+  size_t size() const { return scores_.size(); }
+
+  FLOAT_T getScore(size_t row) const { return scores_[row]; }
+  int getScan(size_t row) const { return scans_[row]; }
+  int getCharge(size_t row) const { return charges_[row]; }
+  int getRank(size_t row) const { return ranks_[row]; }
+  bool isDecoy(size_t row) const { return decoys_[row] != 0; }
+  int getFileIndex(size_t row) const { return file_indices_[row]; }
+  int getPeptideIndex(size_t row) const { return peptide_indices_[row]; }
+
+  /**
+   * \returns the files named in the file column, by their index
+   */
+  const std::vector<std::string>& getFileNames() const;
+
+  /**
+   * \returns whether any row has a decoy index above 0, i.e. whether the
+   * search used more than one decoy per target
+   */
+  bool hasMultipleDecoys() const;
+
+  /**
+   * writes the row as it is in the file, without its line ending
+   */
+  void writeRow(std::ostream& output, size_t row) const;
+
+ protected:
+  struct Chunk;
+
+  void parseChunk(Chunk* chunk) const;
+
+  MappedDelimitedFile file_;
+  int match_indices_[NUMBER_MATCH_COLUMNS];
+  MATCH_COLUMNS_T score_col_;
+  MATCH_COLUMNS_T score_rank_col_;
+  std::string decoy_prefix_;
+  bool read_peptides_;
+
+  std::vector<FLOAT_T> scores_;
+  std::vector<int> scans_;
+  std::vector<int> charges_;
+  std::vector<int> ranks_;  ///< from the score rank column
+  std::vector<char> decoys_;
+  std::vector<int> file_indices_;
+  std::vector<int> peptide_indices_;
+  std::vector<const char*> lines_; ///< the start of each row in the mapping
+  std::vector<unsigned int> line_lengths_;
+  std::vector<std::string> file_names_;
+  bool multiple_decoys_;
+};
+
+#endif //MATCHCOLUMNTABLE_H
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
@@ -72,6 +72,8 @@ static const char* match_column_strings[NUMBER_MATCH_COLUMNS] = {
   "fragment coelution", // added by Yang
   "precursor fragment coelution", // added by Yang
   "ensemble score", // added by Yang
+  "hyperscore",
+  "hyperscore rank",
 #ifdef NEW_COLUMNS
   "decoy PSM q-value",
   "decoy peptide q-value",      // NEW
@@ -211,3 +213,17 @@ int get_column_idx(
   return INVALID_COL;
 }
 
+MATCH_COLUMNS_T get_rank_column(
+  const std::function<bool(MATCH_COLUMNS_T)>& has_rank
+) {
+  static const MATCH_COLUMNS_T rank_cols[] = {
+    PERCOLATOR_RANK_COL, BOTH_PVALUE_RANK, RESIDUE_RANK_COL,
+    XCORR_RANK_COL, HYPERSCORE_RANK_COL, SP_RANK_COL
+  };
+  for (size_t i = 0; i < sizeof(rank_cols) / sizeof(rank_cols[0]); i++) {
+    if (has_rank(rank_cols[i])) {
+      return rank_cols[i];
+    }
+  }
+  return INVALID_COL;
+}
@@ -6,6 +6,8 @@
 #ifndef MATCHCOLUMNS_H
 #define MATCHCOLUMNS_H
 
+#include <functional>
+
 //#define NEW_COLUMNS 1
 
 enum MATCH_COLUMNS_T {
@@ -45,6 +47,8 @@ enum MATCH_COLUMNS_T {
   COELUTE_MS2_COL, // added by Yang
   COELUTE_MS1_MS2_COL, // added by Yang
   ENSEMBLE_SCORE_COL, // added by Yang
+  HYPERSCORE_COL,
+  HYPERSCORE_RANK_COL,
 #ifdef NEW_COLUMNS
   DECOY_XCORR_QVALUE_COL,
   DECOY_XCORR_PEPTIDE_QVALUE_COL,  // NEW
@@ -172,4 +176,14 @@ int get_column_idx(
   const char* column_name
 );
 
+/**
+ * \returns the rank column that top-match-in filters the PSMs of a results
+ * file by: the first of the Percolator, combined p-value, residue-evidence
+ * p-value, XCorr, hyperscore and Sp ranks for which has_rank is true, or
+ * INVALID_COL if there is none.
+ */
+MATCH_COLUMNS_T get_rank_column(
+  const std::function<bool(MATCH_COLUMNS_T)>& has_rank
+);
+
 #endif // MATCHCOLUMNS_H
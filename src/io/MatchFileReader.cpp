@@ -15,14 +15,16 @@ using namespace std;
 /**
  * \returns a blank MatchFileReader object
  */
-MatchFileReader::MatchFileReader() : DelimitedFileReader(), PSMReader() {
+MatchFileReader::MatchFileReader()
+  : DelimitedFileReader(), PSMReader(), attributes_(MATCH_ATTRIBUTE_ALL) {
 }
 
 /**
  * \returns a MatchFileReader object and loads the tab-delimited
  * data specified by file_name.
  */
-MatchFileReader::MatchFileReader(const char* file_name) : DelimitedFileReader(file_name, true) {
+MatchFileReader::MatchFileReader(const char* file_name)
+  : DelimitedFileReader(file_name, true), attributes_(MATCH_ATTRIBUTE_ALL) {
   parseHeader();
 }
 
@@ -31,16 +33,19 @@ MatchFileReader::MatchFileReader(const char* file_name) : DelimitedFileReader(fi
  * data specified by file_name.
  */
 MatchFileReader::MatchFileReader(const string& file_name)
-  : DelimitedFileReader(file_name, true), PSMReader(file_name) {
+  : DelimitedFileReader(file_name, true), PSMReader(file_name),
+    attributes_(MATCH_ATTRIBUTE_ALL) {
   parseHeader();
 }
 
 MatchFileReader::MatchFileReader(const string& file_name, Database* database, Database* decoy_database)
-  : DelimitedFileReader(file_name, true), PSMReader(file_name, database, decoy_database) {
+  : DelimitedFileReader(file_name, true), PSMReader(file_name, database, decoy_database),
+    attributes_(MATCH_ATTRIBUTE_ALL) {
   parseHeader();
 }
 
-MatchFileReader::MatchFileReader(istream* iptr) : DelimitedFileReader(iptr, true, '\t') {
+MatchFileReader::MatchFileReader(istream* iptr)
+  : DelimitedFileReader(iptr, true, '\t'), attributes_(MATCH_ATTRIBUTE_ALL) {
   parseHeader();
 }
 
@@ -175,12 +180,19 @@ void MatchFileReader::getMatchColumnsPresent(
   }
 }
 
+void MatchFileReader::setAttributes(int attributes) {
+  attributes_ = attributes;
+}
+
 // FIXME: Need to generalize this to work with Percolator files.
 MatchCollection* MatchFileReader::parse(
   const string& file_path,
   Database* database,
-  Database* decoy_database) {
-  return MatchFileReader(file_path, database, decoy_database).parse();
+  Database* decoy_database,
+  int attributes) {
+  MatchFileReader reader(file_path, database, decoy_database);
+  reader.setAttributes(attributes);
+  return reader.parse();
 }
 
 MatchCollection* MatchFileReader::parse() {
@@ -221,6 +233,7 @@ MatchCollection* MatchFileReader::parse() {
     match_collection->setScoredType(BY_ION_FRACTION, !empty(  BY_IONS_FRACTION_COL));
     match_collection->setScoredType(BY_ION_REPEAT_MATCH, !empty(BY_IONS_REPEAT_MATCH_COL));
     match_collection->setScoredType(TAILOR_SCORE, !empty(TAILOR_COL)); //Added for tailor score calibration method by AKF
+    match_collection->setScoredType(HYPER_SCORE, !empty(HYPERSCORE_COL));
     match_collection->setScoredType(QVALUE_TDC, !empty(QVALUE_TDC_COL));    
 
     // DIAmeter related, added by Yang
@@ -240,18 +253,9 @@ MatchCollection* MatchFileReader::parse() {
     }
 
     // TODO presumably we can do this once instead of one time per scan
-    MATCH_COLUMNS_T rank_col;
-    if (empty(PERCOLATOR_RANK_COL) == 1) {
-      rank_col = PERCOLATOR_RANK_COL;
-    } else if (empty(BOTH_PVALUE_RANK) == 1) {
-      rank_col = BOTH_PVALUE_RANK;
-    } else if (empty(RESIDUE_RANK_COL) == 1) {
-      rank_col = RESIDUE_RANK_COL;
-    } else if (empty(XCORR_RANK_COL) == 1) {
-      rank_col = XCORR_RANK_COL;
-    } else if (empty(SP_RANK_COL) == 1) {
-      rank_col = SP_RANK_COL;
-    } else {
+    MATCH_COLUMNS_T rank_col = get_rank_column(
+      [this](MATCH_COLUMNS_T col) { return !empty(col); });
+    if (rank_col == INVALID_COL) {
       carp(CARP_FATAL, "Input file does not contain any reconized rank column.");
     }
 
@@ -299,14 +303,17 @@ Crux::Match* MatchFileReader::parseMatch() {
     carp(CARP_ERROR, "Failed to parse spectrum (tab delimited).");
   }
 
-  // parse peptide
-  Crux::Peptide* peptide = parsePeptide();
-  if (peptide == NULL) {
-    carp(CARP_ERROR, "Failed to parse peptide (tab delimited)");
-    // FIXME should this exit or return null. I think sometimes we can get
-    // no peptides, which is valid, in which case NULL makes sense.
-    // maybe this should be fixed at the output match level however.
-    return NULL;
+  // parse peptide, unless only the scores are wanted
+  Crux::Peptide* peptide = NULL;
+  if (attributes_ != MATCH_ATTRIBUTE_NONE) {
+    peptide = parsePeptide();
+    if (peptide == NULL) {
+      carp(CARP_ERROR, "Failed to parse peptide (tab delimited)");
+      // FIXME should this exit or return null. I think sometimes we can get
+      // no peptides, which is valid, in which case NULL makes sense.
+      // maybe this should be fixed at the output match level however.
+      return NULL;
+    }
   }
 
   Crux::Match* match = new Crux::Match(peptide, spectrum, spectrum->getZState(0), false);
@@ -392,6 +399,10 @@ Crux::Match* MatchFileReader::parseMatch() {
   if (!empty(TAILOR_COL)) { //Added for tailor score calibration method by AKF
     match->setScore(TAILOR_SCORE, getFloat(TAILOR_COL));
   }
+  if (!empty(HYPERSCORE_COL)) {
+    match->setScore(HYPER_SCORE, getFloat(HYPERSCORE_COL));
+    match->setRank(HYPER_SCORE, getInteger(HYPERSCORE_RANK_COL));
+  }
   if (!empty(QVALUE_TDC_COL)) {
     match->setScore(QVALUE_TDC, getFloat(QVALUE_TDC_COL));
   }  
@@ -443,34 +454,42 @@ Crux::Peptide* MatchFileReader::parsePeptide() {
     carp(CARP_FATAL, "No peptide sequence found.");
   }
 
-  // In cases where the sequence is in X.seq.X format, parse out the seq part
-  if (seq.length() > 4 && seq[1] == '.' && seq[seq.length() - 2] == '.') {
-    seq = seq.substr(2, seq.length() - 4);
+  peptide = new Crux::Peptide();
+  setPeptideSequence(peptide, seq, getString(MODIFICATIONS_COL));
+
+  // proteins and flanking residues are only looked up if they are wanted
+  if ((attributes_ & MATCH_ATTRIBUTE_PROTEINS) &&
+      !PeptideSrc::parseTabDelimited(peptide, *this, database_, decoy_database_)) {
+    carp(CARP_ERROR, "Failed to parse peptide source.");
+    delete peptide;
+    return NULL;
   }
 
-  peptide = new Crux::Peptide();
+  return peptide;
+}
 
-  string unmodSeq = Crux::Peptide::unmodifySequence(seq);
-  vector<Crux::Modification> mods;
+void MatchFileReader::setPeptideSequence(
+  Crux::Peptide* peptide,
+  string sequence,
+  const string& mods
+) {
+  // In cases where the sequence is in X.seq.X format, parse out the seq part
+  if (sequence.length() > 4 && sequence[1] == '.' && sequence[sequence.length() - 2] == '.') {
+    sequence = sequence.substr(2, sequence.length() - 4);
+  }
+
+  string unmodSeq = Crux::Peptide::unmodifySequence(sequence);
+  vector<Crux::Modification> modifications;
 
   // Parse modifications column first! It has more details about modifications.
-  string modsString = getString(MODIFICATIONS_COL);
-  if (!modsString.empty()) {
-    mods = Crux::Modification::Parse(modsString, &unmodSeq);
+  if (!mods.empty()) {
+    modifications = Crux::Modification::Parse(mods, &unmodSeq);
   } else {
-    Crux::Modification::FromSeq(seq, NULL, &mods);
+    Crux::Modification::FromSeq(sequence, NULL, &modifications);
   }
 
   peptide->setUnmodifiedSequence(unmodSeq);
-  peptide->setMods(mods);
-
-  if (!PeptideSrc::parseTabDelimited(peptide, *this, database_, decoy_database_)) {
-    carp(CARP_ERROR, "Failed to parse peptide source.");
-    delete peptide;
-    return NULL;
-  }
-
-  return peptide;
+  peptide->setMods(modifications);
 }
 
 Crux::Spectrum* MatchFileReader::parseSpectrum() {
@@ -27,6 +27,7 @@ class MatchFileReader: public DelimitedFileReader, public PSMReader {
     Crux::Spectrum* parseSpectrum();
 
     int match_indices_[NUMBER_MATCH_COLUMNS];
+    int attributes_; ///< the MATCH_ATTRIBUTE_* flags of what to build
 
  public:
    /**
@@ -127,10 +128,31 @@ class MatchFileReader: public DelimitedFileReader, public PSMReader {
      */
     void getMatchColumnsPresent (std::vector<bool>& col_is_present);
 
+    /**
+     * Sets which parts of each match beyond its scores, ranks, spectrum
+     * and charge are built, as MATCH_ATTRIBUTE_* flags. Proteins are only
+     * looked up in the databases if MATCH_ATTRIBUTE_PROTEINS is set, and
+     * matches have a NULL peptide if neither flag is. All are built by
+     * default.
+     */
+    void setAttributes(int attributes);
+
+    /**
+     * Sets the unmodified sequence and the modifications of peptide from
+     * the cells of a sequence and a modifications column, the way matches
+     * are read. The sequence may be in X.seq.X format.
+     */
+    static void setPeptideSequence(
+      Crux::Peptide* peptide,
+      std::string sequence,
+      const std::string& mods
+    );
+
     static MatchCollection* parse(
       const std::string& file_path,
       Database* database,
-      Database* decoy_database
+      Database* decoy_database,
+      int attributes = MATCH_ATTRIBUTE_ALL
     );
 
     MatchCollection* parse();
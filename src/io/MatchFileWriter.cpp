@@ -66,6 +66,7 @@ void MatchFileWriter::setPrecision() {
     case CHARGE_COL:
     case SP_RANK_COL:
     case XCORR_RANK_COL:
+    case HYPERSCORE_RANK_COL:
     case PERCOLATOR_RANK_COL:
     case BY_IONS_MATCHED_COL:
     case BY_IONS_TOTAL_COL:
@@ -130,6 +131,7 @@ void MatchFileWriter::setPrecision() {
     case QVALUE_TDC_COL:
     case BY_IONS_FRACTION_COL:
     case TAILOR_COL:
+    case HYPERSCORE_COL:
 #ifdef NEW_COLUMNS
     case DECOY_XCORR_PEPTIDE_QVALUE_COL:  // NEW
     case PERCOLATOR_PEPTIDE_QVALUE_COL:   // NEW
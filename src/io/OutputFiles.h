@@ -51,6 +51,16 @@ class OutputFiles{
   void writeRankedPeptides(const vector<pair<FLOAT_T, Crux::Peptide*> >& scoreToPeptide);
   void pinSetEnabledStatus(const std::string& name, bool enabled);
 
+  /**
+   * \returns the name of an output file,
+   * "[directory/][fileroot.]command_name.[target_decoy.]extension"
+   */
+  static string makeFileName(const std::string& fileroot,
+                             CruxApplication* application,
+                             const char* target_decoy,
+                             const char* extension,
+                             const std::string& directory = "");
+
   bool exact_pval_search_;
 
  private:
@@ -89,11 +99,6 @@ class OutputFiles{
     const std::string& filename, 
     bool overwrite
   );
-  string makeFileName(const std::string& fileroot,
-                      CruxApplication* application,
-                      const char* target_decoy,
-                      const char* extension,
-                      const std::string& directory = "");
   void makeTargetDecoyList();
 
   void printMatchesXml(
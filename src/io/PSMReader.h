@@ -12,6 +12,18 @@ Abstract class for a peptide-spectrum match readers
 #include <iomanip>
 #include <string>
 
+/**
+ * \enum _match_attribute
+ * \brief Flags for the parts of a match, beyond its scores, ranks,
+ * spectrum and charge, that a reader builds. Combine them with |.
+ */
+enum _match_attribute {
+  MATCH_ATTRIBUTE_NONE = 0,     ///< no peptide; the match has a NULL peptide
+  MATCH_ATTRIBUTE_PEPTIDE = 1,  ///< the peptide sequence and its modifications
+  MATCH_ATTRIBUTE_PROTEINS = 2, ///< the proteins and flanking residues of the peptide
+  MATCH_ATTRIBUTE_ALL = 3       ///< everything in the file
+};
+
 class PSMReader {
 
  public:
@@ -10,6 +10,10 @@
 #include "util/StringUtils.h"
 #include "parameter.h"
 #include <iostream>
+#include <algorithm>
+#include <memory>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include "pwiz/data/msdata/SpectrumInfo.hpp"
 #include "pwiz/data/msdata/DefaultReaderList.hpp"
 #if defined (_MSC_VER) &&  defined(INCLUDE_VENDOR_LIBRARIES)
@@ -31,6 +35,24 @@ using namespace std;
 PWIZSpectrumCollection::PWIZSpectrumCollection(
   const string& filename   ///< The spectrum collection filename.
 ) : SpectrumCollection(filename) {
+  reader_ = openFile(filename_);
+}
+
+PWIZSpectrumCollection::~PWIZSpectrumCollection() {
+  delete reader_;
+  for (vector<pwiz::msdata::MSDataFile*>::iterator i = decode_readers_.begin();
+       i != decode_readers_.end(); ++i) {
+    delete *i;
+  }
+}
+
+/**
+ * Opens filename with the readers supported by this build.
+ */
+pwiz::msdata::MSDataFile* PWIZSpectrumCollection::openFile(
+  const string& filename ///< file to open
+) {
+  pwiz::msdata::MSDataFile* reader = NULL;
 #if defined(_MSC_VER) && defined(INCLUDE_VENDOR_LIBRARIES)
   pwiz::msdata::DefaultReaderList readerList;
   //readerList.push_back(pwiz::msdata::ReaderPtr(new pwiz::msdata::Reader_ABI));
@@ -42,28 +64,25 @@ PWIZSpectrumCollection::PWIZSpectrumCollection(
   //readerList.push_back(pwiz::msdata::ReaderPtr(new pwiz::msdata::Reader_Waters));
   carp(CARP_DETAILED_INFO, "Support for vendor specific formats enabled.");  
   try {
-     reader_ = new pwiz::msdata::MSDataFile(filename_, &readerList);
+     reader = new pwiz::msdata::MSDataFile(filename, &readerList);
   } catch (const runtime_error& error) {
-    carp(CARP_FATAL, "Unable to parse spectrum file %s. Error: %s.", filename_.c_str(), error.what());
+    carp(CARP_FATAL, "Unable to parse spectrum file %s. Error: %s.", filename.c_str(), error.what());
   }
 #else
   carp(CARP_DETAILED_INFO, "Support for vendor specific formats not enabled.");  
   try {
     pwiz::msdata::DefaultReaderList readerList;
-    reader_ = new pwiz::msdata::MSDataFile(filename_, &readerList);
+    reader = new pwiz::msdata::MSDataFile(filename, &readerList);
   }
   catch (const runtime_error& error) {
-    carp(CARP_FATAL, "Unable to parse spectrum file %s. Error: %s.", filename_.c_str(), error.what());  
+    carp(CARP_FATAL, "Unable to parse spectrum file %s. Error: %s.", filename.c_str(), error.what());  
   }
 #endif
-  if( reader_ == NULL ) {
+  if( reader == NULL ) {
     carp(CARP_FATAL, "PWIZSpectrumCollection unable to open '%s'.", 
-         filename_.c_str());
+         filename.c_str());
   }
-}
-
-PWIZSpectrumCollection::~PWIZSpectrumCollection() {
-  delete reader_;
+  return reader;
 }
 
 /**
@@ -181,11 +200,24 @@ bool PWIZSpectrumCollection::parse(int ms_level, bool dia_mode) {
   carp(CARP_DEBUG, "PWIZ:Number of spectra:%i", num_spec);
   bool assign_new_scans = false;
   int scan_counter = 0;
+
+  // With several threads, this loop only reads the spectrum metadata and
+  // collects the spectra to keep; their peak arrays, where most of the time
+  // goes in base64 and zlib decoding, are decoded in batches by
+  // decodePending.
+  bool decode_in_parallel = canDecodeInParallel();
+  const size_t batch_size = 256 * num_threads_;
+  vector<PendingSpectrum> pending;
+  if (decode_in_parallel) {
+    carp(CARP_DEBUG, "Decoding spectra of %s on %d threads.",
+         filename_.c_str(), num_threads_);
+  }
+
   for (int spec_idx = 0; spec_idx < num_spec; spec_idx++) {
     carp(CARP_DETAILED_DEBUG, "Parsing spectrum index %d.", spec_idx);
     pwiz::msdata::SpectrumPtr spectrum;
     try {
-      spectrum = all_spectra->spectrum(spec_idx, true);
+      spectrum = all_spectra->spectrum(spec_idx, !decode_in_parallel);
     } catch (boost::bad_lexical_cast) {
       carp(CARP_FATAL, "boost::bad_lexical_cast occured while parsing spectrum.\n"
                        "Do your spectra contain z-lines?");
@@ -253,6 +285,14 @@ bool PWIZSpectrumCollection::parse(int ms_level, bool dia_mode) {
     // skip if no peaks or ms_level doesn't match
     if (spectrum->defaultArrayLength < 1 || spectrum->cvParam(pwiz::msdata::MS_ms_level).valueAs<int>() != ms_level) { continue; }
 
+    if (decode_in_parallel) {
+      PendingSpectrum next = {spec_idx, scan_number_begin, scan_number_end, curr_ms1_scan};
+      pending.push_back(next);
+      if (pending.size() >= batch_size) {
+        decodePending(pending, dia_mode);
+      }
+      continue;
+    }
 
     Crux::Spectrum* crux_spectrum = new Crux::Spectrum();
     if (crux_spectrum->parsePwizSpecInfo(spectrum, scan_number_begin, scan_number_end, dia_mode)) {
@@ -260,17 +300,116 @@ bool PWIZSpectrumCollection::parse(int ms_level, bool dia_mode) {
     	crux_spectrum->setMS1Scan(curr_ms1_scan);
     	carp(CARP_DETAILED_DEBUG, "curr_ms1_scan: %d ", curr_ms1_scan );
 
+    	if (handler_ == NULL) {
+    	  spectraByScan_[scan_number_begin] = crux_spectrum;
+    	}
     	addSpectrumToEnd(crux_spectrum);
-    	spectraByScan_[scan_number_begin] = crux_spectrum;
     } else {
     	delete crux_spectrum;
     }
   }
+  if (decode_in_parallel) {
+    decodePending(pending, dia_mode);
+  }
 
   is_parsed_ = true;
   return true;
 }
 
+/**
+ * \returns True if the file can be read by several readers at once
+ * (indexed XML formats), so that peaks can be decoded in parallel.
+ */
+bool PWIZSpectrumCollection::canDecodeInParallel() {
+  if (num_threads_ < 2) {
+    return false;
+  }
+  // Vendor and MGF readers either cannot be opened twice or parse the peaks
+  // together with the metadata, so only split mzML and mzXML files.
+  string extension = filename_.substr(filename_.rfind('.') + 1);
+  std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+  return extension == "mzml" || extension == "mzxml";
+}
+
+/**
+ * Decodes the peaks of the pending spectra on num_threads_ threads and
+ * adds them to the collection in file order.
+ */
+void PWIZSpectrumCollection::decodePending(
+  vector<PendingSpectrum>& pending,
+  bool dia_mode
+) {
+  if (pending.empty()) {
+    return;
+  }
+  while ((int)decode_readers_.size() < num_threads_ - 1) {
+    decode_readers_.push_back(openFile(filename_));
+  }
+
+  vector<Crux::Spectrum*> decoded(pending.size(), (Crux::Spectrum*)NULL);
+  vector<string> errors(num_threads_);
+  boost::thread_group threadgroup;
+  for (int t = 1; t < num_threads_; ++t) {
+    threadgroup.add_thread(new boost::thread(boost::bind(
+      &PWIZSpectrumCollection::decodeWorker, this, t, &pending, &decoded, dia_mode, &errors[t])));
+  }
+  decodeWorker(0, &pending, &decoded, dia_mode, &errors[0]);
+  threadgroup.join_all();
+
+  for (int t = 0; t < num_threads_; ++t) {
+    if (!errors[t].empty()) {
+      carp(CARP_FATAL, "Error decoding spectra from %s: %s",
+           filename_.c_str(), errors[t].c_str());
+    }
+  }
+
+  for (size_t i = 0; i < pending.size(); ++i) {
+    Crux::Spectrum* crux_spectrum = decoded[i];
+    if (crux_spectrum == NULL) {
+      continue;
+    }
+    crux_spectrum->setMS1Scan(pending[i].ms1_scan);
+    if (handler_ == NULL) {
+      spectraByScan_[pending[i].scan_number_begin] = crux_spectrum;
+    }
+    addSpectrumToEnd(crux_spectrum);
+  }
+  pending.clear();
+}
+
+/**
+ * Worker for decodePending: decodes every num_threads_'th pending
+ * spectrum, starting at thread_id.
+ */
+void PWIZSpectrumCollection::decodeWorker(
+  int thread_id,
+  const vector<PendingSpectrum>* pending,
+  vector<Crux::Spectrum*>* decoded,
+  bool dia_mode,
+  string* error
+) {
+  pwiz::msdata::MSDataFile* reader = thread_id == 0 ? reader_ : decode_readers_[thread_id - 1];
+  pwiz::msdata::SpectrumListPtr spectra = reader->run.spectrumListPtr;
+  try {
+    for (size_t i = thread_id; i < pending->size(); i += num_threads_) {
+      const PendingSpectrum& next = (*pending)[i];
+      pwiz::msdata::SpectrumPtr spectrum = spectra->spectrum(next.spec_idx, true);
+      std::unique_ptr<Crux::Spectrum> crux_spectrum(new Crux::Spectrum());
+      if (crux_spectrum->parsePwizSpecInfo(spectrum, next.scan_number_begin,
+                                           next.scan_number_end, dia_mode)) {
+        (*decoded)[i] = crux_spectrum.release();
+      }
+    }
+  } catch (const std::exception& e) {
+    *error = e.what();
+    if (error->empty()) {
+      *error = "unknown error";
+    }
+  } catch (...) {
+    *error = "unknown error";
+  }
+}
+
 /**
  * Parses a single spectrum from a spectrum_collection with first scan
  * number equal to first_scan.  Removes any existing information in
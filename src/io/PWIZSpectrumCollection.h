@@ -10,6 +10,8 @@
 #include "SpectrumCollection.h"
 
 #include "pwiz/data/msdata/MSDataFile.hpp"
+#include <string>
+#include <vector>
 
 /**
  * \class SpectrumCollection
@@ -19,6 +21,53 @@ class PWIZSpectrumCollection : public Crux::SpectrumCollection {
 
  protected:
   pwiz::msdata::MSDataFile* reader_;
+  /// extra readers on the same file, one per additional decoding thread
+  std::vector<pwiz::msdata::MSDataFile*> decode_readers_;
+
+  /**
+   * A spectrum selected by the metadata pass of parse(), waiting for its
+   * peaks to be decoded.
+   */
+  struct PendingSpectrum {
+    int spec_idx;
+    int scan_number_begin;
+    int scan_number_end;
+    int ms1_scan;
+  };
+
+  /**
+   * Opens filename with the readers supported by this build.
+   */
+  static pwiz::msdata::MSDataFile* openFile(
+    const std::string& filename ///< file to open -in
+  );
+
+  /**
+   * \returns True if the file can be read by several readers at once
+   * (indexed XML formats), so that peaks can be decoded in parallel.
+   */
+  bool canDecodeInParallel();
+
+  /**
+   * Decodes the peaks of the pending spectra on num_threads_ threads and
+   * adds them to the collection in file order.
+   */
+  void decodePending(
+    std::vector<PendingSpectrum>& pending, ///< spectra to decode -in/out
+    bool dia_mode ///< passed on to Spectrum::parsePwizSpecInfo -in
+  );
+
+  /**
+   * Worker for decodePending: decodes every num_threads_'th pending
+   * spectrum, starting at thread_id.
+   */
+  void decodeWorker(
+    int thread_id,
+    const std::vector<PendingSpectrum>* pending,
+    std::vector<Crux::Spectrum*>* decoded,
+    bool dia_mode,
+    std::string* error
+  );
   
   /**
    * Parses the first/last scan from the title
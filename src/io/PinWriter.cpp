@@ -48,6 +48,7 @@ PinWriter::PinWriter():
   features_.push_back(make_pair("deltCn", true));
   features_.push_back(make_pair("XCorr", true));
   features_.push_back(make_pair("TailorScore", true));  
+  features_.push_back(make_pair("HyperScore", false));
   features_.push_back(make_pair("byIonsMatched", true));  
   features_.push_back(make_pair("byIonsTotal", true));  
   features_.push_back(make_pair("byIonsFraction", true));  
@@ -190,6 +191,7 @@ void PinWriter::write(MatchCollection* collection, string database) {
   setEnabledStatus("NegLog10ResEvPValue", combine_p);
   setEnabledStatus("NegLog10CombinePValue", combine_p);
   setEnabledStatus("TailorScore", tailor);
+  setEnabledStatus("HyperScore", collection->getScoredType(HYPER_SCORE));
 
   // DIAmeter related, added by Yang
   if (!MathUtil::AlmostEqual(Params::GetDouble("coeff-precursor"), 0)) {
@@ -319,6 +321,8 @@ void PinWriter::printPSM(
     } else if (feature == "TailorScore" ) {
       FLOAT_T tailor = match->getScore(TAILOR_SCORE);
       fields.push_back(StringUtils::ToString(tailor));
+    } else if (feature == "HyperScore" ) {
+      fields.push_back(StringUtils::ToString(match->getScore(HYPER_SCORE), precision_));
     } else if (feature == "byIonsMatched" ) {
       FLOAT_T byIonsMatched = match->getScore(BY_IONS_MATCHED);
       fields.push_back(StringUtils::ToString(byIonsMatched));
@@ -30,7 +30,8 @@ namespace Crux {
 SpectrumCollection::SpectrumCollection (
   const string& filename ///< The spectrum collection filename. 
   ) 
-: filename_(filename), is_parsed_(false), num_charged_spectra_(0) {
+: filename_(filename), is_parsed_(false), num_charged_spectra_(0), handler_(NULL),
+  num_threads_(1) {
 #if DARWIN
   char path_buffer[PATH_MAX];
   char* absolute_path_file =  realpath(filename.c_str(), path_buffer);
@@ -60,7 +61,9 @@ SpectrumCollection::SpectrumCollection(
   SpectrumCollection& old_collection
   ) : filename_(old_collection.filename_),
       is_parsed_(old_collection.is_parsed_),
-      num_charged_spectra_(old_collection.num_charged_spectra_) {
+      num_charged_spectra_(old_collection.num_charged_spectra_),
+      handler_(NULL),
+      num_threads_(old_collection.num_threads_) {
   // copy spectra
   for (SpectrumIterator spectrum_iterator = old_collection.begin();
     spectrum_iterator != old_collection.end();
@@ -154,9 +157,33 @@ bool SpectrumCollection::getSpectrum(
 void SpectrumCollection::addSpectrumToEnd(
   Spectrum* spectrum ///< spectrum to add to spectrum_collection -in
   ) {
+  num_charged_spectra_ += spectrum->getNumZStates();
+  if (handler_ != NULL) {
+    handler_->handleSpectrum(spectrum);
+    delete spectrum;
+    return;
+  }
   // set spectrum
   spectra_.push_back(spectrum);
-  num_charged_spectra_ += spectrum->getNumZStates();
+}
+
+/**
+ * Pass each spectrum to handler during parse() instead of storing it in
+ * the collection.
+ */
+void SpectrumCollection::setSpectrumHandler(
+  SpectrumHandler* handler ///< receives the parsed spectra -in
+  ) {
+  handler_ = handler;
+}
+
+/**
+ * Allow parse() to decode spectra on up to num_threads threads.
+ */
+void SpectrumCollection::setNumThreads(
+  int num_threads ///< number of decoding threads -in
+  ) {
+  num_threads_ = num_threads < 1 ? 1 : num_threads;
 }
 
 /**
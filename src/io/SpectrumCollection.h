@@ -19,6 +19,23 @@
  */
 namespace Crux {
 
+/**
+ * \class SpectrumHandler
+ * \brief Receives spectra one at a time while a SpectrumCollection is
+ * parsed, so that callers that only stream over the spectra do not have to
+ * hold the whole file in memory.
+ */
+class SpectrumHandler {
+ public:
+  virtual ~SpectrumHandler() {}
+
+  /**
+   * Called for each parsed spectrum, in file order. The spectrum is deleted
+   * by the collection after this returns.
+   */
+  virtual void handleSpectrum(Crux::Spectrum* spectrum) = 0;
+};
+
 class SpectrumCollection {
 
   friend class ::FilteredSpectrumChargeIterator;
@@ -29,6 +46,8 @@ class SpectrumCollection {
   std::string filename_;                  ///< filename
   bool is_parsed_;      ///< file has been read and spectra_ populated 
   int num_charged_spectra_;  ///< sum of all charge states from all spectra
+  SpectrumHandler* handler_; ///< if set, receives spectra instead of spectra_
+  int num_threads_;          ///< threads a parser may use to decode spectra
   
   /**
    * Base class constructor is protected.  Sets filename and
@@ -108,6 +127,23 @@ class SpectrumCollection {
     Crux::Spectrum* spectrum   ///< Put the spectrum info here
   ) = 0;
 
+  /**
+   * Pass each spectrum to handler during parse() instead of storing it in
+   * the collection. Must be called before parse().
+   */
+  void setSpectrumHandler(
+    SpectrumHandler* handler ///< receives the parsed spectra -in
+  );
+
+  /**
+   * Allow parse() to decode spectra on up to num_threads threads. Parsers
+   * that cannot split a file ignore this. Spectra are still added in file
+   * order.
+   */
+  void setNumThreads(
+    int num_threads ///< number of decoding threads -in
+  );
+
   /**
    * \returns A pointer to the name of the file containing these spectra.
    */
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <vector>
+#define BOOST_NO_CXX11_SCOPED_ENUMS
+#include <boost/filesystem.hpp>
+#undef BOOST_NO_CXX11_SCOPED_ENUMS
+#include <boost/thread/mutex.hpp>
+#include "SpectrumRecordCache.h"
+#include "SpectrumRecordWriter.h"
+#include "io/carp.h"
+#include "util/crux-utils.h"
+#include "util/FileUtils.h"
+#include "util/Params.h"
+#include "util/StringUtils.h"
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+map<string, int> SpectrumRecordCache::entry_locks_;
+
+static boost::mutex cache_mutex;
+
+static const char* const CACHE_EXTENSION = ".spectrumrecords";
+
+// Locks path unless a run holds a lock on it, keeping the descriptor in fd.
+// Returns false if path is locked.
+static bool lockExclusive(const string& path, int* fd) {
+  *fd = -1;
+#ifndef _WIN32
+  *fd = open(path.c_str(), O_RDONLY);
+  if (*fd < 0) {
+    return errno == ENOENT;
+  }
+  if (flock(*fd, LOCK_EX | LOCK_NB) != 0) {
+    close(*fd);
+    *fd = -1;
+    return false;
+  }
+#endif
+  return true;
+}
+
+static void unlockExclusive(int fd) {
+#ifndef _WIN32
+  if (fd >= 0) {
+    close(fd);
+  }
+#endif
+}
+
+// 64-bit FNV-1a
+static void hashBytes(const char* data, size_t size, unsigned long long* hash) {
+  for (size_t i = 0; i < size; ++i) {
+    *hash ^= (unsigned char)data[i];
+    *hash *= 1099511628211ULL;
+  }
+}
+
+/**
+ * Returns the cache key of infile for the current parameters.
+ */
+string SpectrumRecordCache::getKey(
+  const string& infile,
+  int ms_level,
+  bool dia_mode
+) {
+  unsigned long long size = boost::filesystem::file_size(infile);
+  time_t mtime = boost::filesystem::last_write_time(infile);
+
+  // Hash the parameters that change the converted records, then the start,
+  // middle and end of the file. Hashing all of a multi-GB file would cost
+  // about as much as converting it; size and mtime cover the rest.
+  string params = StringUtils::ToString(size) + '|' +
+    StringUtils::ToString((long long)mtime) + '|' +
+    StringUtils::ToString(ms_level) + '|' + (dia_mode ? "dia" : "dda") + '|' +
+    Params::GetString("spectrum-parser") + '|' +
+    Params::GetString("scan-number") + '|' +
+    (Params::GetBool("use-z-line") ? "z" : "noz") + '|' +
+    (dia_mode ? StringUtils::ToString(Params::GetInt("max-precursor-charge")) : "") + '|' +
+    getDateFromCurxVersion();
+  unsigned long long hash = 14695981039346656037ULL;
+  hashBytes(params.data(), params.size(), &hash);
+
+  const unsigned long long kChunk = 1 << 20;
+  ifstream in(infile.c_str(), ios::in | ios::binary);
+  vector<char> buf(kChunk);
+  unsigned long long offsets[] = {0, size / 2, size > kChunk ? size - kChunk : 0};
+  for (int i = 0; i < 3 && in.good(); ++i) {
+    in.seekg(offsets[i]);
+    in.read(&buf[0], kChunk);
+    hashBytes(&buf[0], in.gcount(), &hash);
+    in.clear();
+  }
+
+  char key[17];
+  sprintf(key, "%016llx", hash);
+  return FileUtils::Stem(FileUtils::BaseName(infile)) + '.' + key;
+}
+
+/**
+ * Returns the spectrumrecords file for infile, converting it into the cache
+ * directory if there is no entry for it yet.
+ */
+bool SpectrumRecordCache::convert(
+  const string& infile,
+  string& outfile,
+  int& spectra_converted,
+  int ms_level,
+  bool dia_mode,
+  int num_threads
+) {
+  string cache_dir = Params::GetString("spectrum-cache-dir");
+  if (!FileUtils::Exists(cache_dir)) {
+    FileUtils::Mkdir(cache_dir);
+  }
+  outfile = FileUtils::Join(cache_dir, getKey(infile, ms_level, dia_mode) + CACHE_EXTENSION);
+  spectra_converted = 0;
+
+  if (lockEntry(outfile)) {
+    carp(CARP_INFO, "Using cached spectrumrecords %s for %s",
+         outfile.c_str(), infile.c_str());
+    // mark the entry as recently used
+    boost::filesystem::last_write_time(outfile, time(NULL));
+    return true;
+  }
+
+  // Convert to a unique name and rename when complete, so that a concurrent
+  // or interrupted run never sees a partial entry.
+  string partial = outfile + '.' +
+    boost::filesystem::unique_path("%%%%%%%%").string() + ".tmp";
+  if (!lockEntry(partial, true)) {
+    carp(CARP_ERROR, "Could not create %s", partial.c_str());
+    return false;
+  }
+  bool converted = SpectrumRecordWriter::convert(infile, partial, spectra_converted,
+                                                 ms_level, dia_mode, num_threads);
+  boost::mutex::scoped_lock lock(cache_mutex);
+  int fd = entry_locks_[partial];
+  entry_locks_.erase(partial);
+  if (!converted) {
+    FileUtils::Remove(partial);
+    unlockExclusive(fd);
+    return false;
+  }
+  // the lock stays with the file as it is renamed
+  FileUtils::Rename(partial, outfile);
+  entry_locks_[outfile] = fd;
+  lock.unlock();
+  carp(CARP_DEBUG, "Added %s to the spectrum cache", outfile.c_str());
+  evict(cache_dir);
+  return true;
+}
+
+void SpectrumRecordCache::release() {
+  boost::mutex::scoped_lock lock(cache_mutex);
+  for (map<string, int>::const_iterator i = entry_locks_.begin(); i != entry_locks_.end(); ++i) {
+    unlockExclusive(i->second);
+  }
+  entry_locks_.clear();
+}
+
+/**
+ * Takes a shared lock on path, creating it if create is set.
+ */
+bool SpectrumRecordCache::lockEntry(
+  const string& path,
+  bool create
+) {
+  boost::mutex::scoped_lock lock(cache_mutex);
+  if (entry_locks_.find(path) != entry_locks_.end()) {
+    return true;  // already read by this process
+  }
+#ifndef _WIN32
+  int fd = open(path.c_str(), create ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  int locked;
+  while ((locked = flock(fd, LOCK_SH)) != 0 && errno == EINTR) {
+  }
+  // An eviction may have removed the entry while we waited for the lock
+  struct stat locked_file, current_file;
+  if (locked != 0 || fstat(fd, &locked_file) != 0 ||
+      stat(path.c_str(), &current_file) != 0 ||
+      locked_file.st_dev != current_file.st_dev ||
+      locked_file.st_ino != current_file.st_ino) {
+    close(fd);
+    return false;
+  }
+  entry_locks_[path] = fd;
+#else
+  if (!create && !FileUtils::Exists(path)) {
+    return false;
+  }
+  entry_locks_[path] = -1;
+#endif
+  return true;
+}
+
+/**
+ * Removes the least recently used entries until the cache fits in
+ * spectrum-cache-size, and conversions abandoned by interrupted runs.
+ */
+void SpectrumRecordCache::evict(
+  const string& cache_dir
+) {
+  boost::mutex::scoped_lock lock(cache_mutex);
+  unsigned long long max_size =
+    (unsigned long long)Params::GetInt("spectrum-cache-size") * 1000000000;
+  unsigned long long total_size = 0;
+  time_t now = time(NULL);
+  vector<pair<time_t, string> > entries;
+  for (boost::filesystem::directory_iterator i(cache_dir);
+       i != boost::filesystem::directory_iterator(); ++i) {
+    string path = i->path().string();
+    if (!boost::filesystem::is_regular_file(i->status())) {
+      continue;
+    }
+    time_t mtime = boost::filesystem::last_write_time(path);
+    if (StringUtils::EndsWith(path, CACHE_EXTENSION)) {
+      total_size += boost::filesystem::file_size(path);
+      entries.push_back(make_pair(mtime, path));
+      continue;
+    }
+    // A conversion in progress (.tmp), or one of its sorted runs, is locked
+    // through the .tmp file by the run writing it
+    size_t tmp = path.rfind(".tmp");
+    if (path.find(string(CACHE_EXTENSION) + '.') == string::npos ||
+        tmp == string::npos || now - mtime < EVICTION_GRACE_SECONDS) {
+      continue;
+    }
+    int fd;
+    if (lockExclusive(path.substr(0, tmp + 4), &fd)) {
+      carp(CARP_DEBUG, "Removing abandoned %s from the spectrum cache", path.c_str());
+      FileUtils::Remove(path);
+      unlockExclusive(fd);
+    }
+  }
+  std::sort(entries.begin(), entries.end());
+  for (vector<pair<time_t, string> >::const_iterator i = entries.begin();
+       i != entries.end() && total_size > max_size; ++i) {
+    int fd;
+    if (entry_locks_.find(i->second) != entry_locks_.end() ||
+        now - i->first < EVICTION_GRACE_SECONDS ||
+        !lockExclusive(i->second, &fd)) {
+      continue;  // read by a run, or about to be
+    }
+    carp(CARP_DEBUG, "Removing %s from the spectrum cache", i->second.c_str());
+    total_size -= boost::filesystem::file_size(i->second);
+    FileUtils::Remove(i->second);
+    unlockExclusive(fd);
+  }
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
@@ -0,0 +1,91 @@
+#ifndef SPECTRUM_RECORD_CACHE_H
+#define SPECTRUM_RECORD_CACHE_H
+
+#include <map>
+#include <string>
+
+using namespace std;
+
+/**
+ * A directory of converted spectrumrecords files that is shared between
+ * runs. Entries are named by a key built from the identity of the input file
+ * (size, modification time and a hash of its contents) and from the
+ * parameters that change the conversion, so that searches with different
+ * search parameters reuse the same converted spectra. The least recently used
+ * entries are removed when the directory grows beyond spectrum-cache-size.
+ *
+ * Runs hold a shared lock (flock) on the entries they read and on the
+ * conversions they are writing, and eviction only removes files it can lock
+ * exclusively, so runs sharing the directory never remove each other's
+ * files.
+ */
+class SpectrumRecordCache {
+
+ public:
+
+  /**
+   * Returns the spectrumrecords file for infile, converting it into the cache
+   * directory given by spectrum-cache-dir if there is no entry for it yet.
+   * Returns true on success; spectra_converted is set to the number of
+   * spectra converted, which is 0 for a cache hit.
+   */
+  static bool convert(
+    const string& infile, ///< spectra file to convert
+    string& outfile, ///< cached spectrumrecords file -out
+    int& spectra_converted, ///< number of spectra converted -out
+    int ms_level = 2, ///< MS level to extract (1 or 2)
+    bool dia_mode = false, ///< whether it's used in DIAmeter
+    int num_threads = 1 ///< threads used to decode the peaks of the file
+  );
+
+  /**
+   * Releases the locks on the entries returned by convert, once they are no
+   * longer read.
+   */
+  static void release();
+
+ protected:
+
+  /**
+   * Returns the cache key of infile for the current parameters.
+   */
+  static string getKey(
+    const string& infile,
+    int ms_level,
+    bool dia_mode
+  );
+
+  /**
+   * Takes a shared lock on path, creating it if create is set. Returns false
+   * if path does not exist, or was removed before it could be locked.
+   */
+  static bool lockEntry(
+    const string& path,
+    bool create = false
+  );
+
+  /**
+   * Removes the least recently used entries until the cache fits in
+   * spectrum-cache-size, and conversions abandoned by interrupted runs.
+   * Entries that are locked, or were used within the last
+   * EVICTION_GRACE_SECONDS, are never removed.
+   */
+  static void evict(
+    const string& cache_dir
+  );
+
+  static const int EVICTION_GRACE_SECONDS = 600;
+
+ private:
+  // descriptors holding the shared locks of this process, by path
+  static map<string, int> entry_locks_;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
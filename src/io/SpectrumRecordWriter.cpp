@@ -8,6 +8,9 @@
 #include "SpectrumRecordWriter.h"
 #include "io/carp.h"
 #include "util/crux-utils.h"
+#include "util/FileUtils.h"
+#include "util/Params.h"
+#include "util/StringUtils.h"
 
 // For printing uint64_t values
 #define __STDC_FORMAT_MACROS
@@ -19,10 +22,129 @@ int SpectrumRecordWriter::scanCounter_ = 0;
 unsigned long SpectrumRecordWriter::scan_index_ = 0;
 std::string SpectrumRecordWriter::version_date_ = "";
 
-bool cmp_pbspectra(pb::Spectrum& a1, pb::Spectrum& a2) {
+bool cmp_pbspectra(const pb::Spectrum& a1, const pb::Spectrum& a2) {
   return a1.neutral_mass() < a2.neutral_mass();
 }
 
+// Orders (spectrum, run) pairs so that make_heap puts the lightest spectrum
+// on top; ties go to the earlier run to keep the merge deterministic.
+struct cmp_pbspectra_runs {
+  bool operator()(const pair<pb::Spectrum, int>& a, const pair<pb::Spectrum, int>& b) const {
+    if (a.first.neutral_mass() != b.first.neutral_mass()) {
+      return a.first.neutral_mass() > b.first.neutral_mass();
+    }
+    return a.second > b.second;
+  }
+};
+
+SpectrumRecordWriter::SpectrumSorter::SpectrumSorter(
+  const string& outfile,
+  unsigned long long memory_limit
+) : outfile_(outfile), memory_limit_(memory_limit), buffer_bytes_(0),
+    num_spectra_(0) {
+}
+
+SpectrumRecordWriter::SpectrumSorter::~SpectrumSorter() {
+  for (vector<string>::const_iterator i = run_files_.begin(); i != run_files_.end(); ++i) {
+    FileUtils::Remove(*i);
+  }
+}
+
+void SpectrumRecordWriter::SpectrumSorter::handleSpectrum(Crux::Spectrum* spectrum) {
+  spectrum->putHighestPeak(); // Sort peaks by m/z
+
+  vector<pb::Spectrum> pb_spectra = getPbSpectra(spectrum);
+  for (vector<pb::Spectrum>::const_iterator j = pb_spectra.begin();
+       j != pb_spectra.end();
+       ++j) {
+    add(*j);
+  }
+}
+
+void SpectrumRecordWriter::SpectrumSorter::add(const pb::Spectrum& spectrum) {
+  assert(spectrum.has_neutral_mass());
+  buffer_.push_back(spectrum);
+  // in-memory footprint: the message plus two int64 arrays of peaks
+  buffer_bytes_ += sizeof(pb::Spectrum) +
+    (spectrum.peak_m_z_size() + spectrum.peak_intensity_size()) * sizeof(int64_t);
+  ++num_spectra_;
+  if (buffer_bytes_ >= memory_limit_) {
+    dumpRun();
+  }
+}
+
+bool SpectrumRecordWriter::SpectrumSorter::write(HeadedRecordWriter* writer) {
+  if (run_files_.empty()) {
+    std::stable_sort(buffer_.begin(), buffer_.end(), cmp_pbspectra);
+    for (vector<pb::Spectrum>::const_iterator j = buffer_.begin(); j != buffer_.end(); ++j) {
+      if (!writer->Write(&*j)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  dumpRun();
+  carp(CARP_DEBUG, "Merging %d sorted runs of spectra.", (int)run_files_.size());
+
+  vector<RecordReader*> readers;
+  vector<pair<pb::Spectrum, int> > heap;
+  for (int run = 0; run < (int)run_files_.size(); ++run) {
+    readers.push_back(new RecordReader(run_files_[run]));
+    if (!readers.back()->OK()) {
+      carp(CARP_ERROR, "Error reading temporary file %s", run_files_[run].c_str());
+      break;
+    }
+    if (!readers.back()->Done()) {
+      heap.push_back(make_pair(pb::Spectrum(), run));
+      readers.back()->Read(&heap.back().first);
+    }
+  }
+  bool ok = readers.size() == run_files_.size();
+  make_heap(heap.begin(), heap.end(), cmp_pbspectra_runs());
+  while (ok && !heap.empty()) {
+    pop_heap(heap.begin(), heap.end(), cmp_pbspectra_runs());
+    pair<pb::Spectrum, int>& next = heap.back();
+    ok = writer->Write(&next.first);
+    RecordReader* reader = readers[next.second];
+    if (!reader->Done()) {
+      reader->Read(&next.first);
+      ok = ok && reader->OK();
+      push_heap(heap.begin(), heap.end(), cmp_pbspectra_runs());
+    } else {
+      heap.pop_back();
+    }
+  }
+  for (vector<RecordReader*>::iterator i = readers.begin(); i != readers.end(); ++i) {
+    delete *i;
+  }
+  return ok;
+}
+
+void SpectrumRecordWriter::SpectrumSorter::dumpRun() {
+  if (buffer_.empty()) {
+    return;
+  }
+  std::stable_sort(buffer_.begin(), buffer_.end(), cmp_pbspectra);
+
+  string temp_dir = Params::GetString("temp-dir");
+  string run_file = (temp_dir.empty() ? outfile_ :
+    FileUtils::Join(temp_dir, FileUtils::BaseName(outfile_))) +
+    ".partial_" + StringUtils::ToString(run_files_.size());
+  run_files_.push_back(run_file);
+  RecordWriter writer(run_file);
+  for (vector<pb::Spectrum>::const_iterator j = buffer_.begin(); j != buffer_.end(); ++j) {
+    if (!writer.Write(&*j)) {
+      carp(CARP_FATAL, "I/O error writing spectra to %s. Check free disk space.",
+           run_file.c_str());
+    }
+  }
+  carp(CARP_DEBUG, "Wrote a sorted run of %d spectra to %s.",
+       (int)buffer_.size(), run_file.c_str());
+  vector<pb::Spectrum> tmp;
+  buffer_.swap(tmp);
+  buffer_bytes_ = 0;
+}
+
 /**
  * Converts a spectra file to spectrumrecords format for use with tide-search.
  * Spectra file is read by pwiz. Returns true on successful conversion.
@@ -32,7 +154,8 @@ bool SpectrumRecordWriter::convert(
   string outfile,  ///< spectrumrecords file to output
   int &spectra_converted, //output variable that tells the number of spectra converted  
   int ms_level,   /// MS level to extract (1 or 2)
-  bool dia_mode  /// whether it's used in DIAmeter
+  bool dia_mode,  /// whether it's used in DIAmeter
+  int num_threads  /// threads used to decode the peaks of the file
 ) {
   carp(CARP_DEBUG, "Converting ms_level %d ... ", ms_level);
   auto_ptr<Crux::SpectrumCollection> spectra(SpectrumCollectionFactory::create(infile.c_str()));
@@ -42,6 +165,15 @@ bool SpectrumRecordWriter::convert(
   // added by Yang
   if ( ms_level < 1 || ms_level > 2 ) { carp(CARP_FATAL, "ms_level must be 1 or 2 instead of %d.", ms_level); }
 
+  scanCounter_ = 0;
+  carp(CARP_DETAILED_DEBUG, "starting to convert spectrum to pb..." );
+  // Let the parser hand over each spectrum as it is read, rather than
+  // holding the whole file in the collection.
+  unsigned long long memory_limit =
+    (unsigned long long)Params::GetInt("spectrum-memory-limit") * 1000000000;
+  SpectrumSorter sorter(outfile, memory_limit);
+  spectra->setSpectrumHandler(&sorter);
+  spectra->setNumThreads(num_threads);
 
   // Open infile
   try {
@@ -73,36 +205,11 @@ bool SpectrumRecordWriter::convert(
     return false;
   }
 
-  scanCounter_ = 0;
-  carp(CARP_DETAILED_DEBUG, "starting to convert spectrum to pb..." );
-  // go through the spectrum list and write each spectrum
-
-  vector<pb::Spectrum> all_spectra; 
-
-  for (SpectrumIterator i = spectra->begin(); i != spectra->end(); ++i) {
+  spectra_converted = sorter.numSpectra();
 
-  	(*i)->putHighestPeak(); // Sort peaks by m/z
-
-    vector<pb::Spectrum> pb_spectra = getPbSpectra(*i);
-    for (vector<pb::Spectrum>::const_iterator j = pb_spectra.begin();
-         j != pb_spectra.end();
-         ++j) { 
-        assert(j->has_neutral_mass());
-        all_spectra.push_back(*j);
-    }
-  }
-  // sort all spectra by neutral mass.
-  std::sort(all_spectra.begin(), all_spectra.end(), cmp_pbspectra);
-  
-  spectra_converted = all_spectra.size();
-
-  // Write the spectra to spectrum protocol buffer in spectrum records format.
-  for (vector<pb::Spectrum>::const_iterator j = all_spectra.begin();
-         j != all_spectra.end();
-         ++j) { 
-      writer.Write(&*j); 
-  }
-  return true;
+  // Write the spectra to spectrum protocol buffer in spectrum records format,
+  // sorted by neutral mass.
+  return sorter.write(&writer);
 }
 
 /**
@@ -1,9 +1,14 @@
 #ifndef SPECTRUM_RECORD_WRITER_H
 #define SPECTRUM_RECORD_WRITER_H
 
+#include <string>
+#include <vector>
 #include "model/Spectrum.h"
+#include "SpectrumCollection.h"
 #include "spectrum.pb.h"
 
+class HeadedRecordWriter;
+
 using namespace std;
 
 /**
@@ -17,15 +22,21 @@ class SpectrumRecordWriter {
   /**
    * Converts a spectra file to spectrumrecords format for use with tide-search.
    * Spectra file is read by pwiz. Returns true on successful conversion.
+   * Spectra are streamed from the parser into sorted runs of at most
+   * spectrum-memory-limit GB, which are spilled to disk and merged by
+   * neutral mass if the file does not fit.
    */
   static bool convert(
     const string& infile, ///< spectra file to convert
     string outfile,  ///< spectrumrecords file to output
     int &spectra_converted, //output variable that tells the number of spectra converted
     int ms_level = 2,  /// MS level to extract (1 or 2)
-    bool dia_mode = false  /// whether it's used in DIAmeter
+    bool dia_mode = false,  /// whether it's used in DIAmeter
+    int num_threads = 1  /// threads used to decode the peaks of the file
   );
 
+  class SpectrumSorter;
+
  protected:
 
   static int scanCounter_;
@@ -52,6 +63,48 @@ class SpectrumRecordWriter {
 
 };
 
+/**
+ * Collects the pb::Spectrum records of a file as the parser produces them.
+ * Once the buffered records reach the memory limit they are sorted by
+ * neutral mass and written to a temporary run file; write() merges the runs
+ * into the final spectrumrecords file. Spectra of the same mass keep the
+ * order they were added in, so the output does not depend on the limit.
+ */
+class SpectrumRecordWriter::SpectrumSorter : public Crux::SpectrumHandler {
+ public:
+  SpectrumSorter(
+    const string& outfile, ///< spectrumrecords file the runs are named after
+    unsigned long long memory_limit ///< bytes of records to buffer before spilling a run
+  );
+  ~SpectrumSorter();
+
+  virtual void handleSpectrum(Crux::Spectrum* spectrum);
+
+  /**
+   * Add one record, spilling the buffered records to a run if they
+   * reach the memory limit.
+   */
+  void add(const pb::Spectrum& spectrum);
+
+  int numSpectra() const { return num_spectra_; }
+  int numRuns() const { return (int)run_files_.size(); }
+
+  /**
+   * Write all spectra, sorted by neutral mass, to writer.
+   */
+  bool write(HeadedRecordWriter* writer);
+
+ private:
+  void dumpRun();
+
+  string outfile_;
+  unsigned long long memory_limit_;
+  unsigned long long buffer_bytes_;
+  int num_spectra_;
+  vector<pb::Spectrum> buffer_;
+  vector<string> run_files_;
+};
+
 #endif
 
 /*
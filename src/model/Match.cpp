@@ -362,6 +362,14 @@ void Match::printOneMatchField(
     output_file->setColumnCurrentRow((MATCH_COLUMNS_T)column_idx,
                                      getScore(TAILOR_SCORE));
     break;
+  case HYPERSCORE_COL:
+    output_file->setColumnCurrentRow((MATCH_COLUMNS_T)column_idx,
+                                     getScore(HYPER_SCORE));
+    break;
+  case HYPERSCORE_RANK_COL:
+    output_file->setColumnCurrentRow((MATCH_COLUMNS_T)column_idx,
+                                     getRank(HYPER_SCORE));
+    break;
   case QVALUE_TDC_COL:
 //    if (null_peptide_ == false) {
       output_file->setColumnCurrentRow((MATCH_COLUMNS_T)column_idx, 
@@ -16,6 +16,7 @@
 #include "util/AminoAcidUtil.h"
 #include "util/Params.h"
 #include "util/GlobalParams.h"
+#include "util/ParallelUtil.h"
 #include "util/StringUtils.h"
 #include "util/WinCrux.h"
 #include "util/FileUtils.h"
@@ -100,7 +101,8 @@ void MatchCollection::preparePostProcess() {
  * Sort the match collection by score type.
  */
 void MatchCollection::sort(
-  SCORER_TYPE_T score_type ///< the score type to sort by -in
+  SCORER_TYPE_T score_type, ///< the score type to sort by -in
+  int num_threads ///< the number of threads to sort on -in
   )
 {
   carp(CARP_DETAILED_DEBUG, "Sorting match collection.");
@@ -118,6 +120,7 @@ void MatchCollection::sort(
   case SP:
   case XCORR:
   case TAILOR_SCORE:   //Added for tailor score calibration method by AKF
+  case HYPER_SCORE:
     smaller_is_better = false;
     break;
   case EVALUE:
@@ -212,8 +215,9 @@ void MatchCollection::sort(
   }	 
 
   // Do the sort.
+  // Stable on any number of threads, so that tied matches keep their order.
   Match::ScoreComparer comparer(sort_by, smaller_is_better);
-  std::sort(match_.begin(), match_.end(), comparer);
+  ParallelUtil::StableSort(match_.begin(), match_.end(), comparer, num_threads);
   last_sorted_ = sort_by;
 }
 
@@ -229,7 +233,8 @@ void MatchCollection::sortFileCol()
         carp(CARP_FATAL,
             "Cannot sort a match collection when a match iterator is already instantiated");
     }
-    std::sort(match_.begin(), match_.end(), [](Match* a, Match* b) {
+    // stable, so that matches of a spectrum without XCorr ranks keep their order
+    std::stable_sort(match_.begin(), match_.end(), [](Match* a, Match* b) {
       // 1. Primary key: File path (lexicographical order)
       if (a->getFilePath() != b->getFilePath()) {
         return a->getFilePath() < b->getFilePath();
@@ -100,7 +100,8 @@ class MatchCollection {
    * sort the match collection by score_type(SP, XCORR, ... )
    */
   void sort(
-    SCORER_TYPE_T score_type ///< the score type (SP, XCORR) -in
+    SCORER_TYPE_T score_type, ///< the score type (SP, XCORR) -in
+    int num_threads = 1 ///< the number of threads to sort on -in
     );
 
   /**
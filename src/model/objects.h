@@ -479,6 +479,7 @@ enum _scorer_type {
 
   BOTH_PVALUE, //combined res-ev pvalue and xcorr pvalue. added by Andy Lin
   TAILOR_SCORE,  //Added for tailor score calibration method by AKF
+  HYPER_SCORE,   ///< X!Tandem HyperScore
 
   // DIAmeter-related scores, added by Yang
   PRECURSOR_INTENSITY_RANK_M0,
@@ -530,9 +531,9 @@ typedef enum _protein_scorer_type PROTEIN_SCORER_TYPE_T;
 enum _score_function { INVALID_SCORE_FUNCTION, //Added by Andy Lin
                        XCORR_SCORE, //original SEQUEST score fxn
                        PVALUES, // combined p-values
+                       HYPERSCORE, // HyperScore from X!tandem
                       //  PVALUES_HR, // combined p-values for high resolution, including Res-EV,   TODO: Implement these score functions later
                       //  PVALUES_LR, // combined p-values for low  resolution, including only exact p-value,
-                      //  HYPERSCORE, // HyperScore from X!tandem
                       //  HYPERSCORE_LA, // hyperscore-la 
                       //  DIAMETER, // Diameter scoring 
                       //  RESIDUE_EVIDENCE_MATRIX, //score fxn which can be used high-res MS2 data
@@ -36,6 +36,19 @@ void FileUtils::Remove(const string& path) {
   }
 }
 
+string FileUtils::AbsPath(const string& path) {
+  return boost::filesystem::absolute(path).string();
+}
+
+// returns 0 if the file does not exist
+unsigned long long FileUtils::Size(const string& path) {
+  return IsRegularFile(path) ? boost::filesystem::file_size(path) : 0;
+}
+
+void FileUtils::Resize(const string& path, unsigned long long size) {
+  boost::filesystem::resize_file(path, size);
+}
+
 string FileUtils::Join(const string& path1, const string& path2) {
   return (boost::filesystem::path(path1) / boost::filesystem::path(path2)).string();
 }
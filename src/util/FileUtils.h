@@ -12,6 +12,9 @@ class FileUtils {
   static bool Mkdir(const std::string& path);
   static void Rename(const std::string& from, const std::string& to);
   static void Remove(const std::string& path);
+  static std::string AbsPath(const std::string& path);
+  static unsigned long long Size(const std::string& path);
+  static void Resize(const std::string& path, unsigned long long size);
   static std::string Join(const std::string& path1, const std::string& path2);
   static std::string Read(const std::string& path);
   static std::ofstream* GetWriteStream(const std::string& path, bool overwrite);
@@ -0,0 +1,187 @@
+#include "LocalSocket.h"
+#include "io/carp.h"
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifndef _WIN32
+
+static bool MakeAddress(const string& path, sockaddr_un* address) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  if (path.empty() || path.length() >= sizeof(address->sun_path)) {
+    carp(CARP_ERROR, "Invalid socket path '%s'; it may be at most %d characters long.",
+         path.c_str(), (int)sizeof(address->sun_path) - 1);
+    return false;
+  }
+  strncpy(address->sun_path, path.c_str(), sizeof(address->sun_path) - 1);
+  return true;
+}
+
+LocalSocket* LocalSocket::Listen(const string& path) {
+  sockaddr_un address;
+  if (!MakeAddress(path, &address)) {
+    return NULL;
+  }
+  // A peer closing its connection must not kill the process
+  signal(SIGPIPE, SIG_IGN);
+
+  LocalSocket* running = Connect(path);
+  if (running != NULL) {
+    delete running;
+    carp(CARP_ERROR, "A server is already listening on %s.", path.c_str());
+    return NULL;
+  }
+  unlink(path.c_str());  // left behind by a server that did not shut down
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    carp(CARP_ERROR, "Could not create a socket: %s", strerror(errno));
+    return NULL;
+  }
+  // Requests run searches as the server's user, so no one else may connect;
+  // the socket file is created without group and other permissions.
+  mode_t mask = umask(077);
+  int bound = bind(fd, (sockaddr*)&address, sizeof(address));
+  umask(mask);
+  if (bound != 0 || chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0 || listen(fd, 16) != 0) {
+    carp(CARP_ERROR, "Could not listen on %s: %s", path.c_str(), strerror(errno));
+    close(fd);
+    if (bound == 0) {
+      unlink(path.c_str());
+    }
+    return NULL;
+  }
+  return new LocalSocket(fd, path);
+}
+
+LocalSocket* LocalSocket::Connect(const string& path) {
+  sockaddr_un address;
+  if (!MakeAddress(path, &address)) {
+    return NULL;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+    close(fd);
+    return NULL;
+  }
+  return new LocalSocket(fd);
+}
+
+bool LocalSocket::Supported() {
+  return true;
+}
+
+LocalSocket::LocalSocket(int fd, const string& path) : fd_(fd), path_(path) {
+}
+
+LocalSocket::~LocalSocket() {
+  close(fd_);
+  if (!path_.empty()) {
+    unlink(path_.c_str());
+  }
+}
+
+LocalSocket* LocalSocket::Accept() {
+  int fd;
+  do {
+    fd = accept(fd_, NULL, NULL);
+  } while (fd < 0 && errno == EINTR);
+  return fd < 0 ? NULL : new LocalSocket(fd);
+}
+
+bool LocalSocket::SetReceiveTimeout(int seconds) {
+  timeval timeout;
+  timeout.tv_sec = seconds;
+  timeout.tv_usec = 0;
+  return setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0;
+}
+
+bool LocalSocket::ReadLine(string* line) {
+  size_t newline;
+  while ((newline = buffer_.find('\n')) == string::npos) {
+    char data[4096];
+    ssize_t read = recv(fd_, data, sizeof(data), 0);
+    if (read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      // the receive timeout expired; a stalled peer must not hold on to us
+      shutdown(fd_, SHUT_RDWR);
+      return false;
+    }
+    if (read <= 0) {
+      return false;
+    }
+    buffer_.append(data, read);
+  }
+  line->assign(buffer_, 0, newline);
+  buffer_.erase(0, newline + 1);
+  return true;
+}
+
+bool LocalSocket::Write(const string& text) {
+  size_t written = 0;
+  while (written < text.length()) {
+    ssize_t sent = send(fd_, text.data() + written, text.length() - written, 0);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    written += sent;
+  }
+  return true;
+}
+
+#else
+
+LocalSocket* LocalSocket::Listen(const string& path) {
+  carp(CARP_ERROR, "Unix domain sockets are not supported on Windows.");
+  return NULL;
+}
+
+LocalSocket* LocalSocket::Connect(const string& path) {
+  return NULL;
+}
+
+bool LocalSocket::Supported() {
+  return false;
+}
+
+LocalSocket::LocalSocket(int fd, const string& path) : fd_(fd), path_(path) {
+}
+
+LocalSocket::~LocalSocket() {
+}
+
+LocalSocket* LocalSocket::Accept() {
+  return NULL;
+}
+
+bool LocalSocket::SetReceiveTimeout(int seconds) {
+  return false;
+}
+
+bool LocalSocket::ReadLine(string* line) {
+  return false;
+}
+
+bool LocalSocket::Write(const string& text) {
+  return false;
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef LOCALSOCKET_H
+#define LOCALSOCKET_H
+
+#include <string>
+
+// A connection over a Unix domain socket, exchanging lines of text. Used
+// by tide-server and tide-client; not supported on Windows.
+class LocalSocket {
+ public:
+  // Bind a listening socket to path, replacing a stale socket file. Fails
+  // if another server is listening on path. Only the owner may connect.
+  static LocalSocket* Listen(const std::string& path);
+  // Connect to the server listening on path. Returns NULL on failure.
+  static LocalSocket* Connect(const std::string& path);
+  static bool Supported();
+
+  ~LocalSocket();
+
+  // Wait for the next client of a listening socket. Returns NULL on failure.
+  LocalSocket* Accept();
+
+  // Give up on reads that wait longer than seconds (0 waits forever).
+  bool SetReceiveTimeout(int seconds);
+  // Read a line without its newline. Returns false at the end of the input,
+  // or if the receive timeout expires, after which the connection is shut.
+  bool ReadLine(std::string* line);
+  // Write text; returns false if the peer has gone away.
+  bool Write(const std::string& text);
+
+ private:
+  explicit LocalSocket(int fd, const std::string& path = "");
+
+  int fd_;
+  std::string path_;  // removed when a listening socket is closed
+  std::string buffer_;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef PARALLELUTIL_H
+#define PARALLELUTIL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+class ParallelUtil {
+ public:
+  // Arrays shorter than this are sorted on one thread
+  static const size_t MIN_PARALLEL_SORT = 1 << 16;
+
+  // Divides [0, size) into at most num_threads contiguous ranges of about the same size
+  static std::vector< std::pair<size_t, size_t> > Ranges(size_t size, int num_threads) {
+    size_t num_ranges = num_threads < 1 ? 1 : (size_t)num_threads;
+    if (num_ranges > size) {
+      num_ranges = size > 0 ? size : 1;
+    }
+    std::vector< std::pair<size_t, size_t> > ranges;
+    for (size_t i = 0; i < num_ranges; i++) {
+      ranges.push_back(std::make_pair(size * i / num_ranges, size * (i + 1) / num_ranges));
+    }
+    return ranges;
+  }
+
+  // Calls body(i) for each i in [0, count), each on its own thread, and waits for them all
+  template<typename Body>
+  static void ForEach(size_t count, Body body) {
+    boost::thread_group threads;
+    for (size_t i = 1; i < count; i++) {
+      threads.add_thread(new boost::thread(boost::bind<void>(body, i)));
+    }
+    if (count > 0) {
+      body(0);
+    }
+    threads.join_all();
+  }
+
+  // Sorts [first, last) the way std::stable_sort does, sorting pieces of it
+  // on num_threads threads and then merging neighbouring pieces in parallel
+  template<typename RandomIt, typename Compare>
+  static void StableSort(RandomIt first, RandomIt last, Compare comp, int num_threads) {
+    size_t size = last - first;
+    if (num_threads <= 1 || size < MIN_PARALLEL_SORT) {
+      std::stable_sort(first, last, comp);
+      return;
+    }
+    std::vector< std::pair<size_t, size_t> > runs = Ranges(size, num_threads);
+    ForEach(runs.size(), [&](size_t i) {
+      std::stable_sort(first + runs[i].first, first + runs[i].second, comp);
+    });
+    while (runs.size() > 1) {
+      ForEach(runs.size() / 2, [&](size_t i) {
+        std::inplace_merge(first + runs[2*i].first, first + runs[2*i + 1].first,
+                           first + runs[2*i + 1].second, comp);
+      });
+      std::vector< std::pair<size_t, size_t> > merged;
+      for (size_t i = 0; i + 1 < runs.size(); i += 2) {
+        merged.push_back(std::make_pair(runs[i].first, runs[i + 1].second));
+      }
+      if (runs.size() % 2 == 1) {
+        merged.push_back(runs.back());
+      }
+      runs.swap(merged);
+    }
+  }
+
+ private:
+  ParallelUtil();
+  ~ParallelUtil();
+};
+
+#endif
+
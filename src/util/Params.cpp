@@ -314,6 +314,15 @@ Params::Params() : finalized_(false) {
   InitBoolParam("mztab-output", false,
     "Output results in mzTab file to the output directory.",
     "Available for tide-search.", true);    
+  InitBoolParam("profile-output", false,
+    "Write a profile of the search to tide-search.profile.json in the output "
+    "directory. The profile reports the time spent in each phase of the search "
+    "(spectrum reading, waiting for locks, selecting the candidate peptides, "
+    "computing theoretical peaks, preprocessing, scoring, selecting the top "
+    "matches and writing the results), summed over all threads and per thread, "
+    "together with histograms of the number of candidates per spectrum and of "
+    "the size of the peptide queue.",
+    "Available for tide-search.", true);
   InitBoolParam("pout-output", false,
     "Output a Percolator [[html:<a href=\""
     "https://github.com/percolator/percolator/blob/master/src/xml/percolator_out.xsd\">]]"
@@ -336,12 +345,12 @@ Params::Params() : finalized_(false) {
     "Crux also offers a p-value calculation for each psm based on xcorr "
     "or sp (xcorr-pvalue, sp-pvalue).", false);
   InitBoolParam("compute-sp", false,
-    "Compute the preliminary score Sp for all candidate peptides. Report this score in the "
-    "output, along with the corresponding rank, the number of matched ions and the total "
-    "number of ions. This option is recommended if results are to be analyzed by Percolator."
+    "Compute the preliminary score Sp for the reported PSMs. Report this score in the "
+    "output, along with its rank among the reported PSMs of the spectrum, so that the Sp "
+    "and lnrSp features are available in Percolator input files. "
     "If sqt-output is enabled, then compute-sp is automatically enabled and "
     "cannot be overridden. Note that the Sp computation requires re-processing each "
-    "observed spectrum, so turning on this switch involves significant computational overhead.",
+    "observed spectrum, which adds some computational overhead.",
     "Available for tide-search.", true);
   InitStringParam("scan-number", "",
     "A single scan number or a range of numbers to be searched. Range should be "
@@ -402,10 +411,89 @@ Params::Params() : finalized_(false) {
   InitStringParam("temp-dir", "",
     "The name of the directory where temporary files will be created. If this "
     "parameter is blank, then the system temporary directory will be used",
-    "Available for tide-index.", true);
+    "Available for tide-index, tide-search and spectrum-converter.", true);
   InitIntParam("memory-limit", 4, 1, BILLION, 
     "The maximum amount of memory (i.e., RAM), in GB, to be used by tide-index.",
     "Available for tide-index.", true);
+  InitBoolParam("pipeline-search", false,
+    "Search each spectrum file as soon as it has been converted to "
+    "spectrumrecords format, while the remaining files are still being "
+    "converted. The threads that are not converting a file share the search "
+    "of the first converted file that has spectra left. Each searching "
+    "thread streams the peptide index as in a search in order of mass, so "
+    "memory use does not grow with the size of the index, but the index is "
+    "read again for every file a thread moves to. Results are written file "
+    "by file rather than in order of precursor mass.",
+    "Available for tide-search.", true);
+  InitIntParam("checkpoint-interval", 0, 0, BILLION,
+    "Write a checkpoint of the search to tide-search.checkpoint in the output "
+    "directory every time this many spectrum-charge combinations have been "
+    "searched, so that an interrupted search can be continued with --resume. "
+    "The checkpoint records the searched spectra, the length of the output "
+    "files and the converted spectrumrecords files, which are kept until the "
+    "search completes. Cannot be combined with pipeline-search. 0 disables "
+    "checkpoints.",
+    "Available for tide-search.", true);
+  InitBoolParam("resume", false,
+    "Continue the interrupted search whose checkpoint is in the output "
+    "directory: the spectrum files it converted are reused, the spectra it "
+    "searched are skipped and the results of the other spectra are appended "
+    "to its output files. The input files and parameters must be the same as "
+    "those of the interrupted search, except for num-threads. Requires "
+    "checkpoint-interval.",
+    "Available for tide-search.", true);
+  InitIntParam("num-shards", 1, 1, BILLION,
+    "Split the search over this many tide-search processes, each of which "
+    "scores the spectra against one shard of the peptide index, selected "
+    "with shard-index. Every shard writes its top-match+1 matches per spectrum "
+    "and the statistics needed to recompute the delta-Cn and Tailor scores "
+    "to tide-search.shard-stats.txt; merge-search-results combines the output "
+    "directories of all shards into the results of a single search. The "
+    "shards must be run with the same parameters. 1 disables sharding.",
+    "Available for tide-search.", true);
+  InitIntParam("shard-index", 0, 0, BILLION,
+    "The shard of the peptide index searched when num-shards is greater "
+    "than 1, from 0 to num-shards-1. The peptides of the index are dealt to "
+    "the shards in turn.",
+    "Available for tide-search.", true);
+  InitStringParam("server-socket", "tide-server.socket",
+    "The Unix domain socket through which tide-server receives requests and "
+    "tide-client sends them. Relative paths are relative to the directory "
+    "the command is run in.",
+    "Available for tide-server and tide-client.", true);
+  InitIntParam("fragment-index-top-n", 0, 0, BILLION,
+    "Prefilter the candidate peptides of each spectrum with a fragment-ion "
+    "index: count the theoretical fragments each candidate shares with the "
+    "spectrum and compute the XCorr of only the N candidates with the most "
+    "shared fragments. This makes searches with wide precursor windows, such "
+    "as open modification searches, practical. Candidates that are not scored "
+    "are not reported and do not contribute to the Tailor score. The value 0 "
+    "scores every candidate. Requires score-function xcorr.",
+    "Available for tide-search.", true);
+  InitStringParam("spectrum-cache-dir", "",
+    "A directory in which tide-search keeps the spectrumrecords files it "
+    "converts, so that later searches of the same spectrum files reuse them. "
+    "Entries are keyed by the size, modification time and contents of the "
+    "spectrum file and by the parameters that affect conversion. If this "
+    "parameter is blank, converted spectra are deleted after the search.",
+    "Available for tide-search.", true);
+  InitIntParam("spectrum-cache-size", 20, 1, BILLION,
+    "The maximum size, in GB, of spectrum-cache-dir. When a new entry makes "
+    "the cache larger than this, the least recently used entries are removed, "
+    "except those being read by a search or used within the last 10 minutes.",
+    "Available for tide-search.", true);
+  InitIntParam("spectrum-memory-limit", 4, 1, BILLION,
+    "The maximum amount of memory (i.e., RAM), in GB, used to sort the spectra "
+    "of one input file by precursor mass while converting it to spectrumrecords "
+    "format. Larger files are sorted in runs that are written to temporary "
+    "files and then merged. Each conversion thread uses up to this amount.",
+    "Available for tide-search and spectrum-converter.", true);
+  InitBoolParam("compress-index", false,
+    "Store the peptides of the index in compressed, mass-ordered blocks "
+    "(pepix.blocks) instead of one record per peptide. Masses and ids are "
+    "delta-encoded within each block, which shrinks large indexes considerably "
+    "and lets tide-search skip blocks below the lightest precursor mass.",
+    "Available for tide-index.", true);
   // coder options regarding decoys
   InitIntParam("num-decoy-files", 1, 0, 10,
     "Replaces number-decoy-set.  Determined by decoy-location"
@@ -859,13 +947,13 @@ InitStringParam("protein-name-separator", ",",
   InitBoolParam("skip-preprocessing", false,
     "Skip preprocessing steps on spectra. Default = F.",
     "Available for tide-search", true);
-  InitStringParam("score-function", "xcorr", "xcorr|combined-p-values",  //TDOD: implement later : |hyperscore|hyperscore-la
+  InitStringParam("score-function", "xcorr", "xcorr|combined-p-values|hyperscore",
     "Function used for scoring PSMs. 'xcorr' is the original scoring function used by SEQUEST;"
     "`combined-p-values` combined (1) exact-p-value: a calibrated version of XCorr that uses "
     "dynamic programming and (2) residue-evidence-pvalue: a valibarated version of the  ResEV "
-    "that considers pairs of peaks, rather than single peaks; ",
-//    "`hyperscore` is the score function used in X!Tandem; `hyperscore-la` is a variant of the "  TODO: implement later
-//    "hyperscore designed for open modification searching.",
+    "that considers pairs of peaks, rather than single peaks; "
+    "`hyperscore` is the score function used in X!Tandem, computed from the number of "
+    "matched b and y ions and the sum of their intensities.",
     "Available for tide-search.", true);
   InitDoubleParam("fragment-tolerance", .02, 0, 2,
     "Mass tolerance (in Da) for scoring pairs of peaks when creating the residue evidence matrix. "
@@ -884,7 +972,23 @@ InitStringParam("protein-name-separator", ",",
                   "Available for tide-search", true);
   InitIntParam("num-threads", 1, 0, 64,
                "0=poll CPU to set num threads; else specify num threads directly.",
-               "Available for tide-search tab-delimited files only.", true);
+               "Available for tide-search tab-delimited files, assign-confidence and diameter.", true);
+  InitBoolParam("numa-placement", false,
+    "Pin each search thread to its own core, filling one NUMA node before "
+    "the next, so that its workspaces are allocated on the memory of its "
+    "node, and give each NUMA node its own copy of the proteins of the "
+    "index. Improves the scaling of multithreaded searches on machines with "
+    "several processor sockets. Only supported on Linux.",
+    "Available for tide-search.", true);
+  InitIntParam("split-candidates", 10000, 0, BILLION,
+    "Score the candidate peptides of a spectrum with at least this many of "
+    "them with several threads, so that spectra with very wide precursor "
+    "windows do not keep one thread busy after the others have finished. "
+    "The candidates are split into parts of at least half this many, which "
+    "threads score between their own spectra. The value 0 scores every "
+    "spectrum with a single thread. Only used with score-function xcorr and "
+    "without fragment-index-top-n.",
+    "Available for tide-search.", true);
   InitBoolParam("brief-output", false,
     "Output in tab-delimited text only the file name, scan number, charge, score and peptide."
     "Incompatible with mzid-output=T, pin-output=T, pepxml-output=T or txt-output=F.",
@@ -1380,6 +1484,14 @@ InitStringParam("protein-name-separator", ",",
     "Specify this parameter to T in order to treat peptides carrying different or "
     "no modifications as being the same. Works only if estimation = peptide-level.",
     "Used by assign-confidence.", true);
+  InitBoolParam("columnar-input", false,
+    "Read the score, scan, charge, rank and peptide columns of tab-delimited input "
+    "files into arrays, on num-threads threads, instead of building a PSM object for "
+    "each row, and write each accepted target row unchanged with a q-value column "
+    "appended. Inputs that need more than that, such as pepXML, SQT or mzIdentML "
+    "files, multiple decoys per target, the Sidak adjustment or non-tab-delimited "
+    "outputs, are read the usual way.",
+    "Used by assign-confidence.", true);
   InitStringParam("percolator-intraset-features", "F",
     "Set a feature for percolator that in later versions is not an option.",
     "Shouldn't be variable; hide from user.", false);
@@ -1399,6 +1511,10 @@ InitStringParam("protein-name-separator", ",",
     "The minimum number of accepted PSMs required for cascade-search to continue to the "
     "next database in the given series",
     "Used by cascade-search.", false);
+  /*Merge-search-results parameters*/
+  InitArgParam("shard directories",
+    "The output directories of the tide-search shards to be merged, one per "
+    "shard-index.");
   /*Subtract-index parameters*/
   InitArgParam("tide index 1", "A peptide index produced using tide-index");
   InitArgParam("tide index 2", "A second peptide index, to be subtracted from the first index.");
@@ -2166,6 +2282,12 @@ InitStringParam("protein-name-separator", ",",
     "If the peptide in the database is missing in the prediction, its predicted value will be imputed by the median of all predicted values.",
     "It is optional but recommended for DIAmeter. It can be easily generated by DeepRT or any off-the-shelf "
     "RT prediction tools by feeding in the peptide-list generated by tide-index", true);
+  InitStringParam("predrt-library", "",
+    "A binary library of the predicted retention times, which DIAmeter memory-maps instead of reading "
+    "predrt-files. If the file does not exist, it is created from predrt-files, so later searches "
+    "against the same predictions skip parsing and normalizing them. A library built from "
+    "predrt-files that have since changed is rebuilt, and replaced on disk if overwrite is set.",
+    "Available for DIAmeter. Recommended for whole-proteome predictions with millions of peptides.", true);
 
   InitIntParam("msamanda-regional-topk", 10, 1, 1000000,
     "Analogous to the peak-picking in MS Amanda, the m/z range is divided into 10 equal length segments, "
@@ -2320,6 +2442,7 @@ void Params::Categorize() {
   items.insert("deisotope");
   items.insert("exact-p-value");
   items.insert("fragment-mass");
+  items.insert("fragment-index-top-n");
   items.insert("isotope-error");
   items.insert("max-ion-charge");
   items.insert("min-peaks");
@@ -2384,6 +2507,8 @@ void Params::Categorize() {
 
   items.clear();
   items.insert("num-threads");
+  items.insert("numa-placement");
+  items.insert("split-candidates");
   items.insert("num_threads");
   items.insert("threads");
   AddCategory("CPU threads", items);
@@ -2566,6 +2691,7 @@ void Params::Categorize() {
   AddCategory("param-medic options", items);
 
   items.clear();
+  items.insert("compress-index");
   items.insert("concat");
   items.insert("decoy-prefix");
   items.insert("decoy-xml-output");
@@ -2591,14 +2717,24 @@ void Params::Categorize() {
   items.insert("peptide-list");
   items.insert("pepxml-output");
   items.insert("pin-output");
+  items.insert("pipeline-search");
+  items.insert("checkpoint-interval");
+  items.insert("resume");
+  items.insert("num-shards");
+  items.insert("shard-index");
+  items.insert("server-socket");
   items.insert("mztab-output");
   items.insert("pout-output");
   items.insert("precision");
   items.insert("print-search-progress");
   items.insert("print_expect_score");
+  items.insert("profile-output");
   items.insert("sample_enzyme_number");
   items.insert("show_fragment_ions");
+  items.insert("spectrum-cache-dir");
+  items.insert("spectrum-cache-size");
   items.insert("spectrum-format");
+  items.insert("spectrum-memory-limit");
   items.insert("spectrum-parser");
   items.insert("sqt-output");
   items.insert("store-index");
@@ -1,5 +1,8 @@
 #include "StringUtils.h"
 
+#include <cstdio>
+#include <cstdlib>
+
 #include "boost/algorithm/string.hpp"
 
 using namespace std;
@@ -136,6 +139,22 @@ string StringUtils::LineFormat(string s, unsigned limit, unsigned indentSize) {
   return lines.str();
 }
 
+string StringUtils::ToExactString(double value) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%a", value);
+  return buffer;
+}
+
+double StringUtils::FromExactString(const string& s) {
+  const char* begin = s.c_str();
+  char* end;
+  double value = strtod(begin, &end);
+  if (s.empty() || end != begin + s.length()) {
+    throw runtime_error("Could not convert string '" + s + "'");
+  }
+  return value;
+}
+
 StringUtils::StringUtils() {}
 StringUtils::~StringUtils() {}
 
@@ -184,6 +184,12 @@ class StringUtils {
   // Break a string into lines limited by length
   static std::string LineFormat(std::string s, unsigned limit, unsigned indentSize = 0);
 
+  // Convert a double to a hexadecimal float, which reads back exactly
+  static std::string ToExactString(double value);
+
+  // Read a double written by ToExactString, or in decimal
+  static double FromExactString(const std::string& s);
+
  private:
   static const char* WHITESPACE_CHARS;
 
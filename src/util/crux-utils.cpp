@@ -81,7 +81,7 @@ static const int INVALID_ENUM_STRING = -10;
  */
 
 static const char* score_function_strings[NUMBER_SCORE_FUNCTIONS] = {
-  "invalid", "xcorr", "combined-p-values" //, "hyperscore", "hyperscore-la"  TODO: implement hyperscore functions later.
+  "invalid", "xcorr", "combined-p-values", "hyperscore"
 };
 
 SCORE_FUNCTION_T string_to_score_function_type(const string& name) {
@@ -552,6 +552,7 @@ static const char* scorer_type_strings[NUMBER_SCORER_TYPES] = {
   "res-ev p-value",
   "combined p-value",
   "tailor score",
+  "hyperscore",
   "precursor intensity logrank M0",
   "precursor intensity logrank M1",
   "precursor intensity logrank M2",
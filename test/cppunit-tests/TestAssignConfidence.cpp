@@ -0,0 +1,130 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "TestAssignConfidence.h"
+#include "utils.h"
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestAssignConfidence );
+
+// Exposes the thread count, which main normally reads from num-threads.
+class ThreadedAssignConfidence : public AssignConfidenceApplication {
+ public:
+  explicit ThreadedAssignConfidence(int num_threads) {
+    num_threads_ = num_threads;
+  }
+};
+
+void TestAssignConfidence::setUp(){
+  // Enough scores to sort in parallel, drawn from few values so that
+  // thread ranges start inside runs of ties.
+  mysrandom(7);
+  size_t num_scores = (1 << 17) + 123;
+  for (size_t i = 0; i < num_scores; i++) {
+    targets.push_back(myrandom_limit(40) / 4.0);
+    decoys.push_back(myrandom_limit(40) / 4.0 - 1.0);
+  }
+  // fewer targets than decoys
+  targets.resize(num_scores - 1000);
+}
+
+void TestAssignConfidence::tearDown(){
+}
+
+void TestAssignConfidence::tdcSmall(){
+  // Sorted best first, 0, 1, 1, 1 and 2 decoys score above the targets:
+  // FDRs (0+1)/1, (1+1)/2, (1+1)/3, (1+1)/4, (2+1)/5.
+  FLOAT_T target_array[] = {3, 1, 4, 2, 5};
+  FLOAT_T decoy_array[] = {1.5, 4.5};
+  FLOAT_T expected[] = {0.5, 0.5, 0.5, 0.5, 0.6};
+  vector<FLOAT_T> small_targets(target_array, target_array + 5);
+  vector<FLOAT_T> small_decoys(decoy_array, decoy_array + 2);
+  vector<FLOAT_T> qvalues = ThreadedAssignConfidence(1).compute_decoy_qvalues_tdc(
+    small_targets, small_decoys, false, 1.0);
+  CPPUNIT_ASSERT(qvalues.size() == 5);
+  for (size_t i = 0; i < qvalues.size(); i++) {
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i], qvalues[i], 1e-6);
+  }
+
+  // Smaller scores are better: the same targets and decoys mirrored.
+  for (size_t i = 0; i < 5; i++) {
+    target_array[i] = -target_array[i];
+  }
+  decoy_array[0] = -decoy_array[0];
+  decoy_array[1] = -decoy_array[1];
+  small_targets.assign(target_array, target_array + 5);
+  small_decoys.assign(decoy_array, decoy_array + 2);
+  qvalues = ThreadedAssignConfidence(1).compute_decoy_qvalues_tdc(
+    small_targets, small_decoys, true, 1.0);
+  for (size_t i = 0; i < qvalues.size(); i++) {
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i], qvalues[i], 1e-6);
+  }
+}
+
+void TestAssignConfidence::mixmaxSmall(){
+  // More decoys than targets, pi_zero 0.5. Sorted worst first, the
+  // targets are 1, 3, 5 and the decoys 0.5, 2, 4, 6. Walking down from
+  // the best target, each decoy z_j at or above it adds
+  // pi_zero + (1 - pi_zero) * P(x < z_j), with P estimated from the counts
+  // of targets (w) and decoys (z) at or below the next better decoy:
+  //   decoy 6: w = 3, z = 4, P = (3 - 2) / 2 = 1/2   -> FDR(5) = 0.75 / 1
+  //   decoy 4: w = 3, z = 4, P = 1/2                 -> FDR(3) = 1.5 / 2
+  //   decoy 2: w = 2, z = 3, P = (2 - 1.5) / 1.5     -> FDR(1) = (13/6) / 3
+  // The last decoy count is 4, not the number of targets.
+  FLOAT_T target_array[] = {5, 1, 3};
+  FLOAT_T decoy_array[] = {2, 6, 0.5, 4};
+  FLOAT_T expected = 13.0 / 18.0;
+  vector<FLOAT_T> small_targets(target_array, target_array + 3);
+  vector<FLOAT_T> small_decoys(decoy_array, decoy_array + 4);
+  vector<FLOAT_T> qvalues = ThreadedAssignConfidence(1).compute_decoy_qvalues_mixmax(
+    small_targets, small_decoys, false, 0.5);
+  CPPUNIT_ASSERT(qvalues.size() == 3);
+  for (size_t i = 0; i < qvalues.size(); i++) {
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, qvalues[i], 1e-6);
+  }
+
+  for (size_t i = 0; i < 3; i++) {
+    target_array[i] = -target_array[i];
+  }
+  for (size_t i = 0; i < 4; i++) {
+    decoy_array[i] = -decoy_array[i];
+  }
+  small_targets.assign(target_array, target_array + 3);
+  small_decoys.assign(decoy_array, decoy_array + 4);
+  qvalues = ThreadedAssignConfidence(1).compute_decoy_qvalues_mixmax(
+    small_targets, small_decoys, true, 0.5);
+  for (size_t i = 0; i < qvalues.size(); i++) {
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, qvalues[i], 1e-6);
+  }
+}
+
+void TestAssignConfidence::tdcThreads(){
+  for (int ascending = 0; ascending < 2; ascending++) {
+    vector<FLOAT_T> serial_targets = targets, serial_decoys = decoys;
+    vector<FLOAT_T> serial = ThreadedAssignConfidence(1).compute_decoy_qvalues_tdc(
+      serial_targets, serial_decoys, ascending, 1.0);
+    for (int num_threads = 2; num_threads <= 9; num_threads++) {
+      vector<FLOAT_T> cur_targets = targets, cur_decoys = decoys;
+      vector<FLOAT_T> cur = ThreadedAssignConfidence(num_threads).compute_decoy_qvalues_tdc(
+        cur_targets, cur_decoys, ascending, 1.0);
+      CPPUNIT_ASSERT(cur_targets == serial_targets);
+      CPPUNIT_ASSERT(cur_decoys == serial_decoys);
+      CPPUNIT_ASSERT(cur == serial);
+    }
+  }
+}
+
+void TestAssignConfidence::mixmaxThreads(){
+  for (int ascending = 0; ascending < 2; ascending++) {
+    vector<FLOAT_T> serial_targets = targets, serial_decoys = decoys;
+    vector<FLOAT_T> serial = ThreadedAssignConfidence(1).compute_decoy_qvalues_mixmax(
+      serial_targets, serial_decoys, ascending, 0.9);
+    for (int num_threads = 2; num_threads <= 9; num_threads++) {
+      vector<FLOAT_T> cur_targets = targets, cur_decoys = decoys;
+      vector<FLOAT_T> cur = ThreadedAssignConfidence(num_threads).compute_decoy_qvalues_mixmax(
+        cur_targets, cur_decoys, ascending, 0.9);
+      CPPUNIT_ASSERT(cur_targets == serial_targets);
+      CPPUNIT_ASSERT(cur_decoys == serial_decoys);
+      CPPUNIT_ASSERT(cur == serial);
+    }
+  }
+}
@@ -0,0 +1,39 @@
+#ifndef CPP_UNIT_TESTASSIGNCONFIDENCE_H
+#define CPP_UNIT_TESTASSIGNCONFIDENCE_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <vector>
+#include "AssignConfidenceApplication.h"
+
+/*
+ * Test the q-values of small hand-computed cases, and that the q-values
+ * computed on several threads are the same, bit for bit, as those
+ * computed on one.
+ */
+
+class TestAssignConfidence : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestAssignConfidence );
+  CPPUNIT_TEST( tdcSmall );
+  CPPUNIT_TEST( mixmaxSmall );
+  CPPUNIT_TEST( tdcThreads );
+  CPPUNIT_TEST( mixmaxThreads );
+  CPPUNIT_TEST_SUITE_END();
+  
+ protected:
+  // random scores with many ties
+  std::vector<FLOAT_T> targets;
+  std::vector<FLOAT_T> decoys;
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void tdcSmall();
+  void mixmaxSmall();
+  void tdcThreads();
+  void mixmaxThreads();
+};
+
+#endif //CPP_UNIT_TESTASSIGNCONFIDENCE_H
@@ -0,0 +1,137 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "TestColumnarAssignConfidence.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+#define BOOST_NO_CXX11_SCOPED_ENUMS
+#include <boost/filesystem.hpp>
+#undef BOOST_NO_CXX11_SCOPED_ENUMS
+#include "parameter.h"
+#include "util/FileUtils.h"
+#include "util/Params.h"
+#include "util/StringUtils.h"
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestColumnarAssignConfidence );
+
+static const char* kAminoAcids = "ACDEFGHIKLMNPQRSTVWY";
+
+// One of a small pool of peptides, so that peptide-level estimation has
+// peptides matched by several spectra.
+static string peptide(int i, bool decoy) {
+  string sequence = string("PEP") + kAminoAcids[i % 20] + kAminoAcids[(i / 20) % 20] + "TIDEK";
+  return decoy ? string(sequence.rbegin() + 1, sequence.rend()) + "K" : sequence;
+}
+
+static void writePsms(const string& file_name, bool decoy) {
+  ofstream file(file_name.c_str());
+  file << "file\tscan\tcharge\tspectrum precursor m/z\tspectrum neutral mass\t"
+          "peptide mass\tdelta_cn\txcorr score\txcorr rank\tdistinct matches/spectrum\t"
+          "sequence\tprotein id\tflanking aa\n";
+  for (int scan = 1; scan <= 80; scan++) {
+    // some spectra have no decoys, and some are searched at two charges
+    if (decoy && scan % 9 == 0) {
+      continue;
+    }
+    for (int charge = 2; charge <= (scan % 4 == 0 ? 3 : 2); charge++) {
+      for (int rank = 1; rank <= 3; rank++) {
+        // Few distinct scores, so that there are ties within each file. A
+        // target never ties its decoy, since those ties are broken at random.
+        int score = decoy ? (scan * 5 + charge + rank * 7) % 11 : (scan * 7 + charge + rank * 3) % 13;
+        double xcorr = 3.0 - (rank - 1) * 0.5 - (12 - score) / 8.0 + (decoy ? 1.0 / 16 : 0.0);
+        int pep = decoy ? (scan * 3 + rank) % 30 : (scan + rank * 11) % 25;
+        file << "tiny.ms2\t" << scan << '\t' << charge << "\t500.0\t"
+             << 998.0 + (charge - 2) * 500.0 << "\t999.0\t0.1\t"
+             << StringUtils::ToString(xcorr, 4) << '\t'
+             << rank << "\t30\t" << peptide(pep, decoy) << '\t'
+             << (decoy ? "decoy_prot" : "prot") << pep << "(5)\tKR\n";
+      }
+    }
+  }
+}
+
+void TestColumnarAssignConfidence::setUp(){
+  initialize_parameters();
+  targetFile = "tiny-assign.target.txt";
+  decoyFile = "tiny-assign.decoy.txt";
+  outputDir = "tiny-assign-output";
+  writePsms(targetFile, false);
+  writePsms(decoyFile, true);
+  Params::Set("output-dir", outputDir);
+  Params::Set("overwrite", true);
+  Params::Set("num-threads", 2);
+}
+
+void TestColumnarAssignConfidence::tearDown(){
+  remove(targetFile.c_str());
+  remove(decoyFile.c_str());
+  boost::filesystem::remove_all(outputDir);
+}
+
+map<string, double> TestColumnarAssignConfidence::run(const string& method, bool columnar) {
+  boost::filesystem::remove_all(outputDir);
+  FileUtils::Mkdir(outputDir);
+  Params::Set("estimation-method", method);
+  Params::Set("columnar-input", columnar);
+  AssignConfidenceApplication app;
+  CPPUNIT_ASSERT(app.main(vector<string>(1, targetFile)) == 0);
+
+  string qvalue_header = method == "mix-max" ? "mix-max q-value" : "tdc q-value";
+  ifstream file(FileUtils::Join(outputDir, "assign-confidence.target.txt").c_str());
+  CPPUNIT_ASSERT(file.good());
+  string line;
+  getline(file, line);
+  vector<string> header = StringUtils::Split(line, '\t');
+  int scan_col = -1, charge_col = -1, sequence_col = -1, qvalue_col = -1;
+  for (size_t i = 0; i < header.size(); i++) {
+    if (header[i] == "scan") {
+      scan_col = i;
+    } else if (header[i] == "charge") {
+      charge_col = i;
+    } else if (header[i] == "sequence") {
+      sequence_col = i;
+    } else if (header[i] == qvalue_header) {
+      qvalue_col = i;
+    }
+  }
+  CPPUNIT_ASSERT(scan_col >= 0 && charge_col >= 0 && sequence_col >= 0 && qvalue_col >= 0);
+
+  map<string, double> qvalues;
+  while (getline(file, line)) {
+    vector<string> fields = StringUtils::Split(line, '\t');
+    string key = fields[scan_col] + '\t' + fields[charge_col] + '\t' + fields[sequence_col];
+    CPPUNIT_ASSERT(qvalues.find(key) == qvalues.end());
+    qvalues[key] = StringUtils::FromString<double>(fields[qvalue_col]);
+  }
+  return qvalues;
+}
+
+void TestColumnarAssignConfidence::compare(const string& method) {
+  map<string, double> expected = run(method, false);
+  map<string, double> columnar = run(method, true);
+  CPPUNIT_ASSERT(!expected.empty());
+  CPPUNIT_ASSERT(columnar.size() == expected.size());
+  bool below_one = false;
+  for (map<string, double>::const_iterator i = expected.begin(); i != expected.end(); ++i) {
+    map<string, double>::const_iterator j = columnar.find(i->first);
+    CPPUNIT_ASSERT(j != columnar.end());
+    CPPUNIT_ASSERT(fabs(i->second - j->second) < 1e-6);
+    below_one = below_one || i->second < 1.0;
+  }
+  // q-values that do not all hit the ceiling
+  CPPUNIT_ASSERT(below_one);
+}
+
+void TestColumnarAssignConfidence::tdc(){
+  compare("tdc");
+}
+
+void TestColumnarAssignConfidence::mixmax(){
+  compare("mix-max");
+}
+
+void TestColumnarAssignConfidence::peptideLevel(){
+  compare("peptide-level");
+}
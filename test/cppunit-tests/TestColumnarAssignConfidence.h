@@ -0,0 +1,45 @@
+#ifndef CPP_UNIT_TESTCOLUMNARASSIGNCONFIDENCE_H
+#define CPP_UNIT_TESTCOLUMNARASSIGNCONFIDENCE_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <map>
+#include <string>
+#include "AssignConfidenceApplication.h"
+
+/*
+ * Test that assign-confidence with columnar-input accepts the same target
+ * PSMs, and gives them the same q-values, as reading the PSMs into
+ * MatchCollections, for each estimation method.
+ */
+
+class TestColumnarAssignConfidence : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestColumnarAssignConfidence );
+  CPPUNIT_TEST( tdc );
+  CPPUNIT_TEST( mixmax );
+  CPPUNIT_TEST( peptideLevel );
+  CPPUNIT_TEST_SUITE_END();
+
+ protected:
+  // variables to use in testing
+  std::string targetFile;
+  std::string decoyFile;
+  std::string outputDir;
+
+  // Run assign-confidence, and read the q-values of its target PSMs by
+  // scan, charge and sequence.
+  std::map<std::string, double> run(const std::string& method, bool columnar);
+  // Check that both paths give the same q-values.
+  void compare(const std::string& method);
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void tdc();
+  void mixmax();
+  void peptideLevel();
+};
+
+#endif //CPP_UNIT_TESTCOLUMNARASSIGNCONFIDENCE_H
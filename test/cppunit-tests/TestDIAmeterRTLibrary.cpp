@@ -0,0 +1,195 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "TestDIAmeterRTLibrary.h"
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <vector>
+#define BOOST_NO_CXX11_SCOPED_ENUMS
+#include <boost/filesystem.hpp>
+#undef BOOST_NO_CXX11_SCOPED_ENUMS
+#include "DIAmeterApplication.h"
+#include "util/FileUtils.h"
+#include "util/Params.h"
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestDIAmeterRTLibrary );
+
+// Exposes reading the retention times, which main normally does first.
+class TestableDIAmeter : public DIAmeterApplication {
+ public:
+  using DIAmeterApplication::getPeptidePredRTMapping;
+};
+
+void TestDIAmeterRTLibrary::setUp(){
+  predrtFile = "tiny-predrt.txt";
+  libraryFile = "tiny-predrt.rtlib";
+  predrts.clear();
+  predrts["PEPTIDEK"] = 0.25;
+  predrts["PEPTIDER"] = 0.5;
+  predrts["PEP[15.99]TIDEK"] = 0.75;
+  predrts["AAAAAAAK"] = 1.0;
+  Params::Set("predrt-files", predrtFile);
+  Params::Set("predrt-library", libraryFile);
+  Params::Set("overwrite", false);
+}
+
+void TestDIAmeterRTLibrary::tearDown(){
+  remove(predrtFile.c_str());
+  remove(libraryFile.c_str());
+}
+
+void TestDIAmeterRTLibrary::writePredictions(
+  const map<string, double>& predictions,
+  int seconds_later
+) {
+  time_t mtime = time(NULL);
+  ofstream file(predrtFile.c_str());
+  file << "peptide\tpredrt\n";
+  for (map<string, double>::const_iterator i = predictions.begin(); i != predictions.end(); ++i) {
+    file << i->first << '\t' << i->second << '\n';
+  }
+  file.close();
+  // so that a rewrite within the same second is noticed
+  boost::filesystem::last_write_time(predrtFile, mtime + seconds_later);
+}
+
+void TestDIAmeterRTLibrary::load(DIAmeterRTLibrary* library){
+  TestableDIAmeter::getPeptidePredRTMapping(library);
+}
+
+void TestDIAmeterRTLibrary::lookup(){
+  DIAmeterRTLibrary library;
+  double predrt = -1.0;
+  CPPUNIT_ASSERT(!library.find("PEPTIDEK", &predrt));
+
+  library.build(predrts, 42);
+  CPPUNIT_ASSERT(library.size() == predrts.size());
+  CPPUNIT_ASSERT(library.sourceFingerprint() == 42);
+  for (map<string, double>::const_iterator i = predrts.begin(); i != predrts.end(); ++i) {
+    CPPUNIT_ASSERT(library.find(i->first, &predrt) && predrt == i->second);
+  }
+  // modifications and case are part of the sequence
+  CPPUNIT_ASSERT(!library.find("PEPTIDE", &predrt));
+  CPPUNIT_ASSERT(!library.find("peptidek", &predrt));
+  CPPUNIT_ASSERT(!library.find("PEP[16.00]TIDEK", &predrt));
+
+  CPPUNIT_ASSERT(DIAmeterRTLibrary::hash("PEPTIDEK") == DIAmeterRTLibrary::hash("PEPTIDEK"));
+  CPPUNIT_ASSERT(DIAmeterRTLibrary::hash("PEPTIDEK") != DIAmeterRTLibrary::hash("PEPTIDER"));
+  // the 64-bit FNV-1a offset basis
+  CPPUNIT_ASSERT(DIAmeterRTLibrary::hash("") == 14695981039346656037ULL);
+}
+
+void TestDIAmeterRTLibrary::writeAndOpen(){
+  {
+    DIAmeterRTLibrary library;
+    library.build(predrts, 42);
+    CPPUNIT_ASSERT(library.write(libraryFile));
+  }
+  DIAmeterRTLibrary library;
+  CPPUNIT_ASSERT(library.open(libraryFile));
+  CPPUNIT_ASSERT(library.size() == predrts.size());
+  CPPUNIT_ASSERT(library.sourceFingerprint() == 42);
+  double predrt;
+  for (map<string, double>::const_iterator i = predrts.begin(); i != predrts.end(); ++i) {
+    CPPUNIT_ASSERT(library.find(i->first, &predrt) && predrt == i->second);
+  }
+
+  // an empty library
+  DIAmeterRTLibrary empty;
+  empty.build(map<string, double>(), 7);
+  CPPUNIT_ASSERT(empty.write(libraryFile));
+  CPPUNIT_ASSERT(library.open(libraryFile));
+  CPPUNIT_ASSERT(library.size() == 0 && library.sourceFingerprint() == 7);
+  CPPUNIT_ASSERT(!library.find("PEPTIDEK", &predrt));
+
+  // files that are not libraries, or are cut short
+  CPPUNIT_ASSERT(!library.open("tiny-missing.rtlib"));
+  writePredictions(predrts, 0);
+  CPPUNIT_ASSERT(!library.open(predrtFile));
+  CPPUNIT_ASSERT(library.size() == 0);
+  {
+    DIAmeterRTLibrary full;
+    full.build(predrts, 42);
+    CPPUNIT_ASSERT(full.write(libraryFile));
+  }
+  FileUtils::Resize(libraryFile, FileUtils::Size(libraryFile) - 8);
+  CPPUNIT_ASSERT(!library.open(libraryFile));
+  CPPUNIT_ASSERT(!library.find("PEPTIDEK", &predrt));
+}
+
+void TestDIAmeterRTLibrary::fingerprint(){
+  vector<string> files(1, predrtFile);
+  unsigned long long missing = DIAmeterRTLibrary::fingerprint(files);
+  writePredictions(predrts, 0);
+  unsigned long long written = DIAmeterRTLibrary::fingerprint(files);
+  CPPUNIT_ASSERT(written != missing);
+  CPPUNIT_ASSERT(DIAmeterRTLibrary::fingerprint(files) == written);
+
+  // empty entries, as left by a trailing comma, do not count
+  files.push_back("");
+  CPPUNIT_ASSERT(DIAmeterRTLibrary::fingerprint(files) == written);
+  files.push_back("tiny-missing.txt");
+  CPPUNIT_ASSERT(DIAmeterRTLibrary::fingerprint(files) != written);
+  files.resize(1);
+
+  // rewritten with the same size, but later
+  writePredictions(predrts, 10);
+  CPPUNIT_ASSERT(DIAmeterRTLibrary::fingerprint(files) != written);
+}
+
+void TestDIAmeterRTLibrary::rebuild(){
+  map<string, double> first;
+  first["PEPTIDEK"] = 10.0;
+  first["PEPTIDER"] = 20.0;
+  first["AAAAAAAK"] = 30.0;
+  writePredictions(first, 0);
+
+  // built from the predictions, and written
+  DIAmeterRTLibrary library;
+  load(&library);
+  CPPUNIT_ASSERT(library.size() == 3);
+  double k, r, a;
+  CPPUNIT_ASSERT(library.find("PEPTIDEK", &k) && library.find("PEPTIDER", &r) &&
+                 library.find("AAAAAAAK", &a));
+  CPPUNIT_ASSERT(k < r && r < a && a == 1.0);
+  CPPUNIT_ASSERT(FileUtils::Exists(libraryFile));
+  string written = FileUtils::Read(libraryFile);
+
+  // reused while the prediction files keep their size and modification
+  // time, so a library is not rebuilt from an unchanged file
+  map<string, double> second;
+  second["PEPTIDEK"] = 30.0;
+  second["PEPTIDER"] = 20.0;
+  second["AAAAAAAK"] = 10.0;
+  time_t mtime = boost::filesystem::last_write_time(predrtFile);
+  writePredictions(second, 0);
+  boost::filesystem::last_write_time(predrtFile, mtime);
+  DIAmeterRTLibrary reused;
+  load(&reused);
+  double predrt;
+  CPPUNIT_ASSERT(reused.find("PEPTIDEK", &predrt) && predrt == k);
+
+  // rebuilt once they change, but not written without overwrite
+  writePredictions(second, 10);
+  DIAmeterRTLibrary rebuilt;
+  load(&rebuilt);
+  CPPUNIT_ASSERT(rebuilt.find("PEPTIDEK", &predrt) && predrt == 1.0);
+  CPPUNIT_ASSERT(rebuilt.find("AAAAAAAK", &predrt) && predrt == k);
+  CPPUNIT_ASSERT(FileUtils::Read(libraryFile) == written);
+
+  Params::Set("overwrite", true);
+  DIAmeterRTLibrary overwritten;
+  load(&overwritten);
+  CPPUNIT_ASSERT(FileUtils::Read(libraryFile) != written);
+  DIAmeterRTLibrary opened;
+  CPPUNIT_ASSERT(opened.open(libraryFile));
+  CPPUNIT_ASSERT(opened.find("PEPTIDEK", &predrt) && predrt == 1.0);
+
+  // a library that cannot be read is rebuilt from the predictions
+  Params::Set("overwrite", false);
+  { ofstream file(libraryFile.c_str()); file << "not a library"; }
+  DIAmeterRTLibrary corrupt;
+  load(&corrupt);
+  CPPUNIT_ASSERT(corrupt.find("PEPTIDEK", &predrt) && predrt == 1.0);
+}
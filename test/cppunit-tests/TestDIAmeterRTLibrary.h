@@ -0,0 +1,47 @@
+#ifndef CPP_UNIT_TESTDIAMETERRTLIBRARY_H
+#define CPP_UNIT_TESTDIAMETERRTLIBRARY_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <map>
+#include <string>
+#include "DIAmeterRTLibrary.h"
+
+/*
+ * Test that the retention time library finds the peptides it was built
+ * from, reads back what it writes, notices edited prediction files, and
+ * that DIAmeter reuses a library only if it was built from the current
+ * prediction files, replacing it only with overwrite.
+ */
+
+class TestDIAmeterRTLibrary : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestDIAmeterRTLibrary );
+  CPPUNIT_TEST( lookup );
+  CPPUNIT_TEST( writeAndOpen );
+  CPPUNIT_TEST( fingerprint );
+  CPPUNIT_TEST( rebuild );
+  CPPUNIT_TEST_SUITE_END();
+
+ protected:
+  // variables to use in testing
+  std::string predrtFile;
+  std::string libraryFile;
+  std::map<std::string, double> predrts;
+
+  // write the predictions, as peptide and retention time, after a header
+  void writePredictions(const std::map<std::string, double>& predictions, int seconds_later);
+  // read the retention times of DIAmeter with the current parameters
+  void load(DIAmeterRTLibrary* library);
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void lookup();
+  void writeAndOpen();
+  void fingerprint();
+  void rebuild();
+};
+
+#endif //CPP_UNIT_TESTDIAMETERRTLIBRARY_H
@@ -0,0 +1,138 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "TestLocalSocket.h"
+#include <ctime>
+#include <fstream>
+#include <vector>
+#include <sys/stat.h>
+#include "TideServerApplication.h"
+#include "util/FileUtils.h"
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestLocalSocket );
+
+// Exposes request parsing, which serve normally runs before a search.
+class TestableTideServer : public TideServerApplication {
+ public:
+  using TideServerApplication::readRequest;
+};
+
+void TestLocalSocket::setUp(){
+  socketPath = "tiny-server.socket";
+  server = LocalSocket::Listen(socketPath);
+  CPPUNIT_ASSERT(server != NULL);
+  client = NULL;
+  peer = NULL;
+}
+
+void TestLocalSocket::tearDown(){
+  delete client;
+  delete peer;
+  delete server;
+}
+
+void TestLocalSocket::connect(){
+  delete client;
+  delete peer;
+  client = LocalSocket::Connect(socketPath);
+  CPPUNIT_ASSERT(client != NULL);
+  peer = server->Accept();
+  CPPUNIT_ASSERT(peer != NULL);
+}
+
+void TestLocalSocket::readLines(){
+  connect();
+  // several lines in one write, and one line over several writes
+  CPPUNIT_ASSERT(client->Write("first\nsecond\n\nfou"));
+  CPPUNIT_ASSERT(client->Write("r"));
+  CPPUNIT_ASSERT(client->Write("th\n" + string(10000, 'x') + "\nlast"));
+  string line;
+  CPPUNIT_ASSERT(peer->ReadLine(&line) && line == "first");
+  CPPUNIT_ASSERT(peer->ReadLine(&line) && line == "second");
+  CPPUNIT_ASSERT(peer->ReadLine(&line) && line.empty());
+  CPPUNIT_ASSERT(peer->ReadLine(&line) && line == "fourth");
+  CPPUNIT_ASSERT(peer->ReadLine(&line) && line == string(10000, 'x'));
+
+  // a line cut short by the peer going away is not read
+  delete client;
+  client = NULL;
+  CPPUNIT_ASSERT(!peer->ReadLine(&line));
+
+  // and the other direction
+  connect();
+  CPPUNIT_ASSERT(peer->Write("ok /out/tide-search.target.txt\ndone\n"));
+  CPPUNIT_ASSERT(client->ReadLine(&line) && line == "ok /out/tide-search.target.txt");
+  CPPUNIT_ASSERT(client->ReadLine(&line) && line == "done");
+}
+
+void TestLocalSocket::receiveTimeout(){
+  connect();
+  CPPUNIT_ASSERT(peer->SetReceiveTimeout(1));
+  CPPUNIT_ASSERT(client->Write("search /out\n/a.ms2"));
+  string line;
+  CPPUNIT_ASSERT(peer->ReadLine(&line) && line == "search /out");
+  time_t start = time(NULL);
+  CPPUNIT_ASSERT(!peer->ReadLine(&line));
+  CPPUNIT_ASSERT(time(NULL) - start <= 3);
+  // the stalled connection is shut, so the client sees it end
+  CPPUNIT_ASSERT(!client->ReadLine(&line));
+}
+
+void TestLocalSocket::listen(){
+  // the socket file is only accessible to its owner
+  struct stat info;
+  CPPUNIT_ASSERT(stat(socketPath.c_str(), &info) == 0);
+  CPPUNIT_ASSERT((info.st_mode & 0777) == (S_IRUSR | S_IWUSR));
+
+  // one server per path
+  CPPUNIT_ASSERT(LocalSocket::Listen(socketPath) == NULL);
+  CPPUNIT_ASSERT(FileUtils::Exists(socketPath));
+
+  // the file is removed with the server, and a stale file replaced
+  delete server;
+  server = NULL;
+  CPPUNIT_ASSERT(!FileUtils::Exists(socketPath));
+  CPPUNIT_ASSERT(LocalSocket::Connect(socketPath) == NULL);
+  { ofstream stale(socketPath.c_str()); }
+  server = LocalSocket::Listen(socketPath);
+  CPPUNIT_ASSERT(server != NULL);
+  connect();
+
+  // paths too long for a socket address
+  CPPUNIT_ASSERT(LocalSocket::Listen(string(200, 'x')) == NULL);
+  CPPUNIT_ASSERT(LocalSocket::Connect("") == NULL);
+}
+
+void TestLocalSocket::request(){
+  connect();
+  CPPUNIT_ASSERT(client->Write("search /data/out dir\n/data/a.ms2\n"));
+  CPPUNIT_ASSERT(client->Write("/data/b c.mzML\n\n"));
+  string output_dir;
+  vector<string> spectrum_files(1, "left over");
+  CPPUNIT_ASSERT(TestableTideServer::readRequest(peer, &output_dir, &spectrum_files));
+  CPPUNIT_ASSERT(output_dir == "/data/out dir");
+  CPPUNIT_ASSERT(spectrum_files.size() == 2);
+  CPPUNIT_ASSERT(spectrum_files[0] == "/data/a.ms2");
+  CPPUNIT_ASSERT(spectrum_files[1] == "/data/b c.mzML");
+}
+
+void TestLocalSocket::malformedRequest(){
+  const char* requests[] = {
+    "",                               // nothing
+    "hello\n/data/a.ms2\n\n",         // not a search
+    "search\n/data/a.ms2\n\n",        // no output directory
+    "search \n/data/a.ms2\n\n",
+    "search /data/out\n\n",           // no spectrum files
+    "search /data/out\n/data/a.ms2\n" // cut short
+  };
+  for (size_t i = 0; i < sizeof(requests) / sizeof(requests[0]); i++) {
+    connect();
+    CPPUNIT_ASSERT(client->Write(requests[i]));
+    // the client stops sending
+    delete client;
+    client = NULL;
+    string output_dir;
+    vector<string> spectrum_files;
+    CPPUNIT_ASSERT(!TestableTideServer::readRequest(peer, &output_dir, &spectrum_files));
+  }
+}
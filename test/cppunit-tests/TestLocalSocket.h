@@ -0,0 +1,47 @@
+#ifndef CPP_UNIT_TESTLOCALSOCKET_H
+#define CPP_UNIT_TESTLOCALSOCKET_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+#include "LocalSocket.h"
+
+/*
+ * Test that lines are read from a local socket however the peer splits its
+ * writes, that reads give up once the receive timeout expires, that only
+ * one server listens on a path and only its owner may connect, and that
+ * tide-server reads well-formed requests and rejects malformed ones.
+ */
+
+class TestLocalSocket : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestLocalSocket );
+  CPPUNIT_TEST( readLines );
+  CPPUNIT_TEST( receiveTimeout );
+  CPPUNIT_TEST( listen );
+  CPPUNIT_TEST( request );
+  CPPUNIT_TEST( malformedRequest );
+  CPPUNIT_TEST_SUITE_END();
+
+ protected:
+  // variables to use in testing
+  std::string socketPath;
+  LocalSocket* server;
+  LocalSocket* client;  // the client's end of the connection
+  LocalSocket* peer;    // the server's end of the connection
+
+  // connect client to the server, and accept the connection as peer
+  void connect();
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void readLines();
+  void receiveTimeout();
+  void listen();
+  void request();
+  void malformedRequest();
+};
+
+#endif //CPP_UNIT_TESTLOCALSOCKET_H
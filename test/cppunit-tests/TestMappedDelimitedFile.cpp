@@ -0,0 +1,158 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "TestMappedDelimitedFile.h"
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include "DelimitedFileReader.h"
+#include "util/StringUtils.h"
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestMappedDelimitedFile );
+
+// Parse a cell both ways, and check they give the same value or both fail.
+template<typename T>
+static bool sameParse(const string& cell) {
+  T expected = 0, parsed = 0;
+  bool expected_ok = true, parsed_ok = true;
+  try {
+    expected = StringUtils::FromString<T>(cell);
+  } catch (const runtime_error&) {
+    expected_ok = false;
+  }
+  try {
+    MappedDelimitedFile::parseCell(cell.data(), cell.length(), &parsed);
+  } catch (const runtime_error&) {
+    parsed_ok = false;
+  }
+  return expected_ok == parsed_ok && (!expected_ok || expected == parsed);
+}
+
+// Every cell of every row read by reader, with the numeric columns also
+// read as numbers, one row per line.
+static string readAll(DelimitedFileReader& reader) {
+  string rows;
+  while (reader.hasNext()) {
+    size_t num_cells = reader.getCurrentRowData().size();
+    for (size_t col = 0; col < num_cells; col++) {
+      rows += reader.getString(col) + "|";
+    }
+    for (size_t col = 1; col < reader.numCols(); col++) {
+      try {
+        rows += StringUtils::ToString(reader.getDouble(col), 17) + "|";
+      } catch (const runtime_error&) {
+        rows += "error|";
+      }
+    }
+    rows += "[" + reader.getString() + "]\n";
+    reader.next();
+  }
+  return rows;
+}
+
+void TestMappedDelimitedFile::setUp(){
+  filename = "tiny-mapped.txt";
+  noNewlineFilename = "tiny-mapped-no-newline.txt";
+  // rows of different lengths, some short of the header, and special values
+  contents =
+    "name\tx\tn\n"
+    "  a \t1.5\t3\textra\n"
+    "b\t-Inf\n"
+    "\n"
+    "c\tnan\t-7\n"
+    "dd\t1e-3\t42\n"
+    "e\tInf\t+12\t\t\n"
+    "f\t2.5E+10\t0\n";
+  ofstream file(filename);
+  file << contents;
+  file.close();
+  ofstream no_newline(noNewlineFilename);
+  no_newline << contents.substr(0, contents.length() - 1);
+  no_newline.close();
+}
+
+void TestMappedDelimitedFile::tearDown(){
+  remove(filename);
+  remove(noNewlineFilename);
+}
+
+void TestMappedDelimitedFile::parseCells(){
+  const char* cells[] = {
+    "0", "-7", "+3", "123456789", "1234567890", "-2147483648", "2147483647",
+    "2147483648", "1.5", "-0.25", "1e-3", "2.5E+10", ".5", "5.", "1e400",
+    "", "abc", "1.5x", " 1", "1 ", "-", "e5", "0x10", "inf"
+  };
+  for (size_t i = 0; i < sizeof(cells) / sizeof(cells[0]); i++) {
+    CPPUNIT_ASSERT_MESSAGE(cells[i], sameParse<double>(cells[i]));
+    CPPUNIT_ASSERT_MESSAGE(cells[i], sameParse<float>(cells[i]));
+    CPPUNIT_ASSERT_MESSAGE(cells[i], sameParse<int>(cells[i]));
+  }
+}
+
+void TestMappedDelimitedFile::chunkBoundaries(){
+  const char* files[] = { filename, noNewlineFilename };
+  for (size_t file_idx = 0; file_idx < 2; file_idx++) {
+    MappedDelimitedFile mapped;
+    CPPUNIT_ASSERT(mapped.open(files[file_idx]));
+    CPPUNIT_ASSERT(mapped.getColumnNames().size() == 3);
+    CPPUNIT_ASSERT(mapped.numRows() == 7);
+
+    vector<string> lines;
+    MappedDelimitedFile::Cursor rows = mapped.getRows();
+    while (rows.next()) {
+      lines.push_back(string(rows.lineBegin(), rows.lineLength()));
+    }
+    CPPUNIT_ASSERT(lines.size() == 7);
+    CPPUNIT_ASSERT(lines[0] == "  a \t1.5\t3\textra");
+    CPPUNIT_ASSERT(lines[6] == "f\t2.5E+10\t0");
+
+    // Any number of chunks reads every row once, in order, and each chunk
+    // starts at the beginning of a line.
+    for (size_t num_chunks = 1; num_chunks <= 12; num_chunks++) {
+      vector<MappedDelimitedFile::Cursor> chunks;
+      mapped.getChunks(num_chunks, 2, &chunks);
+      CPPUNIT_ASSERT(!chunks.empty() && chunks.size() <= num_chunks);
+      size_t line_idx = 0;
+      for (size_t chunk_idx = 0; chunk_idx < chunks.size(); chunk_idx++) {
+        bool first = true;
+        while (chunks[chunk_idx].next()) {
+          MappedDelimitedFile::Cursor& chunk = chunks[chunk_idx];
+          if (first && chunk_idx > 0) {
+            CPPUNIT_ASSERT(chunk.lineBegin()[-1] == '\n');
+          }
+          first = false;
+          CPPUNIT_ASSERT(line_idx < lines.size());
+          CPPUNIT_ASSERT(string(chunk.lineBegin(), chunk.lineLength()) == lines[line_idx]);
+          // only the cells asked for are split out
+          vector<string> cells = StringUtils::Split(lines[line_idx], '\t');
+          CPPUNIT_ASSERT(chunk.numCells() == min(cells.size(), (size_t)2));
+          for (size_t cell_idx = 0; cell_idx < chunk.numCells(); cell_idx++) {
+            CPPUNIT_ASSERT(chunk.getCell(cell_idx).str() == cells[cell_idx]);
+          }
+          CPPUNIT_ASSERT(chunk.getCell(2).empty());
+          line_idx++;
+        }
+        CPPUNIT_ASSERT(!first);
+      }
+      CPPUNIT_ASSERT(line_idx == lines.size());
+    }
+  }
+}
+
+void TestMappedDelimitedFile::readerMatchesStream(){
+  const char* files[] = { filename, noNewlineFilename };
+  for (size_t file_idx = 0; file_idx < 2; file_idx++) {
+    for (int has_header = 0; has_header < 2; has_header++) {
+      DelimitedFileReader mapped(files[file_idx], has_header);
+      ifstream file(files[file_idx]);
+      DelimitedFileReader streamed(&file, has_header);
+      CPPUNIT_ASSERT(mapped.numRows() == streamed.numRows());
+      CPPUNIT_ASSERT(mapped.getColumnNames() == streamed.getColumnNames());
+      string mapped_rows = readAll(mapped);
+      CPPUNIT_ASSERT(mapped_rows == readAll(streamed));
+      mapped.reset();
+      CPPUNIT_ASSERT(mapped_rows == readAll(mapped));
+    }
+  }
+}
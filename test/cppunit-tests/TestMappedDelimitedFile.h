@@ -0,0 +1,39 @@
+#ifndef CPP_UNIT_TESTMAPPEDDELIMITEDFILE_H
+#define CPP_UNIT_TESTMAPPEDDELIMITEDFILE_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+#include "MappedDelimitedFile.h"
+
+/*
+ * Test that a mapped file is read the same way as through a stream: cells
+ * parse to the values StringUtils::FromString gives, chunks divide the rows
+ * at line boundaries, and DelimitedFileReader returns the same rows from a
+ * mapping as from a stream.
+ */
+
+class TestMappedDelimitedFile : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestMappedDelimitedFile );
+  CPPUNIT_TEST( parseCells );
+  CPPUNIT_TEST( chunkBoundaries );
+  CPPUNIT_TEST( readerMatchesStream );
+  CPPUNIT_TEST_SUITE_END();
+
+ protected:
+  // variables to use in testing
+  const char* filename;
+  const char* noNewlineFilename; // the same rows without a final newline
+  std::string contents;
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void parseCells();
+  void chunkBoundaries();
+  void readerMatchesStream();
+};
+
+#endif //CPP_UNIT_TESTMAPPEDDELIMITEDFILE_H
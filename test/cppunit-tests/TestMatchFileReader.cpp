@@ -1,16 +1,24 @@
 #include <cppunit/config/SourcePrefix.h>
 #include "TestMatchFileReader.h"
 #include "parameter.h" 
+#include "MatchIterator.h"
 
 using namespace std;
 
 CPPUNIT_TEST_SUITE_REGISTRATION( TestMatchFileReader );
 
+// Exposes the databases, which create loads only when they are needed.
+class DatabaseParser : public MatchCollectionParser {
+ public:
+  Database* getDatabase() { return database_; }
+};
+
 void TestMatchFileReader::setUp(){
   // initialize_parameters();  // accessing any parameter values requires this
 
   // initialize variables to use for testing
   tinyReader = new MatchFileReader("sample-files/tiny-tab-file.txt");
+  matchFile = "sample-files/tiny-match-file.txt";
 }
 
 void TestMatchFileReader::tearDown(){
@@ -50,12 +58,57 @@ void TestMatchFileReader::getColumns(){
   */
 }
 
+void TestMatchFileReader::parseNoAttributes(){
+  // no peptides, but the decoy is still told apart by its protein id
+  MatchCollection* matches = MatchFileReader::parse(matchFile, NULL, NULL,
+                                                    MATCH_ATTRIBUTE_NONE);
+  CPPUNIT_ASSERT(matches->getMatchTotal() == 3);
+  MatchIterator iter(matches);
+  bool is_decoy[] = {false, true, false};
+  for (int i = 0; iter.hasNext(); i++) {
+    Crux::Match* match = iter.next();
+    CPPUNIT_ASSERT(match->getPeptide() == NULL);
+    CPPUNIT_ASSERT(match->getNullPeptide() == is_decoy[i]);
+  }
+  delete matches;
+}
 
+void TestMatchFileReader::parsePeptideAttribute(){
+  // the same peptides as a full read, without their proteins
+  MatchCollectionParser all_parser, peptide_parser;
+  MatchCollection* all_matches = all_parser.create(matchFile, "", MATCH_ATTRIBUTE_ALL);
+  MatchCollection* peptide_matches = peptide_parser.create(matchFile, "", MATCH_ATTRIBUTE_PEPTIDE);
+  CPPUNIT_ASSERT(all_matches->getMatchTotal() == 3);
+  CPPUNIT_ASSERT(peptide_matches->getMatchTotal() == 3);
+
+  MatchIterator all_iter(all_matches);
+  MatchIterator peptide_iter(peptide_matches);
+  while (all_iter.hasNext() && peptide_iter.hasNext()) {
+    Crux::Peptide* all_peptide = all_iter.next()->getPeptide();
+    Crux::Peptide* peptide = peptide_iter.next()->getPeptide();
+    CPPUNIT_ASSERT(peptide != NULL);
+    char* all_seq = all_peptide->getSequence();
+    char* seq = peptide->getSequence();
+    CPPUNIT_ASSERT(strcmp(seq, all_seq) == 0);
+    free(all_seq);
+    free(seq);
+    CPPUNIT_ASSERT(peptide->getModifiedSequenceWithMasses() ==
+                   all_peptide->getModifiedSequenceWithMasses());
+    CPPUNIT_ASSERT(peptide->getMods().size() == all_peptide->getMods().size());
+    CPPUNIT_ASSERT(all_peptide->getNumPeptideSrc() > 0);
+    CPPUNIT_ASSERT(peptide->getNumPeptideSrc() == 0);
+  }
+  CPPUNIT_ASSERT(!all_iter.hasNext() && !peptide_iter.hasNext());
+  delete all_matches;
+  delete peptide_matches;
+}
 
-
-
-
-
-
-
-
+void TestMatchFileReader::databaseOnlyForProteins(){
+  DatabaseParser parser;
+  delete parser.create(matchFile, "", MATCH_ATTRIBUTE_NONE);
+  CPPUNIT_ASSERT(parser.getDatabase() == NULL);
+  delete parser.create(matchFile, "", MATCH_ATTRIBUTE_PEPTIDE);
+  CPPUNIT_ASSERT(parser.getDatabase() == NULL);
+  delete parser.create(matchFile, "", MATCH_ATTRIBUTE_PROTEINS);
+  CPPUNIT_ASSERT(parser.getDatabase() != NULL);
+}
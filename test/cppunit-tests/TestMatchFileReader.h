@@ -3,17 +3,22 @@
 
 #include <cppunit/extensions/HelperMacros.h>
 #include "MatchFileReader.h"
+#include "MatchCollectionParser.h"
 
 class TestMatchFileReader : public CPPUNIT_NS::TestFixture
 {
   CPPUNIT_TEST_SUITE( TestMatchFileReader );
   CPPUNIT_TEST( getColumns );
+  CPPUNIT_TEST( parseNoAttributes );
+  CPPUNIT_TEST( parsePeptideAttribute );
+  CPPUNIT_TEST( databaseOnlyForProteins );
   CPPUNIT_TEST_SUITE_END();
   
  protected:
   // variables to use in testing
   MatchFileReader defaultReader;
   MatchFileReader* tinyReader;//("sample-files/tiny-tab-file.txt");
+  const char* matchFile; // a target, its decoy and another target
 
  public:
   void setUp();
@@ -21,6 +26,9 @@ class TestMatchFileReader : public CPPUNIT_NS::TestFixture
 
  protected:
   void getColumns();
+  void parseNoAttributes();
+  void parsePeptideAttribute();
+  void databaseOnlyForProteins();
 };
 
 #endif //CPP_UNIT_TESTMATCHFILEREADER_H
@@ -0,0 +1,230 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "TestMergeSearchResults.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#define BOOST_NO_CXX11_SCOPED_ENUMS
+#include <boost/filesystem.hpp>
+#undef BOOST_NO_CXX11_SCOPED_ENUMS
+#include "util/FileUtils.h"
+#include "util/Params.h"
+#include "util/StringUtils.h"
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestMergeSearchResults );
+
+static const int kTopMatch = 2;
+
+// Exposes the Tailor quantile, which main normally computes per spectrum.
+class TestableMergeSearchResults : public MergeSearchResultsApplication {
+ public:
+  using MergeSearchResultsApplication::ShardStats;
+  using MergeSearchResultsApplication::tailorQuantile;
+};
+
+bool TestMergeSearchResults::byXCorr(const Candidate* x, const Candidate* y) {
+  return x->xcorr_ > y->xcorr_;
+}
+
+void TestMergeSearchResults::setUp(){
+  Params::Set("top-match", kTopMatch);
+  Params::Set("precision", 4);
+  Params::Set("overwrite", true);
+  Params::Set("fileroot", "");
+
+  // Spectra with many candidates, with fewer than top-match+1, with
+  // candidates in only one shard, and with no decoys. The scores are
+  // distinct, so the order of the PSMs does not depend on the shards.
+  int num_candidates[] = {40, 3, 1, 12};
+  int num_decoys[] = {40, 2, 1, 0};
+  candidates.clear();
+  for (int spectrum = 0; spectrum < 4; spectrum++) {
+    vector<Candidate> spectrum_candidates;
+    for (int decoy = 0; decoy < 2; decoy++) {
+      int n = decoy ? num_decoys[spectrum] : num_candidates[spectrum];
+      for (int i = 0; i < n; i++) {
+        Candidate candidate;
+        candidate.id_ = spectrum_candidates.size();
+        candidate.decoy_ = decoy != 0;
+        candidate.xcorr_ = 0.1 + ((i * 37 + spectrum * 11 + decoy * 5) % 101) / 30.0 + i * 1e-9;
+        candidate.sp_score_ = ((i * 53 + decoy) % 97) / 3.0 + i * 1e-7;
+        spectrum_candidates.push_back(candidate);
+      }
+    }
+    candidates.push_back(spectrum_candidates);
+  }
+  dirs.clear();
+}
+
+void TestMergeSearchResults::tearDown(){
+  for (size_t i = 0; i < dirs.size(); i++) {
+    boost::filesystem::remove_all(dirs[i]);
+  }
+}
+
+void TestMergeSearchResults::writeShard(const string& dir, int num_shards, int shard) {
+  dirs.push_back(dir);
+  boost::filesystem::remove_all(dir);
+  FileUtils::Mkdir(dir);
+  string header = "file\tscan\tcharge\tspectrum neutral mass\tdelta_cn\tdelta_lcn\t"
+    "sp rank\txcorr score\txcorr rank\ttailor score\tdistinct matches/spectrum\tsequence\n";
+  ofstream stats(FileUtils::Join(dir, "tide-search.shard-stats.txt").c_str());
+  ofstream target(FileUtils::Join(dir, "tide-search.target.txt").c_str());
+  ofstream decoy(FileUtils::Join(dir, "tide-search.decoy.txt").c_str());
+  stats << "sequence\tfile\tscan\tcharge\tspectrum neutral mass\tpsms\ttop xcorr scores\t"
+           "target psm scores\tdecoy psm scores\n";
+  target << header;
+  decoy << header;
+  for (size_t spectrum = 0; spectrum < candidates.size(); spectrum++) {
+    vector<const Candidate*> psms;
+    for (size_t i = 0; i < candidates[spectrum].size(); i++) {
+      if (candidates[spectrum][i].id_ % num_shards == shard) {
+        psms.push_back(&candidates[spectrum][i]);
+      }
+    }
+    if (psms.empty()) {
+      continue;  // a shard without candidates writes nothing
+    }
+    sort(psms.begin(), psms.end(), byXCorr);
+
+    string spectrum_id = "tiny.ms2\t" + StringUtils::ToString(100 + spectrum, 0) + "\t2\t1000.0000";
+    vector<string> top_xcorr;
+    for (size_t i = 0; i < psms.size(); i++) {
+      top_xcorr.push_back(StringUtils::ToExactString(psms[i]->xcorr_));
+    }
+    // The shard's own ranks and scores, which the merge recomputes
+    vector<string> scores[2];
+    int count[2] = {0, 0};
+    int candidates_of[2] = {0, 0};  // distinct matches/spectrum of each file
+    for (size_t i = 0; i < psms.size(); i++) {
+      candidates_of[psms[i]->decoy_ ? 1 : 0]++;
+    }
+    for (size_t i = 0; i < psms.size(); i++) {
+      int is_decoy = psms[i]->decoy_ ? 1 : 0;
+      if (++count[is_decoy] > kTopMatch + 1) {
+        continue;
+      }
+      string xcorr = StringUtils::ToExactString(psms[i]->xcorr_);
+      scores[is_decoy].push_back(xcorr + ':' + xcorr + ':' +
+                                 StringUtils::ToExactString(psms[i]->sp_score_));
+      (is_decoy ? decoy : target) << spectrum_id << "\t0.1\t0.1\t9\t"
+        << StringUtils::ToString(psms[i]->xcorr_, 4) << '\t' << count[is_decoy] << "\t1.0\t"
+        << candidates_of[is_decoy] << "\tPEPTIDE" << psms[i]->id_ << "K\n";
+    }
+    stats << spectrum << '\t' << spectrum_id << '\t' << psms.size() << '\t'
+          << StringUtils::Join(top_xcorr, ',') << '\t' << StringUtils::Join(scores[0], ',')
+          << '\t' << StringUtils::Join(scores[1], ',') << '\n';
+  }
+}
+
+string TestMergeSearchResults::merge(
+  const vector<string>& shard_dirs,
+  const string& output_dir,
+  const string& result_file
+) {
+  dirs.push_back(output_dir);
+  boost::filesystem::remove_all(output_dir);
+  FileUtils::Mkdir(output_dir);
+  Params::Set("output-dir", output_dir);
+  MergeSearchResultsApplication app;
+  CPPUNIT_ASSERT(app.main(shard_dirs) == 0);
+  return FileUtils::Read(FileUtils::Join(output_dir, result_file));
+}
+
+void TestMergeSearchResults::shardsMatchUnsharded(){
+  writeShard("tiny-merge-unsharded", 1, 0);
+  vector<string> unsharded(1, "tiny-merge-unsharded");
+  string target = merge(unsharded, "tiny-merge-unsharded-out", "tide-search.target.txt");
+  string decoy = merge(unsharded, "tiny-merge-unsharded-out", "tide-search.decoy.txt");
+  CPPUNIT_ASSERT(!target.empty() && !decoy.empty());
+
+  for (int num_shards = 2; num_shards <= 5; num_shards += 3) {
+    vector<string> shards;
+    for (int shard = 0; shard < num_shards; shard++) {
+      shards.push_back("tiny-merge-shard" + StringUtils::ToString(shard, 0));
+      writeShard(shards.back(), num_shards, shard);
+    }
+    CPPUNIT_ASSERT(merge(shards, "tiny-merge-out", "tide-search.target.txt") == target);
+    CPPUNIT_ASSERT(merge(shards, "tiny-merge-out", "tide-search.decoy.txt") == decoy);
+  }
+}
+
+void TestMergeSearchResults::recomputedScores(){
+  writeShard("tiny-merge-shard0", 2, 0);
+  writeShard("tiny-merge-shard1", 2, 1);
+  vector<string> shards;
+  shards.push_back("tiny-merge-shard0");
+  shards.push_back("tiny-merge-shard1");
+  vector<string> rows = StringUtils::Split(
+    merge(shards, "tiny-merge-out", "tide-search.target.txt"), '\n');
+
+  // top-match rows per spectrum, or as many as there are
+  CPPUNIT_ASSERT(rows.size() == 1 + 2 + 2 + 1 + 2 + 1);  // header, spectra, final newline
+  CPPUNIT_ASSERT(rows.back().empty());
+
+  // The first spectrum, against the definitions in TideMatchSet
+  vector<const Candidate*> all;
+  for (size_t i = 0; i < candidates[0].size(); i++) {
+    all.push_back(&candidates[0][i]);
+  }
+  sort(all.begin(), all.end(), byXCorr);
+  vector<const Candidate*> targets;
+  for (size_t i = 0; i < all.size(); i++) {
+    if (!all[i]->decoy_) {
+      targets.push_back(all[i]);
+    }
+  }
+  // 80 candidates put the quantile at its minimum position, the third score
+  double quantile = all[2]->xcorr_ + 5.0;
+  double x1 = targets[0]->xcorr_, x2 = targets[1]->xcorr_, x3 = targets[2]->xcorr_;
+  vector<string> first = StringUtils::Split(rows[1], '\t');
+  vector<string> second = StringUtils::Split(rows[2], '\t');
+  CPPUNIT_ASSERT(first[11] == "PEPTIDE" + StringUtils::ToString(targets[0]->id_, 0) + "K");
+  CPPUNIT_ASSERT(second[11] == "PEPTIDE" + StringUtils::ToString(targets[1]->id_, 0) + "K");
+  CPPUNIT_ASSERT(first[8] == "1" && second[8] == "2");
+  CPPUNIT_ASSERT(first[4] == StringUtils::ToString((x1 - x2) / max(x1, 1.0), 4));
+  CPPUNIT_ASSERT(first[5] == StringUtils::ToString((x1 - x2) / max(x1, 1.0), 4));
+  CPPUNIT_ASSERT(second[4] == StringUtils::ToString((x2 - x3) / max(x2, 1.0), 4));
+  CPPUNIT_ASSERT(first[9] == StringUtils::ToString((x1 + 5.0) / quantile, 4));
+  CPPUNIT_ASSERT(first[10] == "40" && second[10] == "40");
+
+  // Sp ranks among the top-match+1 targets
+  int sp_rank = 1;
+  for (int i = 0; i <= kTopMatch; i++) {
+    if (targets[i]->sp_score_ > targets[0]->sp_score_) {
+      sp_rank++;
+    }
+  }
+  CPPUNIT_ASSERT(first[6] == StringUtils::ToString(sp_rank, 0));
+
+  // The last of fewer than top-match+1 PSMs has no delta-Cn
+  vector<string> lone = StringUtils::Split(rows[5], '\t');
+  CPPUNIT_ASSERT(lone[1] == "102" && lone[8] == "1" && lone[4] == "0.0000");
+}
+
+void TestMergeSearchResults::tailorQuantile(){
+  // 300 candidates put the quantile at the third score
+  vector<TestableMergeSearchResults::ShardStats> stats(2);
+  stats[0].psms_ = 200;
+  stats[0].top_xcorr_.push_back(5.0);
+  stats[0].top_xcorr_.push_back(3.0);
+  stats[0].top_xcorr_.push_back(1.0);
+  stats[1].psms_ = 100;
+  stats[1].top_xcorr_.push_back(4.0);
+  stats[1].top_xcorr_.push_back(2.0);
+  stats[1].top_xcorr_.push_back(0.5);
+  bool exact = false;
+  CPPUNIT_ASSERT(TestableMergeSearchResults::tailorQuantile(stats, exact) == 3.0 + 5.0);
+  CPPUNIT_ASSERT(exact);
+
+  // A shard that lists too few of its scores may hide the quantile
+  stats[1].top_xcorr_.resize(2);
+  TestableMergeSearchResults::tailorQuantile(stats, exact);
+  CPPUNIT_ASSERT(!exact);
+
+  // unless it has no more candidates
+  stats[1].psms_ = 2;
+  TestableMergeSearchResults::tailorQuantile(stats, exact);
+  CPPUNIT_ASSERT(exact);
+}
@@ -0,0 +1,55 @@
+#ifndef CPP_UNIT_TESTMERGESEARCHRESULTS_H
+#define CPP_UNIT_TESTMERGESEARCHRESULTS_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+#include <vector>
+#include "MergeSearchResultsApplication.h"
+
+/*
+ * Test that merging the shards of a search gives the same results, byte for
+ * byte, as merging the output of the search unsharded, that those results
+ * rank and score the PSMs as tide-search does, and that the Tailor quantile
+ * is only reported exact when every shard listed enough of its scores.
+ */
+
+class TestMergeSearchResults : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestMergeSearchResults );
+  CPPUNIT_TEST( shardsMatchUnsharded );
+  CPPUNIT_TEST( recomputedScores );
+  CPPUNIT_TEST( tailorQuantile );
+  CPPUNIT_TEST_SUITE_END();
+
+ protected:
+  // A candidate peptide of a spectrum, with its exact scores
+  struct Candidate {
+    int id_;
+    bool decoy_;
+    double xcorr_;
+    double sp_score_;
+  };
+  static bool byXCorr(const Candidate* x, const Candidate* y);
+
+  // variables to use in testing
+  std::vector<std::vector<Candidate> > candidates;  // by spectrum
+  std::vector<std::string> dirs;
+
+  // Write the output directory of a search of the candidates whose id is
+  // shard modulo num_shards, as tide-search does with those options.
+  void writeShard(const std::string& dir, int num_shards, int shard);
+  // Merge the directories into output_dir and read back the results file.
+  std::string merge(const std::vector<std::string>& shard_dirs,
+                    const std::string& output_dir, const std::string& result_file);
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void shardsMatchUnsharded();
+  void recomputedScores();
+  void tailorQuantile();
+};
+
+#endif //CPP_UNIT_TESTMERGESEARCHRESULTS_H
@@ -0,0 +1,164 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "TestPeptideBlocks.h"
+#include <cstdio>
+#include "records.h"
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestPeptideBlocks );
+
+// Read every peptide left in reader.
+static vector<string> readAll(PeptideReader& reader) {
+  vector<string> read;
+  pb::Peptide peptide;
+  while (!reader.Done()) {
+    CPPUNIT_ASSERT(reader.Read(&peptide));
+    read.push_back(peptide.SerializeAsString());
+  }
+  return read;
+}
+
+static vector<string> serialize(const vector<pb::Peptide>& peptides) {
+  vector<string> serialized;
+  for (size_t i = 0; i < peptides.size(); i++) {
+    serialized.push_back(peptides[i].SerializeAsString());
+  }
+  return serialized;
+}
+
+void TestPeptideBlocks::setUp(){
+  pepixFile = "tiny-pepix";
+  // Two full blocks and part of a third, with tied masses, and the rarely
+  // populated fields set on some of the peptides.
+  int num_peptides = 2 * PeptideBlockWriter::kPeptidesPerBlock + 1000;
+  peptides.clear();
+  for (int i = 0; i < num_peptides; i++) {
+    pb::Peptide peptide;
+    peptide.set_id(i);
+    peptide.set_mass(500.0 + (i / 4) * 0.37);
+    peptide.set_length(7 + i % 20);
+    peptide.mutable_first_location()->set_protein_id(i % 13);
+    peptide.mutable_first_location()->set_pos((i * 3) % 400);
+    if (i % 3 == 0) {
+      for (int j = 0; j <= i % 5; j++) {
+        peptide.add_modifications(((i + j) * 7919) % 100000);
+      }
+    }
+    if (i % 2 == 1) {
+      peptide.set_decoy_index(i % 4);
+    }
+    if (i % 11 == 0) {
+      peptide.set_nterm_mod(i % 3);
+    }
+    if (i % 17 == 0) {
+      peptide.set_cterm_mod(1);
+    }
+    if (i % 101 == 0) {
+      peptide.set_decoy_sequence("PEPTIDEK");
+      peptide.add_decoy_perm_idx(2);
+      peptide.add_decoy_perm_idx(-1);
+    }
+    if (i % 257 == 0) {
+      pb::Location* location = peptide.mutable_aux_loc()->add_location();
+      location->set_protein_id(i % 7);
+      location->set_pos(i % 50);
+    }
+    peptides.push_back(peptide);
+  }
+  writeRecords();
+}
+
+void TestPeptideBlocks::tearDown(){
+  remove(pepixFile.c_str());
+  remove(PeptideBlockWriter::BlocksFileName(pepixFile).c_str());
+}
+
+void TestPeptideBlocks::writeRecords(){
+  pb::Header header;
+  header.set_file_type(pb::Header::PEPTIDES);
+  header.mutable_peptides_header()->set_min_mass(peptides.front().mass());
+  header.mutable_peptides_header()->set_max_mass(peptides.back().mass());
+  HeadedRecordWriter writer(pepixFile, header);
+  CPPUNIT_ASSERT(writer.OK());
+  for (size_t i = 0; i < peptides.size(); i++) {
+    CPPUNIT_ASSERT(writer.Write(&peptides[i]));
+  }
+}
+
+void TestPeptideBlocks::convert(){
+  CPPUNIT_ASSERT(PeptideBlockWriter::ConvertRecords(pepixFile));
+}
+
+void TestPeptideBlocks::roundTrip(){
+  vector<string> expected = serialize(peptides);
+
+  PeptideReader records(pepixFile);
+  CPPUNIT_ASSERT(records.OK());
+  CPPUNIT_ASSERT(!records.Header().peptides_header().block_encoded());
+  CPPUNIT_ASSERT(readAll(records) == expected);
+
+  convert();
+  PeptideBlockReader blocks(PeptideBlockWriter::BlocksFileName(pepixFile));
+  CPPUNIT_ASSERT(blocks.OK());
+  CPPUNIT_ASSERT(blocks.NumBlocks() == 3);
+
+  // The pepix file keeps the header, which points to the blocks.
+  PeptideReader converted(pepixFile);
+  CPPUNIT_ASSERT(converted.OK());
+  CPPUNIT_ASSERT(converted.Header().peptides_header().block_encoded());
+  CPPUNIT_ASSERT(converted.Header().peptides_header().max_mass() == peptides.back().mass());
+  CPPUNIT_ASSERT(readAll(converted) == expected);
+}
+
+void TestPeptideBlocks::rewind(){
+  vector<string> expected = serialize(peptides);
+  for (int block_encoded = 0; block_encoded < 2; block_encoded++) {
+    if (block_encoded) {
+      convert();
+    }
+    PeptideReader reader(pepixFile);
+    // stop inside the second block
+    pb::Peptide peptide;
+    for (int i = 0; i < PeptideBlockWriter::kPeptidesPerBlock + 10; i++) {
+      CPPUNIT_ASSERT(!reader.Done());
+      CPPUNIT_ASSERT(reader.Read(&peptide));
+    }
+    reader.Rewind();
+    CPPUNIT_ASSERT(readAll(reader) == expected);
+    reader.Rewind();
+    CPPUNIT_ASSERT(readAll(reader) == expected);
+  }
+}
+
+void TestPeptideBlocks::skipBelow(){
+  vector<string> expected = serialize(peptides);
+  // A mass inside the second block: the first block can be skipped, and
+  // nothing at or above the mass is.
+  size_t target = PeptideBlockWriter::kPeptidesPerBlock + 100;
+  double mass = peptides[target].mass();
+
+  // Plain records cannot skip.
+  PeptideReader records(pepixFile);
+  records.SkipBelow(mass);
+  CPPUNIT_ASSERT(readAll(records) == expected);
+
+  convert();
+  PeptideReader blocks(pepixFile);
+  blocks.SkipBelow(mass);
+  vector<string> read = readAll(blocks);
+  CPPUNIT_ASSERT(read.size() == peptides.size() - PeptideBlockWriter::kPeptidesPerBlock);
+  CPPUNIT_ASSERT(equal(read.begin(), read.end(),
+                       expected.begin() + PeptideBlockWriter::kPeptidesPerBlock));
+
+  // Skipping only happens between blocks, and past the heaviest peptide
+  // leaves nothing.
+  blocks.Rewind();
+  pb::Peptide peptide;
+  CPPUNIT_ASSERT(!blocks.Done() && blocks.Read(&peptide));
+  blocks.SkipBelow(mass);
+  CPPUNIT_ASSERT(!blocks.Done() && blocks.Read(&peptide));
+  CPPUNIT_ASSERT(peptide.id() == 1);
+  blocks.Rewind();
+  blocks.SkipBelow(peptides.back().mass() + 1.0);
+  CPPUNIT_ASSERT(blocks.Done());
+}
@@ -0,0 +1,43 @@
+#ifndef CPP_UNIT_TESTPEPTIDEBLOCKS_H
+#define CPP_UNIT_TESTPEPTIDEBLOCKS_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+#include <vector>
+#include "peptide_blocks.h"
+
+/*
+ * Test that a block-encoded peptide index reads back the same peptides, in
+ * the same order, as the plain records it was converted from, and that
+ * PeptideReader skips and rewinds either encoding correctly.
+ */
+
+class TestPeptideBlocks : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestPeptideBlocks );
+  CPPUNIT_TEST( roundTrip );
+  CPPUNIT_TEST( rewind );
+  CPPUNIT_TEST( skipBelow );
+  CPPUNIT_TEST_SUITE_END();
+
+ protected:
+  // variables to use in testing
+  std::string pepixFile;
+  std::vector<pb::Peptide> peptides; // in order of mass, over several blocks
+
+  // write the peptides as plain records to pepixFile
+  void writeRecords();
+  // convert pepixFile to the block encoding
+  void convert();
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void roundTrip();
+  void rewind();
+  void skipBelow();
+};
+
+#endif //CPP_UNIT_TESTPEPTIDEBLOCKS_H
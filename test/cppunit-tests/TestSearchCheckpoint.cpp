@@ -0,0 +1,127 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "TestSearchCheckpoint.h"
+#include <cstdio>
+#include <fstream>
+#include "app/tide/search_checkpoint.h"
+#include "util/FileUtils.h"
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestSearchCheckpoint );
+
+void TestSearchCheckpoint::setUp(){
+  journal = "tiny-search.checkpoint";
+  output = "tiny-search.target.txt";
+  records = "tiny-search.spectrumrecords";
+  remove(journal.c_str());
+}
+
+void TestSearchCheckpoint::tearDown(){
+  remove(journal.c_str());
+  remove((journal + ".tmp").c_str());
+  remove(output.c_str());
+  remove(records.c_str());
+}
+
+void TestSearchCheckpoint::noJournal(){
+  SearchCheckpoint checkpoint(journal, 10, "fingerprint");
+  CPPUNIT_ASSERT(!checkpoint.Load());
+  CPPUNIT_ASSERT(!checkpoint.Resuming());
+  CPPUNIT_ASSERT(checkpoint.NumDone() == 0);
+  CPPUNIT_ASSERT(!checkpoint.Done(0));
+
+  // A new search does not reuse anything, even what it records itself.
+  { ofstream file(records.c_str()); }
+  checkpoint.SetSpectrumRecords(0, records, true);
+  string path;
+  bool keep;
+  CPPUNIT_ASSERT(!checkpoint.GetSpectrumRecords(0, &path, &keep));
+  unsigned long long length;
+  CPPUNIT_ASSERT(!checkpoint.OutputLength(output, &length));
+}
+
+void TestSearchCheckpoint::resume(){
+  { ofstream file(records.c_str()); }
+  ofstream out(output.c_str());
+  {
+    SearchCheckpoint checkpoint(journal, 1000, "fingerprint");
+    checkpoint.SetSpectrumRecords(0, records, false);
+    checkpoint.SetSpectrumRecords(1, "tiny-search-missing.spectrumrecords", true);
+    checkpoint.AddOutput(output, &out);
+    // Threads finish out of order; 0-2 and 5 are done, 3 and 4 are not.
+    unsigned long long done[] = {1, 5, 0, 2};
+    for (size_t i = 0; i < sizeof(done) / sizeof(done[0]); i++) {
+      out << "results of " << done[i] << '\n';
+      checkpoint.SetDone(done[i]);
+    }
+    CPPUNIT_ASSERT(checkpoint.NumDone() == 4);
+    checkpoint.Write();
+    // written after the checkpoint, so lost on resuming
+    out << "results of 4\n";
+    checkpoint.SetDone(4);
+  }
+  out.close();
+  unsigned long long journaled_length = string("results of 1\n").length() * 4;
+  CPPUNIT_ASSERT(FileUtils::Size(output) > journaled_length);
+  CPPUNIT_ASSERT(!FileUtils::Exists(journal + ".tmp"));
+
+  SearchCheckpoint checkpoint(journal, 1000, "fingerprint");
+  CPPUNIT_ASSERT(checkpoint.Load());
+  CPPUNIT_ASSERT(checkpoint.Resuming());
+  CPPUNIT_ASSERT(checkpoint.NumDone() == 4);
+  CPPUNIT_ASSERT(checkpoint.Done(0));
+  CPPUNIT_ASSERT(checkpoint.Done(1));
+  CPPUNIT_ASSERT(checkpoint.Done(2));
+  CPPUNIT_ASSERT(!checkpoint.Done(3));
+  CPPUNIT_ASSERT(!checkpoint.Done(4));
+  CPPUNIT_ASSERT(checkpoint.Done(5));
+  CPPUNIT_ASSERT(!checkpoint.Done(6));
+
+  unsigned long long length;
+  CPPUNIT_ASSERT(checkpoint.OutputLength(output, &length));
+  CPPUNIT_ASSERT(length == journaled_length);
+  CPPUNIT_ASSERT(!checkpoint.OutputLength("tiny-search.decoy.txt", &length));
+
+  // Converted files are reused only while they exist.
+  string path;
+  bool keep = true;
+  CPPUNIT_ASSERT(checkpoint.GetSpectrumRecords(0, &path, &keep));
+  CPPUNIT_ASSERT(path == records);
+  CPPUNIT_ASSERT(!keep);
+  CPPUNIT_ASSERT(!checkpoint.GetSpectrumRecords(1, &path, &keep));
+  CPPUNIT_ASSERT(!checkpoint.GetSpectrumRecords(2, &path, &keep));
+
+  // Finishing the gap advances past the spectra done above it.
+  checkpoint.SetDone(3);
+  checkpoint.SetDone(4);
+  CPPUNIT_ASSERT(checkpoint.NumDone() == 6);
+  CPPUNIT_ASSERT(checkpoint.Done(5));
+  CPPUNIT_ASSERT(!checkpoint.Done(6));
+
+  checkpoint.Remove();
+  CPPUNIT_ASSERT(!FileUtils::Exists(journal));
+}
+
+void TestSearchCheckpoint::interval(){
+  {
+    SearchCheckpoint checkpoint(journal, 3, "fingerprint");
+    checkpoint.SetDone(0);
+    checkpoint.SetDone(1);
+    CPPUNIT_ASSERT(!FileUtils::Exists(journal));
+    checkpoint.SetDone(2);
+    CPPUNIT_ASSERT(FileUtils::Exists(journal));
+    checkpoint.SetDone(4);
+  }
+  SearchCheckpoint checkpoint(journal, 3, "fingerprint");
+  CPPUNIT_ASSERT(checkpoint.Load());
+  CPPUNIT_ASSERT(checkpoint.NumDone() == 3);
+  CPPUNIT_ASSERT(!checkpoint.Done(4));
+}
+
+void TestSearchCheckpoint::hash(){
+  string hash = SearchCheckpoint::Hash("tide-search --mz-bin-width 0.02");
+  CPPUNIT_ASSERT(hash.length() == 16);
+  CPPUNIT_ASSERT(hash == SearchCheckpoint::Hash("tide-search --mz-bin-width 0.02"));
+  CPPUNIT_ASSERT(hash != SearchCheckpoint::Hash("tide-search --mz-bin-width 0.03"));
+  CPPUNIT_ASSERT(SearchCheckpoint::Hash("").length() == 16);
+}
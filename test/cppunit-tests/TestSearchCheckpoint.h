@@ -0,0 +1,39 @@
+#ifndef CPP_UNIT_TESTSEARCHCHECKPOINT_H
+#define CPP_UNIT_TESTSEARCHCHECKPOINT_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+
+/*
+ * Test that a tide-search checkpoint journals the spectra done out of order,
+ * the output lengths and the converted spectrumrecords files, and that a
+ * search resuming from the journal skips exactly the journaled spectra.
+ */
+
+class TestSearchCheckpoint : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestSearchCheckpoint );
+  CPPUNIT_TEST( noJournal );
+  CPPUNIT_TEST( resume );
+  CPPUNIT_TEST( interval );
+  CPPUNIT_TEST( hash );
+  CPPUNIT_TEST_SUITE_END();
+
+ protected:
+  // variables to use in testing
+  std::string journal;
+  std::string output;
+  std::string records;
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void noJournal();
+  void resume();
+  void interval();
+  void hash();
+};
+
+#endif //CPP_UNIT_TESTSEARCHCHECKPOINT_H
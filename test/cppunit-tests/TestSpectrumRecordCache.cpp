@@ -0,0 +1,164 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "TestSpectrumRecordCache.h"
+#include <ctime>
+#include <fstream>
+#define BOOST_NO_CXX11_SCOPED_ENUMS
+#include <boost/filesystem.hpp>
+#undef BOOST_NO_CXX11_SCOPED_ENUMS
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include "util/FileUtils.h"
+#include "util/Params.h"
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestSpectrumRecordCache );
+
+// Exposes the key and eviction, which convert normally uses.
+class TestableSpectrumRecordCache : public SpectrumRecordCache {
+ public:
+  using SpectrumRecordCache::getKey;
+  using SpectrumRecordCache::lockEntry;
+  using SpectrumRecordCache::evict;
+  using SpectrumRecordCache::EVICTION_GRACE_SECONDS;
+};
+
+// Holds a shared lock on path, the way another run reading it would.
+static int lockAsOtherRun(const string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  CPPUNIT_ASSERT(fd >= 0);
+  CPPUNIT_ASSERT(flock(fd, LOCK_SH) == 0);
+  return fd;
+}
+
+void TestSpectrumRecordCache::setUp(){
+  spectrumFile = "tiny-cache-spectra.ms2";
+  cacheDir = "tiny-spectrum-cache";
+  ofstream file(spectrumFile.c_str());
+  file << "S\t1\t1\t500.25\nZ\t2\t999.49\n100.1\t20\n200.2\t30\n";
+  file.close();
+  boost::filesystem::remove_all(cacheDir);
+  FileUtils::Mkdir(cacheDir);
+  Params::Set("spectrum-cache-size", 1);
+}
+
+void TestSpectrumRecordCache::tearDown(){
+  SpectrumRecordCache::release();
+  FileUtils::Remove(spectrumFile);
+  boost::filesystem::remove_all(cacheDir);
+}
+
+string TestSpectrumRecordCache::addFile(
+  const string& name,
+  unsigned long long size,
+  int seconds_old
+) {
+  string path = FileUtils::Join(cacheDir, name);
+  { ofstream file(path.c_str()); }
+  // sparse, so that the cache can exceed its 1 GB minimum cheaply
+  boost::filesystem::resize_file(path, size);
+  boost::filesystem::last_write_time(path, time(NULL) - seconds_old);
+  return path;
+}
+
+void TestSpectrumRecordCache::key(){
+  string key = TestableSpectrumRecordCache::getKey(spectrumFile, 2, false);
+  CPPUNIT_ASSERT(key.find("tiny-cache-spectra.") == 0);
+  CPPUNIT_ASSERT(key.length() == string("tiny-cache-spectra.").length() + 16);
+  CPPUNIT_ASSERT(TestableSpectrumRecordCache::getKey(spectrumFile, 2, false) == key);
+
+  // the conversion parameters
+  CPPUNIT_ASSERT(TestableSpectrumRecordCache::getKey(spectrumFile, 1, false) != key);
+  CPPUNIT_ASSERT(TestableSpectrumRecordCache::getKey(spectrumFile, 2, true) != key);
+  string parser = Params::GetString("spectrum-parser");
+  Params::Set("spectrum-parser", parser == "pwiz" ? "mstoolkit" : "pwiz");
+  string other_parser_key = TestableSpectrumRecordCache::getKey(spectrumFile, 2, false);
+  Params::Set("spectrum-parser", parser);
+  CPPUNIT_ASSERT(other_parser_key != key);
+  CPPUNIT_ASSERT(TestableSpectrumRecordCache::getKey(spectrumFile, 2, false) == key);
+
+  // the file: its modification time, and its contents at the same size
+  // and modification time
+  time_t mtime = boost::filesystem::last_write_time(spectrumFile);
+  boost::filesystem::last_write_time(spectrumFile, mtime - 100);
+  CPPUNIT_ASSERT(TestableSpectrumRecordCache::getKey(spectrumFile, 2, false) != key);
+  boost::filesystem::last_write_time(spectrumFile, mtime);
+  CPPUNIT_ASSERT(TestableSpectrumRecordCache::getKey(spectrumFile, 2, false) == key);
+  {
+    fstream file(spectrumFile.c_str(), ios::in | ios::out | ios::binary);
+    file.seekp(2);
+    file.put('2');
+  }
+  boost::filesystem::last_write_time(spectrumFile, mtime);
+  CPPUNIT_ASSERT(TestableSpectrumRecordCache::getKey(spectrumFile, 2, false) != key);
+}
+
+void TestSpectrumRecordCache::evictEntries(){
+  const unsigned long long kEntrySize = 300000000;
+  int old = TestableSpectrumRecordCache::EVICTION_GRACE_SECONDS * 2;
+  // Least recently used first. The cache holds 2.1 GB against a 1 GB limit.
+  string oldest = addFile("a.1.spectrumrecords", kEntrySize, old + 60);
+  string read_here = addFile("b.2.spectrumrecords", kEntrySize, old + 50);
+  string read_elsewhere = addFile("c.3.spectrumrecords", kEntrySize, old + 40);
+  string next = addFile("d.4.spectrumrecords", kEntrySize, old + 30);
+  string newer = addFile("e.5.spectrumrecords", kEntrySize, old + 20);
+  string newest = addFile("f.6.spectrumrecords", kEntrySize, old + 10);
+  string recent = addFile("g.7.spectrumrecords", kEntrySize, 10);
+  string other = addFile("notes.txt", kEntrySize, old);
+
+  CPPUNIT_ASSERT(TestableSpectrumRecordCache::lockEntry(read_here));
+  int fd = lockAsOtherRun(read_elsewhere);
+  TestableSpectrumRecordCache::evict(cacheDir);
+  close(fd);
+
+  // Locked and recent entries are skipped, and entries are removed in
+  // order of use until 1 GB is left: 2.1 - 0.3 * 4 = 0.9 GB.
+  CPPUNIT_ASSERT(!FileUtils::Exists(oldest));
+  CPPUNIT_ASSERT(FileUtils::Exists(read_here));
+  CPPUNIT_ASSERT(FileUtils::Exists(read_elsewhere));
+  CPPUNIT_ASSERT(!FileUtils::Exists(next));
+  CPPUNIT_ASSERT(!FileUtils::Exists(newer));
+  CPPUNIT_ASSERT(!FileUtils::Exists(newest));
+  CPPUNIT_ASSERT(FileUtils::Exists(recent));
+  CPPUNIT_ASSERT(FileUtils::Exists(other));
+
+  // A cache within its limit is left alone.
+  TestableSpectrumRecordCache::evict(cacheDir);
+  CPPUNIT_ASSERT(FileUtils::Exists(read_elsewhere));
+
+  // Once released, the entry can be evicted like any other.
+  SpectrumRecordCache::release();
+  addFile("h.8.spectrumrecords", 2 * kEntrySize, old);
+  TestableSpectrumRecordCache::evict(cacheDir);
+  CPPUNIT_ASSERT(!FileUtils::Exists(read_here));
+  CPPUNIT_ASSERT(FileUtils::Exists(recent));
+}
+
+void TestSpectrumRecordCache::evictAbandoned(){
+  int old = TestableSpectrumRecordCache::EVICTION_GRACE_SECONDS * 2;
+  // an interrupted conversion and its sorted runs
+  string abandoned = addFile("a.1.spectrumrecords.x1.tmp", 10, old);
+  string abandoned_run = addFile("a.1.spectrumrecords.x1.tmp.partial_0", 10, old);
+  // a run whose conversion is gone
+  string orphan_run = addFile("b.2.spectrumrecords.x2.tmp.partial_3", 10, old);
+  // a long conversion still being written by another run
+  string converting = addFile("c.3.spectrumrecords.x3.tmp", 10, old);
+  string converting_run = addFile("c.3.spectrumrecords.x3.tmp.partial_1", 10, old);
+  // a conversion that has just started
+  string started = addFile("d.4.spectrumrecords.x4.tmp", 10, 5);
+  // not part of the cache
+  string other = addFile("notes.tmp", 10, old);
+
+  int fd = lockAsOtherRun(converting);
+  TestableSpectrumRecordCache::evict(cacheDir);
+  close(fd);
+
+  CPPUNIT_ASSERT(!FileUtils::Exists(abandoned));
+  CPPUNIT_ASSERT(!FileUtils::Exists(abandoned_run));
+  CPPUNIT_ASSERT(!FileUtils::Exists(orphan_run));
+  CPPUNIT_ASSERT(FileUtils::Exists(converting));
+  CPPUNIT_ASSERT(FileUtils::Exists(converting_run));
+  CPPUNIT_ASSERT(FileUtils::Exists(started));
+  CPPUNIT_ASSERT(FileUtils::Exists(other));
+}
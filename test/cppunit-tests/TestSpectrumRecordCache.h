@@ -0,0 +1,41 @@
+#ifndef CPP_UNIT_TESTSPECTRUMRECORDCACHE_H
+#define CPP_UNIT_TESTSPECTRUMRECORDCACHE_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+#include "SpectrumRecordCache.h"
+
+/*
+ * Test that cache keys change with the input file and the parameters that
+ * change its conversion, and that eviction removes the least recently used
+ * entries and abandoned conversions, but never entries or conversions that
+ * a run holds a lock on, or that were used within the grace period.
+ */
+
+class TestSpectrumRecordCache : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestSpectrumRecordCache );
+  CPPUNIT_TEST( key );
+  CPPUNIT_TEST( evictEntries );
+  CPPUNIT_TEST( evictAbandoned );
+  CPPUNIT_TEST_SUITE_END();
+
+ protected:
+  // variables to use in testing
+  std::string spectrumFile;
+  std::string cacheDir;
+
+  // create a file in the cache directory, last written seconds_old ago
+  std::string addFile(const std::string& name, unsigned long long size, int seconds_old);
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void key();
+  void evictEntries();
+  void evictAbandoned();
+};
+
+#endif //CPP_UNIT_TESTSPECTRUMRECORDCACHE_H
@@ -0,0 +1,112 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "TestSpectrumRecordWriter.h"
+#include <cstdio>
+#include "parameter.h"
+#include "app/tide/records.h"
+#include "util/FileUtils.h"
+#include "util/StringUtils.h"
+
+using namespace std;
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestSpectrumRecordWriter );
+
+void TestSpectrumRecordWriter::setUp(){
+  initialize_parameters();  // the runs are placed by temp-dir
+
+  outfile = "tiny.spectrumrecords";
+  // Few distinct masses, so that spectra of the same mass end up in
+  // different runs; the scan number records the order they were added in.
+  spectra.clear();
+  for (int i = 0; i < 300; i++) {
+    pb::Spectrum spectrum;
+    spectrum.set_scan_id(i + 1);
+    spectrum.set_neutral_mass(1000.0 + ((i * 37) % 23) * 0.5);
+    spectrum.set_precursor_m_z(spectrum.neutral_mass() / 2.0 + 1.0);
+    spectrum.add_charge_state(2);
+    for (int peak = 0; peak < 1 + i % 5; peak++) {
+      spectrum.add_peak_m_z(100000 + peak * 1000);
+      spectrum.add_peak_intensity(i * 10 + peak);
+    }
+    spectra.push_back(spectrum);
+  }
+}
+
+void TestSpectrumRecordWriter::tearDown(){
+  remove(outfile.c_str());
+}
+
+vector<pb::Spectrum> TestSpectrumRecordWriter::sort(
+  unsigned long long memory_limit,
+  int* num_runs
+) {
+  {
+    SpectrumRecordWriter::SpectrumSorter sorter(outfile, memory_limit);
+    for (size_t i = 0; i < spectra.size(); i++) {
+      sorter.add(spectra[i]);
+    }
+    CPPUNIT_ASSERT(sorter.numSpectra() == (int)spectra.size());
+    *num_runs = sorter.numRuns();
+    pb::Header header;
+    header.set_file_type(pb::Header::SPECTRA);
+    HeadedRecordWriter writer(outfile, header);
+    CPPUNIT_ASSERT(sorter.write(&writer));
+  }
+  // the runs are removed with the sorter
+  for (int run = 0; run <= *num_runs; run++) {
+    CPPUNIT_ASSERT(!FileUtils::Exists(outfile + ".partial_" + StringUtils::ToString(run)));
+  }
+
+  vector<pb::Spectrum> sorted;
+  pb::Header header;
+  HeadedRecordReader reader(outfile, &header);
+  CPPUNIT_ASSERT(reader.OK());
+  CPPUNIT_ASSERT(header.file_type() == pb::Header::SPECTRA);
+  pb::Spectrum spectrum;
+  while (!reader.Done()) {
+    CPPUNIT_ASSERT(reader.Read(&spectrum));
+    sorted.push_back(spectrum);
+  }
+  return sorted;
+}
+
+void TestSpectrumRecordWriter::sortInMemory(){
+  int num_runs;
+  vector<pb::Spectrum> sorted = sort(1000000000, &num_runs);
+  CPPUNIT_ASSERT(num_runs == 0);
+  CPPUNIT_ASSERT(sorted.size() == spectra.size());
+  for (size_t i = 1; i < sorted.size(); i++) {
+    double mass = sorted[i].neutral_mass(), prev_mass = sorted[i - 1].neutral_mass();
+    CPPUNIT_ASSERT(prev_mass <= mass);
+    if (prev_mass == mass) {
+      CPPUNIT_ASSERT(sorted[i - 1].scan_id() < sorted[i].scan_id());
+    }
+  }
+  // nothing is lost or changed
+  vector<bool> seen(spectra.size(), false);
+  for (size_t i = 0; i < sorted.size(); i++) {
+    int idx = sorted[i].scan_id() - 1;
+    CPPUNIT_ASSERT(idx >= 0 && idx < (int)spectra.size() && !seen[idx]);
+    seen[idx] = true;
+    CPPUNIT_ASSERT(sorted[i].SerializeAsString() == spectra[idx].SerializeAsString());
+  }
+}
+
+void TestSpectrumRecordWriter::spillAndMerge(){
+  int num_runs;
+  vector<pb::Spectrum> in_memory = sort(1000000000, &num_runs);
+  // limits that spill a run every spectrum, every few spectra, and once
+  unsigned long long limits[] = {
+    1, 5 * sizeof(pb::Spectrum), 200 * sizeof(pb::Spectrum)
+  };
+  for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++) {
+    vector<pb::Spectrum> merged = sort(limits[i], &num_runs);
+    CPPUNIT_ASSERT(num_runs > 0);
+    if (limits[i] == 1) {
+      CPPUNIT_ASSERT(num_runs == (int)spectra.size());
+    }
+    CPPUNIT_ASSERT(merged.size() == in_memory.size());
+    for (size_t j = 0; j < merged.size(); j++) {
+      CPPUNIT_ASSERT(merged[j].SerializeAsString() == in_memory[j].SerializeAsString());
+    }
+  }
+}
@@ -0,0 +1,39 @@
+#ifndef CPP_UNIT_TESTSPECTRUMRECORDWRITER_H
+#define CPP_UNIT_TESTSPECTRUMRECORDWRITER_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+#include <vector>
+#include "SpectrumRecordWriter.h"
+
+/*
+ * Test that the spectrum sorter writes the same spectrumrecords, sorted by
+ * neutral mass with ties in the order they were added, whether it keeps
+ * all spectra in memory or spills them to sorted runs and merges those.
+ */
+
+class TestSpectrumRecordWriter : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestSpectrumRecordWriter );
+  CPPUNIT_TEST( sortInMemory );
+  CPPUNIT_TEST( spillAndMerge );
+  CPPUNIT_TEST_SUITE_END();
+
+ protected:
+  // variables to use in testing
+  std::string outfile;
+  std::vector<pb::Spectrum> spectra; // in the order they are added
+
+  // sort the spectra with the memory limit and read back the output
+  std::vector<pb::Spectrum> sort(unsigned long long memory_limit, int* num_runs);
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void sortInMemory();
+  void spillAndMerge();
+};
+
+#endif //CPP_UNIT_TESTSPECTRUMRECORDWRITER_H